@@ -120,6 +120,22 @@ HWND ActivityWin::GetHwnd(HANDLE hCancel)
 }
 
 
+/**
+ *  \brief
+ */
+void ActivityWin::Update(HANDLE hCancel, const ActivityProgress& progress)
+{
+    for (auto iWin = WindowList.begin(); iWin != WindowList.end(); ++iWin)
+    {
+        if ((*iWin)->_hCancel == hCancel)
+        {
+            (*iWin)->update(progress);
+            break;
+        }
+    }
+}
+
+
 /**
  *  \brief
  */
@@ -215,11 +231,11 @@ HWND ActivityWin::composeWindow(const TCHAR* text)
 
     MoveWindow(hWndTxt, 5, 5, width - 95, TxtHeight, TRUE);
 
-    HWND hPBar = CreateWindowEx(0, PROGRESS_CLASS, NULL,
+    _hPBar = CreateWindowEx(0, PROGRESS_CLASS, NULL,
             WS_CHILD | WS_VISIBLE | PBS_MARQUEE,
             5, TxtHeight + 10, width - 95, 10,
             _hWnd, NULL, HMod, NULL);
-    SendMessage(hPBar, PBM_SETMARQUEE, TRUE, 100);
+    SendMessage(_hPBar, PBM_SETMARQUEE, TRUE, 100);
 
     _hBtn = CreateWindowEx(0, _T("BUTTON"), _T("Cancel"),
             WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
@@ -250,6 +266,54 @@ void ActivityWin::onResize(int winNum)
 }
 
 
+/**
+ *  \brief  Adds progress info line below the progress bar on first call. The bar stays marquee
+ *          until the percent done is known.
+ */
+void ActivityWin::update(const ActivityProgress& progress)
+{
+    if (!_hInfo)
+    {
+        RECT win;
+        GetClientRect(_hWnd, &win);
+        const int width = win.right - win.left;
+        const int height = win.bottom - win.top + TxtHeight + 5;
+
+        _hInfo = CreateWindowEx(0, _T("STATIC"), NULL,
+                WS_CHILD | WS_VISIBLE | SS_LEFT | SS_ENDELLIPSIS,
+                5, TxtHeight + 25, width - 95, TxtHeight,
+                _hWnd, NULL, HMod, NULL);
+        if (!_hInfo)
+            return;
+
+        if (HFont)
+            SendMessage(_hInfo, WM_SETFONT, (WPARAM)HFont, TRUE);
+
+        int winNum = 1;
+        for (auto iWin = WindowList.begin(); iWin != WindowList.end() && *iWin != this; ++iWin)
+            ++winNum;
+
+        adjustSizeAndPos(width, height, winNum);
+        MoveWindow(_hBtn, width - 85, (height - 25) / 2, 80, 25, TRUE);
+    }
+
+    if (progress._percent >= 0)
+    {
+        const LONG_PTR style = GetWindowLongPtr(_hPBar, GWL_STYLE);
+        if (style & PBS_MARQUEE)
+        {
+            SendMessage(_hPBar, PBM_SETMARQUEE, FALSE, 0);
+            SetWindowLongPtr(_hPBar, GWL_STYLE, style & ~PBS_MARQUEE);
+            SendMessage(_hPBar, PBM_SETRANGE32, 0, 100);
+        }
+
+        SendMessage(_hPBar, PBM_SETPOS, progress._percent, 0);
+    }
+
+    SetWindowText(_hInfo, progress._text.C_str());
+}
+
+
 /**
  *  \brief
  */
@@ -28,11 +28,25 @@
 #include <windows.h>
 #include <tchar.h>
 #include <list>
+#include "Common.h"
 
 
 namespace GTags
 {
 
+/**
+ *  \struct  ActivityProgress
+ *  \brief  WM_UPDATE_ACTIVITY_WIN data - the UI thread takes ownership once the message is posted
+ */
+struct ActivityProgress
+{
+    ActivityProgress(const TCHAR* text, int percent) : _text(text), _percent(percent) {}
+
+    CText   _text;
+    int     _percent;   // -1 if not known
+};
+
+
 /**
  *  \class  ActivityWin
  *  \brief
@@ -45,6 +59,7 @@ public:
 
     static void Show(const TCHAR* text, HANDLE hCancel);
     static HWND GetHwnd(HANDLE hCancel);
+    static void Update(HANDLE hCancel, const ActivityProgress& progress);
 
     static void UpdatePositions();
 
@@ -60,17 +75,20 @@ private:
 
     static LRESULT APIENTRY wndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 
-    ActivityWin(HANDLE hCancel) : _hCancel(hCancel), _hWnd(NULL) {}
+    ActivityWin(HANDLE hCancel) : _hCancel(hCancel), _hWnd(NULL), _hPBar(NULL), _hInfo(NULL) {}
     ActivityWin(const ActivityWin&);
     ~ActivityWin();
 
     void adjustSizeAndPos(int width, int height, int winNum);
     HWND composeWindow(const TCHAR* text);
     void onResize(int winNum);
+    void update(const ActivityProgress& progress);
 
     HANDLE  _hCancel;
     HWND    _hWnd;
     HWND    _hBtn;
+    HWND    _hPBar;
+    HWND    _hInfo;
     int     _initRefCount;
 };
 
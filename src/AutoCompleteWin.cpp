@@ -27,12 +27,16 @@
 
 #include <windows.h>
 #include <commctrl.h>
+#include <string.h>
+#include <algorithm>
 #include "Common.h"
 #include "INpp.h"
 #include "GTags.h"
 #include "AutoCompleteWin.h"
 #include "Cmd.h"
 #include "LineParser.h"
+#include "FuzzyMatcher.h"
+#include "Config.h"
 
 
 namespace GTags
@@ -136,8 +140,21 @@ HWND AutoCompleteWin::composeWindow(const TCHAR* header)
 
     GetClientRect(_hWnd, &win);
 
+    // Fuzzy matches are listed by rank, prefix matches alphabetically
+    if (GTagsSettings._fuzzyCompletion)
+    {
+        _matcher.reset(new FuzzyMatcher(_completion->GetList()));
+    }
+    else
+    {
+        _sorted.assign(_completion->GetList().begin(), _completion->GetList().end());
+        std::sort(_sorted.begin(), _sorted.end(),
+                [](const char* lhs, const char* rhs) { return _stricmp(lhs, rhs) < 0; });
+    }
+
+    // The list is virtual - rows are converted for display on demand
     _hLVWnd = CreateWindow(WC_LISTVIEW, NULL, WS_CHILD | WS_VISIBLE |
-            LVS_REPORT | LVS_SINGLESEL | LVS_NOLABELWRAP | LVS_NOSORTHEADER | LVS_SORTASCENDING,
+            LVS_REPORT | LVS_SINGLESEL | LVS_NOLABELWRAP | LVS_NOSORTHEADER | LVS_OWNERDATA,
             0, 0, win.right - win.left, win.bottom - win.top,
             _hWnd, NULL, HMod, NULL);
 
@@ -170,9 +187,8 @@ HWND AutoCompleteWin::composeWindow(const TCHAR* header)
     ListView_SetBkColor(_hLVWnd, backgroundColor);
     ListView_SetTextBkColor(_hLVWnd, backgroundColor);
 
-    CTextA wordA;
-    INpp::Get().GetWord(wordA, true, true);
-    CText word(wordA.C_str());
+    CTextA word;
+    INpp::Get().GetWord(word, true, true);
 
     if (!filterLV(word))
     {
@@ -192,32 +208,51 @@ HWND AutoCompleteWin::composeWindow(const TCHAR* header)
 /**
  *  \brief
  */
-int AutoCompleteWin::filterLV(const CText& filter)
+int AutoCompleteWin::filterLV(const CTextA& filter)
 {
-    LVITEM lvItem   = {0};
-    lvItem.mask     = LVIF_TEXT | LVIF_STATE;
-
-    int len = filter.Len();
+    if (_matcher)
+    {
+        _matcher->Match(filter.C_str(), false, _items);
+    }
+    else
+    {
+        const unsigned len = filter.Len();
 
-    ListView_DeleteAllItems(_hLVWnd);
+        _items.clear();
 
-    for (const auto& complEntry : _completion->GetList())
-    {
-        if (!len || !_tcsncmp(complEntry, filter.C_str(), len))
-        {
-            lvItem.pszText = complEntry;
-            ListView_InsertItem(_hLVWnd, &lvItem);
-            ++lvItem.iItem;
-        }
+        for (const char* complEntry : _sorted)
+            if (!len || !strncmp(complEntry, filter.C_str(), len))
+                _items.push_back(complEntry);
     }
 
-    if (lvItem.iItem > 0)
+    const int itemsCount = _items.size();
+
+    ListView_SetItemCountEx(_hLVWnd, itemsCount, 0);
+
+    if (itemsCount > 0)
     {
+        ListView_SetItemState(_hLVWnd, -1, 0, LVIS_FOCUSED | LVIS_SELECTED);
         ListView_SetItemState(_hLVWnd, 0, LVIS_FOCUSED | LVIS_SELECTED, LVIS_FOCUSED | LVIS_SELECTED);
+        ListView_EnsureVisible(_hLVWnd, 0, FALSE);
         resizeLV();
     }
 
-    return lvItem.iItem;
+    return itemsCount;
+}
+
+
+/**
+ *  \brief  Converts only the rows the list view shows
+ */
+void AutoCompleteWin::onGetDispInfo(NMLVDISPINFO* dispInfo)
+{
+    LVITEM& lvItem = dispInfo->item;
+
+    if (!(lvItem.mask & LVIF_TEXT) || lvItem.iItem < 0 || lvItem.iItem >= (int)_items.size())
+        return;
+
+    CText itemTxt(_items[lvItem.iItem]);
+    _tcsncpy_s(lvItem.pszText, lvItem.cchTextMax, itemTxt.C_str(), _TRUNCATE);
 }
 
 
@@ -300,18 +335,10 @@ void AutoCompleteWin::resizeLV()
  */
 void AutoCompleteWin::onDblClick()
 {
-    TCHAR itemTxt[MAX_PATH];
-    LVITEM lvItem       = {0};
-    lvItem.mask         = LVIF_TEXT;
-    lvItem.iItem        = ListView_GetNextItem(_hLVWnd, -1, LVNI_SELECTED);
-    lvItem.pszText      = itemTxt;
-    lvItem.cchTextMax   = _countof(itemTxt);
+    const int itemIdx = ListView_GetNextItem(_hLVWnd, -1, LVNI_SELECTED);
 
-    ListView_GetItem(_hLVWnd, &lvItem);
-    lvItem.pszText[lvItem.cchTextMax - 1] = 0;
-
-    CTextA completion(itemTxt);
-    INpp::Get().ReplaceWord(completion.C_str(), true);
+    if (itemIdx >= 0 && itemIdx < (int)_items.size())
+        INpp::Get().ReplaceWord(_items[itemIdx], true);
 
     SendMessage(_hWnd, WM_CLOSE, 0, 0);
 }
@@ -374,9 +401,8 @@ bool AutoCompleteWin::onKeyDown(int keyCode)
         }
     }
 
-    CTextA wordA;
-    INpp::Get().GetWord(wordA, true, true);
-    CText word(wordA.C_str());
+    CTextA word;
+    INpp::Get().GetWord(word, true, true);
     int lvItemsCnt = filterLV(word);
 
     if (lvItemsCnt == 0)
@@ -385,17 +411,7 @@ bool AutoCompleteWin::onKeyDown(int keyCode)
     }
     else if (lvItemsCnt == 1)
     {
-        TCHAR itemTxt[MAX_PATH];
-        LVITEM lvItem       = {0};
-        lvItem.mask         = LVIF_TEXT;
-        lvItem.iItem        = ListView_GetNextItem(_hLVWnd, -1, LVNI_SELECTED);
-        lvItem.pszText      = itemTxt;
-        lvItem.cchTextMax   = _countof(itemTxt);
-
-        ListView_GetItem(_hLVWnd, &lvItem);
-        lvItem.pszText[lvItem.cchTextMax - 1] = 0;
-
-        if (!_tcscmp(word.C_str(), lvItem.pszText))
+        if (!strcmp(word.C_str(), _items[0]))
             SendMessage(_hWnd, WM_CLOSE, 0, 0);
     }
 
@@ -432,6 +448,10 @@ LRESULT APIENTRY AutoCompleteWin::wndProc(HWND hWnd, UINT uMsg, WPARAM wParam, L
                 case NM_DBLCLK:
                     ACW->onDblClick();
                 return 0;
+
+                case LVN_GETDISPINFO:
+                    ACW->onGetDispInfo((NMLVDISPINFO*)lParam);
+                return 0;
             }
         break;
 
@@ -27,6 +27,9 @@
 
 #include <windows.h>
 #include <tchar.h>
+#include <memory>
+#include <vector>
+#include <commctrl.h>
 #include "Common.h"
 #include "CmdDefines.h"
 
@@ -34,6 +37,9 @@
 namespace GTags
 {
 
+class FuzzyMatcher;
+
+
 /**
  *  \class  AutoCompleteWin
  *  \brief
@@ -59,9 +65,10 @@ private:
     AutoCompleteWin& operator=(const AutoCompleteWin&) = delete;
 
     HWND composeWindow(const TCHAR* header);
-    int filterLV(const CText& filter);
+    int filterLV(const CTextA& filter);
     void resizeLV();
 
+    void onGetDispInfo(NMLVDISPINFO* dispInfo);
     void onDblClick();
     bool onKeyDown(int keyCode);
 
@@ -73,6 +80,10 @@ private:
     const CmdId_t   _cmdId;
     const int       _cmdTagLen;
     ParserPtr_t     _completion;
+
+    std::unique_ptr<FuzzyMatcher>   _matcher;
+    std::vector<const char*>        _sorted;
+    std::vector<const char*>        _items;
 };
 
 } // namespace GTags
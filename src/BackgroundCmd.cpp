@@ -0,0 +1,130 @@
+/**
+ *  \file
+ *  \brief  Background commands holding a database read lock
+ *
+ *  \author  Pavel Nedev <pg.nedev@gmail.com>
+ *
+ *  \section COPYRIGHT
+ *  Copyright(C) 2015 Pavel Nedev
+ *
+ *  \section LICENSE
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include "BackgroundCmd.h"
+#include "Cmd.h"
+#include "CmdEngine.h"
+
+
+namespace GTags
+{
+
+const DWORD BackgroundCmd::cStopWait = 1000;
+
+std::list<CmdPtr_t> BackgroundCmd::Locked;
+
+
+/**
+ *  \brief  Cancels the background commands reading the database and releases their locks once they have ended.
+ *          Called when the database write lock is needed. Returns true if any lock is released.
+ */
+bool BackgroundCmd::Stop(const DbHandle& db)
+{
+    bool released = false;
+
+    for (std::list<CmdPtr_t>::iterator cmd = Locked.begin(); cmd != Locked.end();)
+    {
+        if ((*cmd)->Db() != db)
+        {
+            ++cmd;
+            continue;
+        }
+
+        (*cmd)->Cancel();
+
+        // The ones taking too long to end are left to Complete()
+        if ((*cmd)->WaitEnd(cStopWait))
+        {
+            DbManager::Get().PutDb(db);
+            cmd = Locked.erase(cmd);
+            released = true;
+        }
+        else
+        {
+            ++cmd;
+        }
+    }
+
+    return released;
+}
+
+
+/**
+ *  \brief
+ */
+bool BackgroundCmd::Run(const CmdPtr_t& cmd, CompletionCB complCB)
+{
+    cmd->Background(true);
+
+    if (!CmdEngine::Run(cmd, complCB))
+    {
+        DbManager::Get().PutDb(cmd->Db());
+        return false;
+    }
+
+    Cancel();
+
+    _pending = cmd;
+    Locked.push_back(cmd);
+
+    return true;
+}
+
+
+/**
+ *  \brief  Cancels the pending command - its lock is released on its completion
+ */
+void BackgroundCmd::Cancel()
+{
+    if (!_pending)
+        return;
+
+    _pending->Cancel();
+    _pending.reset();
+}
+
+
+/**
+ *  \brief  Called first in the completion callback. Releases the command database lock (if still held).
+ *          Returns false if the command is cancelled or replaced by a newer one - its result is not needed.
+ */
+bool BackgroundCmd::Complete(const CmdPtr_t& cmd)
+{
+    std::list<CmdPtr_t>::iterator locked = std::find(Locked.begin(), Locked.end(), cmd);
+    if (locked != Locked.end())
+    {
+        Locked.erase(locked);
+        DbManager::Get().PutDb(cmd->Db());
+    }
+
+    if (cmd != _pending)
+        return false;
+
+    _pending.reset();
+
+    return true;
+}
+
+} // namespace GTags
@@ -0,0 +1,68 @@
+/**
+ *  \file
+ *  \brief  Background commands holding a database read lock
+ *
+ *  \author  Pavel Nedev <pg.nedev@gmail.com>
+ *
+ *  \section COPYRIGHT
+ *  Copyright(C) 2015 Pavel Nedev
+ *
+ *  \section LICENSE
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+
+#include <windows.h>
+#include <list>
+#include "CmdDefines.h"
+#include "DbManager.h"
+
+
+namespace GTags
+{
+
+/**
+ *  \class  BackgroundCmd
+ *  \brief  Runs one background command at a time (a newer one cancels the previous). Each command keeps its
+ *          database read lock until its process has exited - cancelled ones included, as global may still
+ *          be reading the database. The locks are released in the completion callback or, when a database
+ *          write needs them, by Stop().
+ */
+class BackgroundCmd
+{
+public:
+    BackgroundCmd() {}
+    BackgroundCmd(const BackgroundCmd&) = delete;
+    BackgroundCmd& operator=(const BackgroundCmd&) = delete;
+
+    static bool Stop(const DbHandle& db);
+
+    // The command database has to be read locked. The lock is released if the command can't be run.
+    bool Run(const CmdPtr_t& cmd, CompletionCB complCB);
+    void Cancel();
+    bool Complete(const CmdPtr_t& cmd);
+
+    inline const CmdPtr_t& Pending() const { return _pending; }
+
+private:
+    static const DWORD  cStopWait;
+
+    static std::list<CmdPtr_t>  Locked;
+
+    CmdPtr_t    _pending;
+};
+
+} // namespace GTags
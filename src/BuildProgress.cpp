@@ -0,0 +1,339 @@
+/**
+ *  \file
+ *  \brief  Database build progress and per database build statistics
+ *
+ *  \author  Pavel Nedev <pg.nedev@gmail.com>
+ *
+ *  \section COPYRIGHT
+ *  Copyright(C) 2015 Pavel Nedev
+ *
+ *  \section LICENSE
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <algorithm>
+#include "GTags.h"
+#include "BuildProgress.h"
+
+
+namespace GTags
+{
+
+const TCHAR     BuildProgress::cStatsFile[]     = PLUGIN_NAME _T(".stats");
+const unsigned  BuildProgress::cMaxStatsEntries = 100;
+
+
+/**
+ *  \brief
+ */
+void BuildProgress::Remove(const CPath& dbPath)
+{
+    CPath statsFile(dbPath);
+    statsFile += cStatsFile;
+
+    if (statsFile.FileExists())
+        DeleteFile(statsFile.C_str());
+}
+
+
+/**
+ *  \brief
+ */
+BuildProgress::BuildProgress(const CPath& dbPath) : _dbPath(dbPath), _startTime(GetTickCount()),
+    _filesDone(0), _filesTotal(0), _totalEstimated(false), _bytesDone(0)
+{
+    loadLastStats();
+}
+
+
+/**
+ *  \brief  Splits the output into lines - the last one might be incomplete
+ */
+void BuildProgress::OnPipeData(const char* data, unsigned len)
+{
+    const char* const end = data + len;
+
+    while (data < end)
+    {
+        const char* eol = static_cast<const char*>(memchr(data, '\n', end - data));
+        if (!eol)
+        {
+            _partialLine.insert(_partialLine.end(), data, end);
+            break;
+        }
+
+        if (_partialLine.empty())
+        {
+            parseLine(data, eol - data);
+        }
+        else
+        {
+            _partialLine.insert(_partialLine.end(), data, eol);
+            parseLine(_partialLine.data(), _partialLine.size());
+            _partialLine.clear();
+        }
+
+        data = eol + 1;
+    }
+}
+
+
+/**
+ *  \brief  Returns the percent done or -1 if the total file count is not known
+ */
+int BuildProgress::Format(CText& txt)
+{
+    unsigned filesDone;
+    unsigned filesTotal;
+    bool totalEstimated;
+    unsigned long long bytesDone;
+
+    {
+        AUTOLOCK(_lock);
+
+        filesDone       = _filesDone;
+        filesTotal      = _filesTotal;
+        totalEstimated  = _totalEstimated;
+        bytesDone       = _bytesDone;
+    }
+
+    // The previous build estimate is obviously wrong
+    if (filesTotal && filesDone > filesTotal)
+        filesTotal = 0;
+
+    const DWORD elapsedMs = GetTickCount() - _startTime;
+    TCHAR buf[128];
+
+    if (filesTotal)
+        _sntprintf_s(buf, _countof(buf), _TRUNCATE, _T("%u / %s%u files"),
+                filesDone, totalEstimated ? _T("~") : _T(""), filesTotal);
+    else
+        _sntprintf_s(buf, _countof(buf), _TRUNCATE, _T("%u files"), filesDone);
+
+    txt = buf;
+
+    if (elapsedMs >= 1000 && filesDone)
+    {
+        const double elapsed = elapsedMs / 1000.0;
+
+        _sntprintf_s(buf, _countof(buf), _TRUNCATE, _T(", %.1f files/s, %.2f MB/s"),
+                filesDone / elapsed, bytesDone / (elapsed * 1024 * 1024));
+        txt += buf;
+
+        if (filesTotal)
+        {
+            const unsigned eta = (unsigned)((filesTotal - filesDone) * elapsed / filesDone);
+
+            _sntprintf_s(buf, _countof(buf), _TRUNCATE, _T(", ETA %u:%02u"), eta / 60, eta % 60);
+            txt += buf;
+        }
+    }
+
+    if (!filesTotal)
+        return -1;
+
+    const int percent = (int)((unsigned long long)filesDone * 100 / filesTotal);
+
+    return (totalEstimated && percent > 99) ? 99 : percent;
+}
+
+
+/**
+ *  \brief  Takes the non-progress output in the same form as ReadPipe::GetOutput() - \0 terminated
+ *          or empty. Call once the pipe is done.
+ */
+void BuildProgress::GetDiagnostics(std::vector<char>& diagnostics)
+{
+    if (!_partialLine.empty())
+    {
+        parseLine(_partialLine.data(), _partialLine.size());
+        _partialLine.clear();
+    }
+
+    diagnostics.swap(_diagnostics);
+    _diagnostics.clear();
+
+    if (!diagnostics.empty())
+        diagnostics.push_back(0);
+}
+
+
+/**
+ *  \brief  Appends the finished build to the statistics file keeping the last cMaxStatsEntries
+ */
+bool BuildProgress::SaveStats()
+{
+    const DWORD elapsedMs = GetTickCount() - _startTime;
+
+    CPath statsFile(_dbPath);
+    statsFile += cStatsFile;
+
+    std::vector<CTextA> entries;
+
+    FILE* fp;
+    _tfopen_s(&fp, statsFile.C_str(), _T("rt"));
+    if (fp)
+    {
+        char line[256];
+        while (fgets(line, _countof(line), fp))
+            if (line[0] != '#' && line[0] != '\n')
+                entries.push_back(CTextA(line));
+
+        fclose(fp);
+    }
+
+    if (entries.size() >= cMaxStatsEntries)
+        entries.erase(entries.begin(), entries.end() - (cMaxStatsEntries - 1));
+
+    unsigned filesDone;
+    unsigned long long bytesDone;
+
+    {
+        AUTOLOCK(_lock);
+
+        filesDone = _filesDone;
+        bytesDone = _bytesDone;
+    }
+
+    SYSTEMTIME now;
+    GetLocalTime(&now);
+
+    const double elapsed = elapsedMs / 1000.0;
+
+    char entry[256];
+    _snprintf_s(entry, _countof(entry), _TRUNCATE,
+            "%04u-%02u-%02u %02u:%02u:%02u  %u  %I64u  %.3f  %.1f\n",
+            now.wYear, now.wMonth, now.wDay, now.wHour, now.wMinute, now.wSecond,
+            filesDone, bytesDone, elapsed, (elapsedMs ? filesDone / elapsed : 0.0));
+    entries.push_back(CTextA(entry));
+
+    _tfopen_s(&fp, statsFile.C_str(), _T("wt"));
+    if (fp == NULL)
+        return false;
+
+    bool success = (fputs("# date time  files  bytes  seconds  files/s\n", fp) >= 0);
+    for (unsigned i = 0; success && i < entries.size(); ++i)
+        success = (fputs(entries[i].C_str(), fp) >= 0);
+
+    fclose(fp);
+
+    return success;
+}
+
+
+/**
+ *  \brief  Takes the file count of the last build as total estimate
+ */
+void BuildProgress::loadLastStats()
+{
+    CPath statsFile(_dbPath);
+    statsFile += cStatsFile;
+
+    FILE* fp;
+    _tfopen_s(&fp, statsFile.C_str(), _T("rt"));
+    if (fp == NULL)
+        return;
+
+    unsigned lastFiles = 0;
+
+    char line[256];
+    while (fgets(line, _countof(line), fp))
+    {
+        unsigned files;
+        if (line[0] != '#' && sscanf_s(line, "%*s %*s %u", &files) == 1)
+            lastFiles = files;
+    }
+
+    fclose(fp);
+
+    if (lastFiles)
+    {
+        _filesTotal     = lastFiles;
+        _totalEstimated = true;
+    }
+}
+
+
+/**
+ *  \brief  Progress lines look like " [12] extracting tags of src/file.c" or " [12/345] ...".
+ *          All other verbose messages are either indented or start with a time stamp in brackets.
+ */
+void BuildProgress::parseLine(const char* line, unsigned len)
+{
+    if (len && line[len - 1] == '\r')
+        --len;
+
+    unsigned i = 0;
+    while (i < len && line[i] == ' ')
+        ++i;
+
+    if (i == len)
+        return;
+
+    if (line[i] != '[' || i + 1 == len || line[i + 1] < '0' || line[i + 1] > '9')
+    {
+        if (i == 0 && line[0] != '[')
+        {
+            _diagnostics.insert(_diagnostics.end(), line, line + len);
+            _diagnostics.push_back('\n');
+        }
+        return;
+    }
+
+    unsigned fileNum = 0;
+    unsigned fileTotal = 0;
+
+    for (++i; i < len && line[i] >= '0' && line[i] <= '9'; ++i)
+        fileNum = fileNum * 10 + (line[i] - '0');
+
+    if (i < len && line[i] == '/')
+        for (++i; i < len && line[i] >= '0' && line[i] <= '9'; ++i)
+            fileTotal = fileTotal * 10 + (line[i] - '0');
+
+    if (i == len || line[i] != ']')
+        return;
+
+    static const char cTagsOf[] = " tags of ";
+
+    unsigned long long fileSize = 0;
+
+    const char* tagsOf = std::search(line + i, line + len, cTagsOf, cTagsOf + _countof(cTagsOf) - 1);
+    if (tagsOf != line + len)
+    {
+        const char* file = tagsOf + _countof(cTagsOf) - 1;
+        if (line + len - file > 2 && file[0] == '.' && file[1] == '/')
+            file += 2;
+
+        CPath filePath(_dbPath);
+        filePath.Append(file, line + len - file);
+
+        WIN32_FILE_ATTRIBUTE_DATA fileAttr;
+        if (GetFileAttributesEx(filePath.C_str(), GetFileExInfoStandard, &fileAttr))
+            fileSize = ((unsigned long long)fileAttr.nFileSizeHigh << 32) | fileAttr.nFileSizeLow;
+    }
+
+    AUTOLOCK(_lock);
+
+    _filesDone = fileNum;
+    _bytesDone += fileSize;
+
+    if (fileTotal)
+    {
+        _filesTotal     = fileTotal;
+        _totalEstimated = false;
+    }
+}
+
+} // namespace GTags
@@ -0,0 +1,84 @@
+/**
+ *  \file
+ *  \brief  Database build progress and per database build statistics
+ *
+ *  \author  Pavel Nedev <pg.nedev@gmail.com>
+ *
+ *  \section COPYRIGHT
+ *  Copyright(C) 2015 Pavel Nedev
+ *
+ *  \section LICENSE
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+
+#include <windows.h>
+#include <tchar.h>
+#include <vector>
+#include "Common.h"
+#include "AutoLock.h"
+#include "ReadPipe.h"
+
+
+namespace GTags
+{
+
+/**
+ *  \class  BuildProgress
+ *  \brief  Follows the verbose gtags output while the database is being created. Per file progress
+ *          lines are counted and dropped, the rest (warnings and errors) are kept as diagnostics.
+ *          The file count of the previous build is used as estimate when gtags doesn't report
+ *          the total. Each successful build is appended to a statistics file in the database folder.
+ */
+class BuildProgress : public PipeListener
+{
+public:
+    static void Remove(const CPath& dbPath);
+
+    BuildProgress(const CPath& dbPath);
+    virtual ~BuildProgress() {}
+
+    virtual void OnPipeData(const char* data, unsigned len);
+
+    int Format(CText& txt);
+    void GetDiagnostics(std::vector<char>& diagnostics);
+    bool SaveStats();
+
+private:
+    static const TCHAR      cStatsFile[];
+    static const unsigned   cMaxStatsEntries;
+
+    BuildProgress(const BuildProgress&);
+    const BuildProgress& operator=(const BuildProgress&);
+
+    void loadLastStats();
+    void parseLine(const char* line, unsigned len);
+
+    const CPath         _dbPath;
+    const DWORD         _startTime;
+
+    // Accessed only in the PipeReactor thread until the pipe is done
+    std::vector<char>   _partialLine;
+    std::vector<char>   _diagnostics;
+
+    Mutex               _lock;
+    unsigned            _filesDone;
+    unsigned            _filesTotal;
+    bool                _totalEstimated;
+    unsigned long long  _bytesDone;
+};
+
+} // namespace GTags
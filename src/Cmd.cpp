@@ -34,22 +34,107 @@ namespace GTags
 Cmd::Cmd(CmdId_t id, const TCHAR* name, DbHandle db, ParserPtr_t parser,
         const TCHAR* tag, bool regExp, bool matchCase) :
         _id(id), _db(db), _parser(parser),
-        _regExp(regExp), _matchCase(matchCase), _skipLibs(false), _status(CANCELLED)
+        _regExp(regExp), _matchCase(matchCase), _skipLibs(false), _liveResults(false), _background(false),
+        _completed(false), _status(CANCELLED)
 {
     if (name)
         _name = name;
 
     if (tag)
         _tag = tag;
+
+    _hCancel = CreateEvent(NULL, TRUE, FALSE, NULL);
+    _hEnded = CreateEvent(NULL, TRUE, FALSE, NULL);
+}
+
+
+/**
+ *  \brief
+ */
+Cmd::~Cmd()
+{
+    if (_hCancel)
+        CloseHandle(_hCancel);
+    if (_hEnded)
+        CloseHandle(_hEnded);
 }
 
 
+/**
+ *  \brief
+ */
 void Cmd::AppendToResult(const std::vector<char>& data)
 {
+    unmapResult();
+
     // remove \0 string termination
     if (!_result.empty())
         _result.pop_back();
     _result.insert(_result.cend(), data.begin(), data.end());
 }
 
+
+/**
+ *  \brief  Takes the buffer without copying if the result is empty
+ */
+void Cmd::AppendToResult(std::vector<char>&& data)
+{
+    if (_result.empty() && !_resultFile)
+        _result = std::move(data);
+    else
+        AppendToResult(static_cast<const std::vector<char>&>(data));
+}
+
+
+/**
+ *  \brief  Appends the text together with its \0 string termination
+ */
+void Cmd::AppendToResult(const CTextA& txt)
+{
+    unmapResult();
+
+    if (!_result.empty())
+        _result.pop_back();
+    _result.insert(_result.cend(), txt.C_str(), txt.C_str() + txt.Len() + 1);
+}
+
+
+/**
+ *  \brief  Keeps the mapped file as result if the result is empty
+ */
+void Cmd::AppendToResult(const std::shared_ptr<SpillFile>& file)
+{
+    if (!file || !file->IsValid())
+        return;
+
+    if (_result.empty() && !_resultFile)
+    {
+        _resultFile = file;
+        return;
+    }
+
+    unmapResult();
+
+    if (!file->Data())
+        return;
+
+    if (!_result.empty())
+        _result.pop_back();
+    _result.insert(_result.cend(), file->Data(), file->Data() + file->Size());
+}
+
+
+/**
+ *  \brief  Copies mapped result into memory so it can be modified
+ */
+void Cmd::unmapResult()
+{
+    if (!_resultFile)
+        return;
+
+    if (_resultFile->Data())
+        _result.assign(_resultFile->Data(), _resultFile->Data() + _resultFile->Size());
+    _resultFile.reset();
+}
+
 } // namespace GTags
@@ -28,9 +28,11 @@
 #include <windows.h>
 #include <tchar.h>
 #include <vector>
+#include <memory>
 #include "Common.h"
 #include "CmdDefines.h"
 #include "DbManager.h"
+#include "ReadPipe.h"
 
 
 namespace GTags
@@ -49,12 +51,34 @@ public:
     virtual ~ResultParser() {}
 
     virtual int Parse(const CmdPtr_t&) = 0;
+
+    // Parses output lines while the command is still running and gives their display text.
+    // Returns the count of the new results, -1 if the parser doesn't show partial results.
+    virtual int ParsePartial(const CmdPtr_t&, const char*, CTextA&) { return -1; }
+
     virtual const CTextA& GetText() const { return _buf; }
-    virtual const std::vector<TCHAR*>& GetList() const { return _lines; }
+    virtual const std::vector<char*>& GetList() const { return _lines; }
 
 protected:
     CTextA              _buf;
-    std::vector<TCHAR*> _lines;
+    std::vector<char*>  _lines; // entries in _buf, left in the command output encoding
+};
+
+
+/**
+ *  \struct  PartialResult
+ *  \brief  WM_UPDATE_RESULT_WIN data - the results found so far by a still running command.
+ *          The UI thread takes ownership once the message is posted.
+ */
+struct PartialResult
+{
+    PartialResult(const CmdPtr_t& cmd) : _cmd(cmd), _hits(0), _first(false), _last(false) {}
+
+    CmdPtr_t    _cmd;
+    CTextA      _text;      // display text of the new results (the first one starts with the header)
+    unsigned    _hits;      // results count so far
+    bool        _first;
+    bool        _last;      // the command is done - no text, the final results follow in its completion
 };
 
 
@@ -67,7 +91,9 @@ class Cmd
 public:
     Cmd(CmdId_t id, const TCHAR* name, DbHandle db = NULL, ParserPtr_t parser = ParserPtr_t(NULL),
             const TCHAR* tag = NULL, bool regExp = false, bool matchCase = true);
-    ~Cmd() {}
+    ~Cmd();
+    Cmd(const Cmd&) = delete;
+    Cmd& operator=(const Cmd&) = delete;
 
     inline void Id(CmdId_t id) { _id = id; }
     inline CmdId_t Id() const { return _id; }
@@ -92,18 +118,69 @@ public:
     inline void SkipLibs(bool skipLibs) { _skipLibs = skipLibs; }
     inline bool SkipLibs() const { return _skipLibs; }
 
+    // Results are shown while the command is still running (if it takes long)
+    inline void LiveResults(bool live) { _liveResults = live; }
+    inline bool LiveResults() const { return _liveResults; }
+
+    // Search only the results in this database file - used to refresh results after the file is re-indexed
+    inline void Scope(const CPath& file) { _scope = file; }
+    inline const CPath& Scope() const { return _scope; }
+
     inline void Status(CmdStatus_t stat) { _status = stat; }
     inline CmdStatus_t Status() const { return _status; }
 
-    inline char* Result() { return _result.data(); }
-    inline const char* Result() const { return _result.data(); }
-    inline unsigned ResultLen() const { return _result.size() - 1; }
+    // Background commands don't show activity window while they stay in background
+    inline void Background(bool bg) { _background = bg; }
+    inline bool Background() const { return _background; }
+
+    // Stops the running command, its completion callback is still called (with CANCELLED status)
+    inline void Cancel() { if (_hCancel) SetEvent(_hCancel); }
+
+    // Polled by the parsers and the result merging every cCancelCheckLines lines so cancelling
+    // doesn't have to wait for them to finish
+    static const unsigned cCancelCheckLines = 1024;
+
+    // Problems that didn't stop the command but its results may be incomplete
+    inline void AddWarning(const CTextA& warning)
+    {
+        if (!_warning.IsEmpty())
+            _warning += ", ";
+        _warning += warning;
+    }
+    inline const CTextA& Warning() const { return _warning; }
+
+    inline bool IsCancelled() const { return (_hCancel && WaitForSingleObject(_hCancel, 0) == WAIT_OBJECT_0); }
+
+    // The completion callback has run (UI thread only) - partial results posted before it may still arrive
+    inline bool IsCompleted() const { return _completed; }
+
+    // The command has ended (its processes have exited) - its completion callback may still be queued
+    inline bool WaitEnd(DWORD timeoutMs) const
+    {
+        return (_hEnded && WaitForSingleObject(_hEnded, timeoutMs) == WAIT_OBJECT_0);
+    }
+
+    inline const char* Result() const { return _resultFile ? _resultFile->Data() : _result.data(); }
+    inline bool HasResult() const { return (_resultFile || !_result.empty()); }
+
+    // The result too big to keep in memory (if so) - it can be read in parts instead of mapping it whole by Result()
+    inline const std::shared_ptr<SpillFile>& ResultFile() const { return _resultFile; }
+    inline unsigned ResultLen() const { return (_resultFile ? _resultFile->Size() : _result.size()) - 1; }
 
     void AppendToResult(const std::vector<char>& data);
+    void AppendToResult(std::vector<char>&& data);
+    void AppendToResult(const std::shared_ptr<SpillFile>& file);
+    void AppendToResult(const CTextA& txt);
     void SetResult(const std::vector<char>& data)
     {
+        _resultFile.reset();
         _result.assign(data.begin(), data.end());
     }
+    void SetResult(const CTextA& txt)
+    {
+        _resultFile.reset();
+        _result.assign(txt.C_str(), txt.C_str() + txt.Len() + 1);
+    }
 
 private:
     friend class CmdEngine;
@@ -113,13 +190,23 @@ private:
     DbHandle            _db;
 
     CText               _tag;
+    CPath               _scope;
     ParserPtr_t         _parser;
     bool                _regExp;
     bool                _matchCase;
     bool                _skipLibs;
-
-    CmdStatus_t         _status;
-    std::vector<char>   _result;
+    bool                _liveResults;
+    volatile bool       _background;
+    bool                _completed;
+    HANDLE              _hCancel;
+    HANDLE              _hEnded;
+
+    void unmapResult();
+
+    CmdStatus_t                 _status;
+    CTextA                      _warning;
+    std::vector<char>           _result;
+    std::shared_ptr<SpillFile>  _resultFile;
 };
 
 } // namespace GTags
@@ -44,6 +44,9 @@ enum CmdId_t
     FIND_SYMBOL,
     GREP,
     GREP_TEXT,
+    FILE_TAGS,
+    LIST_FILES,
+    LIST_OTHER_FILES,
     VERSION,
     CTAGS_VERSION
 };
@@ -25,223 +25,1359 @@
 #include <windows.h>
 #include <tchar.h>
 #include <process.h>
+#include <malloc.h>
+#include <new>
+#include <unordered_set>
+#include <string>
 #include "Common.h"
 #include "INpp.h"
 #include "Config.h"
 #include "GTags.h"
 #include "ReadPipe.h"
+#include "GrepEngine.h"
+#include "TrigramIndex.h"
+#include "FileIndex.h"
+#include "LibQueryCache.h"
+#include "BuildProgress.h"
+#include "ResultFeed.h"
+#include "ActivityWin.h"
 #include "CmdEngine.h"
 #include "Cmd.h"
 
 
+#ifndef JOB_OBJECT_CPU_RATE_CONTROL_ENABLE
+
+// Not in the XP toolset SDK - the job CPU rate control is available since Windows 8
+#define JOB_OBJECT_CPU_RATE_CONTROL_ENABLE      0x1
+#define JOB_OBJECT_CPU_RATE_CONTROL_HARD_CAP    0x4
+
+typedef struct _JOBOBJECT_CPU_RATE_CONTROL_INFORMATION
+{
+    DWORD ControlFlags;
+    union
+    {
+        DWORD CpuRate;
+        DWORD Weight;
+    };
+} JOBOBJECT_CPU_RATE_CONTROL_INFORMATION;
+
+#endif
+
+
+namespace
+{
+
+const JOBOBJECTINFOCLASS cJobObjectCpuRateControlInformation = (JOBOBJECTINFOCLASS)15;
+
+
+/**
+ *  \brief  Lowers the process I/O priority. There is no documented API to do that for other than
+ *          the current process so the native one is used if present.
+ */
+void setBackgroundIo(HANDLE hProcess)
+{
+    typedef LONG (WINAPI *NtSetInformationProcess_t)(HANDLE, ULONG, PVOID, ULONG);
+
+    const ULONG cProcessIoPriority = 33;
+
+    HMODULE hNtDll = GetModuleHandle(_T("ntdll.dll"));
+    if (!hNtDll)
+        return;
+
+    NtSetInformationProcess_t setInformationProcess =
+            reinterpret_cast<NtSetInformationProcess_t>(GetProcAddress(hNtDll, "NtSetInformationProcess"));
+
+    if (setInformationProcess)
+    {
+        ULONG ioPriority = 0; // very low
+        setInformationProcess(hProcess, cProcessIoPriority, &ioPriority, sizeof(ioPriority));
+    }
+}
+
+
+/**
+ *  \struct  ViewHasher
+ *  \brief
+ */
+struct ViewHasher
+{
+    inline size_t operator()(const CTextViewA& view) const { return view.Hash(); }
+};
+
+
+/**
+ *  \brief
+ */
+inline bool isAbsolutePath(const char* path, unsigned len)
+{
+    return (len > 2 && path[1] == ':' && (path[2] == '\\' || path[2] == '/'));
+}
+
+
+/**
+ *  \brief  Returns the length of the "path:line" part of a --result=grep line (0 if not found)
+ *          and the length of the path in it
+ */
+unsigned locationLen(const char* pLine, unsigned lineLen, unsigned& pathLen)
+{
+    unsigned i = isAbsolutePath(pLine, lineLen) ? 2 : 0;
+
+    for (; i < lineLen && pLine[i] != ':'; ++i);
+    if (i == lineLen)
+        return 0;
+
+    pathLen = i;
+
+    for (++i; i < lineLen && pLine[i] != ':'; ++i);
+
+    return i;
+}
+
+
+/**
+ *  \brief  Returns the absolute "path:line" of a location ASCII case-folded and with '/' taken as '\\'
+ */
+std::string foldedLocation(const CTextA& root, const char* pLine, unsigned pathLen, unsigned locLen)
+{
+    std::string location;
+
+    if (!isAbsolutePath(pLine, pathLen))
+        location.assign(root.C_str(), root.Len());
+
+    location.append(pLine, locLen);
+
+    for (auto& c : location)
+    {
+        if (c == '/')
+            c = '\\';
+        else if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+    }
+
+    return location;
+}
+
+} // anonymous namespace
+
+
 namespace GTags
 {
 
-const TCHAR CmdEngine::cCreateDatabaseCmd[] = _T("\"%s\\gtags.exe\" -c --skip-unreadable");
-const TCHAR CmdEngine::cUpdateSingleCmd[]   = _T("\"%s\\gtags.exe\" -c --skip-unreadable --single-update \"%s\"");
-const TCHAR CmdEngine::cAutoComplCmd[]      = _T("\"%s\\global.exe\" -cT \"%s\"");
-const TCHAR CmdEngine::cAutoComplSymCmd[]   = _T("\"%s\\global.exe\" -cs \"%s\"");
-const TCHAR CmdEngine::cAutoComplFileCmd[]  = _T("\"%s\\global.exe\" -cP --match-part=all \"%s\"");
-const TCHAR CmdEngine::cFindFileCmd[]       = _T("\"%s\\global.exe\" -P \"%s\"");
-const TCHAR CmdEngine::cFindDefinitionCmd[] = _T("\"%s\\global.exe\" -dT --result=grep \"%s\"");
-const TCHAR CmdEngine::cFindReferenceCmd[]  = _T("\"%s\\global.exe\" -r --result=grep \"%s\"");
-const TCHAR CmdEngine::cFindSymbolCmd[]     = _T("\"%s\\global.exe\" -s --result=grep \"%s\"");
-const TCHAR CmdEngine::cGrepCmd[]           = _T("\"%s\\global.exe\" -g --result=grep \"%s\"");
-const TCHAR CmdEngine::cGrepTxtCmd[]        = _T("\"%s\\global.exe\" -gO --result=grep \"%s\"");
-const TCHAR CmdEngine::cVersionCmd[]        = _T("\"%s\\global.exe\" --version");
-const TCHAR CmdEngine::cCtagsVersionCmd[]   = _T("\"%s\\ctags.exe\" --version");
+const TCHAR CmdEngine::cCreateDatabaseCmd[] = _T("\"%s\\gtags.exe\" -c -v --skip-unreadable");
+const TCHAR CmdEngine::cUpdateSingleCmd[]   = _T("\"%s\\gtags.exe\" -c --skip-unreadable --single-update \"%s\"");
+const TCHAR CmdEngine::cAutoComplCmd[]      = _T("\"%s\\global.exe\" -cT \"%s\"");
+const TCHAR CmdEngine::cAutoComplSymCmd[]   = _T("\"%s\\global.exe\" -cs \"%s\"");
+const TCHAR CmdEngine::cAutoComplFileCmd[]  = _T("\"%s\\global.exe\" -cP --match-part=all \"%s\"");
+const TCHAR CmdEngine::cFindFileCmd[]       = _T("\"%s\\global.exe\" -P \"%s\"");
+const TCHAR CmdEngine::cFindDefinitionCmd[] = _T("\"%s\\global.exe\" -dT --result=grep \"%s\"");
+const TCHAR CmdEngine::cFindReferenceCmd[]  = _T("\"%s\\global.exe\" -r --result=grep \"%s\"");
+const TCHAR CmdEngine::cFindSymbolCmd[]     = _T("\"%s\\global.exe\" -s --result=grep \"%s\"");
+const TCHAR CmdEngine::cGrepCmd[]           = _T("\"%s\\global.exe\" -g --result=grep \"%s\"");
+const TCHAR CmdEngine::cGrepTxtCmd[]        = _T("\"%s\\global.exe\" -gO --result=grep \"%s\"");
+const TCHAR CmdEngine::cFileTagsCmd[]       = _T("\"%s\\global.exe\" -f \"%s\"");
+const TCHAR CmdEngine::cListFilesCmd[]      = _T("\"%s\\global.exe\" -P");
+const TCHAR CmdEngine::cListOtherFilesCmd[] = _T("\"%s\\global.exe\" -PO");
+const TCHAR CmdEngine::cVersionCmd[]        = _T("\"%s\\global.exe\" --version");
+const TCHAR CmdEngine::cCtagsVersionCmd[]   = _T("\"%s\\ctags.exe\" --version");
+
+const DWORD CmdEngine::cProgressUpdateMs    = 500;
+const DWORD CmdEngine::cResultsUpdateMs     = 100;
+
+const unsigned CmdEngine::cMaxComplEntries  = 16;
+const unsigned CmdEngine::cMaxComplSize     = 4 * 1024 * 1024;
+
+
+SLIST_HEADER    CmdEngine::ComplQueue;
+volatile LONG   CmdEngine::WakeupPosted = 0;
+Mutex           CmdEngine::EnvLock;
+
+Mutex                               CmdEngine::ComplCacheLock;
+std::list<CmdEngine::ComplEntry>    CmdEngine::ComplCache;
+
+
+/**
+ *  \brief
+ */
+void CmdEngine::Init()
+{
+    InitializeSListHead(&ComplQueue);
+    WakeupPosted = 0;
+}
+
+
+/**
+ *  \brief  Drops the completions that didn't make it to the UI thread
+ */
+void CmdEngine::DeInit()
+{
+    PSLIST_ENTRY entry = InterlockedFlushSList(&ComplQueue);
+
+    while (entry)
+    {
+        Completion* item = reinterpret_cast<Completion*>(entry);
+        entry = entry->Next;
+
+        item->~Completion();
+        _aligned_free(item);
+    }
+}
+
+
+/**
+ *  \brief
+ */
+bool CmdEngine::Run(const CmdPtr_t& cmd, CompletionCB complCB)
+{
+    if (!complCB)
+        return false;
+
+    CmdEngine* engine = new CmdEngine(cmd, complCB);
+    cmd->Status(RUN_ERROR);
+
+    engine->_hThread = (HANDLE)_beginthreadex(NULL, 0, threadFunc, engine, 0, NULL);
+    if (engine->_hThread == NULL)
+    {
+        delete engine;
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+ *  \brief  Runs (in the UI thread) the completion callbacks of all finished commands in the order they finished.
+ *          Called on WM_RUN_CMD_CALLBACK - one message may carry many completions.
+ *          syncCompletion is the completion that couldn't be queued (sent synchronously) - it is run last.
+ */
+void CmdEngine::RunCompletions(LPARAM syncCompletion)
+{
+    // Re-arm the wakeup before draining so a completion queued meanwhile is never missed
+    InterlockedExchange(&WakeupPosted, 0);
+
+    PSLIST_ENTRY entry = InterlockedFlushSList(&ComplQueue);
+
+    // The list is LIFO - reverse it
+    PSLIST_ENTRY first = NULL;
+    while (entry)
+    {
+        PSLIST_ENTRY next = entry->Next;
+        entry->Next = first;
+        first = entry;
+        entry = next;
+    }
+
+    while (first)
+    {
+        Completion* item = reinterpret_cast<Completion*>(first);
+        first = first->Next;
+
+        if (item->_cmd)
+            item->_cmd->_completed = true;
+
+        if (item->_complCB && item->_cmd)
+            item->_complCB(item->_cmd);
+
+        item->~Completion();
+        _aligned_free(item);
+    }
+
+    if (syncCompletion)
+    {
+        const Completion* item = reinterpret_cast<const Completion*>(syncCompletion);
+
+        if (item->_cmd)
+            item->_cmd->_completed = true;
+
+        if (item->_complCB && item->_cmd)
+            item->_complCB(item->_cmd);
+    }
+}
+
+
+/**
+ *  \brief  Queues the finished command and wakes up the UI thread if it is not already woken up.
+ *          Doesn't wait for the UI thread so the worker thread can exit immediately.
+ */
+void CmdEngine::queueCompletion(CompletionCB complCB, const CmdPtr_t& cmd)
+{
+    void* mem = _aligned_malloc(sizeof(Completion), MEMORY_ALLOCATION_ALIGNMENT);
+
+    // Out of memory - complete synchronously rather than never (the callback releases the database lock)
+    if (mem == NULL)
+    {
+        Completion item;
+        item._complCB = complCB;
+        item._cmd = cmd;
+
+        SendMessage(MainWndH, WM_RUN_CMD_CALLBACK, 0, reinterpret_cast<LPARAM>(&item));
+        return;
+    }
+
+    Completion* item = new (mem) Completion;
+    item->_complCB = complCB;
+    item->_cmd = cmd;
+
+    InterlockedPushEntrySList(&ComplQueue, &item->_entry);
+
+    if (InterlockedExchange(&WakeupPosted, 1) == 0)
+    {
+        if (!PostMessage(MainWndH, WM_RUN_CMD_CALLBACK, 0, 0))
+            InterlockedExchange(&WakeupPosted, 0);
+    }
+}
+
+
+/**
+ *  \brief
+ */
+CmdEngine::CmdEngine(const CmdPtr_t& cmd, CompletionCB complCB) :
+    _cmd(cmd), _complCB(complCB), _hThread(NULL), _hJob(NULL), _feedHits(0), _hActivityCancel(NULL),
+    _activityShown(false), _libsFederated(false), _libQueryStart(0)
+{
+}
+
+
+/**
+ *  \brief
+ */
+CmdEngine::~CmdEngine()
+{
+    stopLibQueries();
+    closeActivityWin();
+
+    // The Results Window either adopts the partial results or drops them on command completion
+    if (_feedHits)
+    {
+        PartialResult* partial = new PartialResult(_cmd);
+        partial->_hits = _feedHits;
+        partial->_last = true;
+
+        if (!PostMessage(MainWndH, WM_UPDATE_RESULT_WIN, 0, reinterpret_cast<LPARAM>(partial)))
+            delete partial;
+    }
+
+    if (_cmd->_hEnded)
+        SetEvent(_cmd->_hEnded);
+
+    queueCompletion(_complCB, _cmd);
+
+    if (_hThread)
+        CloseHandle(_hThread);
+
+    // Terminates whatever the database building process left running
+    if (_hJob)
+        CloseHandle(_hJob);
+}
+
+
+/**
+ *  \brief
+ */
+unsigned __stdcall CmdEngine::threadFunc(void* data)
+{
+    CmdEngine* engine = static_cast<CmdEngine*>(data);
+    unsigned r = engine->start();
+
+    delete engine;
+
+    return r;
+}
+
+
+/**
+ *  \brief
+ */
+unsigned __stdcall CmdEngine::indexThreadFunc(void* data)
+{
+    IndexBuild* build = static_cast<IndexBuild*>(data);
+
+    return TrigramIndex::Build(build->_dbPath, build->_fileList, build->_stop) ? 0 : 1;
+}
+
+
+/**
+ *  \brief
+ */
+unsigned __stdcall CmdEngine::libQueryThreadFunc(void* data)
+{
+    LibQuery* query = static_cast<LibQuery*>(data);
+
+    return query->_engine->queryLib(*query) ? 0 : 1;
+}
+
+
+/**
+ *  \brief
+ */
+CmdEngine::LibQuery::~LibQuery()
+{
+    if (_hThread)
+        CloseHandle(_hThread);
+    if (_hStop)
+        CloseHandle(_hStop);
+}
+
+
+/**
+ *  \brief
+ */
+unsigned CmdEngine::start()
+{
+    if (GTagsSettings._federatedLibQuery && (_cmd->_id == AUTOCOMPLETE || _cmd->_id == FIND_DEFINITION))
+        startLibQueries();
+
+    if ((_cmd->_id == GREP || _cmd->_id == GREP_TEXT) && GTagsSettings._inProcessGrep)
+    {
+        return grepInProcess();
+    }
+    // global doesn't search the library databases for files either (see composeLibPath())
+    // so the database's own file index gives the same results
+    else if ((_cmd->_id == FIND_FILE || _cmd->_id == AUTOCOMPLETE_FILE) && GTagsSettings._fileNameIndex)
+    {
+        return findFileInProcess();
+    }
+
+    const bool cachedCompl = isCachedCompletion();
+
+    if (cachedCompl && getCachedCompletion())
+        return parseResult();
+
+    ReadPipe dataPipe(GTagsSettings._resultSpillMB * 1024 * 1024);
+    ReadPipe errorPipe;
+
+    if (_cmd->_id == CREATE_DATABASE)
+    {
+        _progress.reset(new BuildProgress(_cmd->Db()->GetPath()));
+        errorPipe.SetListener(_progress.get());
+    }
+    else if (_cmd->_liveResults && _cmd->_parser)
+    {
+        _feed.reset(new ResultFeed);
+        dataPipe.SetListener(_feed.get());
+    }
+
+    PROCESS_INFORMATION pi;
+
+    if (!runProcess(pi, dataPipe, errorPipe, _cmd->_id))
+        return 1;
+
+    // Tag and symbol completions (global -cT and -cs) are queried concurrently
+    ReadPipe symDataPipe;
+    ReadPipe symErrorPipe;
+    PROCESS_INFORMATION symPi;
+
+    const bool withSymbols =
+            (_cmd->_id == AUTOCOMPLETE && runProcess(symPi, symDataPipe, symErrorPipe, AUTOCOMPLETE_SYMBOL));
+
+    waitFor(pi.hProcess, true);
+
+    endProcess(pi);
+
+    if (withSymbols)
+    {
+        if (_cmd->_status != CANCELLED)
+        {
+            HANDLE waitSymProcess[] = {symPi.hProcess, _cmd->_hCancel};
+
+            if (WaitForMultipleObjects(_cmd->_hCancel ? 2 : 1, waitSymProcess, FALSE, INFINITE) == WAIT_OBJECT_0 + 1)
+                _cmd->_status = CANCELLED;
+        }
+
+        endProcess(symPi);
+    }
+
+    if (_cmd->_status == CANCELLED)
+        return 1;
+
+    // Only warnings and errors are left from the verbose output
+    if (_progress)
+        _progress->GetDiagnostics(errorPipe.GetOutput());
+
+    const bool withSymbolsOutput = (withSymbols && !symDataPipe.GetOutput().empty());
+
+    if (dataPipe.GetSpillFile())
+    {
+        if (!dataPipe.GetSpillFile()->IsValid())
+        {
+            const CTextA msg("Not enough memory to load command output");
+            _cmd->SetResult(msg);
+            _cmd->_status = FAILED;
+            return 1;
+        }
+
+        _cmd->AppendToResult(dataPipe.GetSpillFile());
+    }
+    else if (!dataPipe.GetOutput().empty())
+    {
+        _cmd->AppendToResult(std::move(dataPipe.GetOutput()));
+    }
+    // Completion fails only if neither global -cT nor global -cs gave any output
+    else if (!withSymbolsOutput && (!errorPipe.GetOutput().empty() ||
+            (withSymbols && !symErrorPipe.GetOutput().empty())))
+    {
+        _cmd->SetResult(errorPipe.GetOutput().empty() ? symErrorPipe.GetOutput() : errorPipe.GetOutput());
+
+        if (_cmd->_id != CREATE_DATABASE && _cmd->_id != UPDATE_SINGLE)
+        {
+            _cmd->_status = FAILED;
+            return 1;
+        }
+    }
+
+    // The completion parser merges and de-duplicates both outputs
+    if (withSymbolsOutput)
+        _cmd->AppendToResult(std::move(symDataPipe.GetOutput()));
+
+    if (cachedCompl)
+        cacheCompletion();
+
+    return parseResult();
+}
+
+
+/**
+ *  \brief  Fuzzy completion asks for all the names starting with the word first letter. That is a lot of output
+ *          for each keystroke so it is kept per database until the database (or its libraries) change.
+ */
+bool CmdEngine::isCachedCompletion() const
+{
+    if (!GTagsSettings._fuzzyCompletion || _cmd->_matchCase)
+        return false;
+
+    if (_cmd->_id == AUTOCOMPLETE || _cmd->_id == AUTOCOMPLETE_SYMBOL)
+        return (_cmd->_tag.Len() == 1);
+
+    // Tag is prefixed with '/'
+    if (_cmd->_id == AUTOCOMPLETE_FILE)
+        return (_cmd->_tag.Len() == 2);
+
+    return false;
+}
+
+
+/**
+ *  \brief  Gets the latest change time of the database and the libraries included in the completion output
+ */
+bool CmdEngine::completionDbTime(FILETIME& dbTime) const
+{
+    static const TCHAR* const cDbFiles[] = { _T("GTAGS"), _T("GRTAGS"), _T("GPATH") };
+
+    std::vector<CPath> dbPaths(1, _cmd->Db()->GetPath());
+
+    CText libPath;
+    composeLibPath(libPath, _cmd->_id);
+
+    if (!libPath.IsEmpty())
+    {
+        const DbConfig& cfg = _cmd->Db()->GetConfig();
+        dbPaths.insert(dbPaths.end(), cfg._libDbPaths.begin(), cfg._libDbPaths.end());
+    }
+
+    dbTime.dwLowDateTime = dbTime.dwHighDateTime = 0;
+
+    for (const auto& dbPath : dbPaths)
+    {
+        for (const TCHAR* dbFile : cDbFiles)
+        {
+            CPath path(dbPath);
+            path += dbFile;
+
+            WIN32_FILE_ATTRIBUTE_DATA attr;
+            if (!GetFileAttributesEx(path.C_str(), GetFileExInfoStandard, &attr))
+            {
+                if (dbFile == cDbFiles[0])
+                    return false;
+                continue;
+            }
+
+            if (CompareFileTime(&attr.ftLastWriteTime, &dbTime) > 0)
+                dbTime = attr.ftLastWriteTime;
+        }
+    }
+
+    return true;
+}
+
+
+/**
+ *  \brief  Sets the cached completion output as result. Returns false if it is not cached or is outdated.
+ */
+bool CmdEngine::getCachedCompletion()
+{
+    FILETIME dbTime;
+    if (!completionDbTime(dbTime))
+        return false;
+
+    CText libPath;
+    composeLibPath(libPath, _cmd->_id);
+
+    const PathKey dbKey(_cmd->Db()->GetPath());
+    const bool withLibs = !libPath.IsEmpty();
+
+    AUTOLOCK(ComplCacheLock);
+
+    for (auto cached = ComplCache.begin(); cached != ComplCache.end(); ++cached)
+    {
+        if (cached->_id != _cmd->_id || cached->_db != dbKey || !(cached->_tag == _cmd->_tag) ||
+                cached->_withLibs != withLibs)
+            continue;
+
+        if (CompareFileTime(&cached->_dbTime, &dbTime))
+        {
+            ComplCache.erase(cached);
+            return false;
+        }
+
+        ComplCache.splice(ComplCache.begin(), ComplCache, cached);
+
+        if (!cached->_output.empty())
+            _cmd->AppendToResult(cached->_output);
+
+        return true;
+    }
+
+    return false;
+}
+
+
+/**
+ *  \brief  Keeps the completion output (if not too big) for the next keystrokes
+ */
+void CmdEngine::cacheCompletion()
+{
+    if (_cmd->_resultFile || _cmd->_result.size() > cMaxComplSize)
+        return;
+
+    ComplEntry entry;
+
+    if (!completionDbTime(entry._dbTime))
+        return;
+
+    CText libPath;
+    composeLibPath(libPath, _cmd->_id);
+
+    entry._db       = PathKey(_cmd->Db()->GetPath());
+    entry._id       = _cmd->_id;
+    entry._tag      = _cmd->_tag;
+    entry._withLibs = !libPath.IsEmpty();
+    entry._output   = _cmd->_result;
+
+    AUTOLOCK(ComplCacheLock);
+
+    for (auto cached = ComplCache.begin(); cached != ComplCache.end(); ++cached)
+    {
+        if (cached->_id == entry._id && cached->_db == entry._db && cached->_tag == entry._tag &&
+                cached->_withLibs == entry._withLibs)
+        {
+            ComplCache.erase(cached);
+            break;
+        }
+    }
+
+    ComplCache.push_front(std::move(entry));
+
+    if (ComplCache.size() > cMaxComplEntries)
+        ComplCache.pop_back();
+}
+
+
+/**
+ *  \brief  Waits for the process (or other waitable object) showing Activity Window if it takes long
+ */
+void CmdEngine::waitFor(HANDLE hWait, bool isProcess)
+{
+    HANDLE waitProcess[] = {hWait, _cmd->_hCancel};
+    const DWORD waitCount = _cmd->_hCancel ? 2 : 1;
+
+    // Activity Window is already shown by a previous stage of the command
+    if (_hActivityCancel)
+    {
+        DWORD waitRes;
+        while ((waitRes = WaitForMultipleObjects(waitCount, waitProcess, FALSE,
+                _feed ? cResultsUpdateMs : INFINITE)) == WAIT_TIMEOUT)
+            postResults();
+
+        if (waitRes == WAIT_OBJECT_0 + 1)
+            _cmd->_status = CANCELLED;
+        return;
+    }
+
+    bool showActivityWin = true;
+    if (_cmd->_id != CREATE_DATABASE && _cmd->_id != UPDATE_SINGLE)
+    {
+        // Wait 300 ms and if process has finished don't show Activity Window.
+        // Background commands don't show it until they are finished or brought to foreground.
+        DWORD waitRes;
+        do
+            waitRes = WaitForMultipleObjects(waitCount, waitProcess, FALSE, 300);
+        while (waitRes == WAIT_TIMEOUT && _cmd->_background);
+
+        if (waitRes == WAIT_OBJECT_0 + 1)
+            _cmd->_status = CANCELLED;
+
+        // Brought to foreground while running
+        if (waitRes == WAIT_TIMEOUT && isProcess)
+            SetPriorityClass(hWait, priorityClass(_cmd->_id));
+
+        if (waitRes != WAIT_TIMEOUT)
+            showActivityWin = false;
+    }
+
+    if (showActivityWin)
+    {
+        // The window cancels the command itself so the stages after the wait (parsing, merging) see it as well
+        HANDLE hCancel = NULL;
+        if (!_cmd->_hCancel || !DuplicateHandle(GetCurrentProcess(), _cmd->_hCancel, GetCurrentProcess(),
+                &hCancel, 0, FALSE, DUPLICATE_SAME_ACCESS))
+            hCancel = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+        if (hCancel)
+        {
+            CText header(_cmd->Name());
+
+            if (_cmd->_id != VERSION && _cmd->_id != CTAGS_VERSION)
+            {
+                header += _T(" - \"");
+                if (_cmd->_id == CREATE_DATABASE)
+                    header += _cmd->Db()->GetPath();
+                else
+                    header += _cmd->Tag();
+                header += _T('\"');
+            }
+
+            // The UI thread takes ownership of the header copy and of the cancel event once the message is posted
+            TCHAR* headerCopy = new TCHAR[header.Len() + 1];
+            _tcscpy_s(headerCopy, header.Len() + 1, header.C_str());
+
+            const bool isShown = (PostMessage(MainWndH, WM_OPEN_ACTIVITY_WIN,
+                    reinterpret_cast<WPARAM>(headerCopy), reinterpret_cast<LPARAM>(hCancel)) != FALSE);
+            if (!isShown)
+                delete [] headerCopy;
+
+            const DWORD waitTime =
+                    (_progress && isShown) ? cProgressUpdateMs : (_feed ? cResultsUpdateMs : INFINITE);
+
+            HANDLE waitHandles[] = {hWait, hCancel, _cmd->_hCancel};
+            DWORD waitRes;
+            while ((waitRes = WaitForMultipleObjects(waitCount + 1, waitHandles, FALSE, waitTime)) == WAIT_TIMEOUT)
+            {
+                if (_progress)
+                    postProgress(hCancel);
+                if (_feed)
+                    postResults();
+            }
+
+            DWORD handleId = waitRes - WAIT_OBJECT_0;
+            if (handleId > 0 && handleId < waitCount + 1)
+                _cmd->_status = CANCELLED;
+
+            // Stays open until the command is completely done
+            _hActivityCancel = hCancel;
+            _activityShown = isShown;
+        }
+        else
+        {
+            if (WaitForMultipleObjects(waitCount, waitProcess, FALSE, INFINITE) == WAIT_OBJECT_0 + 1)
+                _cmd->_status = CANCELLED;
+        }
+    }
+}
+
+
+/**
+ *  \brief
+ */
+void CmdEngine::postProgress(HANDLE hActivityCancel)
+{
+    CText txt;
+    const int percent = _progress->Format(txt);
+
+    ActivityProgress* progress = new ActivityProgress(txt.C_str(), percent);
+
+    if (!PostMessage(MainWndH, WM_UPDATE_ACTIVITY_WIN,
+            reinterpret_cast<WPARAM>(progress), reinterpret_cast<LPARAM>(hActivityCancel)))
+        delete progress;
+}
+
+
+/**
+ *  \brief  Parses the output that arrived so far and posts the new results to the Results Window
+ */
+void CmdEngine::postResults()
+{
+    std::vector<char> lines;
+
+    if (!_feed->Take(lines))
+        return;
+
+    PartialResult* partial = new PartialResult(_cmd);
+
+    const int hits = _cmd->_parser->ParsePartial(_cmd, lines.data(), partial->_text);
+
+    // Not shown partially - no need to collect the rest
+    if (hits < 0)
+        _feed->Stop();
+
+    if (hits <= 0)
+    {
+        delete partial;
+        return;
+    }
+
+    partial->_first = (_feedHits == 0);
+    _feedHits += hits;
+    partial->_hits = _feedHits;
+
+    if (!PostMessage(MainWndH, WM_UPDATE_RESULT_WIN, 0, reinterpret_cast<LPARAM>(partial)))
+        delete partial;
+}
+
+
+/**
+ *  \brief
+ */
+void CmdEngine::closeActivityWin()
+{
+    if (!_hActivityCancel)
+        return;
+
+    if (!_activityShown ||
+            !PostMessage(MainWndH, WM_CLOSE_ACTIVITY_WIN, 0, reinterpret_cast<LPARAM>(_hActivityCancel)))
+        CloseHandle(_hActivityCancel);
+
+    _hActivityCancel = NULL;
+}
+
+
+/**
+ *  \brief  Gets the database file list (LIST_FILES or LIST_OTHER_FILES) from global
+ */
+bool CmdEngine::listFiles(CmdId_t id, std::vector<char>& fileList, std::vector<char>& errors)
+{
+    ReadPipe dataPipe;
+    ReadPipe errorPipe;
+
+    PROCESS_INFORMATION pi;
+
+    if (!runProcess(pi, dataPipe, errorPipe, id))
+        return false;
+
+    HANDLE waitProcess[] = {pi.hProcess, _cmd->_hCancel};
+
+    if (WaitForMultipleObjects(_cmd->_hCancel ? 2 : 1, waitProcess, FALSE, INFINITE) == WAIT_OBJECT_0 + 1)
+        _cmd->_status = CANCELLED;
+
+    endProcess(pi);
+
+    if (_cmd->_status == CANCELLED)
+        return false;
+
+    if (dataPipe.GetOutput().empty() && !errorPipe.GetOutput().empty())
+    {
+        errors = std::move(errorPipe.GetOutput());
+        _cmd->_status = FAILED;
+        return false;
+    }
+
+    fileList = std::move(dataPipe.GetOutput());
+
+    return true;
+}
+
+
+/**
+ *  \brief  Searches the database files in-process - only the file list is taken from global
+ */
+unsigned CmdEngine::grepInProcess()
+{
+    std::vector<char> fileList;
+    std::vector<char> errors;
+
+    if (!_cmd->_scope.IsEmpty())
+    {
+        // Relative to the database folder with forward slashes like global lists the files
+        const CPath& dbPath = _cmd->Db()->GetPath();
+        CTextA file(_cmd->_scope.C_str() + (dbPath.IsParentOf(_cmd->_scope.C_str()) ? dbPath.Len() : 0));
+
+        for (char* pCh = file.C_str(); *pCh; ++pCh)
+            if (*pCh == '\\')
+                *pCh = '/';
+
+        fileList.assign(file.C_str(), file.C_str() + file.Len() + 1);
+    }
+    else if (!listFiles((_cmd->_id == GREP) ? LIST_FILES : LIST_OTHER_FILES, fileList, errors))
+    {
+        if (!errors.empty())
+            _cmd->SetResult(errors);
+        return 1;
+    }
+
+    if (GTagsSettings._trigramIndex && !fileList.empty())
+    {
+        std::shared_ptr<TrigramIndex> index = TrigramIndex::Get(_cmd->Db()->GetPath());
+        std::vector<char> candidates;
+
+        if (index && index->FilterFiles(fileList.data(), CTextA(_cmd->Tag().C_str()), _cmd->_regExp, candidates))
+            fileList.swap(candidates);
+    }
+
+    GrepEngine grep(_cmd->Db()->GetPath(), CTextA(_cmd->Tag().C_str()), _cmd->_regExp, _cmd->_matchCase);
+
+    if (!grep.IsValid())
+    {
+        const CTextA msg(grep.Error().IsEmpty() ? "Search failed" : grep.Error().C_str());
+        _cmd->SetResult(msg);
+        _cmd->_status = FAILED;
+        return 1;
+    }
+
+    if (_cmd->_liveResults && _cmd->_parser)
+    {
+        _feed.reset(new ResultFeed);
+        grep.SetListener(_feed.get());
+    }
+
+    if (!grep.Start(fileList.empty() ? NULL : fileList.data(), _cmd->Db()->GetConfig(), _cmd->_background))
+    {
+        _cmd->_status = RUN_ERROR;
+        return 1;
+    }
+
+    waitFor(grep.DoneEvent(), false);
+
+    if (_cmd->_status == CANCELLED)
+        return 1;
+
+    std::vector<char> result;
+    grep.GetResult(result);
+
+    // A worker thread has failed matching the regular expression
+    if (!grep.IsValid())
+    {
+        _cmd->SetResult(grep.Error());
+        _cmd->_status = FAILED;
+        return 1;
+    }
+
+    if (!result.empty())
+        _cmd->AppendToResult(std::move(result));
+
+    return parseResult();
+}
+
+
+/**
+ *  \brief  Finds or completes file names using the in-memory file index of the database
+ */
+unsigned CmdEngine::findFileInProcess()
+{
+    std::shared_ptr<FileIndex> index = FileIndex::Get(_cmd->Db()->GetPath());
+
+    if (!index)
+    {
+        std::vector<char> fileList;
+        std::vector<char> errors;
+
+        if (!listFiles(LIST_FILES, fileList, errors))
+        {
+            if (!errors.empty())
+                _cmd->SetResult(errors);
+            return 1;
+        }
+
+        index = FileIndex::Create(_cmd->Db()->GetPath(), fileList.empty() ? NULL : fileList.data());
+    }
+
+    std::vector<char> result;
+
+    if (_cmd->_id == AUTOCOMPLETE_FILE)
+    {
+        // Skip the leading '/' the command tag is prefixed with
+        const CTextA prefix(_cmd->Tag().C_str() + 1);
+        index->Complete(prefix, _cmd->_matchCase, result);
+    }
+    else if (!index->Find(CTextA(_cmd->Tag().C_str()), _cmd->_regExp, _cmd->_matchCase, result))
+    {
+        const CTextA msg("Invalid regular expression");
+        _cmd->SetResult(msg);
+        _cmd->_status = FAILED;
+        return 1;
+    }
+
+    if (!result.empty())
+        _cmd->AppendToResult(std::move(result));
+
+    return parseResult();
+}
+
+
+/**
+ *  \brief
+ */
+unsigned CmdEngine::parseResult()
+{
+    if (_libsFederated && !mergeLibResults())
+    {
+        _cmd->_status = CANCELLED;
+        return 1;
+    }
+
+    _cmd->_status = OK;
+
+    if (_cmd->_parser)
+    {
+        if (_cmd->HasResult())
+        {
+            const int parsedEntries = _cmd->_parser->Parse(_cmd);
+
+            // The parser stops early when cancelled
+            if (_cmd->IsCancelled())
+            {
+                _cmd->_status = CANCELLED;
+                return 1;
+            }
+
+            if (parsedEntries < 0)
+            {
+                _cmd->_status = PARSE_ERROR;
+                return 1;
+            }
+            else if (parsedEntries == 0)
+            {
+                _cmd->_status = PARSE_EMPTY; // No results to display actually (due to some filtering)
+                return 1;
+            }
+        }
+        // Blink the auto-complete word to inform the user if nothing is found
+        else if (_cmd->_id == AUTOCOMPLETE || _cmd->_id == AUTOCOMPLETE_FILE || _cmd->_id == AUTOCOMPLETE_SYMBOL)
+        {
+            CTextA wordA;
+            INpp::Get().GetWord(wordA, true, true);
+
+            if (wordA.Len())
+            {
+                CText word(wordA.C_str());
+
+                TCHAR* tag = _cmd->_tag.C_str();
+                int len = _cmd->_tag.Len();
+                if (_cmd->_id == AUTOCOMPLETE_FILE)
+                {
+                    ++tag;
+                    --len;
+                }
+
+                if (!_tcsncmp(word.C_str(), tag, len))
+                    Sleep(50);
+            }
+        }
+    }
+
+    if (_cmd->_id == CREATE_DATABASE)
+    {
+        _cmd->Db()->SaveCfg();
+        if (_progress)
+            _progress->SaveStats();
+        LibQueryCache::Invalidate(_cmd->Db()->GetPath());
+        buildTrigramIndex();
+    }
+    else if (_cmd->_id == UPDATE_SINGLE)
+    {
+        if (GTagsSettings._trigramIndex)
+            TrigramIndex::UpdateFile(_cmd->Db()->GetPath(), CPath(_cmd->Tag().C_str()));
+        else
+            TrigramIndex::Remove(_cmd->Db()->GetPath());
+    }
+
+    return 0;
+}
 
 
 /**
- *  \brief
+ *  \brief  Indexes the new database files. The database stays usable without the index
+ *          so failing or cancelling the build doesn't fail the command.
  */
-bool CmdEngine::Run(const CmdPtr_t& cmd, CompletionCB complCB)
+void CmdEngine::buildTrigramIndex()
 {
-    if (!complCB)
-        return false;
+    TrigramIndex::Remove(_cmd->Db()->GetPath());
 
-    CmdEngine* engine = new CmdEngine(cmd, complCB);
-    cmd->Status(RUN_ERROR);
+    if (!GTagsSettings._trigramIndex)
+        return;
 
-    engine->_hThread = (HANDLE)_beginthreadex(NULL, 0, threadFunc, engine, 0, NULL);
-    if (engine->_hThread == NULL)
+    std::vector<char> fileList;
+    std::vector<char> otherFiles;
+    std::vector<char> errors;
+
+    if (listFiles(LIST_FILES, fileList, errors) && listFiles(LIST_OTHER_FILES, otherFiles, errors))
     {
-        delete engine;
-        return false;
+        if (!fileList.empty())
+            fileList.pop_back();
+        fileList.push_back('\n');
+        fileList.insert(fileList.end(), otherFiles.begin(), otherFiles.end());
+        if (fileList.back() != 0)
+            fileList.push_back(0);
+
+        IndexBuild build;
+        build._dbPath = _cmd->Db()->GetPath();
+        build._fileList = fileList.data();
+        build._stop = false;
+
+        HANDLE hThread = (HANDLE)_beginthreadex(NULL, 0, indexThreadFunc, &build, 0, NULL);
+
+        if (hThread)
+        {
+            waitFor(hThread, false);
+
+            if (_cmd->_status == CANCELLED)
+            {
+                build._stop = true;
+                WaitForSingleObject(hThread, INFINITE);
+            }
+
+            CloseHandle(hThread);
+        }
     }
 
-    return true;
+    _cmd->_status = OK;
 }
 
 
 /**
- *  \brief
+ *  \brief  Starts querying each library database in its own thread. The command database is then
+ *          queried without GTAGSLIBPATH and the library results are merged into its result.
  */
-CmdEngine::CmdEngine(const CmdPtr_t& cmd, CompletionCB complCB) :
-    _cmd(cmd), _complCB(complCB), _hThread(NULL)
+void CmdEngine::startLibQueries()
 {
-}
+    const DbConfig& cfg = _cmd->Db()->GetConfig();
+    if (_cmd->_skipLibs || !cfg._useLibDb || cfg._libDbPaths.empty())
+        return;
 
+    std::unordered_set<PathKey, PathKey::Hasher> libs;
+    libs.insert(_cmd->Db()->GetKey());
 
-/**
- *  \brief
- */
-CmdEngine::~CmdEngine()
-{
-    SendMessage(MainWndH, WM_RUN_CMD_CALLBACK, (WPARAM)_complCB, (LPARAM)(&_cmd));
+    _libQueryStart = GetTickCount();
 
-    if (_hThread)
-        CloseHandle(_hThread);
+    for (const auto& libPath : cfg._libDbPaths)
+    {
+        if (libPath.IsSubpathOf(_cmd->Db()->GetPath()) || !libs.insert(PathKey(libPath)).second)
+            continue;
+
+        std::unique_ptr<LibQuery> query(new LibQuery(this, libPath));
+
+        query->_hStop = CreateEvent(NULL, TRUE, FALSE, NULL);
+        if (query->_hStop)
+            query->_hThread = (HANDLE)_beginthreadex(NULL, 0, libQueryThreadFunc, query.get(), 0, NULL);
+
+        // Fall back to the single query through GTAGSLIBPATH
+        if (query->_hThread == NULL)
+        {
+            stopLibQueries();
+            return;
+        }
+
+        _libQueries.push_back(std::move(query));
+    }
+
+    _libsFederated = !_libQueries.empty();
 }
 
 
 /**
- *  \brief
+ *  \brief  Runs in the library query thread. Repeated queries are answered from the library cache.
  */
-unsigned __stdcall CmdEngine::threadFunc(void* data)
+bool CmdEngine::queryLib(LibQuery& query)
 {
-    CmdEngine* engine = static_cast<CmdEngine*>(data);
-    unsigned r = engine->start();
+    CText cmdBuf;
+    composeCmd(cmdBuf, _cmd->_id);
 
-    delete engine;
+    if (LibQueryCache::Get(query._libPath, cmdBuf, query._output))
+        return true;
 
-    return r;
+    ReadPipe dataPipe;
+    ReadPipe errorPipe;
+    PROCESS_INFORMATION pi;
+
+    if (!createProcess(pi, dataPipe, errorPipe, _cmd->_id, &query._libPath, false))
+        return false;
+
+    HANDLE waitHandles[] = {pi.hProcess, query._hStop};
+    const bool stopped = (WaitForMultipleObjects(2, waitHandles, FALSE, INFINITE) != WAIT_OBJECT_0);
+
+    endProcess(pi);
+
+    if (stopped)
+        return false;
+
+    query._output = std::move(dataPipe.GetOutput());
+
+    LibQueryCache::Put(query._libPath, cmdBuf, query._output);
+
+    return true;
 }
 
 
 /**
- *  \brief
+ *  \brief  Appends the library results after the command database ones in the configured library order,
+ *          dropping entries that are already there. Libraries that haven't answered within their timeout
+ *          or failed are skipped and noted as command warning. Returns false if the command got cancelled meanwhile.
  */
-unsigned CmdEngine::start()
+bool CmdEngine::mergeLibResults()
 {
-    ReadPipe dataPipe;
-    ReadPipe errorPipe;
-
-    PROCESS_INFORMATION pi;
+    const bool isLocation = (_cmd->_id == FIND_DEFINITION);
 
-    if (!runProcess(pi, dataPipe, errorPipe))
-        return 1;
+    // Locations are compared by their absolute path, completions as they are.
+    // The entries are views of the command and the library outputs that outlive the sets.
+    std::unordered_set<CTextViewA, ViewHasher> entries;
+    std::unordered_set<std::string> locations;
 
-    bool showActivityWin = true;
-    if (_cmd->_id != CREATE_DATABASE && _cmd->_id != UPDATE_SINGLE)
+    auto isNewEntry = [&](const CTextA& root, const char* pLine, unsigned lineLen) -> bool
     {
-        // Wait 300 ms and if process has finished don't show Activity Window
-        if (WaitForSingleObject(pi.hProcess, 300) == WAIT_OBJECT_0)
-            showActivityWin = false;
-    }
+        unsigned pathLen = 0;
+        const unsigned locLen = isLocation ? locationLen(pLine, lineLen, pathLen) : 0;
 
-    if (showActivityWin)
+        if (locLen == 0)
+            return entries.insert(CTextViewA(pLine, lineLen)).second;
+
+        return locations.insert(foldedLocation(root, pLine, pathLen, locLen)).second;
+    };
+
+    bool endsWithEol = true;
+
+    const char* pResult = _cmd->Result();
+    if (pResult && *pResult)
     {
-        HANDLE hCancel = CreateEvent(NULL, TRUE, FALSE, NULL);
+        const CTextA dbRoot(_cmd->Db()->GetPath().C_str());
+        const char* pEnd = pResult + _cmd->ResultLen();
 
-        if (hCancel)
+        unsigned lines = 0;
+        for (const char* pLine = pResult; pLine < pEnd;)
         {
-            CText header(_cmd->Name());
+            const char* pEol = pLine;
+            while (pEol < pEnd && *pEol != '\n' && *pEol != '\r')
+                ++pEol;
 
-            if (_cmd->_id != VERSION && _cmd->_id != CTAGS_VERSION)
+            if (pEol > pLine)
+                isNewEntry(dbRoot, pLine, pEol - pLine);
+
+            if (!(++lines % Cmd::cCancelCheckLines) && _cmd->IsCancelled())
             {
-                header += _T(" - \"");
-                if (_cmd->_id == CREATE_DATABASE)
-                    header += _cmd->Db()->GetPath();
-                else
-                    header += _cmd->Tag();
-                header += _T('\"');
+                stopLibQueries();
+                return false;
             }
 
-            SendMessage(MainWndH, WM_OPEN_ACTIVITY_WIN,
-                    reinterpret_cast<WPARAM>(header.C_str()), reinterpret_cast<LPARAM>(hCancel));
-
-            HANDLE waitHandles[] = {pi.hProcess, hCancel};
-            DWORD handleId = WaitForMultipleObjects(2, waitHandles, FALSE, INFINITE) - WAIT_OBJECT_0;
-            if (handleId > 0 && handleId < 2 && waitHandles[handleId] == hCancel)
-                _cmd->_status = CANCELLED;
-
-            SendMessage(MainWndH, WM_CLOSE_ACTIVITY_WIN, 0, reinterpret_cast<LPARAM>(hCancel));
-
-            CloseHandle(hCancel);
-        }
-        else
-        {
-            WaitForSingleObject(pi.hProcess, INFINITE);
+            for (pLine = pEol; pLine < pEnd && (*pLine == '\n' || *pLine == '\r'); ++pLine);
         }
+
+        endsWithEol = (*(pEnd - 1) == '\n');
     }
 
-    endProcess(pi);
+    std::vector<char> merged;
+    if (!endsWithEol)
+        merged.push_back('\n');
 
-    if (_cmd->_status == CANCELLED)
-        return 1;
+    bool cancelled = false;
+    const DWORD timeout = GTagsSettings._libQueryTimeoutMs;
 
-    if (!dataPipe.GetOutput().empty())
-    {
-        _cmd->AppendToResult(dataPipe.GetOutput());
-    }
-    else if (!errorPipe.GetOutput().empty())
+    for (const auto& query : _libQueries)
     {
-        _cmd->SetResult(errorPipe.GetOutput());
+        if (cancelled)
+            break;
 
-        if (_cmd->_id != CREATE_DATABASE && _cmd->_id != UPDATE_SINGLE)
+        DWORD waitTime = INFINITE;
+        if (timeout)
         {
-            _cmd->_status = FAILED;
-            return 1;
+            const DWORD elapsed = GetTickCount() - _libQueryStart;
+            waitTime = (elapsed < timeout) ? timeout - elapsed : 0;
         }
-    }
 
-    _cmd->_status = OK;
+        HANDLE waitHandles[] = {query->_hThread, _cmd->_hCancel};
+        const DWORD waitRes = WaitForMultipleObjects(_cmd->_hCancel ? 2 : 1, waitHandles, FALSE, waitTime);
 
-    if (_cmd->_parser)
-    {
-        if (_cmd->Result())
+        if (waitRes == WAIT_OBJECT_0 + 1)
         {
-            const int parsedEntries = _cmd->_parser->Parse(_cmd);
+            cancelled = true;
+            break;
+        }
 
-            if (parsedEntries < 0)
-            {
-                _cmd->_status = PARSE_ERROR;
-                return 1;
-            }
-            else if (parsedEntries == 0)
-            {
-                _cmd->_status = PARSE_EMPTY; // No results to display actually (due to some filtering)
-                return 1;
-            }
+        DWORD exitCode;
+        if (waitRes != WAIT_OBJECT_0 || !GetExitCodeThread(query->_hThread, &exitCode) || exitCode)
+        {
+            CTextA warning("library \"");
+            warning += query->_libPath.C_str();
+            warning += (waitRes == WAIT_TIMEOUT) ? "\" timed out" : "\" failed";
+            _cmd->AddWarning(warning);
+            continue;
         }
-        // Blink the auto-complete word to inform the user if nothing is found
-        else if (_cmd->_id == AUTOCOMPLETE || _cmd->_id == AUTOCOMPLETE_FILE || _cmd->_id == AUTOCOMPLETE_SYMBOL)
+
+        if (query->_output.empty())
+            continue;
+
+        const CTextA libRoot(query->_libPath.C_str());
+        const char* pEnd = query->_output.data() + query->_output.size() - 1;
+
+        unsigned lines = 0;
+        for (const char* pLine = query->_output.data(); pLine < pEnd && !cancelled;)
         {
-            CTextA wordA;
-            INpp::Get().GetWord(wordA, true, true);
+            if (!(++lines % Cmd::cCancelCheckLines) && _cmd->IsCancelled())
+                cancelled = true;
 
-            if (wordA.Len())
-            {
-                CText word(wordA.C_str());
+            const char* pEol = pLine;
+            while (pEol < pEnd && *pEol != '\n' && *pEol != '\r')
+                ++pEol;
 
-                TCHAR* tag = _cmd->_tag.C_str();
-                int len = _cmd->_tag.Len();
-                if (_cmd->_id == AUTOCOMPLETE_FILE)
-                {
-                    ++tag;
-                    --len;
-                }
+            const unsigned lineLen = pEol - pLine;
 
-                if (!_tcsncmp(word.C_str(), tag, len))
-                    Sleep(50);
+            if (lineLen && isNewEntry(libRoot, pLine, lineLen))
+            {
+                // Library locations are relative to the library root
+                if (isLocation && !isAbsolutePath(pLine, lineLen))
+                    merged.insert(merged.end(), libRoot.C_str(), libRoot.C_str() + libRoot.Len());
+
+                merged.insert(merged.end(), pLine, pEol);
+                merged.push_back('\n');
             }
+
+            for (pLine = pEol; pLine < pEnd && (*pLine == '\n' || *pLine == '\r'); ++pLine);
         }
     }
 
-    if (_cmd->_id == CREATE_DATABASE)
-        _cmd->Db()->SaveCfg();
+    // Libraries that are still running are not waited for
+    stopLibQueries();
 
-    return 0;
+    if (cancelled)
+        return false;
+
+    if (merged.size() > (endsWithEol ? 0u : 1u))
+    {
+        merged.push_back(0);
+        _cmd->AppendToResult(std::move(merged));
+    }
+
+    return true;
+}
+
+
+/**
+ *  \brief
+ */
+void CmdEngine::stopLibQueries()
+{
+    for (const auto& query : _libQueries)
+        SetEvent(query->_hStop);
+
+    for (const auto& query : _libQueries)
+        WaitForSingleObject(query->_hThread, INFINITE);
+
+    _libQueries.clear();
 }
 
 
 /**
  *  \brief
  */
-const TCHAR* CmdEngine::getCmdLine() const
+const TCHAR* CmdEngine::getCmdLine(CmdId_t id) const
 {
-    switch (_cmd->_id)
+    switch (id)
     {
         case CREATE_DATABASE:
             return cCreateDatabaseCmd;
@@ -265,6 +1401,12 @@ const TCHAR* CmdEngine::getCmdLine() const
             return cGrepCmd;
         case GREP_TEXT:
             return cGrepTxtCmd;
+        case FILE_TAGS:
+            return cFileTagsCmd;
+        case LIST_FILES:
+            return cListFilesCmd;
+        case LIST_OTHER_FILES:
+            return cListOtherFilesCmd;
         case VERSION:
             return cVersionCmd;
         case CTAGS_VERSION:
@@ -278,7 +1420,7 @@ const TCHAR* CmdEngine::getCmdLine() const
 /**
  *  \brief
  */
-void CmdEngine::composeCmd(CText& buf) const
+void CmdEngine::composeCmd(CText& buf, CmdId_t id) const
 {
     CPath path(DllPath);
     path.StripFilename();
@@ -286,12 +1428,12 @@ void CmdEngine::composeCmd(CText& buf) const
 
     buf.Resize(2048);
 
-    if (_cmd->_id == CREATE_DATABASE || _cmd->_id == VERSION || _cmd->_id == CTAGS_VERSION)
-        _sntprintf_s(buf.C_str(), buf.Size(), _TRUNCATE, getCmdLine(), path.C_str());
+    if (id == CREATE_DATABASE || id == VERSION || id == CTAGS_VERSION)
+        _sntprintf_s(buf.C_str(), buf.Size(), _TRUNCATE, getCmdLine(id), path.C_str());
     else
-        _sntprintf_s(buf.C_str(), buf.Size(), _TRUNCATE, getCmdLine(), path.C_str(), _cmd->Tag().C_str());
+        _sntprintf_s(buf.C_str(), buf.Size(), _TRUNCATE, getCmdLine(id), path.C_str(), _cmd->Tag().C_str());
 
-    if (_cmd->_id == CREATE_DATABASE || _cmd->_id == UPDATE_SINGLE)
+    if (id == CREATE_DATABASE || id == UPDATE_SINGLE)
     {
         path += _T("\\gtags.conf");
         if (path.FileExists())
@@ -303,7 +1445,7 @@ void CmdEngine::composeCmd(CText& buf) const
             buf += _cmd->Db()->GetConfig().Parser();
         }
     }
-    else if (_cmd->_id != VERSION && _cmd->_id != CTAGS_VERSION)
+    else if (id != VERSION && id != CTAGS_VERSION && id != FILE_TAGS && id != LIST_FILES && id != LIST_OTHER_FILES)
     {
         if (_cmd->_matchCase)
             buf += _T(" -M");
@@ -312,6 +1454,23 @@ void CmdEngine::composeCmd(CText& buf) const
 
         if (!_cmd->_regExp)
             buf += _T(" --literal");
+
+        // global scope is a folder - the parser takes only the results of the scope file
+        if (!_cmd->_scope.IsEmpty())
+        {
+            CPath scope(_cmd->_scope);
+            scope.StripFilename();
+
+            if (PathKey(scope) != _cmd->Db()->GetKey())
+            {
+                // Trailing backslash would escape the closing quote
+                scope.Erase(scope.Len() - 1, 1);
+
+                buf += _T(" -S \"");
+                buf += scope;
+                buf += _T("\"");
+            }
+        }
     }
 }
 
@@ -319,11 +1478,9 @@ void CmdEngine::composeCmd(CText& buf) const
 /**
  *  \brief
  */
-void CmdEngine::setEnvironmentVars() const
+void CmdEngine::composeLibPath(CText& buf, CmdId_t id) const
 {
-    CText buf;
-
-    if (!_cmd->_skipLibs && (_cmd->_id == AUTOCOMPLETE || _cmd->_id == FIND_DEFINITION))
+    if (!_cmd->_skipLibs && !_libsFederated && (id == AUTOCOMPLETE || id == FIND_DEFINITION))
     {
         const DbConfig& cfg = _cmd->Db()->GetConfig();
         if (cfg._useLibDb && cfg._libDbPaths.size())
@@ -341,9 +1498,22 @@ void CmdEngine::setEnvironmentVars() const
             }
         }
     }
+}
+
 
-    if (_cmd->Db())
-        SetEnvironmentVariable(_T("GTAGSDBPATH"), _cmd->Db()->GetPath().C_str());
+/**
+ *  \brief
+ */
+void CmdEngine::setEnvironmentVars(CmdId_t id, const CPath* dbPath, bool withLibs) const
+{
+    CText buf;
+    if (withLibs)
+        composeLibPath(buf, id);
+
+    if (dbPath)
+        SetEnvironmentVariable(_T("GTAGSDBPATH"), dbPath->C_str());
+    else
+        SetEnvironmentVariable(_T("GTAGSDBPATH"), NULL);
 
     SetEnvironmentVariable(_T("GTAGSLIBPATH"), buf.C_str());
 }
@@ -352,27 +1522,61 @@ void CmdEngine::setEnvironmentVars() const
 /**
  *  \brief
  */
-bool CmdEngine::runProcess(PROCESS_INFORMATION& pi, ReadPipe& dataPipe, ReadPipe& errorPipe)
+bool CmdEngine::runProcess(PROCESS_INFORMATION& pi, ReadPipe& dataPipe, ReadPipe& errorPipe, CmdId_t id)
 {
-    const DWORD createFlags = NORMAL_PRIORITY_CLASS | CREATE_NO_WINDOW | CREATE_UNICODE_ENVIRONMENT;
-    const TCHAR* currentDir = (_cmd->_id == VERSION || _cmd->_id == CTAGS_VERSION) ?
-            NULL : _cmd->Db()->GetPath().C_str();
+    const CPath* dbPath = _cmd->Db() ? &_cmd->Db()->GetPath() : NULL;
 
-    CText cmdBuf;
-    composeCmd(cmdBuf);
+    if (!createProcess(pi, dataPipe, errorPipe, id, dbPath, true))
+    {
+        _cmd->_status = RUN_ERROR;
+        return false;
+    }
+
+    // Started suspended
+    if (id == CREATE_DATABASE || id == UPDATE_SINGLE)
+        applyIndexPolicy(pi);
+
+    return true;
+}
 
-    setEnvironmentVars();
+
+/**
+ *  \brief  Starts the command process on the given database (the one of the command
+ *          or a library one). Doesn't touch the command status so it is safe in library query threads.
+ */
+bool CmdEngine::createProcess(PROCESS_INFORMATION& pi, ReadPipe& dataPipe, ReadPipe& errorPipe, CmdId_t id,
+        const CPath* dbPath, bool withLibs)
+{
+    DWORD createFlags = priorityClass(id) | CREATE_NO_WINDOW | CREATE_UNICODE_ENVIRONMENT;
+    if (id == CREATE_DATABASE || id == UPDATE_SINGLE)
+        createFlags |= CREATE_SUSPENDED;
+    const TCHAR* currentDir = (id == VERSION || id == CTAGS_VERSION || !dbPath) ? NULL : dbPath->C_str();
+
+    CText cmdBuf;
+    composeCmd(cmdBuf, id);
 
     STARTUPINFO si  = {0};
     si.cb           = sizeof(si);
     si.dwFlags      = STARTF_USESTDHANDLES;
-    si.hStdError    = errorPipe.GetInputHandle();
-    si.hStdOutput   = dataPipe.GetInputHandle();
 
-    if (!CreateProcess(NULL, cmdBuf.C_str(), NULL, NULL, TRUE, createFlags, NULL, currentDir, &si, &pi))
     {
-        _cmd->_status = RUN_ERROR;
-        return false;
+        // Commands may run concurrently - the environment set and the inheritable pipe ends
+        // must be the ones of this process only
+        AUTOLOCK(EnvLock);
+
+        si.hStdError    = errorPipe.OpenInputHandle();
+        si.hStdOutput   = dataPipe.OpenInputHandle();
+
+        setEnvironmentVars(id, dbPath, withLibs);
+
+        const BOOL created = (si.hStdError && si.hStdOutput &&
+                CreateProcess(NULL, cmdBuf.C_str(), NULL, NULL, TRUE, createFlags, NULL, currentDir, &si, &pi));
+
+        errorPipe.CloseInputHandle();
+        dataPipe.CloseInputHandle();
+
+        if (!created)
+            return false;
     }
 
     SetThreadPriority(pi.hThread, THREAD_PRIORITY_NORMAL);
@@ -380,7 +1584,6 @@ bool CmdEngine::runProcess(PROCESS_INFORMATION& pi, ReadPipe& dataPipe, ReadPipe
     if (!errorPipe.Open() || !dataPipe.Open())
     {
         endProcess(pi);
-        _cmd->_status = RUN_ERROR;
         return false;
     }
 
@@ -388,6 +1591,77 @@ bool CmdEngine::runProcess(PROCESS_INFORMATION& pi, ReadPipe& dataPipe, ReadPipe
 }
 
 
+/**
+ *  \brief  Resource policy by command class - database building, background and interactive queries
+ */
+DWORD CmdEngine::priorityClass(CmdId_t id) const
+{
+    if (id == CREATE_DATABASE || id == UPDATE_SINGLE)
+    {
+        static const DWORD cIndexClasses[Settings::PRIORITY_LIST_END] =
+        {
+            IDLE_PRIORITY_CLASS,
+            BELOW_NORMAL_PRIORITY_CLASS,
+            NORMAL_PRIORITY_CLASS
+        };
+
+        return cIndexClasses[GTagsSettings._indexPriorityIdx];
+    }
+
+    if (_cmd->_background)
+        return BELOW_NORMAL_PRIORITY_CLASS;
+
+    if (id == VERSION || id == CTAGS_VERSION || !GTagsSettings._boostInteractive)
+        return NORMAL_PRIORITY_CLASS;
+
+    return ABOVE_NORMAL_PRIORITY_CLASS;
+}
+
+
+/**
+ *  \brief  Puts the (suspended) database building process in a job with the configured limits
+ *          and resumes it. The job also terminates the parser processes gtags leaves behind.
+ */
+void CmdEngine::applyIndexPolicy(PROCESS_INFORMATION& pi)
+{
+    if (GTagsSettings._indexPriorityIdx != Settings::PRIORITY_NORMAL)
+        setBackgroundIo(pi.hProcess);
+
+    _hJob = CreateJobObject(NULL, NULL);
+    if (_hJob)
+    {
+        JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits = {0};
+        limits.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE | JOB_OBJECT_LIMIT_PRIORITY_CLASS;
+        limits.BasicLimitInformation.PriorityClass = priorityClass(_cmd->_id);
+
+        if (GTagsSettings._indexMemoryLimitMB)
+        {
+            limits.BasicLimitInformation.LimitFlags |= JOB_OBJECT_LIMIT_PROCESS_MEMORY;
+            limits.ProcessMemoryLimit = (SIZE_T)GTagsSettings._indexMemoryLimitMB << 20;
+        }
+
+        // Fails before Windows 8 if Notepad++ itself runs in a job - run without limits then
+        if (!SetInformationJobObject(_hJob, JobObjectExtendedLimitInformation, &limits, sizeof(limits)) ||
+                !AssignProcessToJobObject(_hJob, pi.hProcess))
+        {
+            CloseHandle(_hJob);
+            _hJob = NULL;
+        }
+        else if (GTagsSettings._indexCpuRatePercent)
+        {
+            // Windows 8+ only, silently ignored otherwise
+            JOBOBJECT_CPU_RATE_CONTROL_INFORMATION cpuRate = {0};
+            cpuRate.ControlFlags = JOB_OBJECT_CPU_RATE_CONTROL_ENABLE | JOB_OBJECT_CPU_RATE_CONTROL_HARD_CAP;
+            cpuRate.CpuRate = GTagsSettings._indexCpuRatePercent * 100;
+
+            SetInformationJobObject(_hJob, cJobObjectCpuRateControlInformation, &cpuRate, sizeof(cpuRate));
+        }
+    }
+
+    ResumeThread(pi.hThread);
+}
+
+
 /**
  *  \brief
  */
@@ -396,7 +1670,11 @@ void CmdEngine::endProcess(PROCESS_INFORMATION& pi)
     DWORD r;
     GetExitCodeProcess(pi.hProcess, &r);
     if (r == STILL_ACTIVE)
+    {
+        // Termination is asynchronous - the process keeps its files (the database) open until it is done
         TerminateProcess(pi.hProcess, 0);
+        WaitForSingleObject(pi.hProcess, INFINITE);
+    }
 
     CloseHandle(pi.hThread);
     CloseHandle(pi.hProcess);
@@ -27,7 +27,11 @@
 
 #include <windows.h>
 #include <tchar.h>
+#include <vector>
+#include <list>
+#include <memory>
 #include "Common.h"
+#include "AutoLock.h"
 #include "CmdDefines.h"
 
 
@@ -37,6 +41,10 @@ class ReadPipe;
 namespace GTags
 {
 
+class BuildProgress;
+class ResultFeed;
+
+
 /**
  *  \class  CmdEngine
  *  \brief
@@ -44,9 +52,66 @@ namespace GTags
 class CmdEngine
 {
 public:
+    static void Init();
+    static void DeInit();
+
     static bool Run(const CmdPtr_t& cmd, CompletionCB complCB);
+    static void RunCompletions(LPARAM syncCompletion = 0);
 
 private:
+    /**
+     *  \struct  Completion
+     *  \brief  Finished command waiting in the lock-free queue to be completed in the UI thread
+     */
+    struct Completion
+    {
+        SLIST_ENTRY     _entry; // must be first
+        CompletionCB    _complCB;
+        CmdPtr_t        _cmd;
+    };
+
+    /**
+     *  \struct  ComplEntry
+     *  \brief  Fuzzy completion candidates - all the names starting with a letter in a database
+     */
+    struct ComplEntry
+    {
+        PathKey             _db;
+        CmdId_t             _id;
+        CText               _tag;
+        bool                _withLibs;
+        FILETIME            _dbTime;
+        std::vector<char>   _output;
+    };
+
+    /**
+     *  \struct  IndexBuild
+     *  \brief  Trigram index build running in its own thread so it can be cancelled
+     */
+    struct IndexBuild
+    {
+        CPath           _dbPath;
+        const char*     _fileList;
+        volatile bool   _stop;
+    };
+
+    /**
+     *  \struct  LibQuery
+     *  \brief  Library database query running in its own thread in federated mode
+     */
+    struct LibQuery
+    {
+        LibQuery(CmdEngine* engine, const CPath& libPath) :
+            _engine(engine), _libPath(libPath), _hThread(NULL), _hStop(NULL) {}
+        ~LibQuery();
+
+        CmdEngine*          _engine;
+        CPath               _libPath;
+        HANDLE              _hThread;
+        HANDLE              _hStop;
+        std::vector<char>   _output;
+    };
+
     static const TCHAR  cCreateDatabaseCmd[];
     static const TCHAR  cUpdateSingleCmd[];
     static const TCHAR  cAutoComplCmd[];
@@ -58,25 +123,85 @@ private:
     static const TCHAR  cFindSymbolCmd[];
     static const TCHAR  cGrepCmd[];
     static const TCHAR  cGrepTxtCmd[];
+    static const TCHAR  cFileTagsCmd[];
+    static const TCHAR  cListFilesCmd[];
+    static const TCHAR  cListOtherFilesCmd[];
     static const TCHAR  cVersionCmd[];
     static const TCHAR  cCtagsVersionCmd[];
 
+    static const DWORD  cProgressUpdateMs;
+    static const DWORD  cResultsUpdateMs;
+
+    static const unsigned   cMaxComplEntries;
+    static const unsigned   cMaxComplSize;
+
+    static SLIST_HEADER     ComplQueue;
+    static volatile LONG    WakeupPosted;
+    static Mutex            EnvLock;
+
+    static Mutex                    ComplCacheLock;
+    static std::list<ComplEntry>    ComplCache;
+
     static unsigned __stdcall threadFunc(void* data);
+    static unsigned __stdcall indexThreadFunc(void* data);
+    static unsigned __stdcall libQueryThreadFunc(void* data);
+    static void queueCompletion(CompletionCB complCB, const CmdPtr_t& cmd);
 
     CmdEngine(const CmdPtr_t& cmd, CompletionCB complCB);
     ~CmdEngine();
     CmdEngine& operator=(const CmdEngine&) = delete;
 
     unsigned start();
-    const TCHAR* getCmdLine() const;
-    void composeCmd(CText& buf) const;
-    void setEnvironmentVars() const;
-    bool runProcess(PROCESS_INFORMATION& pi, ReadPipe& dataPipe, ReadPipe& errorPipe);
+    bool listFiles(CmdId_t id, std::vector<char>& fileList, std::vector<char>& errors);
+    bool isCachedCompletion() const;
+    bool completionDbTime(FILETIME& dbTime) const;
+    bool getCachedCompletion();
+    void cacheCompletion();
+    unsigned grepInProcess();
+    unsigned findFileInProcess();
+    void buildTrigramIndex();
+    void startLibQueries();
+    bool queryLib(LibQuery& query);
+    bool mergeLibResults();
+    void stopLibQueries();
+    void waitFor(HANDLE hWait, bool isProcess);
+    void postProgress(HANDLE hActivityCancel);
+    void postResults();
+    void closeActivityWin();
+    unsigned parseResult();
+    const TCHAR* getCmdLine(CmdId_t id) const;
+    void composeCmd(CText& buf, CmdId_t id) const;
+    void composeLibPath(CText& buf, CmdId_t id) const;
+    void setEnvironmentVars(CmdId_t id, const CPath* dbPath, bool withLibs) const;
+    bool runProcess(PROCESS_INFORMATION& pi, ReadPipe& dataPipe, ReadPipe& errorPipe, CmdId_t id);
+    bool createProcess(PROCESS_INFORMATION& pi, ReadPipe& dataPipe, ReadPipe& errorPipe, CmdId_t id,
+            const CPath* dbPath, bool withLibs);
+    DWORD priorityClass(CmdId_t id) const;
+    void applyIndexPolicy(PROCESS_INFORMATION& pi);
     void endProcess(PROCESS_INFORMATION& pi);
 
     CmdPtr_t            _cmd;
     CompletionCB const  _complCB;
     HANDLE              _hThread;
+
+    // Database building job - applies the resource limits and owns the whole process tree
+    HANDLE              _hJob;
+
+    // Database creation progress parsed from the verbose gtags output
+    std::unique_ptr<BuildProgress>  _progress;
+
+    // Search results shown as they arrive - the hits count already posted to the Results Window
+    std::unique_ptr<ResultFeed>     _feed;
+    unsigned                        _feedHits;
+
+    // Activity Window cancel event (duplicate of the command one) - the window is kept until the command ends
+    HANDLE              _hActivityCancel;
+    bool                _activityShown;
+
+    // Library databases queried separately (federated mode) instead of through GTAGSLIBPATH
+    bool                                    _libsFederated;
+    DWORD                                   _libQueryStart;
+    std::vector<std::unique_ptr<LibQuery>>  _libQueries;
 };
 
 } // namespace GTags
@@ -40,6 +40,55 @@ int CALLBACK browseFolderCB(HWND hWnd, UINT uMsg, LPARAM, LPARAM lpData)
     return 0;
 }
 
+
+#ifndef COMPRESSION_FORMAT_LZNT1
+#define COMPRESSION_FORMAT_LZNT1    (0x0002)
+#endif
+#ifndef COMPRESSION_ENGINE_STANDARD
+#define COMPRESSION_ENGINE_STANDARD (0x0000)
+#endif
+
+// Packed block length flag - the block is not compressed
+const ULONG cStoredBlock = 0x80000000;
+
+
+/**
+ *  \class  NtCompression
+ *  \brief  ntdll's LZNT1 codec - loaded at run-time as the functions are not in the import libraries
+ */
+class NtCompression
+{
+public:
+    typedef LONG (WINAPI *GetWorkSpaceSize_t)(USHORT, PULONG, PULONG);
+    typedef LONG (WINAPI *Compress_t)(USHORT, PUCHAR, ULONG, PUCHAR, ULONG, ULONG, PULONG, PVOID);
+    typedef LONG (WINAPI *Decompress_t)(USHORT, PUCHAR, ULONG, PUCHAR, ULONG, PULONG);
+
+    static const NtCompression& Get()
+    {
+        static NtCompression Instance;
+        return Instance;
+    }
+
+    inline bool IsAvailable() const { return (GetWorkSpaceSize && Compress && Decompress); }
+
+    GetWorkSpaceSize_t  GetWorkSpaceSize;
+    Compress_t          Compress;
+    Decompress_t        Decompress;
+
+private:
+    NtCompression() : GetWorkSpaceSize(NULL), Compress(NULL), Decompress(NULL)
+    {
+        HMODULE hNtDll = GetModuleHandle(_T("ntdll.dll"));
+        if (hNtDll)
+        {
+            GetWorkSpaceSize =
+                    reinterpret_cast<GetWorkSpaceSize_t>(GetProcAddress(hNtDll, "RtlGetCompressionWorkSpaceSize"));
+            Compress = reinterpret_cast<Compress_t>(GetProcAddress(hNtDll, "RtlCompressBuffer"));
+            Decompress = reinterpret_cast<Decompress_t>(GetProcAddress(hNtDll, "RtlDecompressBuffer"));
+        }
+    }
+};
+
 } // anonymous namespace
 
 
@@ -231,13 +280,113 @@ HFONT Tools::CreateFromSystemMenuFont(HDC hdc, unsigned fontHeight)
 }
 
 
+/**
+ *  \brief  Compresses text in memory appending it to packed as one block (block length header and data).
+ *          Text that doesn't get any smaller is stored as is. Callers pack big texts in bounded blocks.
+ *          Returns false if the codec is not available.
+ */
+bool Tools::PackText(const char* text, unsigned len, std::vector<char>& packed)
+{
+    const NtCompression& nt = NtCompression::Get();
+
+    if (!nt.IsAvailable() || len == 0)
+        return false;
+
+    const USHORT format = COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_STANDARD;
+
+    ULONG workSpaceSize, fragmentSize;
+    if (nt.GetWorkSpaceSize(format, &workSpaceSize, &fragmentSize) != 0)
+        return false;
+
+    std::vector<char> workSpace(workSpaceSize);
+
+    // Compressed straight into the output - the block is no bigger than the text
+    const size_t blockPos = packed.size();
+    packed.resize(blockPos + sizeof(ULONG) + len);
+
+    char* block = packed.data() + blockPos + sizeof(ULONG);
+    ULONG packedLen = 0;
+
+    if (nt.Compress(format, reinterpret_cast<PUCHAR>(const_cast<char*>(text)), len,
+            reinterpret_cast<PUCHAR>(block), len, 4096, &packedLen, workSpace.data()) != 0 ||
+            packedLen == 0 || packedLen >= len)
+    {
+        memcpy(block, text, len);
+        packedLen = len | cStoredBlock;
+    }
+
+    memcpy(packed.data() + blockPos, &packedLen, sizeof(ULONG));
+    packed.resize(blockPos + sizeof(ULONG) + (packedLen & ~cStoredBlock));
+
+    return true;
+}
+
+
+/**
+ *  \brief  Decompresses text packed by PackText() (one or more blocks) into buffer of the original text length
+ */
+bool Tools::UnpackText(const std::vector<char>& packed, char* text, unsigned len)
+{
+    const NtCompression& nt = NtCompression::Get();
+
+    if (!nt.IsAvailable() || packed.empty())
+        return false;
+
+    unsigned unpacked = 0;
+
+    for (size_t pos = 0; pos < packed.size();)
+    {
+        ULONG packedLen;
+        if (pos + sizeof(ULONG) > packed.size())
+            return false;
+
+        memcpy(&packedLen, packed.data() + pos, sizeof(ULONG));
+        pos += sizeof(ULONG);
+
+        const bool stored = ((packedLen & cStoredBlock) != 0);
+        packedLen &= ~cStoredBlock;
+
+        if (pos + packedLen > packed.size())
+            return false;
+
+        ULONG unpackedLen = 0;
+
+        if (stored)
+        {
+            if (unpacked + packedLen > len)
+                return false;
+
+            memcpy(text + unpacked, packed.data() + pos, packedLen);
+            unpackedLen = packedLen;
+        }
+        else if (nt.Decompress(COMPRESSION_FORMAT_LZNT1, reinterpret_cast<PUCHAR>(text + unpacked), len - unpacked,
+                reinterpret_cast<PUCHAR>(const_cast<char*>(packed.data() + pos)), packedLen, &unpackedLen) != 0)
+        {
+            return false;
+        }
+
+        pos += packedLen;
+        unpacked += unpackedLen;
+    }
+
+    return (unpacked == len);
+}
+
+
+const unsigned CTextW::cUnknownLen = (unsigned)-1;
+const unsigned CTextA::cUnknownLen = (unsigned)-1;
+
+
 /**
  *  \brief
  */
-CTextW::CTextW(const wchar_t* str) : _invalidStrLen(false)
+CTextW::CTextW(const wchar_t* str) : _len(0)
 {
     if (str)
-        _buf.assign(str, str + wcslen(str) + 1);
+    {
+        _len = wcslen(str);
+        _buf.assign(str, str + _len + 1);
+    }
     else
         _buf.push_back(0);
 }
@@ -246,13 +395,15 @@ CTextW::CTextW(const wchar_t* str) : _invalidStrLen(false)
 /**
  *  \brief
  */
-CTextW::CTextW(const char* str) : _invalidStrLen(false)
+CTextW::CTextW(const char* str) : _len(0)
 {
     if (str)
     {
         _buf.resize(strlen(str) + 1, 0);
         size_t cnt;
         mbstowcs_s(&cnt, _buf.data(), _buf.size(), str, _TRUNCATE);
+        _len = wcslen(_buf.data());
+        _buf.resize(_len + 1);
     }
     else
     {
@@ -269,7 +420,24 @@ CTextW& CTextW::operator=(const CTextW& txt)
     if (this != &txt)
     {
         _buf = txt._buf;
-        _invalidStrLen = txt._invalidStrLen;
+        _len = txt._len;
+    }
+    return *this;
+}
+
+
+/**
+ *  \brief
+ */
+CTextW& CTextW::operator=(CTextW&& txt) throw()
+{
+    if (this != &txt)
+    {
+        _buf = std::move(txt._buf);
+        _len = txt._len;
+
+        txt._buf.push_back(0);
+        txt._len = 0;
     }
     return *this;
 }
@@ -282,8 +450,8 @@ CTextW& CTextW::operator=(const wchar_t* str)
 {
     if (str)
     {
-        _buf.assign(str, str + wcslen(str) + 1);
-        _invalidStrLen = false;
+        _len = wcslen(str);
+        _buf.assign(str, str + _len + 1);
     }
     return *this;
 }
@@ -299,7 +467,8 @@ CTextW& CTextW::operator=(const char* str)
         _buf.resize(strlen(str) + 1, 0);
         size_t cnt;
         mbstowcs_s(&cnt, _buf.data(), _buf.size(), str, _TRUNCATE);
-        _invalidStrLen = false;
+        _len = wcslen(_buf.data());
+        _buf.resize(_len + 1);
     }
 
     return *this;
@@ -313,8 +482,11 @@ void CTextW::operator+=(const CTextW& txt)
 {
     AutoFit();
 
+    const unsigned len = txt.Len();
+
     _buf.pop_back();
-    _buf.insert(_buf.cend(), txt._buf.begin(), txt._buf.begin() + txt.Len() + 1);
+    _buf.insert(_buf.cend(), txt._buf.begin(), txt._buf.begin() + len + 1);
+    _len += len;
 }
 
 
@@ -332,6 +504,7 @@ void CTextW::operator+=(const wchar_t* str)
         {
             _buf.pop_back();
             _buf.insert(_buf.cend(), str, str + len + 1);
+            _len += len;
         }
     }
 }
@@ -356,6 +529,8 @@ void CTextW::operator+=(const char* str)
 
             size_t cnt;
             mbstowcs_s(&cnt, &_buf[size], len + 1, str, _TRUNCATE);
+            _len = size + wcslen(&_buf[size]);
+            _buf.resize(_len + 1);
         }
     }
 }
@@ -371,6 +546,7 @@ void CTextW::operator+=(wchar_t letter)
     _buf.pop_back();
     _buf.push_back(letter);
     _buf.push_back(0);
+    ++_len;
 }
 
 
@@ -386,6 +562,7 @@ void CTextW::Append(const wchar_t* data, unsigned len)
         _buf.pop_back();
         _buf.insert(_buf.cend(), data, data + len);
         _buf.push_back(0);
+        _len += len;
     }
 }
 
@@ -399,10 +576,12 @@ void CTextW::Append(const char* data, unsigned len)
 
     if (data && len)
     {
-        const unsigned currentLen = Len();
+        const unsigned currentLen = _len;
         _buf.resize(currentLen + len + 1, 0);
         size_t cnt;
         mbstowcs_s(&cnt, _buf.data() + currentLen, len + 1, data, _TRUNCATE);
+        _len = currentLen + wcslen(_buf.data() + currentLen);
+        _buf.resize(_len + 1);
     }
 }
 
@@ -414,8 +593,11 @@ void CTextW::Insert(unsigned at_pos, wchar_t letter)
 {
     AutoFit();
 
-    if (at_pos < _buf.size())
+    if (at_pos <= _len)
+    {
         _buf.insert(_buf.cbegin() + at_pos, letter);
+        ++_len;
+    }
 }
 
 
@@ -426,8 +608,11 @@ void CTextW::Insert(unsigned at_pos, const wchar_t* data, unsigned len)
 {
     AutoFit();
 
-    if ((at_pos < _buf.size()) && data && len)
+    if ((at_pos <= _len) && data && len)
+    {
         _buf.insert(_buf.cbegin() + at_pos, data, data + len);
+        _len += len;
+    }
 }
 
 
@@ -438,12 +623,13 @@ void CTextW::Erase(unsigned from_pos, unsigned len)
 {
     AutoFit();
 
-    if ((from_pos < _buf.size()) && len)
+    if ((from_pos < _len) && len)
     {
-        if (len > _buf.size())
-            len = _buf.size();
+        if (len > _len - from_pos)
+            len = _len - from_pos;
 
         _buf.erase(_buf.cbegin() + from_pos, _buf.cbegin() + from_pos + len);
+        _len -= len;
     }
 }
 
@@ -455,7 +641,7 @@ void CTextW::Clear()
 {
     _buf.clear();
     _buf.push_back(0);
-    _invalidStrLen = false;
+    _len = 0;
 }
 
 
@@ -468,17 +654,20 @@ void CTextW::Resize(unsigned size)
 
     _buf.resize(size);
     _buf.push_back(0);
-    _invalidStrLen = _invalidStrLen || (size > len);
+    _len = (_len == cUnknownLen || size > len) ? cUnknownLen : size;
 }
 
 
 /**
  *  \brief
  */
-CTextA::CTextA(const char* str) : _invalidStrLen(false)
+CTextA::CTextA(const char* str) : _len(0)
 {
     if (str)
-        _buf.assign(str, str + strlen(str) + 1);
+    {
+        _len = strlen(str);
+        _buf.assign(str, str + _len + 1);
+    }
     else
         _buf.push_back(0);
 }
@@ -487,13 +676,15 @@ CTextA::CTextA(const char* str) : _invalidStrLen(false)
 /**
  *  \brief
  */
-CTextA::CTextA(const wchar_t* str) : _invalidStrLen(false)
+CTextA::CTextA(const wchar_t* str) : _len(0)
 {
     if (str)
     {
         _buf.resize(wcslen(str) + 1, 0);
         size_t cnt;
         wcstombs_s(&cnt, _buf.data(), _buf.size(), str, _TRUNCATE);
+        _len = strlen(_buf.data());
+        _buf.resize(_len + 1);
     }
     else
     {
@@ -510,7 +701,24 @@ CTextA& CTextA::operator=(const CTextA& txt)
     if (this != &txt)
     {
         _buf = txt._buf;
-        _invalidStrLen = txt._invalidStrLen;
+        _len = txt._len;
+    }
+    return *this;
+}
+
+
+/**
+ *  \brief
+ */
+CTextA& CTextA::operator=(CTextA&& txt) throw()
+{
+    if (this != &txt)
+    {
+        _buf = std::move(txt._buf);
+        _len = txt._len;
+
+        txt._buf.push_back(0);
+        txt._len = 0;
     }
     return *this;
 }
@@ -523,8 +731,8 @@ CTextA& CTextA::operator=(const char* str)
 {
     if (str)
     {
-        _buf.assign(str, str + strlen(str) + 1);
-        _invalidStrLen = false;
+        _len = strlen(str);
+        _buf.assign(str, str + _len + 1);
     }
     return *this;
 }
@@ -540,7 +748,8 @@ CTextA& CTextA::operator=(const wchar_t* str)
         _buf.resize(wcslen(str) + 1, 0);
         size_t cnt;
         wcstombs_s(&cnt, _buf.data(), _buf.size(), str, _TRUNCATE);
-        _invalidStrLen = false;
+        _len = strlen(_buf.data());
+        _buf.resize(_len + 1);
     }
 
     return *this;
@@ -554,8 +763,11 @@ void CTextA::operator+=(const CTextA& txt)
 {
     AutoFit();
 
+    const unsigned len = txt.Len();
+
     _buf.pop_back();
-    _buf.insert(_buf.cend(), txt._buf.begin(), txt._buf.begin() + txt.Len() + 1);
+    _buf.insert(_buf.cend(), txt._buf.begin(), txt._buf.begin() + len + 1);
+    _len += len;
 }
 
 
@@ -573,6 +785,7 @@ void CTextA::operator+=(const char* str)
         {
             _buf.pop_back();
             _buf.insert(_buf.cend(), str, str + len + 1);
+            _len += len;
         }
     }
 }
@@ -597,6 +810,8 @@ void CTextA::operator+=(const wchar_t* str)
 
             size_t cnt;
             wcstombs_s(&cnt, &_buf[size], len + 1, str, _TRUNCATE);
+            _len = size + strlen(&_buf[size]);
+            _buf.resize(_len + 1);
         }
     }
 }
@@ -612,6 +827,7 @@ void CTextA::operator+=(char letter)
     _buf.pop_back();
     _buf.push_back(letter);
     _buf.push_back(0);
+    ++_len;
 }
 
 
@@ -627,6 +843,7 @@ void CTextA::Append(const char* data, unsigned len)
         _buf.pop_back();
         _buf.insert(_buf.cend(), data, data + len);
         _buf.push_back(0);
+        _len += len;
     }
 }
 
@@ -640,10 +857,12 @@ void CTextA::Append(const wchar_t* data, unsigned len)
 
     if (data && len)
     {
-        const unsigned currentLen = Len();
+        const unsigned currentLen = _len;
         _buf.resize(currentLen + len + 1, 0);
         size_t cnt;
         wcstombs_s(&cnt, _buf.data() + currentLen, len + 1, data, _TRUNCATE);
+        _len = currentLen + strlen(_buf.data() + currentLen);
+        _buf.resize(_len + 1);
     }
 }
 
@@ -655,8 +874,11 @@ void CTextA::Insert(unsigned at_pos, char letter)
 {
     AutoFit();
 
-    if (at_pos < _buf.size())
+    if (at_pos <= _len)
+    {
         _buf.insert(_buf.cbegin() + at_pos, letter);
+        ++_len;
+    }
 }
 
 
@@ -667,8 +889,11 @@ void CTextA::Insert(unsigned at_pos, const char* data, unsigned len)
 {
     AutoFit();
 
-    if ((at_pos < _buf.size()) && data && len)
+    if ((at_pos <= _len) && data && len)
+    {
         _buf.insert(_buf.cbegin() + at_pos, data, data + len);
+        _len += len;
+    }
 }
 
 
@@ -679,12 +904,13 @@ void CTextA::Erase(unsigned from_pos, unsigned len)
 {
     AutoFit();
 
-    if ((from_pos < _buf.size()) && len)
+    if ((from_pos < _len) && len)
     {
-        if (len > _buf.size())
-            len = _buf.size();
+        if (len > _len - from_pos)
+            len = _len - from_pos;
 
         _buf.erase(_buf.cbegin() + from_pos, _buf.cbegin() + from_pos + len);
+        _len -= len;
     }
 }
 
@@ -696,7 +922,7 @@ void CTextA::Clear()
 {
     _buf.clear();
     _buf.push_back(0);
-    _invalidStrLen = false;
+    _len = 0;
 }
 
 
@@ -709,7 +935,7 @@ void CTextA::Resize(unsigned size)
 
     _buf.resize(size);
     _buf.push_back(0);
-    _invalidStrLen = _invalidStrLen || (size > len);
+    _len = (_len == cUnknownLen || size > len) ? cUnknownLen : size;
 }
 
 
@@ -733,6 +959,7 @@ void CPath::AsFolder()
         _buf.push_back(_T('\\'));
 
     _buf.push_back(0);
+    _len = _buf.size() - 1;
 }
 
 
@@ -751,6 +978,7 @@ unsigned CPath::StripFilename()
 
     _buf.erase(_buf.begin() + len, _buf.end());
     _buf.push_back(0);
+    _len = len;
 
     return len;
 }
@@ -773,6 +1001,7 @@ unsigned CPath::DirUp()
 
     _buf.erase(_buf.begin() + len, _buf.end());
     _buf.push_back(0);
+    _len = len;
 
     return len;
 }
@@ -806,9 +1035,8 @@ bool CPath::pathMatches(const TCHAR* pathStr, unsigned len) const
 
     for (int i = (int)len - 1; i >= 0; --i)
     {
-        if ((_buf[i] != pathStr[i]) &&
-            !(_buf[i] == _T('\\') && pathStr[i] == _T('/')) && !(_buf[i] == _T('/') && pathStr[i] == _T('\\')))
-        return false;
+        if ((_buf[i] != pathStr[i]) && (PathKey::Fold(_buf[i]) != PathKey::Fold(pathStr[i])))
+            return false;
     }
 
     return true;
@@ -865,3 +1093,50 @@ bool CPath::IsSubpathOf(const TCHAR* pathStr) const
 
     return pathMatches(pathStr, len);
 }
+
+
+/**
+ *  \brief
+ */
+void PathKey::set(const TCHAR* pathStr, unsigned len)
+{
+    _key.Resize(len);
+
+    TCHAR* pKey = _key.C_str();
+    for (unsigned i = 0; i < len; ++i)
+        pKey[i] = Fold(pathStr[i]);
+    _key.AutoFit();
+
+    _hash = _key.View().Hash();
+}
+
+
+/**
+ *  \brief
+ */
+bool PathKey::IsParentOf(const PathKey& key) const
+{
+    const unsigned len = _key.Len();
+    if (len > key._key.Len())
+        return false;
+
+    return !memcmp(_key.C_str(), key._key.C_str(), len * sizeof(TCHAR));
+}
+
+
+/**
+ *  \brief  Folds the other path on the fly so it doesn't need a key of its own
+ */
+bool PathKey::IsParentOf(const TCHAR* pathStr, unsigned len) const
+{
+    const unsigned keyLen = _key.Len();
+    if (keyLen > len)
+        return false;
+
+    const TCHAR* pKey = _key.C_str();
+    for (int i = (int)keyLen - 1; i >= 0; --i)
+        if (pKey[i] != Fold(pathStr[i]))
+            return false;
+
+    return true;
+}
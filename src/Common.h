@@ -30,46 +30,113 @@
 #include <stdlib.h>
 #include <string.h>
 #include <vector>
+#include <utility>
+#include "SmallBuffer.h"
 
 
 #ifdef UNICODE
-#define CText   CTextW
+#define CText       CTextW
+#define CTextView   CTextViewW
 #else
-#define CText   CTextA
+#define CText       CTextA
+#define CTextView   CTextViewA
 #endif
 
 
+/**
+ *  \class  TextView
+ *  \brief  Non-owning view of a text span - cheap to pass around and to take substrings of
+ */
+template<typename CharType>
+class TextView
+{
+public:
+    TextView() : _str(NULL), _len(0) {}
+    TextView(const CharType* str, unsigned len) : _str(str), _len(len) {}
+
+    inline const CharType* Data() const { return _str; }
+    inline unsigned Len() const { return _len; }
+    inline bool IsEmpty() const { return (_len == 0); }
+
+    inline TextView Sub(unsigned pos, unsigned len = (unsigned)-1) const
+    {
+        if (pos > _len)
+            pos = _len;
+        if (len > _len - pos)
+            len = _len - pos;
+
+        return TextView(_str + pos, len);
+    }
+
+    inline bool operator==(const TextView& view) const
+    {
+        return (_len == view._len && !memcmp(_str, view._str, _len * sizeof(CharType)));
+    }
+
+    // FNV-1a
+    inline size_t Hash() const
+    {
+        unsigned long long hash = 14695981039346656037ULL;
+
+        const unsigned char* pByte = reinterpret_cast<const unsigned char*>(_str);
+        for (unsigned i = _len * sizeof(CharType); i; --i, ++pByte)
+            hash = (hash ^ *pByte) * 1099511628211ULL;
+
+        return (size_t)hash;
+    }
+
+private:
+    const CharType* _str;
+    unsigned        _len;
+};
+
+
+typedef TextView<wchar_t>   CTextViewW;
+typedef TextView<char>      CTextViewA;
+
+
 /**
  *  \class  CTextW
- *  \brief
+ *  \brief  Short texts are kept inline, longer ones allocate
  */
 class CTextW
 {
 protected:
-    std::vector<wchar_t>    _buf;
-    bool                    _invalidStrLen;
+    static const unsigned cUnknownLen;
+
+    SmallBuffer<wchar_t, 64>    _buf;
+
+    // Cached length - cUnknownLen while the buffer may be filled in directly through C_str()
+    unsigned                    _len;
 
 public:
-    CTextW() : _invalidStrLen(false) { _buf.push_back(0); }
-    CTextW(unsigned size) : _invalidStrLen(true) { _buf.resize(size + 1, 0); }
+    CTextW() : _len(0) { _buf.push_back(0); }
+    CTextW(unsigned size) : _len(cUnknownLen) { _buf.resize(size + 1, 0); }
 
     CTextW(const wchar_t* str);
     CTextW(const char* str);
 
-    CTextW(const CTextW& txt) : _buf(txt._buf), _invalidStrLen(txt._invalidStrLen) {}
+    CTextW(const CTextW& txt) : _buf(txt._buf), _len(txt._len) {}
+
+    CTextW(CTextW&& txt) throw() : _buf(std::move(txt._buf)), _len(txt._len)
+    {
+        txt._buf.push_back(0);
+        txt._len = 0;
+    }
 
     ~CTextW() {}
 
     inline void AutoFit()
     {
-        if (_invalidStrLen)
+        if (_len == cUnknownLen)
         {
-            _buf.resize(wcslen(_buf.data()) + 1);
-            _invalidStrLen = false;
+            _len = wcslen(_buf.data());
+            _buf.resize(_len + 1);
         }
     }
 
     CTextW& operator=(const CTextW& txt);
+    CTextW& operator=(CTextW&& txt) throw();
     CTextW& operator=(const wchar_t* str);
     CTextW& operator=(const char* str);
 
@@ -90,9 +157,12 @@ public:
     void Clear();
     void Resize(unsigned size);
 
-    inline unsigned Len() const { return (_invalidStrLen) ? wcslen(_buf.data()) : (_buf.size() - 1); }
+    inline unsigned Len() const { return (_len != cUnknownLen) ? _len : wcslen(_buf.data()); }
     inline bool IsEmpty() const { return (Len() == 0); }
-    inline const std::vector<wchar_t>& Vector() const { return _buf; }
+    inline CTextViewW View(unsigned pos = 0, unsigned len = (unsigned)-1) const
+    {
+        return CTextViewW(_buf.data(), Len()).Sub(pos, len);
+    }
     inline const wchar_t* C_str() const { return _buf.data(); }
     inline wchar_t* C_str() { return _buf.data(); }
     inline unsigned Size() const { return _buf.size(); }
@@ -101,35 +171,46 @@ public:
 
 /**
  *  \class  CTextA
- *  \brief
+ *  \brief  Short texts are kept inline, longer ones allocate
  */
 class CTextA
 {
 protected:
-    std::vector<char>   _buf;
-    bool                _invalidStrLen;
+    static const unsigned cUnknownLen;
+
+    SmallBuffer<char, 64>   _buf;
+
+    // Cached length - cUnknownLen while the buffer may be filled in directly through C_str()
+    unsigned                _len;
 
 public:
-    CTextA() : _invalidStrLen(false) { _buf.push_back(0); }
-    CTextA(unsigned size) : _invalidStrLen(true) { _buf.resize(size + 1, 0); }
+    CTextA() : _len(0) { _buf.push_back(0); }
+    CTextA(unsigned size) : _len(cUnknownLen) { _buf.resize(size + 1, 0); }
 
     CTextA(const char* str);
     CTextA(const wchar_t* str);
 
-    CTextA(const CTextA& txt) : _buf(txt._buf), _invalidStrLen(txt._invalidStrLen) {}
+    CTextA(const CTextA& txt) : _buf(txt._buf), _len(txt._len) {}
+
+    CTextA(CTextA&& txt) throw() : _buf(std::move(txt._buf)), _len(txt._len)
+    {
+        txt._buf.push_back(0);
+        txt._len = 0;
+    }
 
     ~CTextA() {}
 
     inline void AutoFit()
     {
-        if (_invalidStrLen)
+        if (_len == cUnknownLen)
         {
-            _buf.resize(strlen(_buf.data()) + 1);
-            _invalidStrLen = false;
+            _len = strlen(_buf.data());
+            _buf.resize(_len + 1);
         }
     }
 
     CTextA& operator=(const CTextA& txt);
+    CTextA& operator=(CTextA&& txt) throw();
     CTextA& operator=(const char* str);
     CTextA& operator=(const wchar_t* str);
 
@@ -150,9 +231,12 @@ public:
     void Clear();
     void Resize(unsigned size);
 
-    inline unsigned Len() const { return (_invalidStrLen) ? strlen(_buf.data()) : (_buf.size() - 1); }
+    inline unsigned Len() const { return (_len != cUnknownLen) ? _len : strlen(_buf.data()); }
     inline bool IsEmpty() const { return (Len() == 0); }
-    inline const std::vector<char>& Vector() const { return _buf; }
+    inline CTextViewA View(unsigned pos = 0, unsigned len = (unsigned)-1) const
+    {
+        return CTextViewA(_buf.data(), Len()).Sub(pos, len);
+    }
     inline const char* C_str() const { return _buf.data(); }
     inline char* C_str() { return _buf.data(); }
     inline unsigned Size() const { return _buf.size(); }
@@ -168,11 +252,15 @@ class CPath : public CText
 public:
 	CPath() : CText() {}
     CPath(const CPath& path) : CText(path) {}
+    CPath(CPath&& path) throw() : CText(std::move(path)) {}
 	CPath(const char* pathStr) : CText(pathStr) {}
 	CPath(const wchar_t* pathStr) : CText(pathStr) {}
     CPath(unsigned size) : CText(size) {}
     ~CPath() {}
 
+    inline CPath& operator=(const CPath& path) { CText::operator=(path); return *this; }
+    inline CPath& operator=(CPath&& path) throw() { CText::operator=(std::move(path)); return *this; }
+
     inline bool Exists() const
     {
         if (IsEmpty())
@@ -204,6 +292,51 @@ private:
 };
 
 
+/**
+ *  \class  PathKey
+ *  \brief  Canonical path form for lookups - case folded, with '/' turned to '\\'
+ *          and the hash computed once on construction
+ */
+class PathKey
+{
+public:
+    struct Hasher
+    {
+        inline size_t operator()(const PathKey& key) const { return key._hash; }
+    };
+
+    PathKey() : _hash(CTextView().Hash()) {}
+    explicit PathKey(const CPath& path) { set(path.C_str(), path.Len()); }
+    explicit PathKey(const TCHAR* pathStr) { set(pathStr, (unsigned)_tcslen(pathStr)); }
+
+    static inline TCHAR Fold(TCHAR ch)
+    {
+        if (ch == _T('/'))
+            return _T('\\');
+        if (ch >= _T('A') && ch <= _T('Z'))
+            return ch + (_T('a') - _T('A'));
+        if ((_TUCHAR)ch < 0x80)
+            return ch;
+        return (TCHAR)(ULONG_PTR)CharLower((LPTSTR)(ULONG_PTR)(_TUCHAR)ch);
+    }
+
+    inline size_t Hash() const { return _hash; }
+    inline const CText& Str() const { return _key; }
+
+    inline bool operator==(const PathKey& key) const { return (_hash == key._hash && _key == key._key); }
+    inline bool operator!=(const PathKey& key) const { return !(*this == key); }
+
+    bool IsParentOf(const PathKey& key) const;
+    bool IsParentOf(const TCHAR* pathStr, unsigned len) const;
+
+private:
+    void set(const TCHAR* pathStr, unsigned len);
+
+    CText   _key;
+    size_t  _hash;
+};
+
+
 namespace Tools
 {
 
@@ -213,6 +346,8 @@ unsigned GetFontHeight(HDC hdc, HFONT font);
 unsigned GetWindowsVersion();
 HFONT CreateFromSystemMessageFont(HDC hdc = NULL, unsigned fontHeight = 0);
 HFONT CreateFromSystemMenuFont(HDC hdc = NULL, unsigned fontHeight = 0);
+bool PackText(const char* text, unsigned len, std::vector<char>& packed);
+bool UnpackText(const std::vector<char>& packed, char* text, unsigned len);
 
 
 #ifdef DEVELOPMENT
@@ -43,6 +43,34 @@ const TCHAR Settings::cUseDefDbKey[]     = _T("UseDefaultDB = ");
 const TCHAR Settings::cDefDbPathKey[]    = _T("DefaultDBPath = ");
 const TCHAR Settings::cREOptionKey[]     = _T("RegExpOptionOn = ");
 const TCHAR Settings::cMCOptionKey[]     = _T("MatchCaseOptionOn = ");
+const TCHAR Settings::cResultSpillKey[]  = _T("ResultSpillThresholdMB = ");
+const TCHAR Settings::cResultTabsMemKey[] = _T("ResultTabsMemoryMB = ");
+const TCHAR Settings::cSpeculativeFindKey[] = _T("SpeculativeFind = ");
+const TCHAR Settings::cPrefetchKey[]     = _T("PrefetchDefinitions = ");
+const TCHAR Settings::cFileTagsKey[]     = _T("FileTagSnapshots = ");
+const TCHAR Settings::cInProcessGrepKey[] = _T("InProcessGrep = ");
+const TCHAR Settings::cTrigramIndexKey[] = _T("TrigramIndex = ");
+const TCHAR Settings::cFileNameIndexKey[] = _T("FileNameIndex = ");
+const TCHAR Settings::cFuzzyComplKey[]   = _T("FuzzyCompletion = ");
+const TCHAR Settings::cFederatedLibKey[] = _T("FederatedLibQuery = ");
+const TCHAR Settings::cLibTimeoutKey[]   = _T("LibQueryTimeoutMs = ");
+const TCHAR Settings::cIndexPriorityKey[] = _T("IndexPriority = ");
+const TCHAR Settings::cIndexMemLimitKey[] = _T("IndexMemoryLimitMB = ");
+const TCHAR Settings::cIndexCpuRateKey[] = _T("IndexCpuRatePercent = ");
+const TCHAR Settings::cBoostInteractiveKey[] = _T("BoostInteractiveQueries = ");
+
+const TCHAR Settings::cIdlePriority[]    = _T("idle");
+const TCHAR Settings::cLowPriority[]     = _T("low");
+const TCHAR Settings::cNormalPriority[]  = _T("normal");
+
+const TCHAR* Settings::cPriorities[Settings::PRIORITY_LIST_END] = {
+    Settings::cIdlePriority,
+    Settings::cLowPriority,
+    Settings::cNormalPriority
+};
+
+// Result memory limits are converted to bytes in 32 bits
+const unsigned Settings::cMaxResultMemMB = 2048;
 
 const TCHAR DbConfig::cInfo[] =
         _T("# ") PLUGIN_NAME _T(" database config\n");
@@ -84,7 +112,7 @@ void DbConfig::SetDefaults()
     _useLibDb = false;
     _libDbPaths.clear();
     _usePathFilter = false;
-    _pathFilters.clear();
+    ClearFilters();
 }
 
 
@@ -269,6 +297,8 @@ void DbConfig::FiltersFromBuf(TCHAR* buf, const TCHAR* separators)
     TCHAR* pTmp = NULL;
     for (TCHAR* ptr = _tcstok_s(buf, separators, &pTmp); ptr; ptr = _tcstok_s(NULL, separators, &pTmp))
         _pathFilters.push_back(CPath(ptr));
+
+    updateFilterKeys();
 }
 
 
@@ -281,6 +311,35 @@ void DbConfig::FiltersToBuf(CText& buf, TCHAR separator) const
 }
 
 
+/**
+ *  \brief  Checks if the path (relative to the DB root) falls under any of the path filters
+ */
+bool DbConfig::IsPathFiltered(const TCHAR* pathStr, unsigned len) const
+{
+    if (!_usePathFilter)
+        return false;
+
+    for (const auto& filter : _pathFilterKeys)
+        if (filter.IsParentOf(pathStr, len))
+            return true;
+
+    return false;
+}
+
+
+/**
+ *  \brief
+ */
+void DbConfig::updateFilterKeys()
+{
+    _pathFilterKeys.clear();
+    _pathFilterKeys.reserve(_pathFilters.size());
+
+    for (const auto& filter : _pathFilters)
+        _pathFilterKeys.push_back(PathKey(filter));
+}
+
+
 /**
  *  \brief
  */
@@ -294,6 +353,7 @@ const DbConfig& DbConfig::operator=(const DbConfig& rhs)
         _libDbPaths     = rhs._libDbPaths;
         _usePathFilter  = rhs._usePathFilter;
         _pathFilters    = rhs._pathFilters;
+        _pathFilterKeys = rhs._pathFilterKeys;
     }
 
     return *this;
@@ -350,6 +410,21 @@ void Settings::SetDefaults()
     _defDbPath.Clear();
     _re = false;
     _mc = true;
+    _resultSpillMB = 64;
+    _resultTabsMemMB = 64;
+    _speculativeFind = true;
+    _prefetchDefinitions = false;
+    _fileTagSnapshots = false;
+    _inProcessGrep = true;
+    _trigramIndex = false;
+    _fileNameIndex = true;
+    _fuzzyCompletion = true;
+    _federatedLibQuery = false;
+    _libQueryTimeoutMs = 3000;
+    _indexPriorityIdx = PRIORITY_LOW;
+    _indexMemoryLimitMB = 0;
+    _indexCpuRatePercent = 0;
+    _boostInteractive = true;
 
     _genericDbCfg.SetDefaults();
 }
@@ -418,6 +493,119 @@ bool Settings::Load()
             else
                 _mc = false;
         }
+        else if (!_tcsncmp(line, cResultSpillKey, _countof(cResultSpillKey) - 1))
+        {
+            const unsigned pos = _countof(cResultSpillKey) - 1;
+            _resultSpillMB = _tcstoul(&line[pos], NULL, 10);
+            if (_resultSpillMB > cMaxResultMemMB)
+                _resultSpillMB = cMaxResultMemMB;
+        }
+        else if (!_tcsncmp(line, cResultTabsMemKey, _countof(cResultTabsMemKey) - 1))
+        {
+            const unsigned pos = _countof(cResultTabsMemKey) - 1;
+            _resultTabsMemMB = _tcstoul(&line[pos], NULL, 10);
+            if (_resultTabsMemMB > cMaxResultMemMB)
+                _resultTabsMemMB = cMaxResultMemMB;
+        }
+        else if (!_tcsncmp(line, cSpeculativeFindKey, _countof(cSpeculativeFindKey) - 1))
+        {
+            const unsigned pos = _countof(cSpeculativeFindKey) - 1;
+            if (!_tcsncmp(&line[pos], _T("yes"), _countof(_T("yes")) - 1))
+                _speculativeFind = true;
+            else
+                _speculativeFind = false;
+        }
+        else if (!_tcsncmp(line, cPrefetchKey, _countof(cPrefetchKey) - 1))
+        {
+            const unsigned pos = _countof(cPrefetchKey) - 1;
+            if (!_tcsncmp(&line[pos], _T("yes"), _countof(_T("yes")) - 1))
+                _prefetchDefinitions = true;
+            else
+                _prefetchDefinitions = false;
+        }
+        else if (!_tcsncmp(line, cFileTagsKey, _countof(cFileTagsKey) - 1))
+        {
+            const unsigned pos = _countof(cFileTagsKey) - 1;
+            if (!_tcsncmp(&line[pos], _T("yes"), _countof(_T("yes")) - 1))
+                _fileTagSnapshots = true;
+            else
+                _fileTagSnapshots = false;
+        }
+        else if (!_tcsncmp(line, cInProcessGrepKey, _countof(cInProcessGrepKey) - 1))
+        {
+            const unsigned pos = _countof(cInProcessGrepKey) - 1;
+            if (!_tcsncmp(&line[pos], _T("yes"), _countof(_T("yes")) - 1))
+                _inProcessGrep = true;
+            else
+                _inProcessGrep = false;
+        }
+        else if (!_tcsncmp(line, cTrigramIndexKey, _countof(cTrigramIndexKey) - 1))
+        {
+            const unsigned pos = _countof(cTrigramIndexKey) - 1;
+            if (!_tcsncmp(&line[pos], _T("yes"), _countof(_T("yes")) - 1))
+                _trigramIndex = true;
+            else
+                _trigramIndex = false;
+        }
+        else if (!_tcsncmp(line, cFileNameIndexKey, _countof(cFileNameIndexKey) - 1))
+        {
+            const unsigned pos = _countof(cFileNameIndexKey) - 1;
+            if (!_tcsncmp(&line[pos], _T("yes"), _countof(_T("yes")) - 1))
+                _fileNameIndex = true;
+            else
+                _fileNameIndex = false;
+        }
+        else if (!_tcsncmp(line, cFuzzyComplKey, _countof(cFuzzyComplKey) - 1))
+        {
+            const unsigned pos = _countof(cFuzzyComplKey) - 1;
+            if (!_tcsncmp(&line[pos], _T("yes"), _countof(_T("yes")) - 1))
+                _fuzzyCompletion = true;
+            else
+                _fuzzyCompletion = false;
+        }
+        else if (!_tcsncmp(line, cFederatedLibKey, _countof(cFederatedLibKey) - 1))
+        {
+            const unsigned pos = _countof(cFederatedLibKey) - 1;
+            if (!_tcsncmp(&line[pos], _T("yes"), _countof(_T("yes")) - 1))
+                _federatedLibQuery = true;
+            else
+                _federatedLibQuery = false;
+        }
+        else if (!_tcsncmp(line, cLibTimeoutKey, _countof(cLibTimeoutKey) - 1))
+        {
+            const unsigned pos = _countof(cLibTimeoutKey) - 1;
+            _libQueryTimeoutMs = _tcstoul(&line[pos], NULL, 10);
+        }
+        else if (!_tcsncmp(line, cIndexPriorityKey, _countof(cIndexPriorityKey) - 1))
+        {
+            const unsigned pos = _countof(cIndexPriorityKey) - 1;
+            if (!_tcsncmp(&line[pos], cIdlePriority, _countof(cIdlePriority) - 1))
+                _indexPriorityIdx = PRIORITY_IDLE;
+            else if (!_tcsncmp(&line[pos], cNormalPriority, _countof(cNormalPriority) - 1))
+                _indexPriorityIdx = PRIORITY_NORMAL;
+            else
+                _indexPriorityIdx = PRIORITY_LOW;
+        }
+        else if (!_tcsncmp(line, cIndexMemLimitKey, _countof(cIndexMemLimitKey) - 1))
+        {
+            const unsigned pos = _countof(cIndexMemLimitKey) - 1;
+            _indexMemoryLimitMB = _tcstoul(&line[pos], NULL, 10);
+        }
+        else if (!_tcsncmp(line, cIndexCpuRateKey, _countof(cIndexCpuRateKey) - 1))
+        {
+            const unsigned pos = _countof(cIndexCpuRateKey) - 1;
+            _indexCpuRatePercent = _tcstoul(&line[pos], NULL, 10);
+            if (_indexCpuRatePercent > 100)
+                _indexCpuRatePercent = 0;
+        }
+        else if (!_tcsncmp(line, cBoostInteractiveKey, _countof(cBoostInteractiveKey) - 1))
+        {
+            const unsigned pos = _countof(cBoostInteractiveKey) - 1;
+            if (!_tcsncmp(&line[pos], _T("yes"), _countof(_T("yes")) - 1))
+                _boostInteractive = true;
+            else
+                _boostInteractive = false;
+        }
         else if (!_genericDbCfg.ReadOption(line))
         {
             success = false;
@@ -451,7 +639,22 @@ bool Settings::Save() const
     if (_ftprintf_s(fp, _T("%s%s\n"), cUseDefDbKey, (_useDefDb ? _T("yes") : _T("no"))) > 0)
     if (_ftprintf_s(fp, _T("%s%s\n"), cDefDbPathKey, _defDbPath.C_str()) > 0)
     if (_ftprintf_s(fp, _T("%s%s\n"), cREOptionKey, (_re ? _T("yes") : _T("no"))) > 0)
-    if (_ftprintf_s(fp, _T("%s%s\n\n"), cMCOptionKey, (_mc ? _T("yes") : _T("no"))) > 0)
+    if (_ftprintf_s(fp, _T("%s%s\n"), cMCOptionKey, (_mc ? _T("yes") : _T("no"))) > 0)
+    if (_ftprintf_s(fp, _T("%s%u\n"), cResultSpillKey, _resultSpillMB) > 0)
+    if (_ftprintf_s(fp, _T("%s%u\n"), cResultTabsMemKey, _resultTabsMemMB) > 0)
+    if (_ftprintf_s(fp, _T("%s%s\n"), cSpeculativeFindKey, (_speculativeFind ? _T("yes") : _T("no"))) > 0)
+    if (_ftprintf_s(fp, _T("%s%s\n"), cPrefetchKey, (_prefetchDefinitions ? _T("yes") : _T("no"))) > 0)
+    if (_ftprintf_s(fp, _T("%s%s\n"), cFileTagsKey, (_fileTagSnapshots ? _T("yes") : _T("no"))) > 0)
+    if (_ftprintf_s(fp, _T("%s%s\n"), cInProcessGrepKey, (_inProcessGrep ? _T("yes") : _T("no"))) > 0)
+    if (_ftprintf_s(fp, _T("%s%s\n"), cTrigramIndexKey, (_trigramIndex ? _T("yes") : _T("no"))) > 0)
+    if (_ftprintf_s(fp, _T("%s%s\n"), cFileNameIndexKey, (_fileNameIndex ? _T("yes") : _T("no"))) > 0)
+    if (_ftprintf_s(fp, _T("%s%s\n"), cFuzzyComplKey, (_fuzzyCompletion ? _T("yes") : _T("no"))) > 0)
+    if (_ftprintf_s(fp, _T("%s%s\n"), cFederatedLibKey, (_federatedLibQuery ? _T("yes") : _T("no"))) > 0)
+    if (_ftprintf_s(fp, _T("%s%u\n"), cLibTimeoutKey, _libQueryTimeoutMs) > 0)
+    if (_ftprintf_s(fp, _T("%s%s\n"), cIndexPriorityKey, cPriorities[_indexPriorityIdx]) > 0)
+    if (_ftprintf_s(fp, _T("%s%u\n"), cIndexMemLimitKey, _indexMemoryLimitMB) > 0)
+    if (_ftprintf_s(fp, _T("%s%u\n"), cIndexCpuRateKey, _indexCpuRatePercent) > 0)
+    if (_ftprintf_s(fp, _T("%s%s\n\n"), cBoostInteractiveKey, (_boostInteractive ? _T("yes") : _T("no"))) > 0)
     if (_genericDbCfg.Write(fp))
         success = true;
 
@@ -468,11 +671,26 @@ const Settings& Settings::operator=(const Settings& rhs)
 {
     if (this != &rhs)
     {
-        _useDefDb       = rhs._useDefDb;
-        _defDbPath      = rhs._defDbPath;
-        _re             = rhs._re;
-        _mc             = rhs._mc;
-        _genericDbCfg   = rhs._genericDbCfg;
+        _useDefDb        = rhs._useDefDb;
+        _defDbPath       = rhs._defDbPath;
+        _re              = rhs._re;
+        _mc              = rhs._mc;
+        _resultSpillMB   = rhs._resultSpillMB;
+        _resultTabsMemMB = rhs._resultTabsMemMB;
+        _speculativeFind = rhs._speculativeFind;
+        _prefetchDefinitions = rhs._prefetchDefinitions;
+        _fileTagSnapshots = rhs._fileTagSnapshots;
+        _inProcessGrep   = rhs._inProcessGrep;
+        _trigramIndex    = rhs._trigramIndex;
+        _fileNameIndex   = rhs._fileNameIndex;
+        _fuzzyCompletion = rhs._fuzzyCompletion;
+        _federatedLibQuery = rhs._federatedLibQuery;
+        _libQueryTimeoutMs = rhs._libQueryTimeoutMs;
+        _indexPriorityIdx = rhs._indexPriorityIdx;
+        _indexMemoryLimitMB = rhs._indexMemoryLimitMB;
+        _indexCpuRatePercent = rhs._indexCpuRatePercent;
+        _boostInteractive = rhs._boostInteractive;
+        _genericDbCfg    = rhs._genericDbCfg;
     }
 
     return *this;
@@ -488,7 +706,16 @@ bool Settings::operator==(const Settings& rhs) const
         return true;
 
     return (_useDefDb == rhs._useDefDb && _defDbPath == rhs._defDbPath &&
-            _re == rhs._re && _mc == rhs._mc && _genericDbCfg == rhs._genericDbCfg);
+            _re == rhs._re && _mc == rhs._mc &&
+            _resultSpillMB == rhs._resultSpillMB && _resultTabsMemMB == rhs._resultTabsMemMB &&
+            _speculativeFind == rhs._speculativeFind && _prefetchDefinitions == rhs._prefetchDefinitions &&
+            _fileTagSnapshots == rhs._fileTagSnapshots &&
+            _inProcessGrep == rhs._inProcessGrep && _trigramIndex == rhs._trigramIndex &&
+            _fileNameIndex == rhs._fileNameIndex && _fuzzyCompletion == rhs._fuzzyCompletion &&
+            _federatedLibQuery == rhs._federatedLibQuery && _libQueryTimeoutMs == rhs._libQueryTimeoutMs &&
+            _indexPriorityIdx == rhs._indexPriorityIdx && _indexMemoryLimitMB == rhs._indexMemoryLimitMB &&
+            _indexCpuRatePercent == rhs._indexCpuRatePercent && _boostInteractive == rhs._boostInteractive &&
+            _genericDbCfg == rhs._genericDbCfg);
 }
 
 } // namespace GTags
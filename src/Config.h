@@ -67,7 +67,15 @@ public:
     void DbPathsToBuf(CText& buf, TCHAR separator) const;
 
     void FiltersFromBuf(TCHAR* buf, const TCHAR* separators);
-    void FiltersToBuf(CText& buf, TCHAR separator) const;
+    void FiltersToBuf(CText& buf, TCHAR separator) const;
+
+    bool IsPathFiltered(const TCHAR* pathStr, unsigned len) const;
+
+    inline void ClearFilters()
+    {
+        _pathFilters.clear();
+        _pathFilterKeys.clear();
+    }
 
     const DbConfig& operator=(const DbConfig&);
     bool operator==(const DbConfig&) const;
@@ -77,11 +85,12 @@ public:
     bool                _useLibDb;
     std::vector<CPath>  _libDbPaths;
     bool                _usePathFilter;
-    std::vector<CPath>  _pathFilters;
+    std::vector<CPath>  _pathFilters;
 
-private:
+private:
     bool ReadOption(TCHAR* line);
     bool Write(FILE* fp) const;
+    void updateFilterKeys();
 
     static const TCHAR cInfo[];
 
@@ -101,6 +110,9 @@ private:
     friend class Settings;
 
     static void vectorToBuf(const std::vector<CPath>& vect, CText& buf, TCHAR separator);
+
+    // Canonical form of _pathFilters so entries can be checked without converting the filters
+    std::vector<PathKey>    _pathFilterKeys;
 };
 
 
@@ -111,9 +123,22 @@ private:
 class Settings
 {
 public:
+    enum
+    {
+        PRIORITY_IDLE = 0,
+        PRIORITY_LOW,
+        PRIORITY_NORMAL,
+        PRIORITY_LIST_END
+    };
+
     Settings();
     ~Settings() {}
 
+    static const TCHAR* Priority(unsigned idx)
+    {
+        return (idx < PRIORITY_LIST_END) ? cPriorities[idx] : NULL;
+    }
+
     void SetDefaults();
     bool Load();
     bool Save() const;
@@ -126,7 +151,25 @@ public:
     bool    _re;
     bool    _mc;
 
-    DbConfig    _genericDbCfg;
+    unsigned    _resultSpillMB;
+    unsigned    _resultTabsMemMB;
+    bool        _speculativeFind;
+    bool        _prefetchDefinitions;
+    bool        _fileTagSnapshots;
+    bool        _inProcessGrep;
+    bool        _trigramIndex;
+    bool        _fileNameIndex;
+    bool        _fuzzyCompletion;
+    bool        _federatedLibQuery;
+    unsigned    _libQueryTimeoutMs;
+
+    // Resource policies of the database (re)building processes and of the interactive queries
+    unsigned    _indexPriorityIdx;
+    unsigned    _indexMemoryLimitMB;
+    unsigned    _indexCpuRatePercent;
+    bool        _boostInteractive;
+
+    DbConfig    _genericDbCfg;
 
 private:
     static const TCHAR cInfo[];
@@ -135,6 +178,29 @@ private:
     static const TCHAR cDefDbPathKey[];
     static const TCHAR cREOptionKey[];
     static const TCHAR cMCOptionKey[];
+    static const TCHAR cResultSpillKey[];
+    static const TCHAR cResultTabsMemKey[];
+    static const TCHAR cSpeculativeFindKey[];
+    static const TCHAR cPrefetchKey[];
+    static const TCHAR cFileTagsKey[];
+    static const TCHAR cInProcessGrepKey[];
+    static const TCHAR cTrigramIndexKey[];
+    static const TCHAR cFileNameIndexKey[];
+    static const TCHAR cFuzzyComplKey[];
+    static const TCHAR cFederatedLibKey[];
+    static const TCHAR cLibTimeoutKey[];
+    static const TCHAR cIndexPriorityKey[];
+    static const TCHAR cIndexMemLimitKey[];
+    static const TCHAR cIndexCpuRateKey[];
+    static const TCHAR cBoostInteractiveKey[];
+
+    static const TCHAR cIdlePriority[];
+    static const TCHAR cLowPriority[];
+    static const TCHAR cNormalPriority[];
+
+    static const TCHAR* cPriorities[PRIORITY_LIST_END];
+
+    static const unsigned cMaxResultMemMB;
 };
 
 } // namespace GTags
@@ -28,6 +28,12 @@
 #include "GTags.h"
 #include "Cmd.h"
 #include "CmdEngine.h"
+#include "FileTags.h"
+#include "BackgroundCmd.h"
+#include "TrigramIndex.h"
+#include "FileIndex.h"
+#include "LibQueryCache.h"
+#include "BuildProgress.h"
 
 
 namespace GTags
@@ -37,7 +43,7 @@ namespace GTags
 /**
  *  \brief
  */
-GTagsDb::GTagsDb(const CPath& dbPath, bool writeEn) : _path(dbPath), _writeLock(writeEn)
+GTagsDb::GTagsDb(const CPath& dbPath, bool writeEn) : _path(dbPath), _key(dbPath), _writeLock(writeEn)
 {
     if (!_cfg.LoadFromFolder(dbPath))
         _cfg = GTagsSettings._genericDbCfg;
@@ -46,6 +52,19 @@ GTagsDb::GTagsDb(const CPath& dbPath, bool writeEn) : _path(dbPath), _writeLock(
 }
 
 
+/**
+ *  \brief  Re-links the library databases the new config refers to
+ */
+void GTagsDb::SetConfig(const DbConfig& cfg)
+{
+    DbManager& dbm = DbManager::Get();
+
+    dbm.unlinkLibs(*this);
+    _cfg = cfg;
+    dbm.linkLibs(*this);
+}
+
+
 /**
  *  \brief
  */
@@ -62,12 +81,8 @@ void GTagsDb::Update(const CPath& file)
  */
 void GTagsDb::ScheduleUpdate(const CPath& file)
 {
-    std::list<CPath>::reverse_iterator iFile;
-    for (iFile = _updateList.rbegin(); iFile != _updateList.rend(); ++iFile)
-        if (*iFile == file)
-            return;
-
-    _updateList.push_back(file);
+    if (_updateSet.insert(PathKey(file)).second)
+        _updateList.push_back(file);
 }
 
 
@@ -124,13 +139,33 @@ void GTagsDb::runScheduledUpdate()
 
     lock(true);
 
-    CPath file = *(_updateList.begin());
-    _updateList.erase(_updateList.begin());
+    CPath file = std::move(_updateList.front());
+    _updateList.pop_front();
+    _updateSet.erase(PathKey(file));
 
     Update(file);
 }
 
 
+/**
+ *  \brief  Passes the re-indexed files to the changes callback (the open results refresh them) - once all scheduled
+ *          updates are done and the database is not write locked anymore
+ */
+void GTagsDb::publishChanges()
+{
+    if (_changedFiles.empty() || _writeLock || !_updateList.empty())
+        return;
+
+    std::vector<CPath> changedFiles;
+    changedFiles.swap(_changedFiles);
+
+    DbChangesCB changesCB = DbManager::Get()._changesCB;
+
+    if (changesCB)
+        changesCB(_path, changedFiles);
+}
+
+
 /**
  *  \brief
  */
@@ -146,8 +181,34 @@ void GTagsDb::dbUpdateCB(const CmdPtr_t& cmd)
         MessageBox(INpp::Get().GetHandle(), msg.C_str(), cmd->Name(), MB_OK | MB_ICONEXCLAMATION);
     }
 
-    cmd->Db()->unlock();
-    cmd->Db()->runScheduledUpdate();
+    DbHandle db = cmd->Db();
+
+    if (cmd->Status() == OK)
+    {
+        const CPath file(cmd->Tag().C_str());
+        const PathKey fileKey(file);
+
+        bool isNew = true;
+        for (const auto& changed : db->_changedFiles)
+        {
+            if (PathKey(changed) == fileKey)
+            {
+                isNew = false;
+                break;
+            }
+        }
+
+        if (isNew)
+            db->_changedFiles.push_back(file);
+    }
+
+    db->unlock();
+    db->runScheduledUpdate();
+
+    if (cmd->Status() == OK)
+        FileTags::OnFileUpdate(CPath(cmd->Tag().C_str()));
+
+    db->publishChanges();
 }
 
 
@@ -172,17 +233,14 @@ bool DbManager::UnregisterDb(const DbHandle& db)
 
     bool ret = false;
 
-    for (std::list<DbHandle>::iterator dbi = _dbList.begin(); dbi != _dbList.end(); ++dbi)
+    auto dbi = _dbMap.find(db->_key);
+    if (dbi != _dbMap.end() && dbi->second == db)
     {
-        if (db == *dbi)
+        if (db->unlock())
         {
-            if (db->unlock())
-            {
-                ret = deleteDb(db->_path);
-                _dbList.erase(dbi);
-            }
-
-            break;
+            unlinkLibs(*db);
+            ret = deleteDb(db->_path);
+            _dbMap.erase(dbi);
         }
     }
 
@@ -239,15 +297,11 @@ void DbManager::PutDb(const DbHandle& db)
     if (!db)
         return;
 
-    for (std::list<DbHandle>::iterator dbi = _dbList.begin(); dbi != _dbList.end(); ++dbi)
+    auto dbi = _dbMap.find(db->_key);
+    if (dbi != _dbMap.end() && dbi->second == db)
     {
-        if (db == *dbi)
-        {
-            if (db->unlock())
-                db->runScheduledUpdate();
-
-            break;
-        }
+        if (db->unlock())
+            db->runScheduledUpdate();
     }
 }
 
@@ -270,6 +324,11 @@ bool DbManager::deleteDb(CPath& dbPath)
 {
     BOOL ret = FALSE;
 
+    TrigramIndex::Remove(dbPath);
+    FileIndex::Remove(dbPath);
+    LibQueryCache::Invalidate(dbPath);
+    BuildProgress::Remove(dbPath);
+
     dbPath += _T("GTAGS");
     if (dbPath.FileExists())
         ret = DeleteFile(dbPath.C_str());
@@ -298,21 +357,71 @@ bool DbManager::deleteDb(CPath& dbPath)
  */
 const DbHandle& DbManager::lockDb(const CPath& dbPath, bool writeEn, bool* success)
 {
-    for (std::list<DbHandle>::iterator dbi = _dbList.begin(); dbi != _dbList.end(); ++dbi)
+    PathKey key(dbPath);
+
+    auto dbi = _dbMap.find(key);
+    if (dbi != _dbMap.end())
     {
-        if ((*dbi)->_path == dbPath)
-        {
-            *success = (*dbi)->lock(writeEn);
-            return *dbi;
-        }
+        *success = dbi->second->lock(writeEn);
+
+        // Background commands give way to the database writes
+        if (!*success && writeEn && BackgroundCmd::Stop(dbi->second))
+            *success = dbi->second->lock(writeEn);
+
+        return dbi->second;
     }
 
-    DbHandle newDb(new GTagsDb(dbPath, writeEn));
-    _dbList.push_back(newDb);
+    DbHandle& newDb = _dbMap[std::move(key)];
+    newDb.reset(new GTagsDb(dbPath, writeEn));
+    linkLibs(*newDb);
 
     *success = true;
 
-    return *(_dbList.rbegin());
+    return newDb;
+}
+
+
+/**
+ *  \brief  Gets the library databases the project queries - each one once
+ */
+void DbManager::getLibs(const GTagsDb& db, std::vector<CPath>& libs)
+{
+    const DbConfig& cfg = db.GetConfig();
+    if (!cfg._useLibDb)
+        return;
+
+    std::unordered_set<PathKey, PathKey::Hasher> keys;
+    keys.insert(db.GetKey());
+
+    for (const auto& libPath : cfg._libDbPaths)
+        if (!libPath.IsSubpathOf(db.GetPath()) && keys.insert(PathKey(libPath)).second)
+            libs.push_back(libPath);
+}
+
+
+/**
+ *  \brief  Library databases are shared by all projects that link them so their caches are loaded once
+ */
+void DbManager::linkLibs(const GTagsDb& db)
+{
+    std::vector<CPath> libs;
+    getLibs(db, libs);
+
+    for (const auto& libPath : libs)
+        LibQueryCache::Acquire(libPath);
+}
+
+
+/**
+ *  \brief  Releases the library caches no project needs anymore
+ */
+void DbManager::unlinkLibs(const GTagsDb& db)
+{
+    std::vector<CPath> libs;
+    getLibs(db, libs);
+
+    for (const auto& libPath : libs)
+        LibQueryCache::Release(libPath);
 }
 
 } // namespace GTags
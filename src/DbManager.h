@@ -27,7 +27,10 @@
 
 #include <tchar.h>
 #include <list>
+#include <vector>
 #include <memory>
+#include <unordered_set>
+#include <unordered_map>
 #include "Common.h"
 #include "Config.h"
 #include "CmdDefines.h"
@@ -47,9 +50,10 @@ public:
     ~GTagsDb() {}
 
     inline const CPath& GetPath() const { return _path; }
+    inline const PathKey& GetKey() const { return _key; }
 
     inline const DbConfig& GetConfig() const { return _cfg; }
-    inline void SetConfig(const DbConfig& cfg) { _cfg = cfg; }
+    void SetConfig(const DbConfig& cfg);
 
     void Update(const CPath& file);
     void ScheduleUpdate(const CPath& file);
@@ -70,19 +74,28 @@ private:
     bool unlock();
 
     void runScheduledUpdate();
+    void publishChanges();
 
     CPath       _path;
+    PathKey     _key;
     DbConfig    _cfg;
 
     int     _readLocks;
     bool    _writeLock;
 
-    std::list<CPath> _updateList;
+    std::list<CPath>                                _updateList;
+    std::unordered_set<PathKey, PathKey::Hasher>    _updateSet;
+
+    // Files re-indexed since the open results were last told about it
+    std::vector<CPath>                              _changedFiles;
 };
 
 
 typedef std::shared_ptr<GTagsDb> DbHandle;
 
+// Called with the files re-indexed in a database, once its scheduled updates are done
+typedef void (*DbChangesCB)(const CPath& dbPath, const std::vector<CPath>& files);
+
 
 /**
  *  \class  DbManager
@@ -104,15 +117,25 @@ public:
     void PutDb(const DbHandle& db);
     bool DbExistsInFolder(const CPath& folder);
 
+    inline void SetChangesCB(DbChangesCB changesCB) { _changesCB = changesCB; }
+
 private:
-    DbManager() {}
+    friend class GTagsDb;
+
+    DbManager() : _changesCB(NULL) {}
     DbManager(const DbManager&);
     ~DbManager() {}
 
     bool deleteDb(CPath& dbPath);
     const DbHandle& lockDb(const CPath& dbPath, bool writeEn, bool* success);
 
-    std::list<DbHandle> _dbList;
+    static void getLibs(const GTagsDb& db, std::vector<CPath>& libs);
+    void linkLibs(const GTagsDb& db);
+    void unlinkLibs(const GTagsDb& db);
+
+    std::unordered_map<PathKey, DbHandle, PathKey::Hasher> _dbMap;
+
+    DbChangesCB _changesCB;
 };
 
 } // namespace GTags
@@ -67,6 +67,7 @@ void DocLocation::Push()
     Location loc;
     INpp& npp = INpp::Get();
     npp.GetFilePath(loc._filePath);
+    loc._fileKey = PathKey(loc._filePath);
     loc._posInFile = npp.GetPos();
 
     if (_locList.empty() || !(loc == _locList.back()))
@@ -121,6 +122,7 @@ void DocLocation::swapView(Location& loc)
     INpp& npp = INpp::Get();
 
     npp.GetFilePath(newLoc._filePath);
+    newLoc._fileKey = PathKey(newLoc._filePath);
     newLoc._posInFile = npp.GetPos();
 
     npp.OpenFile(loc._filePath.C_str());
@@ -57,18 +57,20 @@ private:
     struct Location
     {
         CPath   _filePath;
+        PathKey _fileKey;
         long    _posInFile;
 
         inline const Location& operator=(const Location& loc)
         {
             _posInFile = loc._posInFile;
             _filePath = loc._filePath;
+            _fileKey = loc._fileKey;
             return loc;
         }
 
         inline bool operator==(const Location& loc) const
         {
-            return ((_posInFile == loc._posInFile) && (_filePath == loc._filePath));
+            return ((_posInFile == loc._posInFile) && (_fileKey == loc._fileKey));
         }
     };
 
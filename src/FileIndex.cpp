@@ -0,0 +1,383 @@
+/**
+ *  \file
+ *  \brief  In-memory index of the database file names
+ *
+ *  \author  Pavel Nedev <pg.nedev@gmail.com>
+ *
+ *  \section COPYRIGHT
+ *  Copyright(C) 2015 Pavel Nedev
+ *
+ *  \section LICENSE
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <string.h>
+#include <algorithm>
+#include <regex>
+#include <unordered_set>
+#include "FileIndex.h"
+
+
+namespace
+{
+
+/**
+ *  \brief
+ */
+inline char toLowerAscii(char ch)
+{
+    return (ch >= 'A' && ch <= 'Z') ? ch + ('a' - 'A') : ch;
+}
+
+
+/**
+ *  \brief  Returns the length of the path component (ended by '/' or by the path end)
+ */
+inline unsigned componentLen(const char* pComp)
+{
+    const char* pEnd = pComp;
+    while (*pEnd != '/' && *pEnd != '\n')
+        ++pEnd;
+
+    return pEnd - pComp;
+}
+
+
+/**
+ *  \brief
+ */
+inline bool lessThan(const char* pLhs, unsigned lhsLen, const char* pRhs, unsigned rhsLen)
+{
+    return std::lexicographical_compare(
+            reinterpret_cast<const unsigned char*>(pLhs), reinterpret_cast<const unsigned char*>(pLhs) + lhsLen,
+            reinterpret_cast<const unsigned char*>(pRhs), reinterpret_cast<const unsigned char*>(pRhs) + rhsLen);
+}
+
+} // anonymous namespace
+
+
+namespace GTags
+{
+
+const TCHAR FileIndex::cPathFile[] = _T("GPATH");
+
+Mutex FileIndex::CacheLock;
+std::unordered_map<std::basic_string<TCHAR>, FileIndex::CacheEntry> FileIndex::Cache;
+
+
+/**
+ *  \brief  Returns the cached index of the database if it is still valid, NULL otherwise
+ */
+std::shared_ptr<FileIndex> FileIndex::Get(const CPath& dbPath)
+{
+    AUTOLOCK(CacheLock);
+
+    auto entry = Cache.find(dbPath.C_str());
+    if (entry == Cache.end())
+        return std::shared_ptr<FileIndex>();
+
+    FILETIME pathTime;
+
+    if (!getPathTime(dbPath, pathTime) || CompareFileTime(&entry->second._pathTime, &pathTime))
+    {
+        Cache.erase(entry);
+        return std::shared_ptr<FileIndex>();
+    }
+
+    return entry->second._index;
+}
+
+
+/**
+ *  \brief  Indexes the listed files and caches the index.
+ *          The database should be at least read locked so GPATH doesn't change meanwhile.
+ */
+std::shared_ptr<FileIndex> FileIndex::Create(const CPath& dbPath, const char* fileList)
+{
+    std::shared_ptr<FileIndex> index(new FileIndex(fileList));
+
+    CacheEntry entry;
+    entry._index = index;
+
+    if (getPathTime(dbPath, entry._pathTime))
+    {
+        AUTOLOCK(CacheLock);
+        Cache[dbPath.C_str()] = entry;
+    }
+
+    return index;
+}
+
+
+/**
+ *  \brief
+ */
+void FileIndex::Remove(const CPath& dbPath)
+{
+    AUTOLOCK(CacheLock);
+    Cache.erase(dbPath.C_str());
+}
+
+
+/**
+ *  \brief
+ */
+bool FileIndex::getPathTime(const CPath& dbPath, FILETIME& pathTime)
+{
+    CPath path(dbPath);
+    path += cPathFile;
+
+    WIN32_FILE_ATTRIBUTE_DATA attr;
+    if (!GetFileAttributesEx(path.C_str(), GetFileExInfoStandard, &attr))
+        return false;
+
+    pathTime = attr.ftLastWriteTime;
+
+    return true;
+}
+
+
+/**
+ *  \brief
+ */
+FileIndex::FileIndex(const char* fileList)
+{
+    for (const char* pSrc = fileList; pSrc && *pSrc;)
+    {
+        while (*pSrc == '\n' || *pSrc == '\r')
+            ++pSrc;
+        if (*pSrc == 0)
+            break;
+
+        const char* pEol = pSrc;
+        while (*pEol != '\n' && *pEol != '\r' && *pEol != 0)
+            ++pEol;
+
+        const unsigned offset = _paths.size();
+        _pathOffsets.push_back(offset);
+        _components.push_back(offset);
+
+        unsigned baseOffset = offset;
+
+        for (const char* pCh = pSrc; pCh < pEol; ++pCh)
+        {
+            if (*pCh == '/' && pCh + 1 < pEol)
+            {
+                baseOffset = offset + (pCh - pSrc) + 1;
+                _components.push_back(baseOffset);
+            }
+        }
+
+        _baseOffsets.push_back(baseOffset);
+
+        _paths.insert(_paths.end(), pSrc, pEol);
+        _paths.push_back('\n');
+
+        pSrc = pEol;
+    }
+
+    _pathOffsets.push_back(_paths.size());
+
+    _folded.resize(_paths.size());
+    std::transform(_paths.begin(), _paths.end(), _folded.begin(), toLowerAscii);
+
+    const char* pFolded = _folded.data();
+
+    std::sort(_components.begin(), _components.end(),
+        [pFolded](unsigned lhs, unsigned rhs)
+        {
+            return lessThan(pFolded + lhs, componentLen(pFolded + lhs), pFolded + rhs, componentLen(pFolded + rhs));
+        });
+}
+
+
+/**
+ *  \brief  Gives the paths matching the pattern (global -P output format). Paths whose file name
+ *          matches come first. Returns false if the regular expression is invalid.
+ *          This is a linear scan - of the folded path table (memchr driven) or path by path for regular expressions.
+ */
+bool FileIndex::Find(const CTextA& pattern, bool regExp, bool matchCase, std::vector<char>& result) const
+{
+    const unsigned pathsCount = _pathOffsets.size() - 1;
+
+    // Matching paths by rank
+    std::vector<unsigned> ranked[4];
+
+    if (regExp)
+    {
+        std::regex re;
+
+        try
+        {
+            // global uses POSIX extended regular expressions
+            std::regex::flag_type flags = std::regex::extended | std::regex::nosubs | std::regex::optimize;
+            if (!matchCase)
+                flags |= std::regex::icase;
+
+            re.assign(pattern.C_str(), flags);
+        }
+        catch (const std::regex_error&)
+        {
+            return false;
+        }
+
+        for (unsigned i = 0; i < pathsCount; ++i)
+        {
+            const char* pPath = _paths.data() + _pathOffsets[i];
+            const char* pBase = _paths.data() + _baseOffsets[i];
+            const char* pEnd = _paths.data() + _pathOffsets[i + 1] - 1;
+
+            if (std::regex_search(pBase, pEnd, re))
+                ranked[2].push_back(i);
+            else if (std::regex_search(pPath, pEnd, re))
+                ranked[3].push_back(i);
+        }
+    }
+    else
+    {
+        CTextA folded(pattern);
+        for (char* pCh = folded.C_str(); *pCh; ++pCh)
+            *pCh = toLowerAscii(*pCh);
+
+        const unsigned len = folded.Len();
+
+        if (len == 0)
+        {
+            for (unsigned i = 0; i < pathsCount; ++i)
+                ranked[3].push_back(i);
+        }
+        else if (_folded.size() >= len)
+        {
+            const char* pCur = _folded.data();
+            const char* const pLast = _folded.data() + _folded.size() - len;
+
+            while (pCur <= pLast)
+            {
+                pCur = static_cast<const char*>(memchr(pCur, folded.C_str()[0], pLast - pCur + 1));
+                if (pCur == NULL)
+                    break;
+
+                const unsigned offset = pCur - _folded.data();
+
+                if (memcmp(pCur, folded.C_str(), len) ||
+                        (matchCase && memcmp(_paths.data() + offset, pattern.C_str(), len)))
+                {
+                    ++pCur;
+                    continue;
+                }
+
+                const unsigned pathIdx = pathAt(offset);
+
+                ranked[rank(pathIdx, folded.C_str(), len)].push_back(pathIdx);
+
+                // A path is listed once
+                pCur = _folded.data() + _pathOffsets[pathIdx + 1];
+            }
+        }
+    }
+
+    result.clear();
+
+    for (const auto& paths : ranked)
+    {
+        for (unsigned pathIdx : paths)
+            result.insert(result.end(), _paths.data() + _pathOffsets[pathIdx],
+                    _paths.data() + _pathOffsets[pathIdx + 1]);
+    }
+
+    if (!result.empty())
+        result.push_back(0);
+
+    return true;
+}
+
+
+/**
+ *  \brief  Gives the unique path components starting with the prefix (global -cP --match-part=all output format)
+ */
+void FileIndex::Complete(const CTextA& prefix, bool matchCase, std::vector<char>& result) const
+{
+    CTextA folded(prefix);
+    for (char* pCh = folded.C_str(); *pCh; ++pCh)
+        *pCh = toLowerAscii(*pCh);
+
+    const char* pFolded = _folded.data();
+    const unsigned len = folded.Len();
+
+    auto comp = std::lower_bound(_components.begin(), _components.end(), folded.C_str(),
+        [pFolded, len](unsigned offset, const char* pPrefix)
+        {
+            return lessThan(pFolded + offset, componentLen(pFolded + offset), pPrefix, len);
+        });
+
+    std::unordered_set<std::string> found;
+
+    result.clear();
+
+    for (; comp != _components.end(); ++comp)
+    {
+        const unsigned compLen = componentLen(pFolded + *comp);
+
+        if (compLen < len || memcmp(pFolded + *comp, folded.C_str(), len))
+            break;
+
+        const char* pComp = _paths.data() + *comp;
+
+        if (matchCase && memcmp(pComp, prefix.C_str(), len))
+            continue;
+
+        if (found.emplace(pComp, compLen).second)
+        {
+            result.push_back('/');
+            result.insert(result.end(), pComp, pComp + compLen);
+            result.push_back('\n');
+        }
+    }
+
+    if (!result.empty())
+        result.push_back(0);
+}
+
+
+/**
+ *  \brief  Returns the index of the path containing the offset
+ */
+unsigned FileIndex::pathAt(unsigned offset) const
+{
+    return std::upper_bound(_pathOffsets.begin(), _pathOffsets.end(), offset) - _pathOffsets.begin() - 1;
+}
+
+
+/**
+ *  \brief  Ranks the path by the match position - 0 is file name match, 1 is file name prefix match,
+ *          2 is file name substring match and 3 is match in the directory part
+ */
+unsigned FileIndex::rank(unsigned pathIdx, const char* pattern, unsigned len) const
+{
+    const char* pBase = _folded.data() + _baseOffsets[pathIdx];
+    const unsigned baseLen = _pathOffsets[pathIdx + 1] - 1 - _baseOffsets[pathIdx];
+
+    if (baseLen < len)
+        return 3;
+
+    if (!memcmp(pBase, pattern, len))
+        return (baseLen == len) ? 0 : 1;
+
+    if (std::search(pBase, pBase + baseLen, pattern, pattern + len) != pBase + baseLen)
+        return 2;
+
+    return 3;
+}
+
+} // namespace GTags
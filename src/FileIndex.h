@@ -0,0 +1,91 @@
+/**
+ *  \file
+ *  \brief  In-memory index of the database file names
+ *
+ *  \author  Pavel Nedev <pg.nedev@gmail.com>
+ *
+ *  \section COPYRIGHT
+ *  Copyright(C) 2015 Pavel Nedev
+ *
+ *  \section LICENSE
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+
+#include <windows.h>
+#include <tchar.h>
+#include <vector>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "Common.h"
+#include "AutoLock.h"
+
+
+namespace GTags
+{
+
+/**
+ *  \class  FileIndex
+ *  \brief  The database file list (as given by global -P) kept in memory with its ASCII case-folded copy
+ *          and the path components sorted for prefix lookup. Valid until GPATH changes.
+ */
+class FileIndex
+{
+public:
+    static std::shared_ptr<FileIndex> Get(const CPath& dbPath);
+    static std::shared_ptr<FileIndex> Create(const CPath& dbPath, const char* fileList);
+    static void Remove(const CPath& dbPath);
+
+    bool Find(const CTextA& pattern, bool regExp, bool matchCase, std::vector<char>& result) const;
+    void Complete(const CTextA& prefix, bool matchCase, std::vector<char>& result) const;
+
+private:
+    /**
+     *  \struct  CacheEntry
+     *  \brief
+     */
+    struct CacheEntry
+    {
+        std::shared_ptr<FileIndex>  _index;
+        FILETIME                    _pathTime;
+    };
+
+    static const TCHAR cPathFile[];
+
+    static Mutex CacheLock;
+    static std::unordered_map<std::basic_string<TCHAR>, CacheEntry> Cache;
+
+    static bool getPathTime(const CPath& dbPath, FILETIME& pathTime);
+
+    FileIndex(const char* fileList);
+    FileIndex(const FileIndex&) = delete;
+    FileIndex& operator=(const FileIndex&) = delete;
+
+    unsigned pathAt(unsigned offset) const;
+    unsigned rank(unsigned pathIdx, const char* pattern, unsigned len) const;
+
+    // Paths separated (and terminated) by '\n'
+    std::vector<char>       _paths;
+    std::vector<char>       _folded;
+    std::vector<unsigned>   _pathOffsets;
+    std::vector<unsigned>   _baseOffsets;
+
+    // Path component offsets sorted by the case-folded component
+    std::vector<unsigned>   _components;
+};
+
+} // namespace GTags
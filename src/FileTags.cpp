@@ -0,0 +1,351 @@
+/**
+ *  \file
+ *  \brief  In-memory tag snapshots of the open files
+ *
+ *  \author  Pavel Nedev <pg.nedev@gmail.com>
+ *
+ *  \section COPYRIGHT
+ *  Copyright(C) 2015 Pavel Nedev
+ *
+ *  \section LICENSE
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <string.h>
+#include "FileTags.h"
+#include "INpp.h"
+#include "Config.h"
+#include "Cmd.h"
+#include "ResultWin.h"
+
+
+namespace GTags
+{
+
+const unsigned FileTags::cMaxSnapshots = 16;
+
+std::list<FileTags::Snapshot> FileTags::Snapshots;
+BackgroundCmd FileTags::Fetch;
+
+
+/**
+ *  \brief  Parses one output line. Returns NULL at the end of the output.
+ *          Malformed lines give entry with empty name.
+ */
+const char* FileTags::ParseEntry(const char* pSrc, const CTextA& path, Entry& entry)
+{
+    while (*pSrc == '\n' || *pSrc == '\r')
+        ++pSrc;
+    if (*pSrc == 0)
+        return NULL;
+
+    entry._name     = pSrc;
+    entry._nameLen  = 0;
+    entry._line     = 0;
+    entry._image    = NULL;
+    entry._imageLen = 0;
+
+    while (*pSrc != ' ' && *pSrc != '\t' && *pSrc != '\n' && *pSrc != '\r' && *pSrc != 0)
+        ++pSrc;
+
+    const unsigned nameLen = pSrc - entry._name;
+
+    while (*pSrc == ' ' || *pSrc == '\t')
+        ++pSrc;
+
+    if (*pSrc >= '0' && *pSrc <= '9')
+    {
+        for (; *pSrc >= '0' && *pSrc <= '9'; ++pSrc)
+            entry._line = entry._line * 10 + (*pSrc - '0');
+
+        while (*pSrc == ' ' || *pSrc == '\t')
+            ++pSrc;
+
+        // The path may contain spaces - skip it by its known length if it is there as expected
+        if (!strncmp(pSrc, path.C_str(), path.Len()))
+            pSrc += path.Len();
+        else
+            while (*pSrc != ' ' && *pSrc != '\t' && *pSrc != '\n' && *pSrc != '\r' && *pSrc != 0)
+                ++pSrc;
+
+        while (*pSrc == ' ' || *pSrc == '\t')
+            ++pSrc;
+
+        entry._nameLen  = nameLen;
+        entry._image    = pSrc;
+    }
+
+    while (*pSrc != '\n' && *pSrc != '\r' && *pSrc != 0)
+        ++pSrc;
+
+    if (entry._image)
+        entry._imageLen = pSrc - entry._image;
+
+    return pSrc;
+}
+
+
+/**
+ *  \brief  Returns the file path as global expects it - relative to the database folder
+ */
+CText FileTags::RelativePath(const DbHandle& db, const CPath& file)
+{
+    if (!file.IsSubpathOf(db->GetPath()))
+        return file;
+
+    CText path(file.C_str() + db->GetPath().Len());
+
+    for (TCHAR* pCh = path.C_str(); *pCh; ++pCh)
+        if (*pCh == _T('\\'))
+            *pCh = _T('/');
+
+    return path;
+}
+
+
+/**
+ *  \brief  Fetches (in background) the tags of the activated file if they are not already in memory
+ */
+void FileTags::OnFileActivate()
+{
+    if (!GTagsSettings._fileTagSnapshots)
+        return;
+
+    CPath file;
+    INpp::Get().GetFilePath(file);
+
+    if (!file.FileExists())
+        return;
+
+    // No snapshot while the database is written - the file may not be indexed yet
+    bool success;
+    DbHandle db = DbManager::Get().GetDb(file, false, &success);
+    if (!db || !success)
+        return;
+
+    const CText path = RelativePath(db, file);
+
+    std::list<Snapshot>::iterator snapshot = find(db->GetPath(), path);
+    if (snapshot != Snapshots.end())
+    {
+        Snapshots.splice(Snapshots.begin(), Snapshots, snapshot);
+        DbManager::Get().PutDb(db);
+        return;
+    }
+
+    const CmdPtr_t& pending = Fetch.Pending();
+    if (pending && pending->Db() == db && pending->Tag() == path)
+    {
+        DbManager::Get().PutDb(db);
+        return;
+    }
+
+    CmdPtr_t cmd(new Cmd(FILE_TAGS, NULL, db, ParserPtr_t(), path.C_str()));
+    Fetch.Run(cmd, fetchCB);
+}
+
+
+/**
+ *  \brief  Drops the outdated snapshot of the file just updated in the database.
+ *          Refetches it if it is the active file.
+ */
+void FileTags::OnFileUpdate(const CPath& file)
+{
+    const PathKey fileKey(file);
+
+    for (std::list<Snapshot>::iterator snapshot = Snapshots.begin(); snapshot != Snapshots.end(); ++snapshot)
+    {
+        if (snapshot->_path == fileKey)
+        {
+            Snapshots.erase(snapshot);
+            break;
+        }
+    }
+
+    CPath currentFile;
+    INpp::Get().GetFilePath(currentFile);
+
+    if (PathKey(currentFile) == fileKey)
+        OnFileActivate();
+}
+
+
+/**
+ *  \brief  The active file tags are fetched again on its next activation
+ */
+void FileTags::Cancel()
+{
+    Fetch.Cancel();
+}
+
+
+/**
+ *  \brief
+ */
+void FileTags::Clear()
+{
+    Cancel();
+    Snapshots.clear();
+}
+
+
+/**
+ *  \brief  Keeps the global -f output of the command as snapshot of its file
+ */
+void FileTags::Store(const CmdPtr_t& cmd)
+{
+    if (cmd->Id() != FILE_TAGS || (cmd->Status() != OK && cmd->Status() != PARSE_EMPTY))
+        return;
+
+    std::list<Snapshot>::iterator snapshot = find(cmd->Db()->GetPath(), cmd->Tag());
+    if (snapshot != Snapshots.end())
+        Snapshots.erase(snapshot);
+
+    Snapshots.emplace_front();
+
+    Snapshot& newSnapshot = Snapshots.front();
+    newSnapshot._dbPath = cmd->Db()->GetPath();
+    newSnapshot._file   = cmd->Tag();
+
+    CPath filePath(newSnapshot._dbPath);
+    filePath += newSnapshot._file;
+    newSnapshot._path = PathKey(filePath);
+
+    if (cmd->Result())
+        newSnapshot._raw.assign(cmd->Result(), cmd->Result() + cmd->ResultLen() + 1);
+    else
+        newSnapshot._raw.push_back(0);
+
+    const CTextA path(cmd->Tag().C_str());
+    Entry entry;
+
+    for (const char* pSrc = newSnapshot._raw.data(); (pSrc = ParseEntry(pSrc, path, entry)) != NULL;)
+        if (entry._nameLen)
+            newSnapshot._entries.push_back(entry);
+
+    if (Snapshots.size() > cMaxSnapshots)
+        Snapshots.pop_back();
+}
+
+
+/**
+ *  \brief  Sets the command result from the file snapshot and parses it.
+ *          Returns false if there is no snapshot - the command has to be run.
+ */
+bool FileTags::Load(const CmdPtr_t& cmd)
+{
+    std::list<Snapshot>::iterator snapshot = find(cmd->Db()->GetPath(), cmd->Tag());
+    if (snapshot == Snapshots.end())
+        return false;
+
+    Snapshots.splice(Snapshots.begin(), Snapshots, snapshot);
+
+    cmd->SetResult(snapshot->_raw);
+
+    const int parsedEntries = cmd->Parser() ? cmd->Parser()->Parse(cmd) : 1;
+
+    if (parsedEntries < 0)
+        cmd->Status(PARSE_ERROR);
+    else if (parsedEntries == 0)
+        cmd->Status(PARSE_EMPTY);
+    else
+        cmd->Status(OK);
+
+    return true;
+}
+
+
+/**
+ *  \brief  Returns the parsed definition search result if the tag is defined in the active file,
+ *          NULL otherwise. It has the active file definitions only - the full search has to be run as well.
+ */
+CmdPtr_t FileTags::FindDefinition(const DbHandle& db, const CText& tag, const TCHAR* name)
+{
+    CPath file;
+    INpp::Get().GetFilePath(file);
+
+    if (!file.IsSubpathOf(db->GetPath()))
+        return CmdPtr_t();
+
+    const CText path = RelativePath(db, file);
+
+    std::list<Snapshot>::iterator snapshot = find(db->GetPath(), path);
+    if (snapshot == Snapshots.end())
+        return CmdPtr_t();
+
+    const CTextA tagA(tag.C_str());
+    const CTextA pathA(path.C_str());
+
+    // Compose the result as global --result=grep would
+    CTextA result;
+    char lineNum[16];
+
+    for (const auto& entry : snapshot->_entries)
+    {
+        if (entry._nameLen != tagA.Len() || strncmp(entry._name, tagA.C_str(), entry._nameLen))
+            continue;
+
+        _itoa_s(entry._line, lineNum, _countof(lineNum), 10);
+
+        result += pathA;
+        result += ':';
+        result += lineNum;
+        result += ':';
+        result.Append(entry._image, entry._imageLen);
+        result += '\n';
+    }
+
+    if (result.IsEmpty())
+        return CmdPtr_t();
+
+    ParserPtr_t parser(new ResultWin::TabParser);
+    CmdPtr_t cmd(new Cmd(FIND_DEFINITION, name, db, parser, tag.C_str()));
+    cmd->SetResult(result);
+
+    if (parser->Parse(cmd) <= 0)
+        return CmdPtr_t();
+
+    cmd->Status(OK);
+
+    return cmd;
+}
+
+
+/**
+ *  \brief
+ */
+void FileTags::fetchCB(const CmdPtr_t& cmd)
+{
+    if (Fetch.Complete(cmd))
+        Store(cmd);
+}
+
+
+/**
+ *  \brief
+ */
+std::list<FileTags::Snapshot>::iterator FileTags::find(const CPath& dbPath, const CText& file)
+{
+    std::list<Snapshot>::iterator snapshot;
+
+    for (snapshot = Snapshots.begin(); snapshot != Snapshots.end(); ++snapshot)
+    {
+        if (snapshot->_file == file && snapshot->_dbPath == dbPath)
+            break;
+    }
+
+    return snapshot;
+}
+
+} // namespace GTags
@@ -0,0 +1,97 @@
+/**
+ *  \file
+ *  \brief  In-memory tag snapshots of the open files
+ *
+ *  \author  Pavel Nedev <pg.nedev@gmail.com>
+ *
+ *  \section COPYRIGHT
+ *  Copyright(C) 2015 Pavel Nedev
+ *
+ *  \section LICENSE
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+
+#include <windows.h>
+#include <tchar.h>
+#include <vector>
+#include <list>
+#include "Common.h"
+#include "CmdDefines.h"
+#include "DbManager.h"
+#include "BackgroundCmd.h"
+
+
+namespace GTags
+{
+
+/**
+ *  \class  FileTags
+ *  \brief  Keeps the tags of the recently activated files (global -f) so definitions in the same file are
+ *          shown before the full search is done and the file symbols list is served without running global
+ */
+class FileTags
+{
+public:
+    /**
+     *  \struct  Entry
+     *  \brief  One line of global -f (ctags-x format) output: "tag line path image"
+     */
+    struct Entry
+    {
+        const char* _name;
+        unsigned    _nameLen;
+        unsigned    _line;
+        const char* _image;
+        unsigned    _imageLen;
+    };
+
+    static const char* ParseEntry(const char* pSrc, const CTextA& path, Entry& entry);
+    static CText RelativePath(const DbHandle& db, const CPath& file);
+
+    static void OnFileActivate();
+    static void OnFileUpdate(const CPath& file);
+    static void Cancel();
+    static void Clear();
+
+    static void Store(const CmdPtr_t& cmd);
+    static bool Load(const CmdPtr_t& cmd);
+    static CmdPtr_t FindDefinition(const DbHandle& db, const CText& tag, const TCHAR* name);
+
+private:
+    /**
+     *  \struct  Snapshot
+     *  \brief  The entries point into the raw output so snapshots are built in place and never copied
+     */
+    struct Snapshot
+    {
+        CPath               _dbPath;
+        CText               _file;
+        PathKey             _path;
+        std::vector<char>   _raw;
+        std::vector<Entry>  _entries;
+    };
+
+    static const unsigned   cMaxSnapshots;
+
+    static std::list<Snapshot>  Snapshots;
+    static BackgroundCmd        Fetch;
+
+    static void fetchCB(const CmdPtr_t& cmd);
+    static std::list<Snapshot>::iterator find(const CPath& dbPath, const CText& file);
+};
+
+} // namespace GTags
@@ -0,0 +1,355 @@
+/**
+ *  \file
+ *  \brief  Fuzzy subsequence matcher for the completion lists
+ *
+ *  \author  Pavel Nedev <pg.nedev@gmail.com>
+ *
+ *  \section COPYRIGHT
+ *  Copyright(C) 2015 Pavel Nedev
+ *
+ *  \section LICENSE
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include "FuzzyMatcher.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define FUZZY_SSE2
+#include <emmintrin.h>
+#endif
+
+
+namespace
+{
+
+const int cMatch        = 16;
+const int cBoundary     = 8;
+const int cConsecutive  = 4;
+const int cSameCase     = 1;
+const int cGapStart     = -3;
+const int cGapExtension = -1;
+
+
+/**
+ *  \brief
+ */
+inline char toLowerAscii(char ch)
+{
+    return (ch >= 'A' && ch <= 'Z') ? ch + ('a' - 'A') : ch;
+}
+
+
+/**
+ *  \brief
+ */
+inline bool isLower(char ch)
+{
+    return (ch >= 'a' && ch <= 'z');
+}
+
+
+/**
+ *  \brief
+ */
+inline bool isUpper(char ch)
+{
+    return (ch >= 'A' && ch <= 'Z');
+}
+
+
+/**
+ *  \brief
+ */
+inline bool isDigit(char ch)
+{
+    return (ch >= '0' && ch <= '9');
+}
+
+
+/**
+ *  \brief  Multi-byte (non-ASCII) characters are treated as word characters
+ */
+inline bool isWordChar(char ch)
+{
+    return (isLower(ch) || isUpper(ch) || isDigit(ch) || (unsigned char)ch >= 0x80);
+}
+
+
+/**
+ *  \brief  Checks if a word starts at the position - string start, after a separator,
+ *          a camelCase hump or a letter-digit transition
+ */
+inline bool isBoundary(const char* str, unsigned pos)
+{
+    if (pos == 0)
+        return true;
+
+    const char prev = str[pos - 1];
+    const char cur = str[pos];
+
+    return ((!isWordChar(prev) && isWordChar(cur)) || (isLower(prev) && isUpper(cur)) ||
+            (!isDigit(prev) && isDigit(cur)));
+}
+
+
+/**
+ *  \brief
+ */
+inline bool isEqual(char lhs, char rhs, bool matchCase)
+{
+    return matchCase ? (lhs == rhs) : (toLowerAscii(lhs) == toLowerAscii(rhs));
+}
+
+} // anonymous namespace
+
+
+namespace GTags
+{
+
+const unsigned FuzzyMatcher::cMaxMatches = 1000;
+
+
+/**
+ *  \brief
+ */
+FuzzyMatcher::FuzzyMatcher(const std::vector<char*>& candidates) : _candidates(candidates)
+{
+    _masks.resize(_candidates.size());
+    _lens.resize(_candidates.size());
+
+    for (unsigned i = 0; i < _candidates.size(); ++i)
+        _masks[i] = charMask(_candidates[i], &_lens[i]);
+}
+
+
+/**
+ *  \brief  Gives the best matching candidates, best first
+ */
+void FuzzyMatcher::Match(const char* pattern, bool matchCase, std::vector<const char*>& matches) const
+{
+    matches.clear();
+
+    unsigned patternLen;
+    const unsigned long long mask = charMask(pattern, &patternLen);
+
+    if (patternLen == 0)
+    {
+        const unsigned count = std::min<unsigned>(_candidates.size(), cMaxMatches);
+        matches.assign(_candidates.begin(), _candidates.begin() + count);
+        return;
+    }
+
+    std::vector<unsigned> passed;
+    prefilter(mask, passed);
+
+    std::vector<Scored> scored;
+    scored.reserve(passed.size());
+
+    for (unsigned idx : passed)
+    {
+        Scored entry;
+        entry._idx = idx;
+
+        if (score(pattern, patternLen, _candidates[idx], _lens[idx], matchCase, entry._score))
+            scored.push_back(entry);
+    }
+
+    const std::vector<unsigned>& lens = _lens;
+
+    auto isBetter = [&lens](const Scored& lhs, const Scored& rhs)
+    {
+        if (lhs._score != rhs._score)
+            return lhs._score > rhs._score;
+        if (lens[lhs._idx] != lens[rhs._idx])
+            return lens[lhs._idx] < lens[rhs._idx];
+        return lhs._idx < rhs._idx;
+    };
+
+    if (scored.size() > cMaxMatches)
+    {
+        std::partial_sort(scored.begin(), scored.begin() + cMaxMatches, scored.end(), isBetter);
+        scored.resize(cMaxMatches);
+    }
+    else
+    {
+        std::sort(scored.begin(), scored.end(), isBetter);
+    }
+
+    matches.reserve(scored.size());
+
+    for (const auto& entry : scored)
+        matches.push_back(_candidates[entry._idx]);
+}
+
+
+/**
+ *  \brief  Sets a bit per (ASCII case-folded) character - letters, digits and '_' have their own bits,
+ *          the rest share the remaining ones
+ */
+unsigned long long FuzzyMatcher::charMask(const char* str, unsigned* len)
+{
+    unsigned long long mask = 0;
+    const char* pCh = str;
+
+    for (; *pCh; ++pCh)
+    {
+        const char ch = toLowerAscii(*pCh);
+        unsigned bit;
+
+        if (isLower(ch))
+            bit = ch - 'a';
+        else if (isDigit(ch))
+            bit = 26 + (ch - '0');
+        else if (ch == '_')
+            bit = 36;
+        else
+            bit = 37 + (unsigned char)ch % 27;
+
+        mask |= 1ULL << bit;
+    }
+
+    if (len)
+        *len = pCh - str;
+
+    return mask;
+}
+
+
+/**
+ *  \brief  Scores the shortest match span ending at the first complete match.
+ *          Returns false if the string doesn't contain the pattern characters in order.
+ */
+bool FuzzyMatcher::score(const char* pattern, unsigned patternLen, const char* str, unsigned len,
+        bool matchCase, int& result)
+{
+    unsigned patternIdx = 0;
+    unsigned start = 0;
+    unsigned end = 0;
+
+    for (unsigned i = 0; i < len; ++i)
+    {
+        if (isEqual(str[i], pattern[patternIdx], matchCase))
+        {
+            if (patternIdx == 0)
+                start = i;
+
+            if (++patternIdx == patternLen)
+            {
+                end = i + 1;
+                break;
+            }
+        }
+    }
+
+    if (patternIdx < patternLen)
+        return false;
+
+    // Walk back from the match end to find the latest possible start
+    for (unsigned i = end; i-- > start;)
+    {
+        if (isEqual(str[i], pattern[patternIdx - 1], matchCase))
+        {
+            if (--patternIdx == 0)
+            {
+                start = i;
+                break;
+            }
+        }
+    }
+
+    result = 0;
+    patternIdx = 0;
+
+    bool inGap = false;
+    unsigned lastMatch = start;
+    int runBonus = 0;
+
+    for (unsigned i = start; i < end; ++i)
+    {
+        if (patternIdx < patternLen && isEqual(str[i], pattern[patternIdx], matchCase))
+        {
+            int charScore = cMatch;
+
+            // Consecutive matches keep the bonus of the run start so whole matched words rank high
+            if (isBoundary(str, i))
+                runBonus = (i == 0) ? 2 * cBoundary : cBoundary;
+            else if (patternIdx > 0 && lastMatch + 1 == i)
+                runBonus = std::max(runBonus, cConsecutive);
+            else
+                runBonus = 0;
+
+            charScore += runBonus;
+
+            if (str[i] == pattern[patternIdx])
+                charScore += cSameCase;
+
+            result += charScore;
+            lastMatch = i;
+            inGap = false;
+            ++patternIdx;
+        }
+        else
+        {
+            result += inGap ? cGapExtension : cGapStart;
+            inGap = true;
+        }
+    }
+
+    // Matches nearer the name start are preferred
+    result -= std::min<int>(start, cMatch);
+
+    return true;
+}
+
+
+/**
+ *  \brief  Collects the candidates having all the pattern character bits
+ */
+void FuzzyMatcher::prefilter(unsigned long long mask, std::vector<unsigned>& passed) const
+{
+    const unsigned count = _masks.size();
+    unsigned i = 0;
+
+#ifdef FUZZY_SSE2
+    const __m128i patternMask = _mm_set_epi32((int)(mask >> 32), (int)mask, (int)(mask >> 32), (int)mask);
+
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128i masks01 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&_masks[i]));
+        const __m128i masks23 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&_masks[i + 2]));
+
+        const int eq01 = _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(masks01, patternMask), patternMask));
+        const int eq23 = _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(masks23, patternMask), patternMask));
+
+        if ((eq01 | eq23) == 0)
+            continue;
+
+        if ((eq01 & 0x00FF) == 0x00FF)
+            passed.push_back(i);
+        if ((eq01 & 0xFF00) == 0xFF00)
+            passed.push_back(i + 1);
+        if ((eq23 & 0x00FF) == 0x00FF)
+            passed.push_back(i + 2);
+        if ((eq23 & 0xFF00) == 0xFF00)
+            passed.push_back(i + 3);
+    }
+#endif
+
+    for (; i < count; ++i)
+        if ((_masks[i] & mask) == mask)
+            passed.push_back(i);
+}
+
+} // namespace GTags
@@ -0,0 +1,75 @@
+/**
+ *  \file
+ *  \brief  Fuzzy subsequence matcher for the completion lists
+ *
+ *  \author  Pavel Nedev <pg.nedev@gmail.com>
+ *
+ *  \section COPYRIGHT
+ *  Copyright(C) 2015 Pavel Nedev
+ *
+ *  \section LICENSE
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+
+#include <windows.h>
+#include <tchar.h>
+#include <vector>
+
+
+namespace GTags
+{
+
+/**
+ *  \class  FuzzyMatcher
+ *  \brief  Ranks the completion candidates containing the pattern characters in order, favouring matches
+ *          at word boundaries (camelCase humps, after '_' and other separators) and consecutive matches.
+ *          Candidates are prefiltered by character bitmasks computed once for the whole list.
+ */
+class FuzzyMatcher
+{
+public:
+    FuzzyMatcher(const std::vector<char*>& candidates);
+    FuzzyMatcher(const FuzzyMatcher&) = delete;
+    FuzzyMatcher& operator=(const FuzzyMatcher&) = delete;
+
+    void Match(const char* pattern, bool matchCase, std::vector<const char*>& matches) const;
+
+private:
+    /**
+     *  \struct  Scored
+     *  \brief
+     */
+    struct Scored
+    {
+        int         _score;
+        unsigned    _idx;
+    };
+
+    static const unsigned   cMaxMatches;
+
+    static unsigned long long charMask(const char* str, unsigned* len = NULL);
+    static bool score(const char* pattern, unsigned patternLen, const char* str, unsigned len, bool matchCase,
+            int& result);
+
+    void prefilter(unsigned long long mask, std::vector<unsigned>& passed) const;
+
+    const std::vector<char*>&      _candidates;
+    std::vector<unsigned long long> _masks;
+    std::vector<unsigned>           _lens;
+};
+
+} // namespace GTags
@@ -32,6 +32,10 @@
 #include "DbManager.h"
 #include "Cmd.h"
 #include "CmdEngine.h"
+#include "SpeculativeFind.h"
+#include "Prefetcher.h"
+#include "FileTags.h"
+#include "PipeReactor.h"
 #include "DocLocation.h"
 #include "SearchWin.h"
 #include "ActivityWin.h"
@@ -55,9 +59,9 @@ const TCHAR cAutoComplFile[]    = _T("AutoComplete File Name");
 const TCHAR cFindFile[]         = _T("Find File");
 const TCHAR cFindDefinition[]   = _T("Find Definition");
 const TCHAR cFindReference[]    = _T("Find Reference");
-const TCHAR cFindSymbol[]       = _T("Find Symbol");
 const TCHAR cSearchSrc[]        = _T("Search in Source Files");
 const TCHAR cSearchOther[]      = _T("Search in Other Files");
+const TCHAR cFileSymbols[]      = _T("Symbols in This File");
 const TCHAR cVersion[]          = _T("About");
 
 
@@ -152,6 +156,10 @@ CText getSelection(HWND hSci = NULL, bool skipPreSelect = false,
  */
 DbHandle getDatabase(bool writeEn = false)
 {
+    // Interactive command - don't let a prefetch or a file tags fetch compete with it
+    Prefetcher::Cancel();
+    FileTags::Cancel();
+
     INpp& npp = INpp::Get();
     bool success;
     CPath currentFile;
@@ -213,51 +221,33 @@ DbHandle getDatabaseAt(const CPath& dbPath)
 
 
 /**
- *  \brief
+ *  \brief  Fuzzy completion queries the names starting with the word first letter (case insensitive) only.
+ *          The query output stays bounded - the matcher filters them further.
  */
-void autoComplCB(const CmdPtr_t& cmd)
+void fuzzyComplTag(CText& tag)
 {
-    DbManager::Get().PutDb(cmd->Db());
-
-    if (cmd->Status() == OK && cmd->Result())
-    {
-        AutoCompleteWin::Show(cmd);
+    if (!GTagsSettings._fuzzyCompletion)
         return;
-    }
-
-    INpp::Get().ClearSelection();
 
-    if (cmd->Status() == FAILED)
-    {
-        CText msg(cmd->Result());
-        msg += _T("\nTry re-creating database.");
-        MessageBox(INpp::Get().GetHandle(), msg.C_str(), cmd->Name(), MB_OK | MB_ICONEXCLAMATION);
-    }
-    else if (cmd->Status() == RUN_ERROR)
-    {
-        MessageBox(INpp::Get().GetHandle(), _T("Running GTags failed"), cmd->Name(), MB_OK | MB_ICONERROR);
-    }
+    const TCHAR first = tag.C_str()[0];
+    tag.Clear();
+    tag += first;
 }
 
 
 /**
  *  \brief
  */
-void halfComplCB(const CmdPtr_t& cmd)
+void autoComplCB(const CmdPtr_t& cmd)
 {
-    if (cmd->Status() == OK)
-    {
-        cmd->Id(AUTOCOMPLETE_SYMBOL);
-
-        ParserPtr_t parser(new LineParser);
-        cmd->Parser(parser);
+    DbManager::Get().PutDb(cmd->Db());
 
-        CmdEngine::Run(cmd, autoComplCB);
+    if (cmd->Status() == OK && cmd->Result())
+    {
+        AutoCompleteWin::Show(cmd);
         return;
     }
 
-    DbManager::Get().PutDb(cmd->Db());
-
     INpp::Get().ClearSelection();
 
     if (cmd->Status() == FAILED)
@@ -282,7 +272,7 @@ void showResultCB(const CmdPtr_t& cmd)
 
     if (cmd->Status() == OK || cmd->Status() == PARSE_EMPTY)
     {
-        if (cmd->Result() && cmd->Status() == OK)
+        if (cmd->HasResult() && cmd->Status() == OK)
         {
             ResultWin::Show(cmd);
         }
@@ -315,19 +305,10 @@ void showResultCB(const CmdPtr_t& cmd)
 /**
  *  \brief
  */
-void findCB(const CmdPtr_t& cmd)
+void fileSymbolsCB(const CmdPtr_t& cmd)
 {
-    if (cmd->Status() == OK && cmd->Result() == NULL)
-    {
-        cmd->Id(FIND_SYMBOL);
-        cmd->Name(cFindSymbol);
-
-        CmdEngine::Run(cmd, showResultCB);
-    }
-    else
-    {
-        showResultCB(cmd);
-    }
+    FileTags::Store(cmd);
+    showResultCB(cmd);
 }
 
 
@@ -336,6 +317,10 @@ void findCB(const CmdPtr_t& cmd)
  */
 void dbWriteCB(const CmdPtr_t& cmd)
 {
+    // The whole database is re-created
+    Prefetcher::Clear();
+    FileTags::Clear();
+
     if (cmd->Status() != OK)
         DbManager::Get().UnregisterDb(cmd->Db());
     else
@@ -361,7 +346,7 @@ void aboutCB(const CmdPtr_t& cmd)
     if (cmd->Status() != OK)
     {
         const CTextA txt("\nVERSION READ FAILED\n\n");
-        cmd->AppendToResult(txt.Vector());
+        cmd->AppendToResult(txt);
     }
 
 	const CText msg = cmd->Result();
@@ -378,11 +363,11 @@ void halfAboutCB(const CmdPtr_t& cmd)
     if (cmd->Status() != OK)
     {
         const CTextA txt("VERSION READ FAILED\n");
-        cmd->SetResult(txt.Vector());
+        cmd->SetResult(txt);
     }
 
     const CTextA txt("\nCurrent Ctags parser version:\n\n");
-    cmd->AppendToResult(txt.Vector());
+    cmd->AppendToResult(txt);
 
     cmd->Id(CTAGS_VERSION);
     CmdEngine::Run(cmd, aboutCB);
@@ -402,9 +387,13 @@ void AutoComplete()
     if (!db)
         return;
 
-    CmdPtr_t cmd(new Cmd(AUTOCOMPLETE, cAutoCompl, db, NULL, tag.C_str()));
+    fuzzyComplTag(tag);
+
+    ParserPtr_t parser(new LineParser);
+    CmdPtr_t cmd(new Cmd(AUTOCOMPLETE, cAutoCompl, db, parser, tag.C_str(), false,
+            !GTagsSettings._fuzzyCompletion));
 
-    CmdEngine::Run(cmd, halfComplCB);
+    CmdEngine::Run(cmd, autoComplCB);
 }
 
 
@@ -417,6 +406,8 @@ void AutoCompleteFile()
     if (tag.IsEmpty())
         return;
 
+    fuzzyComplTag(tag);
+
     tag.Insert(0, _T('/'));
 
     DbHandle db = getDatabase();
@@ -424,7 +415,8 @@ void AutoCompleteFile()
         return;
 
     ParserPtr_t parser(new LineParser);
-    CmdPtr_t cmd(new Cmd(AUTOCOMPLETE_FILE, cAutoComplFile, db, parser, tag.C_str()));
+    CmdPtr_t cmd(new Cmd(AUTOCOMPLETE_FILE, cAutoComplFile, db, parser, tag.C_str(), false,
+            !GTagsSettings._fuzzyCompletion));
 
     CmdEngine::Run(cmd, autoComplCB);
 }
@@ -450,6 +442,7 @@ void FindFile()
 
     ParserPtr_t parser(new ResultWin::TabParser);
     CmdPtr_t cmd(new Cmd(FIND_FILE, cFindFile, db, parser));
+    cmd->LiveResults(true);
 
     CText tag = getSelection(rwHSci, false, DONT_SELECT);
     if (tag.IsEmpty())
@@ -491,12 +484,26 @@ void FindDefinition()
     CText tag = getSelection(rwHSci);
     if (tag.IsEmpty())
     {
-        SearchWin::Show(cmd, findCB, false);
+        SearchWin::Show(cmd, showResultCB, false);
+        return;
+    }
+
+    // Definitions in the active file are shown right away - the full search (other files and library databases)
+    // still runs and its results replace them in the same tab
+    CmdPtr_t local = rwHSci ? CmdPtr_t() : FileTags::FindDefinition(db, tag, cFindDefinition);
+    if (local)
+        ResultWin::Show(local);
+
+    // The definition may already be prefetched (it has the same DB handle so it releases our lock)
+    CmdPtr_t prefetched = Prefetcher::Take(db, tag);
+    if (prefetched)
+    {
+        showResultCB(prefetched);
     }
     else
     {
         cmd->Tag(tag);
-        CmdEngine::Run(cmd, findCB);
+        SpeculativeFind::Run(cmd, showResultCB);
     }
 }
 
@@ -531,16 +538,17 @@ void FindReference()
 
     ParserPtr_t parser(new ResultWin::TabParser);
     CmdPtr_t cmd(new Cmd(FIND_REFERENCE, cFindReference, db, parser));
+    cmd->LiveResults(true);
 
     CText tag = getSelection(rwHSci);
     if (tag.IsEmpty())
     {
-        SearchWin::Show(cmd, findCB, false);
+        SearchWin::Show(cmd, showResultCB, false);
     }
     else
     {
         cmd->Tag(tag);
-        CmdEngine::Run(cmd, findCB);
+        SpeculativeFind::Run(cmd, showResultCB);
     }
 }
 
@@ -565,6 +573,7 @@ void SearchSrc()
 
     ParserPtr_t parser(new ResultWin::TabParser);
     CmdPtr_t cmd(new Cmd(GREP, cSearchSrc, db, parser));
+    cmd->LiveResults(true);
 
     CText tag = getSelection(rwHSci);
     if (tag.IsEmpty())
@@ -599,6 +608,7 @@ void SearchOther()
 
     ParserPtr_t parser(new ResultWin::TabParser);
     CmdPtr_t cmd(new Cmd(GREP_TEXT, cSearchOther, db, parser));
+    cmd->LiveResults(true);
 
     CText tag = getSelection(rwHSci);
     if (tag.IsEmpty())
@@ -613,6 +623,30 @@ void SearchOther()
 }
 
 
+/**
+ *  \brief
+ */
+void FileSymbols()
+{
+    SearchWin::Close();
+
+    DbHandle db = getDatabase();
+    if (!db)
+        return;
+
+    CPath file;
+    INpp::Get().GetFilePath(file);
+
+    ParserPtr_t parser(new ResultWin::TabParser);
+    CmdPtr_t cmd(new Cmd(FILE_TAGS, cFileSymbols, db, parser, FileTags::RelativePath(db, file).C_str()));
+
+    if (FileTags::Load(cmd))
+        showResultCB(cmd);
+    else
+        CmdEngine::Run(cmd, fileSymbolsCB);
+}
+
+
 /**
  *  \brief
  */
@@ -701,6 +735,9 @@ void DeleteDatabase()
         return;
     }
 
+    Prefetcher::Clear();
+    FileTags::Clear();
+
     if (DbManager::Get().UnregisterDb(db))
         MessageBox(npp.GetHandle(), _T("GTags database deleted"), cPluginName, MB_OK | MB_ICONINFORMATION);
     else
@@ -764,7 +801,7 @@ void About()
 namespace GTags
 {
 
-FuncItem Menu[19] = {
+FuncItem Menu[20] = {
     /* 0 */  FuncItem(cAutoCompl, AutoComplete),
     /* 1 */  FuncItem(cAutoComplFile, AutoCompleteFile),
     /* 2 */  FuncItem(cFindFile, FindFile),
@@ -783,7 +820,8 @@ FuncItem Menu[19] = {
     /* 15 */ FuncItem(),
     /* 16 */ FuncItem(_T("Settings..."), SettingsCfg),
     /* 17 */ FuncItem(),
-    /* 18 */ FuncItem(_T("About..."), About)
+    /* 18 */ FuncItem(_T("About..."), About),
+    /* 19 */ FuncItem(cFileSymbols, FileSymbols)
 };
 
 HINSTANCE HMod = NULL;
@@ -832,6 +870,8 @@ void PluginInit()
     const HRESULT coInitRes = CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
     DeInitCOM = (coInitRes == S_OK || coInitRes == S_FALSE) ? true : false;
 
+    CmdEngine::Init();
+
     ActivityWin::Register();
     SearchWin::Register();
     AutoCompleteWin::Register();
@@ -860,6 +900,11 @@ void PluginDeInit()
     AutoCompleteWin::Unregister();
     ResultWin::Unregister();
 
+    Prefetcher::Clear();
+    FileTags::Clear();
+    PipeReactor::Get().Stop();
+    CmdEngine::DeInit();
+
     if (DeInitCOM)
     {
         DeInitCOM = false;
@@ -893,6 +938,12 @@ void OnFileChangeCancel()
  */
 void OnFileChange(const CPath& file)
 {
+    // Prefetched results may be outdated
+    Prefetcher::Clear();
+
+    // The database is about to be updated - the active file tags are refetched after that
+    FileTags::Cancel();
+
     CPath path(file);
 
     while (path.DirUp())
@@ -950,4 +1001,22 @@ void OnFileDelete(const CPath& file)
     }
 }
 
+
+/**
+ *  \brief
+ */
+void OnFileActivate()
+{
+    FileTags::OnFileActivate();
+}
+
+
+/**
+ *  \brief
+ */
+void OnCaretMove()
+{
+    Prefetcher::OnCaretMove();
+}
+
 } // namespace GTags
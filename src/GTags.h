@@ -47,10 +47,12 @@ enum PluginWinMessages_t
 {
     WM_RUN_CMD_CALLBACK = WM_USER,
     WM_OPEN_ACTIVITY_WIN,
-    WM_CLOSE_ACTIVITY_WIN
+    WM_UPDATE_ACTIVITY_WIN,
+    WM_CLOSE_ACTIVITY_WIN,
+    WM_UPDATE_RESULT_WIN
 };
 
-extern FuncItem     Menu[19];
+extern FuncItem     Menu[20];
 
 extern HINSTANCE    HMod;
 extern CPath        DllPath;
@@ -74,5 +76,7 @@ void OnFileChangeCancel();
 void OnFileChange(const CPath& file);
 void OnFileRename(const CPath& file);
 void OnFileDelete(const CPath& file);
+void OnFileActivate();
+void OnCaretMove();
 
 } // namespace GTags
@@ -0,0 +1,549 @@
+/**
+ *  \file
+ *  \brief  In-process multi-threaded search in the database files
+ *
+ *  \author  Pavel Nedev <pg.nedev@gmail.com>
+ *
+ *  \section COPYRIGHT
+ *  Copyright(C) 2015 Pavel Nedev
+ *
+ *  \section LICENSE
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <process.h>
+#include <string.h>
+#include <algorithm>
+#include <intrin.h>
+#include "GrepEngine.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define GREP_SSE2
+#include <emmintrin.h>
+#endif
+
+
+namespace
+{
+
+/**
+ *  \brief
+ */
+inline char toLowerAscii(char ch)
+{
+    return (ch >= 'A' && ch <= 'Z') ? ch + ('a' - 'A') : ch;
+}
+
+
+/**
+ *  \brief
+ */
+inline char toUpperAscii(char ch)
+{
+    return (ch >= 'a' && ch <= 'z') ? ch - ('a' - 'A') : ch;
+}
+
+} // anonymous namespace
+
+
+namespace GTags
+{
+
+const unsigned GrepEngine::cMaxThreads      = 16;
+const unsigned GrepEngine::cMaxFileSize     = 256 * 1024 * 1024;
+const unsigned GrepEngine::cBinaryCheckLen  = 8000;
+
+// The std::regex matchers recurse (libstdc++ per character) and can run out of stack on very long lines
+const unsigned GrepEngine::cMaxRegExpLineLen = 4096;
+
+
+/**
+ *  \brief
+ */
+GrepEngine::GrepEngine(const CPath& root, const CTextA& pattern, bool regExp, bool matchCase) :
+    _root(root), _pattern(pattern), _regExp(regExp), _matchCase(matchCase), _valid(true),
+    _listener(NULL), _fed(0), _next(0), _running(0), _failed(0), _stop(false)
+{
+    _hDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+    if (_hDone == NULL || _pattern.IsEmpty())
+    {
+        _valid = false;
+        return;
+    }
+
+    if (_regExp)
+    {
+        // global uses POSIX extended regular expressions
+        std::regex::flag_type flags = std::regex::extended | std::regex::nosubs | std::regex::optimize;
+        if (!_matchCase)
+            flags |= std::regex::icase;
+
+        try
+        {
+            _re.assign(_pattern.C_str(), flags);
+        }
+        catch (const std::regex_error&)
+        {
+            _valid = false;
+            _error = "Invalid regular expression";
+        }
+
+        return;
+    }
+
+    if (!_matchCase)
+    {
+        for (char* pCh = _pattern.C_str(); *pCh; ++pCh)
+            *pCh = toLowerAscii(*pCh);
+    }
+
+    const char first = _pattern.C_str()[0];
+    const char last = _pattern.C_str()[_pattern.Len() - 1];
+
+    _first[0] = first;
+    _first[1] = _matchCase ? first : toUpperAscii(first);
+    _last[0] = last;
+    _last[1] = _matchCase ? last : toUpperAscii(last);
+}
+
+
+/**
+ *  \brief
+ */
+GrepEngine::~GrepEngine()
+{
+    Stop();
+
+    if (_hDone)
+        CloseHandle(_hDone);
+}
+
+
+/**
+ *  \brief  Starts searching the listed files (one relative path per line).
+ *          DoneEvent() is signaled when all files are searched.
+ */
+bool GrepEngine::Start(const char* fileList, const DbConfig& cfg, bool background)
+{
+    if (!_valid)
+        return false;
+
+    for (const char* pSrc = fileList; pSrc && *pSrc;)
+    {
+        while (*pSrc == '\n' || *pSrc == '\r')
+            ++pSrc;
+        if (*pSrc == 0)
+            break;
+
+        const char* pEol = pSrc;
+        while (*pEol != '\n' && *pEol != '\r' && *pEol != 0)
+            ++pEol;
+
+        if (!isFiltered(cfg, pSrc, pEol - pSrc))
+        {
+            _files.push_back(CTextA());
+            _files.back().Append(pSrc, pEol - pSrc);
+        }
+
+        pSrc = pEol;
+    }
+
+    _results.resize(_files.size());
+    _searched.resize(_files.size(), false);
+
+    if (_files.empty())
+    {
+        SetEvent(_hDone);
+        return true;
+    }
+
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+
+    unsigned threadsCount = std::min<unsigned>(cMaxThreads, si.dwNumberOfProcessors);
+    threadsCount = std::max<unsigned>(1, std::min<unsigned>(threadsCount, _files.size()));
+
+    _running = threadsCount;
+
+    for (unsigned i = 0; i < threadsCount; ++i)
+    {
+        HANDLE hThread = (HANDLE)_beginthreadex(NULL, 0, threadFunc, this, CREATE_SUSPENDED, NULL);
+
+        if (hThread == NULL)
+        {
+            if (InterlockedDecrement(&_running) == 0)
+                SetEvent(_hDone);
+            continue;
+        }
+
+        if (background)
+            SetThreadPriority(hThread, THREAD_PRIORITY_BELOW_NORMAL);
+
+        _threads.push_back(hThread);
+        ResumeThread(hThread);
+    }
+
+    return !_threads.empty();
+}
+
+
+/**
+ *  \brief
+ */
+void GrepEngine::Stop()
+{
+    _stop = true;
+    join();
+}
+
+
+/**
+ *  \brief  Gives the matched lines in the order of the file list
+ */
+void GrepEngine::GetResult(std::vector<char>& result)
+{
+    join();
+
+    size_t size = 0;
+    for (const auto& fileResult : _results)
+        size += fileResult.size();
+
+    result.clear();
+
+    if (size == 0)
+        return;
+
+    result.reserve(size + 1);
+
+    for (auto& fileResult : _results)
+    {
+        result.insert(result.end(), fileResult.begin(), fileResult.end());
+        std::vector<char>().swap(fileResult);
+    }
+
+    result.push_back(0);
+}
+
+
+/**
+ *  \brief
+ */
+unsigned __stdcall GrepEngine::threadFunc(void* data)
+{
+    static_cast<GrepEngine*>(data)->worker();
+
+    return 0;
+}
+
+
+/**
+ *  \brief
+ */
+bool GrepEngine::isFiltered(const DbConfig& cfg, const char* pFile, unsigned len)
+{
+    if (!cfg._usePathFilter)
+        return false;
+
+    CPath file;
+    file.Append(pFile, len);
+
+    return cfg.IsPathFiltered(file.C_str(), file.Len());
+}
+
+
+/**
+ *  \brief  Each worker takes the next not searched file until all are done
+ */
+void GrepEngine::worker()
+{
+    while (!_stop)
+    {
+        const LONG idx = InterlockedIncrement(&_next) - 1;
+        if (idx >= (LONG)_files.size())
+            break;
+
+        searchFile(idx);
+
+        if (_listener)
+            feedResults(idx);
+    }
+
+    if (InterlockedDecrement(&_running) == 0)
+        SetEvent(_hDone);
+}
+
+
+/**
+ *  \brief
+ */
+void GrepEngine::searchFile(unsigned idx)
+{
+    CPath path(_root);
+    path += _files[idx].C_str();
+
+    for (TCHAR* pCh = path.C_str(); *pCh; ++pCh)
+        if (*pCh == _T('/'))
+            *pCh = _T('\\');
+
+    HANDLE hFile = CreateFile(path.C_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(hFile, &size) || size.QuadPart == 0 || size.QuadPart > cMaxFileSize)
+    {
+        CloseHandle(hFile);
+        return;
+    }
+
+    HANDLE hMap = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(hFile);
+
+    if (hMap == NULL)
+        return;
+
+    const char* pData = static_cast<const char*>(MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0));
+    CloseHandle(hMap);
+
+    if (pData == NULL)
+        return;
+
+    const char* pEnd = pData + (size_t)size.QuadPart;
+
+    // Skip binary files
+    if (!memchr(pData, 0, std::min<size_t>(pEnd - pData, cBinaryCheckLen)))
+    {
+        if (_regExp)
+            searchRegExp(pData, pEnd, idx);
+        else
+            searchLiteral(pData, pEnd, idx);
+    }
+
+    UnmapViewOfFile(pData);
+}
+
+
+/**
+ *  \brief  Looks for the pattern in the whole buffer and counts lines only up to the matches
+ */
+void GrepEngine::searchLiteral(const char* pSrc, const char* pEnd, unsigned idx)
+{
+    const char* pCounted = pSrc;
+    unsigned lineNum = 1;
+
+    for (const char* pMatch; !_stop && (pMatch = findLiteral(pSrc, pEnd)) != NULL;)
+    {
+        const char* pLine = pMatch;
+        while (pLine > pSrc && *(pLine - 1) != '\n')
+            --pLine;
+
+        lineNum += std::count(pCounted, pLine, '\n');
+        pCounted = pLine;
+
+        const char* pEol = static_cast<const char*>(memchr(pMatch, '\n', pEnd - pMatch));
+        if (pEol == NULL)
+            pEol = pEnd;
+
+        addLine(idx, lineNum, pLine, pEol);
+
+        if (pEol == pEnd)
+            break;
+
+        pSrc = pEol + 1;
+    }
+}
+
+
+/**
+ *  \brief  Matches only the first cMaxRegExpLineLen bytes of longer lines (minified files for example)
+ */
+void GrepEngine::searchRegExp(const char* pSrc, const char* pEnd, unsigned idx)
+{
+    for (unsigned lineNum = 1; !_stop && pSrc < pEnd; ++lineNum)
+    {
+        const char* pEol = static_cast<const char*>(memchr(pSrc, '\n', pEnd - pSrc));
+        if (pEol == NULL)
+            pEol = pEnd;
+
+        const char* pLineEnd = pEol;
+        if (pLineEnd > pSrc && *(pLineEnd - 1) == '\r')
+            --pLineEnd;
+
+        if (pLineEnd - pSrc > (ptrdiff_t)cMaxRegExpLineLen)
+            pLineEnd = pSrc + cMaxRegExpLineLen;
+
+        try
+        {
+            if (std::regex_search(pSrc, pLineEnd, _re))
+                addLine(idx, lineNum, pSrc, pEol);
+        }
+        catch (const std::regex_error&)
+        {
+            // MSVC gives up with error_complexity / error_stack on heavy backtracking
+            fail("Regular expression is too complex to search with");
+            return;
+        }
+
+        pSrc = pEol + 1;
+    }
+}
+
+
+/**
+ *  \brief  Finds the first pattern occurrence - candidates are the positions where both the first and
+ *          the last pattern bytes match (16 positions at a time with SSE2)
+ */
+const char* GrepEngine::findLiteral(const char* pSrc, const char* pEnd) const
+{
+    const unsigned len = _pattern.Len();
+
+    if ((size_t)(pEnd - pSrc) < len)
+        return NULL;
+
+    const char* pLast = pEnd - len;
+
+#ifdef GREP_SSE2
+    const __m128i first0 = _mm_set1_epi8(_first[0]);
+    const __m128i first1 = _mm_set1_epi8(_first[1]);
+    const __m128i last0 = _mm_set1_epi8(_last[0]);
+    const __m128i last1 = _mm_set1_epi8(_last[1]);
+
+    for (; pLast - pSrc >= 15; pSrc += 16)
+    {
+        const __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc));
+        const __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + len - 1));
+
+        const __m128i eqFirst = _mm_or_si128(_mm_cmpeq_epi8(blockFirst, first0), _mm_cmpeq_epi8(blockFirst, first1));
+        const __m128i eqLast = _mm_or_si128(_mm_cmpeq_epi8(blockLast, last0), _mm_cmpeq_epi8(blockLast, last1));
+
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(eqFirst, eqLast));
+
+        while (mask)
+        {
+            unsigned long bit;
+            _BitScanForward(&bit, mask);
+
+            if (equalsAt(pSrc + bit))
+                return pSrc + bit;
+
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for (; pSrc <= pLast; ++pSrc)
+    {
+        if ((*pSrc == _first[0] || *pSrc == _first[1]) && equalsAt(pSrc))
+            return pSrc;
+    }
+
+    return NULL;
+}
+
+
+/**
+ *  \brief
+ */
+bool GrepEngine::equalsAt(const char* pSrc) const
+{
+    const char* pPattern = _pattern.C_str();
+    const unsigned len = _pattern.Len();
+
+    if (_matchCase)
+        return !memcmp(pSrc, pPattern, len);
+
+    for (unsigned i = 0; i < len; ++i)
+        if (toLowerAscii(pSrc[i]) != pPattern[i])
+            return false;
+
+    return true;
+}
+
+
+/**
+ *  \brief  Adds the line as global --result=grep does - "path:line:text"
+ */
+void GrepEngine::addLine(unsigned idx, unsigned lineNum, const char* pLine, const char* pEol)
+{
+    if (pEol > pLine && *(pEol - 1) == '\r')
+        --pEol;
+
+    std::vector<char>& result = _results[idx];
+    const CTextA& file = _files[idx];
+
+    char num[16];
+    _itoa_s(lineNum, num, _countof(num), 10);
+
+    result.insert(result.end(), file.C_str(), file.C_str() + file.Len());
+    result.push_back(':');
+    result.insert(result.end(), num, num + strlen(num));
+    result.push_back(':');
+    result.insert(result.end(), pLine, pEol);
+    result.push_back('\n');
+}
+
+
+/**
+ *  \brief  Passes to the listener the results of the files searched so far without a gap in the file list
+ */
+void GrepEngine::feedResults(unsigned idx)
+{
+    AUTOLOCK(_feedLock);
+
+    _searched[idx] = true;
+
+    for (; _fed < _files.size() && _searched[_fed]; ++_fed)
+    {
+        const std::vector<char>& result = _results[_fed];
+
+        if (!result.empty())
+            _listener->OnPipeData(result.data(), result.size());
+    }
+}
+
+
+/**
+ *  \brief  Stops the search on the first failure in any worker thread - called in the worker threads
+ */
+void GrepEngine::fail(const char* error)
+{
+    if (InterlockedCompareExchange(&_failed, 1, 0) == 0)
+    {
+        _error = error;
+        _valid = false;
+    }
+
+    _stop = true;
+}
+
+
+/**
+ *  \brief
+ */
+void GrepEngine::join()
+{
+    if (_threads.empty())
+        return;
+
+    WaitForMultipleObjects(_threads.size(), _threads.data(), TRUE, INFINITE);
+
+    for (HANDLE hThread : _threads)
+        CloseHandle(hThread);
+
+    _threads.clear();
+}
+
+} // namespace GTags
@@ -0,0 +1,113 @@
+/**
+ *  \file
+ *  \brief  In-process multi-threaded search in the database files
+ *
+ *  \author  Pavel Nedev <pg.nedev@gmail.com>
+ *
+ *  \section COPYRIGHT
+ *  Copyright(C) 2015 Pavel Nedev
+ *
+ *  \section LICENSE
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+
+#include <windows.h>
+#include <tchar.h>
+#include <vector>
+#include <regex>
+#include "Common.h"
+#include "AutoLock.h"
+#include "Config.h"
+#include "ReadPipe.h"
+
+
+namespace GTags
+{
+
+/**
+ *  \class  GrepEngine
+ *  \brief  Searches the database files concurrently (memory mapped, one file at a time per worker thread)
+ *          and gives the result in global --result=grep format
+ */
+class GrepEngine
+{
+public:
+    GrepEngine(const CPath& root, const CTextA& pattern, bool regExp, bool matchCase);
+    ~GrepEngine();
+    GrepEngine(const GrepEngine&) = delete;
+    GrepEngine& operator=(const GrepEngine&) = delete;
+
+    inline bool IsValid() const { return _valid; }
+    inline const CTextA& Error() const { return _error; }
+
+    // Gets the results of the searched files in the file list order as they are found - called in the worker threads
+    inline void SetListener(PipeListener* listener) { _listener = listener; }
+
+    bool Start(const char* fileList, const DbConfig& cfg, bool background);
+    inline HANDLE DoneEvent() const { return _hDone; }
+    void Stop();
+    void GetResult(std::vector<char>& result);
+
+private:
+    static const unsigned   cMaxThreads;
+    static const unsigned   cMaxFileSize;
+    static const unsigned   cBinaryCheckLen;
+    static const unsigned   cMaxRegExpLineLen;
+
+    static unsigned __stdcall threadFunc(void* data);
+    static bool isFiltered(const DbConfig& cfg, const char* pFile, unsigned len);
+
+    void worker();
+    void searchFile(unsigned idx);
+    void searchLiteral(const char* pSrc, const char* pEnd, unsigned idx);
+    void searchRegExp(const char* pSrc, const char* pEnd, unsigned idx);
+    const char* findLiteral(const char* pSrc, const char* pEnd) const;
+    bool equalsAt(const char* pSrc) const;
+    void addLine(unsigned idx, unsigned lineNum, const char* pLine, const char* pEol);
+    void feedResults(unsigned idx);
+    void fail(const char* error);
+    void join();
+
+    CPath       _root;
+    CTextA      _pattern;
+    bool        _regExp;
+    bool        _matchCase;
+    std::regex  _re;
+    bool        _valid;
+    CTextA      _error;
+
+    // First and last pattern bytes in both cases (the same if matching case)
+    char        _first[2];
+    char        _last[2];
+
+    std::vector<CTextA>             _files;
+    std::vector<std::vector<char>>  _results;
+    std::vector<HANDLE>             _threads;
+
+    PipeListener*                   _listener;
+    Mutex                           _feedLock;
+    std::vector<bool>               _searched;
+    unsigned                        _fed;
+
+    volatile LONG   _next;
+    volatile LONG   _running;
+    volatile LONG   _failed;
+    volatile bool   _stop;
+    HANDLE          _hDone;
+};
+
+} // namespace GTags
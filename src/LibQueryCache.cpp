@@ -0,0 +1,181 @@
+/**
+ *  \file
+ *  \brief  Per library database cache of query results
+ *
+ *  \author  Pavel Nedev <pg.nedev@gmail.com>
+ *
+ *  \section COPYRIGHT
+ *  Copyright(C) 2015 Pavel Nedev
+ *
+ *  \section LICENSE
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "LibQueryCache.h"
+
+
+namespace GTags
+{
+
+const TCHAR     LibQueryCache::cTagsFile[]          = _T("GTAGS");
+const unsigned  LibQueryCache::cMaxResultsPerLib    = 32;
+const unsigned  LibQueryCache::cMaxResultSize       = 1024 * 1024;
+
+Mutex LibQueryCache::CacheLock;
+std::unordered_map<PathKey, LibQueryCache::LibEntry, PathKey::Hasher> LibQueryCache::Cache;
+
+
+/**
+ *  \brief  Adds project reference to the library
+ */
+void LibQueryCache::Acquire(const CPath& libPath)
+{
+    AUTOLOCK(CacheLock);
+    ++Cache[PathKey(libPath)]._refCount;
+}
+
+
+/**
+ *  \brief  Drops project reference to the library. Returns true if that was the last one
+ *          and the library cache is released.
+ */
+bool LibQueryCache::Release(const CPath& libPath)
+{
+    AUTOLOCK(CacheLock);
+
+    auto lib = Cache.find(PathKey(libPath));
+    if (lib == Cache.end())
+        return false;
+
+    if (--lib->second._refCount)
+        return false;
+
+    Cache.erase(lib);
+
+    return true;
+}
+
+
+/**
+ *  \brief
+ */
+bool LibQueryCache::Get(const CPath& libPath, const CText& query, std::vector<char>& output)
+{
+    FILETIME tagsTime;
+    if (!getTagsTime(libPath, tagsTime))
+        return false;
+
+    AUTOLOCK(CacheLock);
+
+    auto lib = Cache.find(PathKey(libPath));
+    if (lib == Cache.end())
+        return false;
+
+    // Re-indexed outside of the plugin
+    if (CompareFileTime(&lib->second._tagsTime, &tagsTime))
+    {
+        lib->second._results.clear();
+        return false;
+    }
+
+    std::list<std::pair<CText, std::vector<char>>>& results = lib->second._results;
+
+    for (auto result = results.begin(); result != results.end(); ++result)
+    {
+        if (result->first == query)
+        {
+            output = result->second;
+            results.splice(results.begin(), results, result);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/**
+ *  \brief
+ */
+void LibQueryCache::Put(const CPath& libPath, const CText& query, const std::vector<char>& output)
+{
+    if (output.size() > cMaxResultSize)
+        return;
+
+    FILETIME tagsTime;
+    if (!getTagsTime(libPath, tagsTime))
+        return;
+
+    AUTOLOCK(CacheLock);
+
+    // Not linked by any project
+    auto libi = Cache.find(PathKey(libPath));
+    if (libi == Cache.end())
+        return;
+
+    LibEntry& lib = libi->second;
+
+    if (CompareFileTime(&lib._tagsTime, &tagsTime))
+    {
+        lib._tagsTime = tagsTime;
+        lib._results.clear();
+    }
+
+    for (auto result = lib._results.begin(); result != lib._results.end(); ++result)
+    {
+        if (result->first == query)
+        {
+            lib._results.erase(result);
+            break;
+        }
+    }
+
+    lib._results.push_front(std::make_pair(query, output));
+
+    if (lib._results.size() > cMaxResultsPerLib)
+        lib._results.pop_back();
+}
+
+
+/**
+ *  \brief  Drops the cached results of re-indexed or deleted library, its references are kept
+ */
+void LibQueryCache::Invalidate(const CPath& libPath)
+{
+    AUTOLOCK(CacheLock);
+
+    auto lib = Cache.find(PathKey(libPath));
+    if (lib != Cache.end())
+        lib->second._results.clear();
+}
+
+
+/**
+ *  \brief
+ */
+bool LibQueryCache::getTagsTime(const CPath& libPath, FILETIME& tagsTime)
+{
+    CPath path(libPath);
+    path += cTagsFile;
+
+    WIN32_FILE_ATTRIBUTE_DATA attr;
+    if (!GetFileAttributesEx(path.C_str(), GetFileExInfoStandard, &attr))
+        return false;
+
+    tagsTime = attr.ftLastWriteTime;
+
+    return true;
+}
+
+} // namespace GTags
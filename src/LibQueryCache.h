@@ -0,0 +1,81 @@
+/**
+ *  \file
+ *  \brief  Per library database cache of query results
+ *
+ *  \author  Pavel Nedev <pg.nedev@gmail.com>
+ *
+ *  \section COPYRIGHT
+ *  Copyright(C) 2015 Pavel Nedev
+ *
+ *  \section LICENSE
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+
+#include <windows.h>
+#include <tchar.h>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include "Common.h"
+#include "AutoLock.h"
+
+
+namespace GTags
+{
+
+/**
+ *  \class  LibQueryCache
+ *  \brief  Recent query results of each library database. Libraries rarely change so repeated
+ *          look-ups are answered from memory until the library is re-indexed.
+ *          A library is cached once no matter how many projects link it - the entry lives while
+ *          at least one project holds a reference to it.
+ */
+class LibQueryCache
+{
+public:
+    static void Acquire(const CPath& libPath);
+    static bool Release(const CPath& libPath);
+
+    static bool Get(const CPath& libPath, const CText& query, std::vector<char>& output);
+    static void Put(const CPath& libPath, const CText& query, const std::vector<char>& output);
+    static void Invalidate(const CPath& libPath);
+
+private:
+    /**
+     *  \struct  LibEntry
+     *  \brief  Most recently used result first
+     */
+    struct LibEntry
+    {
+        LibEntry() : _refCount(0) { _tagsTime.dwLowDateTime = _tagsTime.dwHighDateTime = 0; }
+
+        unsigned                                        _refCount;
+        FILETIME                                        _tagsTime;
+        std::list<std::pair<CText, std::vector<char>>>  _results;
+    };
+
+    static const TCHAR      cTagsFile[];
+    static const unsigned   cMaxResultsPerLib;
+    static const unsigned   cMaxResultSize;
+
+    static Mutex CacheLock;
+    static std::unordered_map<PathKey, LibEntry, PathKey::Hasher> Cache;
+
+    static bool getTagsTime(const CPath& libPath, FILETIME& tagsTime);
+};
+
+} // namespace GTags
@@ -36,17 +36,24 @@ int LineParser::Parse(const CmdPtr_t& cmd)
 {
     int result = 0;
 
-    const bool filterReoccurring = cmd->Db()->GetConfig()._useLibDb;
+    // Tag and symbol completions are merged in one result
+    const bool filterReoccurring = (cmd->Db()->GetConfig()._useLibDb || cmd->Id() == AUTOCOMPLETE);
 
-    StrUniquenessChecker<TCHAR> strChecker;
+    StrUniquenessChecker<char> strChecker;
 
+    // The entries stay narrow - only the displayed ones get converted
     _lines.clear();
     _buf = cmd->Result();
 
-    TCHAR* pTmp = NULL;
-    for (TCHAR* pToken = _tcstok_s(_buf.C_str(), _T("\n\r"), &pTmp); pToken;
-            pToken = _tcstok_s(NULL, _T("\n\r"), &pTmp))
+    unsigned lines = 0;
+
+    char* pTmp = NULL;
+    for (char* pToken = strtok_s(_buf.C_str(), "\n\r", &pTmp); pToken;
+            pToken = strtok_s(NULL, "\n\r", &pTmp))
     {
+        if (!(++lines % Cmd::cCancelCheckLines) && cmd->IsCancelled())
+            break;
+
         if (cmd->Id() == FIND_FILE || cmd->Id() == AUTOCOMPLETE_FILE)
             ++pToken;
 
@@ -47,9 +47,6 @@ public:
     virtual ~LineParser() {}
 
     virtual int Parse(const CmdPtr_t&);
-
-private:
-    CText _buf;
 };
 
 } // namespace GTags
@@ -0,0 +1,243 @@
+/**
+ *  \file
+ *  \brief  Single thread I/O completion port reactor servicing all process output pipes
+ *
+ *  \author  Pavel Nedev <pg.nedev@gmail.com>
+ *
+ *  \section COPYRIGHT
+ *  Copyright(C) 2015 Pavel Nedev
+ *
+ *  \section LICENSE
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "PipeReactor.h"
+#include "ReadPipe.h"
+#include <tchar.h>
+#include <process.h>
+
+
+const DWORD PipeReactor::cStopTimeout = 1000;
+
+
+/**
+ *  \brief  Runs on DLL unload under the loader lock so it must not wait for the reactor thread.
+ *          The reactor is stopped by PluginDeInit() before that.
+ */
+PipeReactor::~PipeReactor()
+{
+    if (_hThread)
+        CloseHandle(_hThread);
+    if (_hIOCP)
+        CloseHandle(_hIOCP);
+}
+
+
+/**
+ *  \brief  Associates the pipe read handle with the completion port (starting the reactor if needed).
+ *          Read completions on that handle are then passed to the owning ReadPipe in the reactor thread.
+ */
+bool PipeReactor::Register(HANDLE hPipe, ReadPipe* pipe)
+{
+    AUTOLOCK(_lock);
+
+    if (!_hThread && !start())
+        return false;
+
+    if (!CreateIoCompletionPort(hPipe, _hIOCP, reinterpret_cast<ULONG_PTR>(pipe), 0))
+        return false;
+
+    _pipes.insert(pipe);
+
+    return true;
+}
+
+
+/**
+ *  \brief  Called by the pipe when it is finished - no more reads will be issued on it
+ */
+void PipeReactor::Unregister(ReadPipe* pipe)
+{
+    AUTOLOCK(_lock);
+
+    _pipes.erase(pipe);
+}
+
+
+/**
+ *  \brief  Cancels the reads in progress so all pipes finish (their owners don't wait forever)
+ *          and then stops the reactor thread
+ */
+void PipeReactor::Stop()
+{
+    HANDLE hThread;
+
+    {
+        AUTOLOCK(_lock);
+
+        if (!_hThread)
+            return;
+
+        cancelReads();
+
+        // Zero completion key and no OVERLAPPED tells the reactor thread to exit
+        PostQueuedCompletionStatus(_hIOCP, 0, 0, NULL);
+
+        hThread = _hThread;
+    }
+
+    // The reactor thread takes the lock to finish the pipes
+    WaitForSingleObject(hThread, INFINITE);
+
+    AUTOLOCK(_lock);
+
+    CloseHandle(_hThread);
+    _hThread = NULL;
+    CloseHandle(_hIOCP);
+    _hIOCP = NULL;
+}
+
+
+/**
+ *  \brief
+ */
+bool PipeReactor::start()
+{
+    _hIOCP = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    if (_hIOCP == NULL)
+        return false;
+
+    _hThread = (HANDLE)_beginthreadex(NULL, 0, threadFunc, this, 0, NULL);
+    if (_hThread)
+        return true;
+
+    CloseHandle(_hIOCP);
+    _hIOCP = NULL;
+    return false;
+}
+
+
+/**
+ *  \brief
+ */
+unsigned __stdcall PipeReactor::threadFunc(void* data)
+{
+    return static_cast<PipeReactor*>(data)->thread();
+}
+
+
+/**
+ *  \brief
+ */
+unsigned PipeReactor::thread()
+{
+    bool stopping = false;
+
+    for (;;)
+    {
+        DWORD bytesRead = 0;
+        ULONG_PTR key = 0;
+        LPOVERLAPPED ovl = NULL;
+
+        const BOOL success = GetQueuedCompletionStatus(_hIOCP, &bytesRead, &key, &ovl,
+                stopping ? cStopTimeout : INFINITE);
+
+        if (ovl == NULL)
+        {
+            // Stop request or the cancelled reads didn't complete in time
+            if (success && key == 0 && !stopping)
+            {
+                stopping = true;
+
+                // Reads issued since Stop() cancelled them
+                cancelReads();
+            }
+            else if (stopping || !success)
+            {
+                finishPipes();
+                break;
+            }
+
+            if (stopping && !hasPipes())
+                break;
+
+            continue;
+        }
+
+        // Failed completion means the pipe is broken - the process has exited (or the read was cancelled)
+        reinterpret_cast<ReadPipe*>(key)->onReadComplete(success ? bytesRead : 0, success != FALSE);
+
+        if (stopping)
+        {
+            // A read that completed before the cancel issues the next one
+            cancelReads();
+
+            if (!hasPipes())
+                break;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ *  \brief  CancelIoEx() is not available on XP - CancelIo() there cancels only the reads issued by this thread
+ *          (the reactor thread issues all but the first read of each pipe)
+ */
+void PipeReactor::cancelReads()
+{
+    typedef BOOL (WINAPI *CancelIoEx_t)(HANDLE, LPOVERLAPPED);
+
+    static CancelIoEx_t cancelIoEx = reinterpret_cast<CancelIoEx_t>(
+            GetProcAddress(GetModuleHandle(_T("kernel32.dll")), "CancelIoEx"));
+
+    AUTOLOCK(_lock);
+
+    for (ReadPipe* pipe : _pipes)
+    {
+        if (cancelIoEx)
+            cancelIoEx(pipe->_hOut, &pipe->_ovl);
+        else
+            CancelIo(pipe->_hOut);
+    }
+}
+
+
+/**
+ *  \brief  Finishes the pipes whose reads haven't completed - so nobody waits for them forever
+ */
+void PipeReactor::finishPipes()
+{
+    std::unordered_set<ReadPipe*> pipes;
+
+    {
+        AUTOLOCK(_lock);
+        pipes.swap(_pipes);
+    }
+
+    for (ReadPipe* pipe : pipes)
+        pipe->finish();
+}
+
+
+/**
+ *  \brief
+ */
+bool PipeReactor::hasPipes()
+{
+    AUTOLOCK(_lock);
+
+    return !_pipes.empty();
+}
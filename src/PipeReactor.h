@@ -0,0 +1,74 @@
+/**
+ *  \file
+ *  \brief  Single thread I/O completion port reactor servicing all process output pipes
+ *
+ *  \author  Pavel Nedev <pg.nedev@gmail.com>
+ *
+ *  \section COPYRIGHT
+ *  Copyright(C) 2015 Pavel Nedev
+ *
+ *  \section LICENSE
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+
+#include <windows.h>
+#include <unordered_set>
+#include "AutoLock.h"
+
+
+class ReadPipe;
+
+
+/**
+ *  \class  PipeReactor
+ *  \brief  Services the overlapped reads of all ReadPipes through one I/O completion port and one thread
+ */
+class PipeReactor
+{
+public:
+    static PipeReactor& Get()
+    {
+        static PipeReactor Instance;
+        return Instance;
+    }
+
+    bool Register(HANDLE hPipe, ReadPipe* pipe);
+    void Unregister(ReadPipe* pipe);
+    void Stop();
+
+private:
+    static const DWORD cStopTimeout;
+
+    static unsigned __stdcall threadFunc(void* data);
+
+    PipeReactor() : _hIOCP(NULL), _hThread(NULL) {}
+    PipeReactor(const PipeReactor&);
+    ~PipeReactor();
+
+    bool start();
+    unsigned thread();
+    void cancelReads();
+    void finishPipes();
+    bool hasPipes();
+
+    Mutex   _lock;
+    HANDLE  _hIOCP;
+    HANDLE  _hThread;
+
+    // Pipes with a read in progress - they are all finished before the reactor thread exits
+    std::unordered_set<ReadPipe*>   _pipes;
+};
@@ -113,6 +113,15 @@ extern "C" __declspec(dllexport) void beNotified(SCNotification* notifyCode)
         }
         break;
 
+        case NPPN_BUFFERACTIVATED:
+            GTags::OnFileActivate();
+        break;
+
+        case SCN_UPDATEUI:
+            if (notifyCode->updated & SC_UPDATE_SELECTION)
+                GTags::OnCaretMove();
+        break;
+
         case NPPN_WORDSTYLESUPDATED:
         {
             INpp& npp = INpp::Get();
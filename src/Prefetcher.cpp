@@ -0,0 +1,221 @@
+/**
+ *  \file
+ *  \brief  Idle-time prefetch of the definition of the word under the caret
+ *
+ *  \author  Pavel Nedev <pg.nedev@gmail.com>
+ *
+ *  \section COPYRIGHT
+ *  Copyright(C) 2015 Pavel Nedev
+ *
+ *  \section LICENSE
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ctype.h>
+#include "Prefetcher.h"
+#include "Common.h"
+#include "INpp.h"
+#include "Config.h"
+#include "Cmd.h"
+#include "ResultWin.h"
+#include "GTags.h"
+
+
+namespace GTags
+{
+
+const TCHAR Prefetcher::cFindDefinition[] = _T("Find Definition");
+const UINT Prefetcher::cIdleTime        = 500;
+const DWORD Prefetcher::cDbInterval     = 1000;
+const DWORD Prefetcher::cResultTTL      = 60000;
+const unsigned Prefetcher::cMaxResults  = 8;
+
+UINT_PTR Prefetcher::IdleTimer = 0;
+BackgroundCmd Prefetcher::Fetch;
+std::list<Prefetcher::Entry> Prefetcher::Results;
+std::unordered_map<PathKey, DWORD, PathKey::Hasher> Prefetcher::LastRun;
+
+
+/**
+ *  \brief  Restarts the idle timer
+ */
+void Prefetcher::OnCaretMove()
+{
+    if (IdleTimer)
+    {
+        KillTimer(NULL, IdleTimer);
+        IdleTimer = 0;
+    }
+
+    if (GTagsSettings._prefetchDefinitions)
+        IdleTimer = SetTimer(NULL, 0, cIdleTime, idleTimerProc);
+}
+
+
+/**
+ *  \brief  Returns (and forgets) the prefetched definition search for the tag if there is one
+ */
+CmdPtr_t Prefetcher::Take(const DbHandle& db, const CText& tag)
+{
+    std::list<Entry>::iterator entry = find(db, tag.C_str());
+    if (entry == Results.end())
+        return CmdPtr_t();
+
+    const bool expired = (GetTickCount() - entry->_time > cResultTTL);
+    CmdPtr_t cmd = entry->_cmd;
+
+    Results.erase(entry);
+
+    return expired ? CmdPtr_t() : cmd;
+}
+
+
+/**
+ *  \brief  Stops the running prefetch (if any) so it doesn't compete with interactive commands
+ */
+void Prefetcher::Cancel()
+{
+    if (IdleTimer)
+    {
+        KillTimer(NULL, IdleTimer);
+        IdleTimer = 0;
+    }
+
+    Fetch.Cancel();
+}
+
+
+/**
+ *  \brief  Drops the prefetched results (e.g. database has changed)
+ */
+void Prefetcher::Clear()
+{
+    Cancel();
+    Results.clear();
+}
+
+
+/**
+ *  \brief
+ */
+VOID CALLBACK Prefetcher::idleTimerProc(HWND, UINT, UINT_PTR, DWORD)
+{
+    if (IdleTimer)
+    {
+        KillTimer(NULL, IdleTimer);
+        IdleTimer = 0;
+    }
+
+    prefetch();
+}
+
+
+/**
+ *  \brief
+ */
+void Prefetcher::prefetch()
+{
+    INpp& npp = INpp::Get();
+
+    npp.ReadSciHandle();
+
+    if (npp.IsSelectionVertical())
+        return;
+
+    CTextA wordA;
+    npp.GetWord(wordA);
+
+    if (wordA.IsEmpty() || (wordA.C_str()[0] >= '0' && wordA.C_str()[0] <= '9'))
+        return;
+
+    for (const char* pCh = wordA.C_str(); *pCh; ++pCh)
+        if (!isalnum((unsigned char)*pCh) && *pCh != '_')
+            return;
+
+    const CText tag(wordA.C_str());
+
+    if (Fetch.Pending())
+    {
+        if (Fetch.Pending()->Tag() == tag)
+            return;
+
+        Fetch.Cancel();
+    }
+
+    CPath currentFile;
+    npp.GetFilePath(currentFile);
+
+    // Read lock only - skip the prefetch if the database is being written
+    bool success;
+    DbHandle db = DbManager::Get().GetDb(currentFile, false, &success);
+
+    if (!db && GTagsSettings._useDefDb && !GTagsSettings._defDbPath.IsEmpty())
+        db = DbManager::Get().GetDbAt(GTagsSettings._defDbPath, false, &success);
+
+    if (!db || !success)
+        return;
+
+    const DWORD now = GetTickCount();
+    DWORD& lastRun = LastRun[db->GetKey()];
+
+    if (find(db, tag.C_str()) != Results.end() || (lastRun && now - lastRun < cDbInterval))
+    {
+        DbManager::Get().PutDb(db);
+        return;
+    }
+
+    ParserPtr_t parser(new ResultWin::TabParser);
+    CmdPtr_t cmd(new Cmd(FIND_DEFINITION, cFindDefinition, db, parser, tag.C_str()));
+
+    if (Fetch.Run(cmd, prefetchCB))
+        lastRun = now;
+}
+
+
+/**
+ *  \brief
+ */
+void Prefetcher::prefetchCB(const CmdPtr_t& cmd)
+{
+    if (!Fetch.Complete(cmd) || cmd->Status() != OK || !cmd->HasResult())
+        return;
+
+    Entry entry;
+    entry._cmd  = cmd;
+    entry._time = GetTickCount();
+
+    Results.push_front(entry);
+
+    if (Results.size() > cMaxResults)
+        Results.pop_back();
+}
+
+
+/**
+ *  \brief
+ */
+std::list<Prefetcher::Entry>::iterator Prefetcher::find(const DbHandle& db, const TCHAR* tag)
+{
+    std::list<Entry>::iterator entry;
+
+    for (entry = Results.begin(); entry != Results.end(); ++entry)
+    {
+        if (entry->_cmd->Db() == db && entry->_cmd->Tag() == tag)
+            break;
+    }
+
+    return entry;
+}
+
+} // namespace GTags
@@ -0,0 +1,85 @@
+/**
+ *  \file
+ *  \brief  Idle-time prefetch of the definition of the word under the caret
+ *
+ *  \author  Pavel Nedev <pg.nedev@gmail.com>
+ *
+ *  \section COPYRIGHT
+ *  Copyright(C) 2015 Pavel Nedev
+ *
+ *  \section LICENSE
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+
+#include <windows.h>
+#include <tchar.h>
+#include <list>
+#include <unordered_map>
+#include "Common.h"
+#include "CmdDefines.h"
+#include "DbManager.h"
+#include "BackgroundCmd.h"
+
+
+class CText;
+
+
+namespace GTags
+{
+
+/**
+ *  \class  Prefetcher
+ *  \brief  When the caret rests on a word, looks up its definition in background (low priority,
+ *          read-only database lock) and keeps the result for the next Find Definition
+ */
+class Prefetcher
+{
+public:
+    static void OnCaretMove();
+    static CmdPtr_t Take(const DbHandle& db, const CText& tag);
+    static void Cancel();
+    static void Clear();
+
+private:
+    /**
+     *  \struct  Entry
+     *  \brief
+     */
+    struct Entry
+    {
+        CmdPtr_t    _cmd;
+        DWORD       _time;
+    };
+
+    static const TCHAR      cFindDefinition[];
+    static const UINT       cIdleTime;
+    static const DWORD      cDbInterval;
+    static const DWORD      cResultTTL;
+    static const unsigned   cMaxResults;
+
+    static UINT_PTR         IdleTimer;
+    static BackgroundCmd    Fetch;
+    static std::list<Entry> Results;
+    static std::unordered_map<PathKey, DWORD, PathKey::Hasher>  LastRun;
+
+    static VOID CALLBACK idleTimerProc(HWND hWnd, UINT uMsg, UINT_PTR idEvent, DWORD dwTime);
+    static void prefetch();
+    static void prefetchCB(const CmdPtr_t& cmd);
+    static std::list<Entry>::iterator find(const DbHandle& db, const TCHAR* tag);
+};
+
+} // namespace GTags
@@ -23,66 +23,196 @@
 
 
 #include "ReadPipe.h"
-#include <process.h>
+#include "PipeReactor.h"
+#include <tchar.h>
+#include <string.h>
 
 
 const unsigned ReadPipe::cChunkSize = 4096;
 
+volatile LONG ReadPipe::PipeCounter = 0;
+
+
+/**
+ *  \brief  Takes ownership of the file handle
+ */
+SpillFile::SpillFile(HANDLE hFile, unsigned size) : _hFile(hFile), _hMap(NULL), _view(NULL), _size(size)
+{
+    _hMap = CreateFileMapping(_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+}
+
 
 /**
  *  \brief
  */
-ReadPipe::ReadPipe() : _hIn(NULL), _hOut(NULL), _hThread(NULL)
+SpillFile::~SpillFile()
 {
-    SECURITY_ATTRIBUTES attr    = {0};
-    attr.nLength                = sizeof(attr);
-    attr.bInheritHandle         = TRUE;
+    if (_view)
+        UnmapViewOfFile(_view);
+    if (_hMap)
+        CloseHandle(_hMap);
+    if (_hFile)
+        CloseHandle(_hFile);
+}
+
+
+/**
+ *  \brief  Maps the whole file on first call - NULL if there is not enough address space
+ */
+const char* SpillFile::Data() const
+{
+    if (!_view && _hMap)
+        _view = MapViewOfFile(_hMap, FILE_MAP_READ, 0, 0, 0);
 
-    _ready = CreatePipe(&_hOut, &_hIn, &attr, 0);
-    if (_ready)
-        _ready = SetHandleInformation(_hOut, HANDLE_FLAG_INHERIT, HANDLE_FLAG_INHERIT);
+    return static_cast<const char*>(_view);
 }
 
 
 /**
- *  \brief
+ *  \brief  Copies up to len bytes from offset to buf through a view of just that part of the file.
+ *          Returns the bytes copied.
  */
-ReadPipe::~ReadPipe()
+unsigned SpillFile::Read(unsigned offset, char* buf, unsigned len) const
 {
-    if (_hThread)
+    if (!_hMap || offset >= _size)
+        return 0;
+
+    if (len > _size - offset)
+        len = _size - offset;
+
+    if (_view)
     {
-        Wait(INFINITE);
+        memcpy(buf, static_cast<const char*>(_view) + offset, len);
+        return len;
     }
-    else
+
+    static DWORD Granularity = 0;
+    if (!Granularity)
     {
-        if (_hIn)
-            CloseHandle(_hIn);
-        if (_hOut)
-            CloseHandle(_hOut);
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        Granularity = si.dwAllocationGranularity;
     }
+
+    // View offset must be multiple of the allocation granularity
+    const unsigned viewOffset = offset - offset % Granularity;
+
+    LPVOID view = MapViewOfFile(_hMap, FILE_MAP_READ, 0, viewOffset, offset - viewOffset + len);
+    if (!view)
+        return 0;
+
+    memcpy(buf, static_cast<const char*>(view) + offset - viewOffset, len);
+    UnmapViewOfFile(view);
+
+    return len;
+}
+
+
+/**
+ *  \brief  Creates a named pipe as anonymous pipes don't support overlapped reads.
+ *          The read end is overlapped and stays with us, the write end is opened later by OpenInputHandle()
+ *          to be inherited by the child process.
+ *          Output bigger than spillThreshold bytes (if not 0) is moved to a temp file.
+ */
+ReadPipe::ReadPipe(unsigned spillThreshold) :
+    _ready(FALSE), _open(false), _hIn(NULL), _hOut(NULL), _hDone(NULL), _totalBytesRead(0), _listener(NULL),
+    _spillThreshold(spillThreshold), _hSpill(NULL)
+{
+    ZeroMemory(&_ovl, sizeof(_ovl));
+
+    _sntprintf_s(_pipeName, _countof(_pipeName), _TRUNCATE, _T("\\\\.\\pipe\\NppGTags.%lu.%ld"),
+            GetCurrentProcessId(), InterlockedIncrement(&PipeCounter));
+
+    _hOut = CreateNamedPipe(_pipeName, PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+            PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT, 1, cChunkSize, cChunkSize, 0, NULL);
+    if (_hOut == INVALID_HANDLE_VALUE)
+    {
+        _hOut = NULL;
+        return;
+    }
+
+    _hDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+    _ready = (_hDone != NULL);
 }
 
 
 /**
  *  \brief
  */
+ReadPipe::~ReadPipe()
+{
+    if (_open)
+        Wait(INFINITE);
+
+    if (_hIn)
+        CloseHandle(_hIn);
+    if (_hOut)
+        CloseHandle(_hOut);
+    if (_hDone)
+        CloseHandle(_hDone);
+    if (_hSpill)
+        CloseHandle(_hSpill);
+}
+
+
+/**
+ *  \brief  Opens the inheritable write end of the pipe. Any process created while it is open inherits it so
+ *          it should be open only for the creation of its own process (under the same lock)
+ *          and closed right after by CloseInputHandle().
+ */
+HANDLE ReadPipe::OpenInputHandle()
+{
+    if (!_ready || _hIn)
+        return _hIn;
+
+    SECURITY_ATTRIBUTES attr    = {0};
+    attr.nLength                = sizeof(attr);
+    attr.bInheritHandle         = TRUE;
+
+    _hIn = CreateFile(_pipeName, GENERIC_WRITE, 0, &attr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (_hIn == INVALID_HANDLE_VALUE)
+        _hIn = NULL;
+
+    return _hIn;
+}
+
+
+/**
+ *  \brief  Closes our copy of the write end - the pipe then ends when the child process exits
+ */
+void ReadPipe::CloseInputHandle()
+{
+    if (_hIn)
+    {
+        CloseHandle(_hIn);
+        _hIn = NULL;
+    }
+}
+
+
+/**
+ *  \brief  Hands the pipe over to the PipeReactor - no reading thread of its own
+ */
 bool ReadPipe::Open()
 {
     if (!_ready || !_hOut)
         return false;
-    if (_hThread)
+    if (_open)
         return true;
 
-    CloseHandle(_hIn);
-    _hIn = NULL;
-    _hThread = (HANDLE)_beginthreadex(NULL, 0, threadFunc, this, 0, NULL);
-    if (_hThread)
-        return true;
+    CloseInputHandle();
 
-    // on error
-    CloseHandle(_hOut);
-    _hOut = NULL;
-    return false;
+    if (!PipeReactor::Get().Register(_hOut, this))
+    {
+        CloseHandle(_hOut);
+        _hOut = NULL;
+        return false;
+    }
+
+    _open = true;
+    readNext();
+
+    return true;
 }
 
 
@@ -91,16 +221,15 @@ bool ReadPipe::Open()
  */
 DWORD ReadPipe::Wait(DWORD time_ms)
 {
-    if (!_hThread)
+    if (!_open)
         return WAIT_OBJECT_0;
 
-    DWORD r = WaitForSingleObject(_hThread, time_ms);
+    DWORD r = WaitForSingleObject(_hDone, time_ms);
     if (r != WAIT_TIMEOUT)
     {
         CloseHandle(_hOut);
         _hOut = NULL;
-        CloseHandle(_hThread);
-        _hThread = NULL;
+        _open = false;
     }
 
     return r;
@@ -112,7 +241,7 @@ DWORD ReadPipe::Wait(DWORD time_ms)
  */
 std::vector<char>& ReadPipe::GetOutput()
 {
-    if (_hThread)
+    if (_open)
         Wait(INFINITE);
 
     return _output;
@@ -120,41 +249,133 @@ std::vector<char>& ReadPipe::GetOutput()
 
 
 /**
- *  \brief
+ *  \brief  Returns NULL if the output was kept in memory
+ */
+const std::shared_ptr<SpillFile>& ReadPipe::GetSpillFile()
+{
+    if (_open)
+        Wait(INFINITE);
+
+    return _spillFile;
+}
+
+
+/**
+ *  \brief  Issues overlapped read directly into the output buffer.
+ *          Its completion (even if immediate) is delivered to the PipeReactor thread.
  */
-unsigned __stdcall ReadPipe::threadFunc(void* data)
+bool ReadPipe::readNext()
 {
-    return static_cast<ReadPipe*>(data)->thread();
+    // Spilled output is read chunk by chunk at the buffer start and then written to the temp file
+    const unsigned offset = _hSpill ? 0 : _totalBytesRead;
+
+    if (_output.size() == offset)
+        _output.resize(offset + cChunkSize);
+
+    ZeroMemory(&_ovl, sizeof(_ovl));
+
+    if (ReadFile(_hOut, _output.data() + offset, _output.size() - offset, NULL, &_ovl) ||
+            GetLastError() == ERROR_IO_PENDING)
+        return true;
+
+    finish();
+    return false;
 }
 
 
 /**
- *  \brief
+ *  \brief  Called in the PipeReactor thread
  */
-unsigned ReadPipe::thread()
+void ReadPipe::onReadComplete(DWORD bytesRead, bool success)
 {
-    DWORD bytesRead = 0;
-    unsigned totalBytesRead = 0;
-    unsigned chunkRemainingSize = 0;
+    if (!success)
+    {
+        finish();
+        return;
+    }
 
-    for (;;)
+    if (_hSpill)
     {
-        if (!chunkRemainingSize)
+        DWORD bytesWritten;
+        if (!WriteFile(_hSpill, _output.data(), bytesRead, &bytesWritten, NULL) || bytesWritten != bytesRead)
         {
-            _output.resize(totalBytesRead + cChunkSize);
-            chunkRemainingSize = cChunkSize;
+            finish();
+            return;
         }
+    }
 
-        if (!ReadFile(_hOut, _output.data() + totalBytesRead, chunkRemainingSize, &bytesRead, NULL))
-            break;
+    if (_listener && bytesRead)
+        _listener->OnPipeData(_output.data() + (_hSpill ? 0 : _totalBytesRead), bytesRead);
 
-        chunkRemainingSize -= bytesRead;
-        totalBytesRead += bytesRead;
+    _totalBytesRead += bytesRead;
+
+    // Keep reading in memory if spilling fails
+    if (!_hSpill && _spillThreshold && _totalBytesRead > _spillThreshold && !spill())
+        _spillThreshold = 0;
+
+    readNext();
+}
+
+
+/**
+ *  \brief  Moves the output read so far to a temp file and frees the memory. From now on the output
+ *          buffer holds only the last read chunk.
+ */
+bool ReadPipe::spill()
+{
+    TCHAR tmpPath[MAX_PATH];
+    TCHAR tmpFile[MAX_PATH];
+
+    if (!GetTempPath(_countof(tmpPath), tmpPath) || !GetTempFileName(tmpPath, _T("gtg"), 0, tmpFile))
+        return false;
+
+    _hSpill = CreateFile(tmpFile, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+            CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    if (_hSpill == INVALID_HANDLE_VALUE)
+    {
+        _hSpill = NULL;
+        DeleteFile(tmpFile);
+        return false;
+    }
+
+    DWORD bytesWritten;
+    if (!WriteFile(_hSpill, _output.data(), _totalBytesRead, &bytesWritten, NULL) || bytesWritten != _totalBytesRead)
+    {
+        CloseHandle(_hSpill);
+        _hSpill = NULL;
+        return false;
     }
 
-    _output.resize(totalBytesRead);
-    if (totalBytesRead)
-        _output.push_back(0);
+    std::vector<char>(cChunkSize).swap(_output);
+
+    return true;
+}
+
+
+/**
+ *  \brief  Must be the last access to the object from the PipeReactor thread
+ */
+void ReadPipe::finish()
+{
+    PipeReactor::Get().Unregister(this);
+
+    if (_hSpill)
+    {
+        std::vector<char>().swap(_output);
+
+        const char term = 0;
+        DWORD bytesWritten;
+        WriteFile(_hSpill, &term, 1, &bytesWritten, NULL);
+
+        _spillFile = std::make_shared<SpillFile>(_hSpill, _totalBytesRead + 1);
+        _hSpill = NULL;
+    }
+    else
+    {
+        _output.resize(_totalBytesRead);
+        if (_totalBytesRead)
+            _output.push_back(0);
+    }
 
-    return 0;
+    SetEvent(_hDone);
 }
@@ -27,6 +27,48 @@
 
 #include <windows.h>
 #include <vector>
+#include <memory>
+
+
+/**
+ *  \class  SpillFile
+ *  \brief  Read-only file mapping of process output that was too big to keep in memory.
+ *          It is read through small views mapped on demand, the whole file is mapped only if Data() is asked for.
+ *          The backing temp file is deleted when the object is destroyed.
+ */
+class SpillFile
+{
+public:
+    SpillFile(HANDLE hFile, unsigned size);
+    ~SpillFile();
+
+    inline bool IsValid() const { return (_hMap != NULL); }
+    inline unsigned Size() const { return _size; }
+    const char* Data() const;
+    unsigned Read(unsigned offset, char* buf, unsigned len) const;
+
+private:
+    SpillFile(const SpillFile&);
+    const SpillFile& operator=(const SpillFile&);
+
+    HANDLE          _hFile;
+    HANDLE          _hMap;
+    mutable LPVOID  _view;
+    unsigned        _size;
+};
+
+
+/**
+ *  \class  PipeListener
+ *  \brief  Gets the process output as it arrives - called in the PipeReactor thread
+ */
+class PipeListener
+{
+public:
+    virtual ~PipeListener() {}
+
+    virtual void OnPipeData(const char* data, unsigned len) = 0;
+};
 
 
 /**
@@ -36,27 +78,44 @@
 class ReadPipe
 {
 public:
-    ReadPipe();
+    ReadPipe(unsigned spillThreshold = 0);
     ~ReadPipe();
 
-    HANDLE GetInputHandle() { return _hIn; }
+    HANDLE OpenInputHandle();
+    void CloseInputHandle();
+    void SetListener(PipeListener* listener) { _listener = listener; }
     bool Open();
     DWORD Wait(DWORD time_ms);
     std::vector<char>& GetOutput();
+    const std::shared_ptr<SpillFile>& GetSpillFile();
 
 private:
+    friend class PipeReactor;
+
     static const unsigned cChunkSize;
 
-    static unsigned __stdcall threadFunc(void* data);
+    static volatile LONG PipeCounter;
 
     ReadPipe(const ReadPipe&);
     const ReadPipe& operator=(const ReadPipe&);
 
-    unsigned thread();
+    bool readNext();
+    void onReadComplete(DWORD bytesRead, bool success);
+    bool spill();
+    void finish();
 
     BOOL                _ready;
+    bool                _open;
     HANDLE              _hIn;
     HANDLE              _hOut;
-    HANDLE              _hThread;
+    HANDLE              _hDone;
+    OVERLAPPED          _ovl;
+    TCHAR               _pipeName[64];
+    unsigned            _totalBytesRead;
     std::vector<char>   _output;
+    PipeListener*       _listener;
+
+    unsigned                    _spillThreshold;
+    HANDLE                      _hSpill;
+    std::shared_ptr<SpillFile>  _spillFile;
 };
@@ -0,0 +1,78 @@
+/**
+ *  \file
+ *  \brief  Command output lines collected for showing the results while the command is still running
+ *
+ *  \author  Pavel Nedev <pg.nedev@gmail.com>
+ *
+ *  \section COPYRIGHT
+ *  Copyright(C) 2015 Pavel Nedev
+ *
+ *  \section LICENSE
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "ResultFeed.h"
+
+
+namespace GTags
+{
+
+/**
+ *  \brief
+ */
+void ResultFeed::OnPipeData(const char* data, unsigned len)
+{
+    AUTOLOCK(_lock);
+
+    if (!_stopped)
+        _data.insert(_data.end(), data, data + len);
+}
+
+
+/**
+ *  \brief  Gives the complete lines received since the last call (\0 terminated).
+ *          Returns false if there are none.
+ */
+bool ResultFeed::Take(std::vector<char>& lines)
+{
+    AUTOLOCK(_lock);
+
+    unsigned len = _data.size();
+    while (len && _data[len - 1] != '\n')
+        --len;
+
+    if (len == 0)
+        return false;
+
+    lines.assign(_data.begin(), _data.begin() + len);
+    lines.push_back(0);
+
+    _data.erase(_data.begin(), _data.begin() + len);
+
+    return true;
+}
+
+
+/**
+ *  \brief  Drops the collected and any further output - the whole output is still kept by the command
+ */
+void ResultFeed::Stop()
+{
+    AUTOLOCK(_lock);
+
+    _stopped = true;
+    std::vector<char>().swap(_data);
+}
+
+} // namespace GTags
@@ -0,0 +1,61 @@
+/**
+ *  \file
+ *  \brief  Command output lines collected for showing the results while the command is still running
+ *
+ *  \author  Pavel Nedev <pg.nedev@gmail.com>
+ *
+ *  \section COPYRIGHT
+ *  Copyright(C) 2015 Pavel Nedev
+ *
+ *  \section LICENSE
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+
+#include <windows.h>
+#include <vector>
+#include "AutoLock.h"
+#include "ReadPipe.h"
+
+
+namespace GTags
+{
+
+/**
+ *  \class  ResultFeed
+ *  \brief  Collects the command output as it arrives (from the PipeReactor or the in-process grep threads)
+ *          and hands it over in complete lines to the command thread
+ */
+class ResultFeed : public PipeListener
+{
+public:
+    ResultFeed() : _stopped(false) {}
+    virtual ~ResultFeed() {}
+    ResultFeed(const ResultFeed&) = delete;
+    ResultFeed& operator=(const ResultFeed&) = delete;
+
+    virtual void OnPipeData(const char* data, unsigned len);
+
+    bool Take(std::vector<char>& lines);
+    void Stop();
+
+private:
+    Mutex               _lock;
+    std::vector<char>   _data;
+    bool                _stopped;
+};
+
+} // namespace GTags
@@ -31,6 +31,8 @@
 #include "DocLocation.h"
 #include "ActivityWin.h"
 #include "Cmd.h"
+#include "CmdEngine.h"
+#include "FileTags.h"
 #include <windowsx.h>
 #include <richedit.h>
 #include <commctrl.h>
@@ -68,806 +70,2392 @@ const TCHAR ResultWin::cSearchClassName[]   = _T("ResultSearchWin");
 const int ResultWin::cSearchBkgndColor      = COLOR_INFOBK;
 const unsigned ResultWin::cSearchFontSize   = 10;
 const int ResultWin::cSearchWidth           = 420;
+const UINT_PTR ResultWin::cStreamTimerId    = 1;
+const UINT ResultWin::cStreamPeriod         = 16;
+const unsigned ResultWin::cStreamBatchSize  = 128 * 1024;
+const UINT_PTR ResultWin::cPackTimerId      = 2;
+const UINT ResultWin::cPackPeriod           = 50;
+const unsigned ResultWin::cPackBatchSize    = 256 * 1024;
+const unsigned ResultWin::cPackBlockSize    = 64 * 1024;
+const unsigned ResultWin::cMaxRefreshFiles  = 16;
+const unsigned ResultWin::cMaxRefreshes     = 64;
+
+const unsigned ResultWin::TabParser::cSpillChunkSize = 4 * 1024 * 1024;
 
 
 ResultWin* ResultWin::RW = NULL;
 
+BackgroundCmd ResultWin::RefreshCmd;
+
 
 /**
  *  \brief
  */
 int ResultWin::TabParser::Parse(const CmdPtr_t& cmd)
 {
-    // Add the search header - cmd name + search word + project path
-    _buf = cmd->Name();
-    _buf += " \"";
-    _buf += cmd->Tag().C_str();
-    _buf += "\" (";
-    _buf += cmd->RegExp() ? "regexp, ": "literal, ";
-    _buf += cmd->MatchCase() ? "match case": "ignore case";
-    _buf += ") in \"";
-    _buf += cmd->Db()->GetPath().C_str();
-    _buf += "\"";
+    // The partial results are parsed again with the rest
+    clear();
+
+    composeHeader(cmd);
 
     // parsing command result
-    if (cmd->Id() == FIND_FILE)
-        return parseFindFile(cmd);
+    int result;
+
+    // Definitions are filtered for reoccurring results across the whole output so they are parsed at once.
+    // They are never that many anyway.
+    if (cmd->ResultFile() && cmd->Id() != FIND_DEFINITION && cmd->Id() != FILE_TAGS)
+        result = parseSpillFile(cmd, *cmd->ResultFile());
+    else if (cmd->Id() == FIND_FILE)
+        result = parseFindFile(cmd, cmd->Result());
+    else if (cmd->Id() == FILE_TAGS)
+        result = parseFileTags(cmd);
     else
-        return parseCmd(cmd);
+        result = parseCmd(cmd, cmd->Result());
+
+    return result;
 }
 
 
 /**
- *  \brief
+ *  \brief  Adds the complete output lines to the results and gives their text in the order they were found.
+ *          Definitions (filtered for reoccurring library results) and file tags are not shown partially.
  */
-bool ResultWin::TabParser::filterEntry(const DbConfig& cfg, const char* pEntry, unsigned len)
+int ResultWin::TabParser::ParsePartial(const CmdPtr_t& cmd, const char* pLines, CTextA& text)
 {
-    if (cfg._usePathFilter)
+    if (cmd->Id() == FIND_DEFINITION || cmd->Id() == FILE_TAGS)
+        return -1;
+
+    const int result = (cmd->Id() == FIND_FILE) ? parseFindFile(cmd, pLines) : parseCmd(cmd, pLines);
+    if (result <= 0)
+        return result;
+
+    if (_partialFiles == 0 && _partialHits == 0)
     {
-        CPath currentEntry;
-        currentEntry.Append(pEntry, len);
+        composeHeader(cmd);
+        text += _header;
+    }
+
+    if (cmd->Id() == FIND_FILE)
+    {
+        for (; _partialFiles < _fileNameLen.size(); ++_partialFiles)
+        {
+            text += "\n\t";
+            text.Append(fileName(_partialFiles), _fileNameLen[_partialFiles]);
+        }
+
+        return result;
+    }
+
+    char lineNum[16];
+
+    for (; _partialHits < _hitLine.size(); ++_partialHits)
+    {
+        const unsigned fileIdx = _hitFile[_partialHits];
 
-        for (const auto& filter : cfg._pathFilters)
+        if ((int)fileIdx != _partialFile)
         {
-            if (filter.IsParentOf(currentEntry))
-                return true;
+            text += "\n\t";
+            text.Append(fileName(fileIdx), _fileNameLen[fileIdx]);
+            _partialFile = fileIdx;
         }
+
+        _itoa_s(_hitLine[_partialHits], lineNum, _countof(lineNum), 10);
+
+        text += "\n\t\tline ";
+        text += lineNum;
+        text += ":\t";
+        text.Append(_previews.data() + _hitPreviewOffset[_partialHits], _hitPreviewLen[_partialHits]);
     }
 
-    return false;
+    return result;
 }
 
 
 /**
- *  \brief
+ *  \brief  Composes the display text from the results model on first request
  */
-int ResultWin::TabParser::parseFindFile(const CmdPtr_t& cmd)
+const CTextA& ResultWin::TabParser::GetText() const
 {
-    int result = 0;
+    if (!_text)
+        composeText();
 
-    const char* pSrc = cmd->Result();
-    const char* pEol;
+    return *_text;
+}
 
-    const DbConfig& cfg = cmd->Db()->GetConfig();
 
-    for (;;)
-    {
-        while (*pSrc == '\n' || *pSrc == '\r' || *pSrc == ' ' || *pSrc == '\t')
-            ++pSrc;
-        if (*pSrc == 0) break;
+/**
+ *  \brief  Compresses the next maxLen bytes of the preview texts pool (the bulk of the model) in bounded blocks.
+ *          The pool is dropped once it is all compressed. Returns false if there is nothing more to pack.
+ */
+bool ResultWin::TabParser::Pack(unsigned maxLen)
+{
+    ReleaseText();
 
-        pEol = pSrc;
-        while (*pEol != '\n' && *pEol != '\r' && *pEol != 0)
-            ++pEol;
+    if (!CanPack())
+        return false;
 
-        if (!filterEntry(cfg, pSrc, pEol - pSrc))
-        {
-            _buf += "\n\t";
-            _buf.Append(pSrc, pEol - pSrc);
+    const unsigned end = (_previewsLen - _packedLen > maxLen) ? _packedLen + maxLen : _previewsLen;
 
-            ++result;
+    while (_packedLen < end)
+    {
+        const unsigned len = (end - _packedLen > cPackBlockSize) ? cPackBlockSize : end - _packedLen;
+
+        if (!Tools::PackText(_previews.data() + _packedLen, len, _packedPreviews))
+        {
+            std::vector<char>().swap(_packedPreviews);
+            _packedLen = 0;
+            _packFailed = true;
+            return false;
         }
 
-        pSrc = pEol;
+        _packedLen += len;
     }
 
-    return result;
+    if (_packedLen < _previewsLen)
+        return true;
+
+    std::vector<char>().swap(_previews);
+    _packedPreviews.shrink_to_fit();
+
+    return false;
 }
 
 
 /**
  *  \brief
  */
-int ResultWin::TabParser::parseCmd(const CmdPtr_t& cmd)
+unsigned ResultWin::TabParser::MemSize() const
 {
-    int result = 0;
+    unsigned size = _header.Size() + _fileNames.capacity() + _previews.capacity() + _packedPreviews.capacity();
 
-    bool filterReoccurring = false;
+    size += (_fileNameOffset.capacity() + _fileNameLen.capacity() + _fileHits.capacity() +
+            _hitFile.capacity() + _hitLine.capacity() +
+            _hitPreviewOffset.capacity() + _hitPreviewLen.capacity()) * sizeof(unsigned);
 
-    const DbConfig& cfg = cmd->Db()->GetConfig();
-    if (cmd->Id() == FIND_DEFINITION && cfg._useLibDb)
+    if (_text)
+        size += _text->Size();
+
+    return size;
+}
+
+
+/**
+ *  \brief  Returns the file table index of the file or -1 if there are no results in it.
+ *          If runs is given it gets the number of file table entries of the file (its results are not contiguous).
+ */
+int ResultWin::TabParser::FindFile(const CPath& root, const PathKey& file, unsigned* runs) const
+{
+    int fileIdx = -1;
+
+    if (runs)
+        *runs = 0;
+
+    for (unsigned i = 0; i < _fileNameLen.size(); ++i)
     {
-        for (const auto& libPath : cfg._libDbPaths)
+        CPath path;
+
+        // Path is not absolute (does not start with drive letter)
+        if (_fileNameLen[i] < 3 || fileName(i)[1] != ':')
+            path = root;
+
+        path.Append(fileName(i), _fileNameLen[i]);
+
+        if (PathKey(path) == file)
         {
-            if (libPath.IsParentOf(cmd->Db()->GetPath()))
-            {
-                filterReoccurring = true;
+            if (fileIdx < 0)
+                fileIdx = i;
+
+            if (!runs)
                 break;
-            }
+
+            ++*runs;
         }
     }
 
-    StrUniquenessChecker<char> strChecker;
+    return fileIdx;
+}
 
-    char*       pSrc = cmd->Result();
-    char*       pIdx;
 
-    const char* pLine;
-    const char* pPreviousFile = NULL;
-    unsigned    previousFileLen = 0;
-    bool        previousFileFiltered = false;
+/**
+ *  \brief  Returns the display text line of the file header - the search header is line 0
+ */
+unsigned ResultWin::TabParser::FileLine(unsigned fileIdx) const
+{
+    unsigned line = 1;
 
-    unsigned    previousBufLen;
+    for (unsigned i = 0; i < fileIdx; ++i)
+        line += 1 + _fileHits[i];
 
-    for (;;)
-    {
-        while (*pSrc == '\n' || *pSrc == '\r')
-            ++pSrc;
-        if (*pSrc == 0) break;
+    return line;
+}
 
-        previousBufLen = _buf.Len();
-        pLine = pSrc;
 
-        pIdx = pSrc;
-        while (*pIdx != ':')
-            ++pIdx;
+/**
+ *  \brief  Replaces the results in file fileIdx (-1 if there were none) with the results in file updateIdx
+ *          of the update (-1 if there are none). A file without results is dropped, a new one goes last.
+ *          Returns the display text lines the file takes now.
+ */
+unsigned ResultWin::TabParser::Splice(int fileIdx, const TabParser& update, int updateIdx)
+{
+    ReleaseText();
 
-        // Path is absolute (starts with drive letter)
-        if ((pIdx - pSrc == 1) && ((*(pIdx + 1) == '\\') || (*(pIdx + 1) == '/')))
-            while (*++pIdx != ':');
+    // The previews pool is rebuilt
+    if (IsPacked())
+    {
+        _previews.resize(_previewsLen);
 
-        // add new file name to the UI buffer only if it is different
-        // than the previous one
-        if ((pPreviousFile == NULL) || ((unsigned)(pIdx - pSrc) != previousFileLen) ||
-            strncmp(pSrc, pPreviousFile, previousFileLen))
-        {
-            pPreviousFile = pSrc;
-            previousFileLen = pIdx - pSrc;
+        if (!Tools::UnpackText(_packedPreviews, _previews.data(), _previewsLen))
+            _previews.assign(_previewsLen, ' ');
+    }
 
-            if (filterEntry(cfg, pPreviousFile, previousFileLen))
-            {
-                previousFileFiltered = true;
-            }
-            else
-            {
-                _buf += "\n\t";
-                _buf.Append(pPreviousFile, previousFileLen);
+    std::vector<char>().swap(_packedPreviews);
+    _packedLen = 0;
 
-                previousFileFiltered = false;
-            }
-        }
+    if (fileIdx >= 0)
+    {
+        // Hits previews are in the pool in hits order so they can be compacted in place
+        unsigned kept = 0;
+        unsigned previewsLen = 0;
 
-        if (previousFileFiltered)
+        for (unsigned i = 0; i < _hitFile.size(); ++i)
         {
-            while (*pSrc != '\n' && *pSrc != '\r')
-                ++pSrc;
-            continue;
-        }
+            if (_hitFile[i] == (unsigned)fileIdx)
+                continue;
 
-        pSrc = ++pIdx;
-        while (*pSrc != ':')
-            ++pSrc;
+            memmove(_previews.data() + previewsLen, _previews.data() + _hitPreviewOffset[i], _hitPreviewLen[i]);
 
-        _buf += "\n\t\tline ";
-        _buf.Append(pIdx, pSrc - pIdx);
-        _buf += ":\t";
+            _hitFile[kept]          = _hitFile[i];
+            _hitLine[kept]          = _hitLine[i];
+            _hitPreviewOffset[kept] = previewsLen;
+            _hitPreviewLen[kept]    = _hitPreviewLen[i];
 
-        pIdx = ++pSrc;
-        while (*pIdx == ' ' || *pIdx == '\t')
-            ++pIdx;
+            previewsLen += _hitPreviewLen[i];
+            ++kept;
+        }
 
-        pSrc = pIdx + 1;
-        while (*pSrc != '\n' && *pSrc != '\r')
-            ++pSrc;
+        _hitFile.resize(kept);
+        _hitLine.resize(kept);
+        _hitPreviewOffset.resize(kept);
+        _hitPreviewLen.resize(kept);
+        _previews.resize(previewsLen);
+        _previewsLen = previewsLen;
 
-        if (pSrc == pIdx + 1)
-            return -1;
+        _fileHits[fileIdx] = 0;
+    }
 
-        _buf.Append(pIdx, pSrc - pIdx);
+    if (updateIdx < 0 || update._fileHits[updateIdx] == 0)
+    {
+        if (fileIdx >= 0)
+        {
+            eraseFile(fileIdx);
 
-        *pSrc++ = 0;
+            for (auto& hitFile : _hitFile)
+                if (hitFile > (unsigned)fileIdx)
+                    --hitFile;
+        }
 
-        if (filterReoccurring && !strChecker.IsUnique(pLine))
-            _buf.Resize(previousBufLen);
-        else
-            ++result;
+        return 0;
     }
 
-    return result;
+    if (fileIdx < 0)
+    {
+        fileIdx = _fileNameLen.size();
+        _fileNameOffset.push_back(_fileNames.size());
+        _fileNameLen.push_back(update._fileNameLen[updateIdx]);
+        _fileNames.insert(_fileNames.end(), update.fileName(updateIdx),
+                update.fileName(updateIdx) + update._fileNameLen[updateIdx]);
+        _fileHits.push_back(0);
+    }
+
+    for (unsigned i = 0; i < update._hitFile.size(); ++i)
+        if (update._hitFile[i] == (unsigned)updateIdx)
+            addHit(fileIdx, update._hitLine[i], update._previews.data() + update._hitPreviewOffset[i],
+                    update._hitPreviewLen[i]);
+
+    return 1 + _fileHits[fileIdx];
 }
 
 
 /**
- *  \brief
+ *  \brief  Search header - cmd name + search word + project path
  */
-ResultWin::Tab::Tab(const CmdPtr_t& cmd) :
-    _cmdId(cmd->Id()), _regExp(cmd->RegExp()), _matchCase(cmd->MatchCase()),
-    _projectPath(cmd->Db()->GetPath().C_str()), _search(cmd->Tag().C_str()), _currentLine(1), _firstVisibleLine(0),
-    _parser(cmd->Parser())
+void ResultWin::TabParser::composeHeader(const CmdPtr_t& cmd)
 {
+    _header = cmd->Name();
+    _header += " \"";
+    _header += cmd->Tag().C_str();
+    _header += "\" (";
+    _header += cmd->RegExp() ? "regexp, ": "literal, ";
+    _header += cmd->MatchCase() ? "match case": "ignore case";
+    _header += ") in \"";
+    _header += cmd->Db()->GetPath().C_str();
+    _header += "\"";
+
+    if (!cmd->Warning().IsEmpty())
+    {
+        _header += " - ";
+        _header += cmd->Warning();
+    }
 }
 
 
 /**
- *  \brief
+ *  \brief  Drops the results model (including the results already given partially)
  */
-inline void ResultWin::Tab::SetFolded(int lineNum)
+void ResultWin::TabParser::clear()
 {
-    _expandedLines.erase(lineNum);
+    ReleaseText();
+    _packedPreviews.clear();
+    _packedLen = 0;
+
+    _fileNames.clear();
+    _fileNameOffset.clear();
+    _fileNameLen.clear();
+    _fileHits.clear();
+    _hitFile.clear();
+    _hitLine.clear();
+    _hitPreviewOffset.clear();
+    _hitPreviewLen.clear();
+    _previews.clear();
+    _previewsLen = 0;
+
+    _partialFiles = 0;
+    _partialHits = 0;
+    _partialFile = -1;
 }
 
 
 /**
- *  \brief
+ *  \brief  Returns the file table index of the file, adding it if it is not the last one. The table keeps the order
+ *          of global output - a file found again after other files gets a new entry, just like a new file header.
  */
-inline void ResultWin::Tab::SetAllFolded()
+unsigned ResultWin::TabParser::internFile(const char* pFile, unsigned len)
 {
-    _expandedLines.clear();
+    if (!_fileNameLen.empty())
+    {
+        const unsigned last = _fileNameLen.size() - 1;
+
+        if (_fileNameLen[last] == len && !strncmp(fileName(last), pFile, len))
+            return last;
+    }
+
+    _fileNameOffset.push_back(_fileNames.size());
+    _fileNameLen.push_back(len);
+    _fileNames.insert(_fileNames.end(), pFile, pFile + len);
+    _fileHits.push_back(0);
+
+    return _fileNameLen.size() - 1;
 }
 
 
 /**
- *  \brief
+ *  \brief  Removes the file table entry and its name from the pool. The file should have no results left.
  */
-inline void ResultWin::Tab::ClearFolded(int lineNum)
+void ResultWin::TabParser::eraseFile(unsigned fileIdx)
 {
-    _expandedLines.insert(lineNum);
+    const unsigned offset = _fileNameOffset[fileIdx];
+    const unsigned len = _fileNameLen[fileIdx];
+
+    _fileNames.erase(_fileNames.begin() + offset, _fileNames.begin() + offset + len);
+
+    for (unsigned i = fileIdx + 1; i < _fileNameOffset.size(); ++i)
+        _fileNameOffset[i] -= len;
+
+    _fileNameOffset.erase(_fileNameOffset.begin() + fileIdx);
+    _fileNameLen.erase(_fileNameLen.begin() + fileIdx);
+    _fileHits.erase(_fileHits.begin() + fileIdx);
 }
 
 
 /**
  *  \brief
  */
-inline bool ResultWin::Tab::IsFolded(int lineNum)
+void ResultWin::TabParser::addHit(unsigned fileIdx, unsigned line, const char* pPreview, unsigned len)
 {
-    return (_expandedLines.find(lineNum) == _expandedLines.end());
+    _hitFile.push_back(fileIdx);
+    _hitLine.push_back(line);
+    _hitPreviewOffset.push_back(_previewsLen);
+    _hitPreviewLen.push_back(len);
+
+    _previews.insert(_previews.cend(), pPreview, pPreview + len);
+    _previewsLen += len;
+
+    ++_fileHits[fileIdx];
 }
 
 
 /**
- *  \brief
+ *  \brief  Builds the display text - results grouped by file table entry (the order of global output).
+ *          Refreshed file results are added at the end of the results arrays so they need the grouping.
  */
-HWND ResultWin::Register()
+void ResultWin::TabParser::composeText() const
 {
-    if (RW)
-        return NULL;
-
-    WNDCLASS wc         = {0};
-    wc.style            = CS_HREDRAW | CS_VREDRAW;
-    wc.lpfnWndProc      = wndProc;
-    wc.hInstance        = HMod;
-    wc.hCursor          = LoadCursor(NULL, IDC_ARROW);
-    wc.hbrBackground    = GetSysColorBrush(COLOR_WINDOW);
-    wc.lpszClassName    = cClassName;
+    _text.reset(new CTextA(_header));
+    CTextA& text = *_text;
 
-    RegisterClass(&wc);
+    std::vector<char> unpacked;
+    const char* previews = _previews.data();
 
-    wc.lpfnWndProc      = searchWndProc;
-    wc.hbrBackground    = GetSysColorBrush(COLOR_BTNFACE);
-    wc.lpszClassName    = cSearchClassName;
+    if (IsPacked())
+    {
+        unpacked.resize(_previewsLen);
 
-    RegisterClass(&wc);
+        // Should never happen - show the results without previews rather than nothing
+        if (!Tools::UnpackText(_packedPreviews, unpacked.data(), _previewsLen))
+            unpacked.assign(_previewsLen, ' ');
 
-    INITCOMMONCONTROLSEX icex   = {0};
-    icex.dwSize                 = sizeof(icex);
-    icex.dwICC                  = ICC_STANDARD_CLASSES;
+        previews = unpacked.data();
+    }
 
-    InitCommonControlsEx(&icex);
+    // Counting sort of the results by file
+    const unsigned filesCount = _fileNameLen.size();
+    std::vector<unsigned> fileStart(filesCount + 1, 0);
 
-    // Scintilla uses that, make sure it is not accidentally unloaded
-    LoadLibrary(_T("Riched20.dll"));
+    for (unsigned i = 0; i < filesCount; ++i)
+        fileStart[i + 1] = fileStart[i] + _fileHits[i];
 
-    RW = new ResultWin();
-    if (RW->composeWindow() == NULL)
+    std::vector<unsigned> order(_hitLine.size());
     {
-        Unregister();
-        return NULL;
+        std::vector<unsigned> pos(fileStart.begin(), fileStart.end() - 1);
+
+        for (unsigned i = 0; i < _hitFile.size(); ++i)
+            order[pos[_hitFile[i]]++] = i;
     }
 
-    tTbData data        = {0};
-    data.hClient        = RW->_hWnd;
-    data.pszName        = const_cast<TCHAR*>(cPluginName);
-    data.uMask          = 0;
-    data.pszAddInfo     = NULL;
-    data.uMask          = DWS_DF_CONT_BOTTOM;
-    data.pszModuleName  = DllPath.GetFilename();
-    data.dlgID          = 0;
+    char lineNum[16];
 
-    INpp& npp = INpp::Get();
-    npp.RegisterDockingWin(data);
-    npp.HideDockingWin(RW->_hWnd);
+    for (unsigned i = 0; i < filesCount; ++i)
+    {
+        text += "\n\t";
+        text.Append(fileName(i), _fileNameLen[i]);
 
-    return RW->_hWnd;
+        for (unsigned j = fileStart[i]; j < fileStart[i + 1]; ++j)
+        {
+            const unsigned hit = order[j];
+
+            _itoa_s(_hitLine[hit], lineNum, _countof(lineNum), 10);
+
+            text += "\n\t\tline ";
+            text += lineNum;
+            text += ":\t";
+            text.Append(previews + _hitPreviewOffset[hit], _hitPreviewLen[hit]);
+        }
+    }
 }
 
 
 /**
  *  \brief
  */
-void ResultWin::Unregister()
+bool ResultWin::TabParser::filterEntry(const DbConfig& cfg, const char* pEntry, unsigned len)
 {
-    if (RW)
+    if (cfg._usePathFilter)
     {
-        delete RW;
-        RW = NULL;
+        CPath currentEntry;
+        currentEntry.Append(pEntry, len);
+
+        return cfg.IsPathFiltered(currentEntry.C_str(), currentEntry.Len());
     }
 
-    UnregisterClass(cClassName, HMod);
-    UnregisterClass(cSearchClassName, HMod);
+    return false;
 }
 
 
 /**
  *  \brief
  */
-void ResultWin::show()
+int ResultWin::TabParser::parseFindFile(const CmdPtr_t& cmd, const char* pSrc)
 {
-    INpp& npp = INpp::Get();
-
-    if (GetFocus() != npp.ReadSciHandle())
-        SetFocus(npp.GetSciHandle());
-    else if (TabCtrl_GetItemCount(_hTab))
-        showWindow();
-}
+    int result = 0;
 
+    const char* pEol;
 
-/**
- *  \brief
- */
-void ResultWin::show(const CmdPtr_t& cmd)
-{
-    Tab* tab = new Tab(cmd);
+    const DbConfig& cfg = cmd->Db()->GetConfig();
 
-    int i;
-    for (i = TabCtrl_GetItemCount(_hTab); i; --i)
+    for (unsigned lines = 1;; ++lines)
     {
-        Tab* oldTab = getTab(i - 1);
+        if (!(lines % Cmd::cCancelCheckLines) && cmd->IsCancelled())
+            break;
 
-        if (oldTab && (*tab == *oldTab)) // same search tab already present?
-        {
-            if (_activeTab == oldTab) // is this the currently active tab?
-                _activeTab = NULL;
-            delete oldTab;
+        while (*pSrc == '\n' || *pSrc == '\r' || *pSrc == ' ' || *pSrc == '\t')
+            ++pSrc;
+        if (*pSrc == 0) break;
+
+        pEol = pSrc;
+        while (*pEol != '\n' && *pEol != '\r' && *pEol != 0)
+            ++pEol;
+
+        if (!filterEntry(cfg, pSrc, pEol - pSrc))
+        {
+            internFile(pSrc, pEol - pSrc);
+
+            ++result;
+        }
+
+        pSrc = pEol;
+    }
+
+    return result;
+}
+
+
+/**
+ *  \brief  Parses the output spilled to file in chunks of whole lines so the file is never mapped (or copied) whole
+ */
+int ResultWin::TabParser::parseSpillFile(const CmdPtr_t& cmd, const SpillFile& file)
+{
+    int result = 0;
+
+    // Without the \0 string termination
+    const unsigned size = file.Size() - 1;
+
+    unsigned chunkSize = cSpillChunkSize;
+    std::vector<char> chunk(chunkSize + 1);
+
+    for (unsigned offset = 0; offset < size;)
+    {
+        unsigned len = file.Read(offset, chunk.data(), (size - offset > chunkSize) ? chunkSize : size - offset);
+        if (len == 0)
+            return -1;
+
+        // The incomplete last line is read again with the next chunk
+        if (offset + len < size)
+        {
+            unsigned lineEnd = len;
+            while (lineEnd && chunk[lineEnd - 1] != '\n')
+                --lineEnd;
+
+            // Line longer than the chunk - unlikely but try again with bigger one
+            if (lineEnd == 0)
+            {
+                chunkSize *= 2;
+                chunk.resize(chunkSize + 1);
+                continue;
+            }
+
+            len = lineEnd;
+        }
+
+        chunk[len] = 0;
+
+        const int parsed = (cmd->Id() == FIND_FILE) ? parseFindFile(cmd, chunk.data()) : parseCmd(cmd, chunk.data());
+        if (parsed < 0)
+            return parsed;
+
+        result += parsed;
+
+        if (cmd->IsCancelled())
+            break;
+
+        offset += len;
+    }
+
+    return result;
+}
+
+
+/**
+ *  \brief  Parses global -f output - all results are in the searched file
+ */
+int ResultWin::TabParser::parseFileTags(const CmdPtr_t& cmd)
+{
+    int result = 0;
+
+    const CTextA path(cmd->Tag().C_str());
+
+    if (filterEntry(cmd->Db()->GetConfig(), path.C_str(), path.Len()))
+        return 0;
+
+    unsigned fileIdx = 0;
+    FileTags::Entry entry;
+
+    unsigned lines = 0;
+    for (const char* pSrc = cmd->Result(); (pSrc = FileTags::ParseEntry(pSrc, path, entry)) != NULL;)
+    {
+        if (!(++lines % Cmd::cCancelCheckLines) && cmd->IsCancelled())
             break;
+
+        if (!entry._nameLen)
+            continue;
+
+        if (result == 0)
+            fileIdx = internFile(path.C_str(), path.Len());
+
+        addHit(fileIdx, entry._line, entry._image, entry._imageLen);
+        ++result;
+    }
+
+    return result;
+}
+
+
+/**
+ *  \brief
+ */
+int ResultWin::TabParser::parseCmd(const CmdPtr_t& cmd, const char* pSrc)
+{
+    int result = 0;
+
+    bool filterReoccurring = false;
+
+    const DbConfig& cfg = cmd->Db()->GetConfig();
+    if (cmd->Id() == FIND_DEFINITION && cfg._useLibDb)
+    {
+        for (const auto& libPath : cfg._libDbPaths)
+        {
+            if (libPath.IsParentOf(cmd->Db()->GetPath()))
+            {
+                filterReoccurring = true;
+                break;
+            }
         }
     }
 
-    if (i == 0) // search is completely new - add new tab
+    StrUniquenessChecker<char> strChecker;
+
+    const char* pIdx;
+
+    const char* pLine;
+    const char* pPreviousFile = NULL;
+    unsigned    previousFileLen = 0;
+    unsigned    previousFileIdx = 0;
+    bool        previousFileFiltered = false;
+
+    unsigned    lineNum;
+
+    for (unsigned lines = 1;; ++lines)
     {
-        TCHAR buf[64];
-        _sntprintf_s(buf, _countof(buf), _TRUNCATE, _T("%s \"%s\""), cmd->Name(), cmd->Tag().C_str());
+        if (!(lines % Cmd::cCancelCheckLines) && cmd->IsCancelled())
+            break;
+
+        while (*pSrc == '\n' || *pSrc == '\r')
+            ++pSrc;
+        if (*pSrc == 0) break;
+
+        pLine = pSrc;
+
+        pIdx = pSrc;
+        while (*pIdx != ':' && *pIdx != 0)
+            ++pIdx;
+
+        // Path is absolute (starts with drive letter)
+        if ((pIdx - pSrc == 1) && ((*(pIdx + 1) == '\\') || (*(pIdx + 1) == '/')))
+            while (*++pIdx != ':' && *pIdx != 0);
+
+        if (*pIdx == 0)
+            return -1;
+
+        // look-up the file only if it is different than the previous one
+        if ((pPreviousFile == NULL) || ((unsigned)(pIdx - pSrc) != previousFileLen) ||
+            strncmp(pSrc, pPreviousFile, previousFileLen))
+        {
+            pPreviousFile = pSrc;
+            previousFileLen = pIdx - pSrc;
+
+            if (filterEntry(cfg, pPreviousFile, previousFileLen))
+            {
+                previousFileFiltered = true;
+            }
+            else
+            {
+                previousFileIdx = internFile(pPreviousFile, previousFileLen);
+                previousFileFiltered = false;
+            }
+        }
+
+        if (previousFileFiltered)
+        {
+            while (*pSrc != '\n' && *pSrc != '\r')
+                ++pSrc;
+            continue;
+        }
+
+        lineNum = 0;
+        for (pSrc = pIdx + 1; *pSrc != ':'; ++pSrc)
+        {
+            if (*pSrc < '0' || *pSrc > '9')
+                return -1;
+
+            lineNum = lineNum * 10 + (*pSrc - '0');
+        }
+
+        if (pSrc == pIdx + 1)
+            return -1;
+
+        pIdx = ++pSrc;
+        while (*pIdx == ' ' || *pIdx == '\t')
+            ++pIdx;
+
+        pSrc = pIdx + 1;
+        while (*pSrc != '\n' && *pSrc != '\r')
+            ++pSrc;
+
+        if (pSrc == pIdx + 1)
+            return -1;
+
+        // The result may be a read-only mapped file so don't terminate the line in place
+        if (!filterReoccurring || strChecker.IsUnique(pLine, pSrc - pLine))
+        {
+            addHit(previousFileIdx, lineNum, pIdx, pSrc - pIdx);
+            ++result;
+        }
+    }
+
+    return result;
+}
+
+
+/**
+ *  \brief
+ */
+ResultWin::Tab::Tab(const CmdPtr_t& cmd) :
+    _cmdId(cmd->Id()), _regExp(cmd->RegExp()), _matchCase(cmd->MatchCase()), _name(cmd->Name()),
+    _projectPath(cmd->Db()->GetPath().C_str()), _search(cmd->Tag().C_str()), _currentLine(1), _firstVisibleLine(0),
+    _parser(std::static_pointer_cast<TabParser>(cmd->Parser())), _doc(0), _docSize(0), _lastUsed(0),
+    _reloading(false)
+{
+}
+
+
+/**
+ *  \brief
+ */
+inline void ResultWin::Tab::SetFolded(int lineNum)
+{
+    _expandedLines.erase(lineNum);
+}
+
+
+/**
+ *  \brief
+ */
+inline void ResultWin::Tab::SetAllFolded()
+{
+    _expandedLines.clear();
+}
+
+
+/**
+ *  \brief
+ */
+inline void ResultWin::Tab::ClearFolded(int lineNum)
+{
+    _expandedLines.insert(lineNum);
+}
+
+
+/**
+ *  \brief
+ */
+inline bool ResultWin::Tab::IsFolded(int lineNum)
+{
+    return (_expandedLines.find(lineNum) == _expandedLines.end());
+}
+
+
+/**
+ *  \brief  Moves the fold and scroll state after lines [start, start + oldLen) were replaced by newLen lines
+ */
+void ResultWin::Tab::RemapLines(int start, int oldLen, int newLen)
+{
+    auto remap = [start, oldLen, newLen](int lineNum) -> int
+    {
+        if (lineNum < start)
+            return lineNum;
+        if (lineNum >= start + oldLen)
+            return lineNum + newLen - oldLen;
+
+        // Within the replaced lines - stay there if possible
+        return (lineNum < start + newLen) ? lineNum : (newLen ? start + newLen - 1 : start);
+    };
+
+    std::unordered_set<int> expandedLines;
+
+    for (int lineNum : _expandedLines)
+    {
+        // The replaced file header keeps its state unless the file is gone
+        if (lineNum != start || newLen)
+            expandedLines.insert(remap(lineNum));
+    }
+
+    _expandedLines.swap(expandedLines);
+
+    _currentLine = remap(_currentLine);
+    _firstVisibleLine = remap(_firstVisibleLine);
+}
+
+
+/**
+ *  \brief
+ */
+HWND ResultWin::Register()
+{
+    if (RW)
+        return NULL;
+
+    WNDCLASS wc         = {0};
+    wc.style            = CS_HREDRAW | CS_VREDRAW;
+    wc.lpfnWndProc      = wndProc;
+    wc.hInstance        = HMod;
+    wc.hCursor          = LoadCursor(NULL, IDC_ARROW);
+    wc.hbrBackground    = GetSysColorBrush(COLOR_WINDOW);
+    wc.lpszClassName    = cClassName;
+
+    RegisterClass(&wc);
+
+    wc.lpfnWndProc      = searchWndProc;
+    wc.hbrBackground    = GetSysColorBrush(COLOR_BTNFACE);
+    wc.lpszClassName    = cSearchClassName;
+
+    RegisterClass(&wc);
+
+    INITCOMMONCONTROLSEX icex   = {0};
+    icex.dwSize                 = sizeof(icex);
+    icex.dwICC                  = ICC_STANDARD_CLASSES;
+
+    InitCommonControlsEx(&icex);
+
+    // Scintilla uses that, make sure it is not accidentally unloaded
+    LoadLibrary(_T("Riched20.dll"));
+
+    RW = new ResultWin();
+    if (RW->composeWindow() == NULL)
+    {
+        Unregister();
+        return NULL;
+    }
+
+    tTbData data        = {0};
+    data.hClient        = RW->_hWnd;
+    data.pszName        = const_cast<TCHAR*>(cPluginName);
+    data.uMask          = 0;
+    data.pszAddInfo     = NULL;
+    data.uMask          = DWS_DF_CONT_BOTTOM;
+    data.pszModuleName  = DllPath.GetFilename();
+    data.dlgID          = 0;
+
+    INpp& npp = INpp::Get();
+    npp.RegisterDockingWin(data);
+    npp.HideDockingWin(RW->_hWnd);
+
+    DbManager::Get().SetChangesCB(OnDbUpdate);
+
+    return RW->_hWnd;
+}
+
+
+/**
+ *  \brief
+ */
+void ResultWin::Unregister()
+{
+    if (RW)
+    {
+        DbManager::Get().SetChangesCB(NULL);
+
+        delete RW;
+        RW = NULL;
+    }
+
+    UnregisterClass(cClassName, HMod);
+    UnregisterClass(cSearchClassName, HMod);
+}
+
+
+/**
+ *  \brief
+ */
+void ResultWin::show()
+{
+    INpp& npp = INpp::Get();
+
+    if (GetFocus() != npp.ReadSciHandle())
+        SetFocus(npp.GetSciHandle());
+    else if (TabCtrl_GetItemCount(_hTab))
+        showWindow();
+}
+
+
+/**
+ *  \brief
+ */
+void ResultWin::show(const CmdPtr_t& cmd)
+{
+    Tab* tab = new Tab(cmd);
+
+    // The results shown while the search was running are kept - the tab with them is replaced below
+    sptr_t liveDoc = 0;
+    if (cmd == _liveCmd)
+        liveDoc = adoptLiveDoc(tab);
+    else if (_liveDone)
+        dropLiveTab();
+
+    int i;
+    for (i = TabCtrl_GetItemCount(_hTab); i; --i)
+    {
+        Tab* oldTab = getTab(i - 1);
+
+        if (oldTab && (*tab == *oldTab)) // same search tab already present?
+        {
+            deleteTab(oldTab);
+            break;
+        }
+    }
+
+    if (i == 0) // search is completely new - add new tab
+    {
+        TCHAR buf[64];
+        _sntprintf_s(buf, _countof(buf), _TRUNCATE, _T("%s \"%s\""), cmd->Name(), cmd->Tag().C_str());
+
+        TCITEM tci  = {0};
+        tci.mask    = TCIF_TEXT | TCIF_PARAM;
+        tci.pszText = buf;
+        tci.lParam  = (LPARAM)tab;
+
+        i = TabCtrl_InsertItem(_hTab, TabCtrl_GetItemCount(_hTab), &tci);
+        if (i == -1)
+        {
+            deleteTab(tab);
+            return;
+        }
+    }
+    else // same search tab exists - reuse it, just update results
+    {
+        TCITEM tci  = {0};
+        tci.mask    = TCIF_PARAM;
+        tci.lParam  = (LPARAM)tab;
+
+        if (!TabCtrl_SetItem(_hTab, --i, &tci))
+        {
+            TabCtrl_DeleteItem(_hTab, i);
+            deleteTab(tab);
+            tab = NULL;
+        }
+        else
+        {
+            // The live tab was shown next to the old results of the same search - those go now
+            for (int j = TabCtrl_GetItemCount(_hTab); j; --j)
+            {
+                Tab* oldTab = getTab(j - 1);
+
+                if (oldTab && oldTab != tab && (*tab == *oldTab))
+                {
+                    deleteTab(oldTab);
+                    TabCtrl_DeleteItem(_hTab, j - 1);
+
+                    if (j - 1 < i)
+                        --i;
+                }
+            }
+        }
+    }
+
+    if (tab == NULL)
+    {
+        if (liveDoc)
+            sendSci(SCI_RELEASEDOCUMENT, 0, liveDoc);
+
+        if (_activeTab)
+            return;
+
+        int cnt = TabCtrl_GetItemCount(_hTab);
+        if (cnt == 0)
+        {
+            closeAllTabs();
+            return;
+        }
+
+        if (i > cnt - 1)
+            i = cnt - 1;
+        tab = getTab(i);
+    }
+
+    TabCtrl_SetCurSel(_hTab, i);
+
+    if (liveDoc)
+        resumeTab(tab, liveDoc);
+    else
+        loadTab(tab);
+
+    showWindow();
+}
+
+
+/**
+ *  \brief
+ */
+void ResultWin::applyStyle()
+{
+    INpp& npp = INpp::Get();
+
+    char font[32];
+    npp.GetFontName(STYLE_DEFAULT, font);
+    int size = npp.GetFontSize(STYLE_DEFAULT);
+    COLORREF caretLineBackColor = npp.GetCaretLineBack();
+    COLORREF foreColor = npp.GetForegroundColor(STYLE_DEFAULT);
+    COLORREF backColor = npp.GetBackgroundColor(STYLE_DEFAULT);
+    COLORREF lineNumColor = npp.GetForegroundColor(STYLE_LINENUMBER);
+
+    COLORREF fileForeColor =
+            RGB(GetRValue(backColor) ^ 0xFF, GetGValue(backColor) ^ 0x7F, GetBValue(backColor) ^ 0x7F);
+    COLORREF findForeColor =
+            RGB(GetRValue(backColor) ^ 0x1C, GetGValue(backColor) ^ 0xFF, GetBValue(backColor) ^ 0xFF);
+
+    HFONT hFont = Tools::CreateFromSystemMenuFont();
+    if (hFont)
+        SendMessage(_hTab, WM_SETFONT, (WPARAM)hFont, TRUE);
+
+    sendSci(SCI_STYLERESETDEFAULT);
+    setStyle(STYLE_DEFAULT, foreColor, backColor, false, false, size, font);
+    sendSci(SCI_STYLECLEARALL);
+
+    setStyle(SCE_GTAGS_HEADER, foreColor, backColor, true);
+    setStyle(SCE_GTAGS_PROJECT_PATH, foreColor, backColor, true, true);
+    setStyle(SCE_GTAGS_FILE, fileForeColor, backColor, true);
+    setStyle(SCE_GTAGS_LINE_NUM, lineNumColor, backColor, false, true);
+    setStyle(SCE_GTAGS_WORD2SEARCH, findForeColor, backColor, true);
+
+    sendSci(SCI_SETCARETLINEBACK, caretLineBackColor);
+    sendSci(SCI_STYLESETHOTSPOT, SCE_GTAGS_WORD2SEARCH, true);
+}
+
+
+/**
+ *  \brief
+ */
+ResultWin::~ResultWin()
+{
+    RefreshCmd.Cancel();
+
+    if (_hWnd)
+    {
+        closeAllTabs();
+
+        if (_hSci)
+        {
+            INpp::Get().DestroySciHandle(_hSci);
+            _hSci = NULL;
+        }
+
+        SendMessage(_hWnd, WM_CLOSE, 0, 0);
+    }
+}
+
+
+/**
+ *  \brief
+ */
+void ResultWin::setStyle(int style, COLORREF fore, COLORREF back, bool bold, bool italic, int size, const char *font)
+{
+    sendSci(SCI_STYLESETEOLFILLED, style, 1);
+    sendSci(SCI_STYLESETFORE, style, fore);
+    sendSci(SCI_STYLESETBACK, style, back);
+    sendSci(SCI_STYLESETBOLD, style, bold);
+    sendSci(SCI_STYLESETITALIC, style, italic);
+
+    if (size >= 1)
+        sendSci(SCI_STYLESETSIZE, style, size);
+    if (font)
+        sendSci(SCI_STYLESETFONT, style, reinterpret_cast<LPARAM>(font));
+}
+
+
+/**
+ *  \brief
+ */
+void ResultWin::configScintilla()
+{
+    configDocument();
+
+    sendSci(SCI_USEPOPUP, false);
+    sendSci(SCI_SETCARETSTYLE, CARETSTYLE_LINE);
+    sendSci(SCI_SETCARETLINEVISIBLE, true);
+    sendSci(SCI_SETCARETLINEVISIBLEALWAYS, true);
+    sendSci(SCI_SETHOTSPOTACTIVEUNDERLINE, false);
+
+    sendSci(SCI_SETWRAPMODE, SC_WRAP_WORD);
+    sendSci(SCI_SETWRAPVISUALFLAGS, SC_WRAPVISUALFLAG_START);
+    sendSci(SCI_SETWRAPVISUALFLAGSLOCATION, SC_WRAPVISUALFLAGLOC_DEFAULT);
+    sendSci(SCI_SETWRAPINDENTMODE, SC_WRAPINDENT_FIXED);
+    sendSci(SCI_SETWRAPSTARTINDENT, 24);
+    sendSci(SCI_SETLAYOUTCACHE, SC_CACHE_CARET);
+
+    // Implement lexer in the container
+    sendSci(SCI_SETLEXER, 0);
+
+    ApplyStyle();
+
+    sendSci(SCI_SETPROPERTY, reinterpret_cast<WPARAM>("fold"), reinterpret_cast<LPARAM>("1"));
+
+    sendSci(SCI_SETMARGINTYPEN, 1, SC_MARGIN_SYMBOL);
+    sendSci(SCI_SETMARGINMASKN, 1, SC_MASK_FOLDERS);
+    sendSci(SCI_SETMARGINWIDTHN, 1, 20);
+    sendSci(SCI_SETFOLDMARGINCOLOUR, 1, cBlack);
+    sendSci(SCI_SETFOLDMARGINHICOLOUR, 1, cBlack);
+    sendSci(SCI_SETMARGINSENSITIVEN, 1, true);
+    sendSci(SCI_SETFOLDFLAGS, 0);
+
+    sendSci(SCI_MARKERDEFINE, SC_MARKNUM_FOLDER, SC_MARK_BOXPLUS);
+    sendSci(SCI_MARKERDEFINE, SC_MARKNUM_FOLDEROPEN, SC_MARK_BOXMINUS);
+    sendSci(SCI_MARKERDEFINE, SC_MARKNUM_FOLDEREND, SC_MARK_BOXPLUSCONNECTED);
+    sendSci(SCI_MARKERDEFINE, SC_MARKNUM_FOLDERSUB, SC_MARK_VLINE);
+    sendSci(SCI_MARKERDEFINE, SC_MARKNUM_FOLDERTAIL, SC_MARK_LCORNER);
+    sendSci(SCI_MARKERDEFINE, SC_MARKNUM_FOLDERMIDTAIL, SC_MARK_TCORNER);
+    sendSci(SCI_MARKERDEFINE, SC_MARKNUM_FOLDEROPENMID, SC_MARK_BOXMINUSCONNECTED);
+}
+
+
+/**
+ *  \brief  Document settings - each tab has its own Scintilla document
+ */
+void ResultWin::configDocument()
+{
+    sendSci(SCI_SETCODEPAGE, SC_CP_UTF8);
+    sendSci(SCI_SETEOLMODE, SC_EOL_CRLF);
+    sendSci(SCI_SETUNDOCOLLECTION, false);
+}
+
+
+/**
+ *  \brief
+ */
+HWND ResultWin::composeWindow()
+{
+    INpp& npp = INpp::Get();
+    HWND hOwner = npp.GetHandle();
+
+    DWORD style = WS_POPUP | WS_CAPTION | WS_SIZEBOX | WS_CLIPCHILDREN;
+
+    _hWnd = CreateWindow(cClassName, cPluginName, style,
+            0, 0, 10, 10, hOwner, NULL, HMod, NULL);
+    if (_hWnd == NULL)
+        return NULL;
+
+    _hSci = npp.CreateSciHandle(_hWnd);
+    if (_hSci)
+    {
+        _sciFunc    = (SciFnDirect)::SendMessage(_hSci, SCI_GETDIRECTFUNCTION, 0, 0);
+        _sciPtr     = (sptr_t)::SendMessage(_hSci, SCI_GETDIRECTPOINTER, 0, 0);
+    }
+
+    if (_hSci == NULL || _sciFunc == NULL || _sciPtr == 0)
+    {
+        SendMessage(_hWnd, WM_CLOSE, 0, 0);
+        _hWnd = NULL;
+        _hSci = NULL;
+        return NULL;
+    }
+
+    _hTab = CreateWindowEx(0, WC_TABCONTROL, NULL,
+            WS_CHILD | WS_VISIBLE | TCS_BUTTONS | TCS_FOCUSNEVER | TCS_TOOLTIPS,
+            0, 0, 10, 10, _hWnd, NULL, HMod, NULL);
+
+    configScintilla();
+
+    ShowWindow(_hSci, SW_SHOWNORMAL);
+
+    return _hWnd;
+}
+
+
+/**
+ *  \brief
+ */
+void ResultWin::createSearchWindow()
+{
+    if (_hSearch)
+    {
+        SetFocus(_hSearchTxt);
+        Edit_SetSel(_hSearchTxt, 0, -1);
+        return;
+    }
+
+    const DWORD styleEx = WS_EX_WINDOWEDGE | WS_EX_TOOLWINDOW;
+    const DWORD style   = WS_POPUP | WS_CAPTION;
+
+    CreateWindowEx(styleEx, cSearchClassName, _T("Search in results"), style, 0, 0, 10, 10, _hWnd, NULL, HMod, NULL);
+}
+
+
+/**
+ *  \brief
+ */
+void ResultWin::onSearchWindowCreate(HWND hWnd)
+{
+    _hSearch = hWnd;
+
+    HDC hdc = GetWindowDC(_hSearch);
+
+    _hSearchFont    = Tools::CreateFromSystemMessageFont(hdc, cSearchFontSize);
+    _hBtnFont       = Tools::CreateFromSystemMenuFont(hdc, cSearchFontSize - 1);
+
+    int searchHeight    = Tools::GetFontHeight(hdc, _hSearchFont) + 1;
+    int btnHeight       = Tools::GetFontHeight(hdc, _hBtnFont) + 2;
+
+    ReleaseDC(_hSearch, hdc);
+
+    const DWORD styleTxtEx  = WS_EX_CLIENTEDGE;
+    const DWORD styleTxt    = WS_CHILD | WS_VISIBLE;
+
+    {
+        RECT win { 0, 0, cSearchWidth, searchHeight };
+        AdjustWindowRectEx(&win, styleTxt, FALSE, styleTxtEx);
+        searchHeight = win.bottom - win.top;
+    }
+
+    RECT win = Tools::GetWinRect(_hWnd,
+            GetWindowLongPtr(_hSearch, GWL_EXSTYLE), GetWindowLongPtr(_hSearch, GWL_STYLE),
+            cSearchWidth + 1, searchHeight + btnHeight + 1);
+    RECT ownerWin;
+    GetWindowRect(_hWnd, &ownerWin);
+
+    MoveWindow(_hSearch,
+            ownerWin.right - (win.right - win.left) -
+            GetSystemMetrics(SM_CXSIZEFRAME) - GetSystemMetrics(SM_CXFIXEDFRAME) - GetSystemMetrics(SM_CXVSCROLL),
+            ownerWin.top +
+            GetSystemMetrics(SM_CYSIZEFRAME) + GetSystemMetrics(SM_CYFIXEDFRAME) + GetSystemMetrics(SM_CYSIZE),
+            win.right - win.left, win.bottom - win.top, TRUE);
+
+    GetClientRect(_hSearch, &win);
+
+    int btnWidth = (win.right - win.left - 120) / 3;
+
+    _hRE = CreateWindowEx(0, _T("BUTTON"), _T("RegExp"),
+            WS_CHILD | WS_VISIBLE | BS_AUTOCHECKBOX,
+            1, 0, btnWidth, btnHeight,
+            _hSearch, NULL, HMod, NULL);
+
+    _hMC = CreateWindowEx(0, _T("BUTTON"), _T("MatchCase"),
+            WS_CHILD | WS_VISIBLE | BS_AUTOCHECKBOX,
+            btnWidth + 1, 0, btnWidth, btnHeight,
+            _hSearch, NULL, HMod, NULL);
+
+    _hWW = CreateWindowEx(0, _T("BUTTON"), _T("WholeWord"),
+            WS_CHILD | WS_VISIBLE | BS_AUTOCHECKBOX,
+            2 * btnWidth + 1, 0, btnWidth, btnHeight,
+            _hSearch, NULL, HMod, NULL);
+
+    _hUp = CreateWindowEx(0, _T("BUTTON"), _T("Up"),
+            WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+            3 * btnWidth + 1, 0, 60, btnHeight,
+            _hSearch, NULL, HMod, NULL);
+
+    _hDown = CreateWindowEx(0, _T("BUTTON"), _T("Down"),
+            WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+            3 * btnWidth + 61, 0, 60, btnHeight,
+            _hSearch, NULL, HMod, NULL);
+
+    if (_hBtnFont)
+    {
+        SendMessage(_hRE, WM_SETFONT, (WPARAM)_hBtnFont, TRUE);
+        SendMessage(_hMC, WM_SETFONT, (WPARAM)_hBtnFont, TRUE);
+        SendMessage(_hWW, WM_SETFONT, (WPARAM)_hBtnFont, TRUE);
+        SendMessage(_hUp, WM_SETFONT, (WPARAM)_hBtnFont, TRUE);
+        SendMessage(_hDown, WM_SETFONT, (WPARAM)_hBtnFont, TRUE);
+    }
+
+    Button_SetCheck(_hRE, _lastRE ? BST_CHECKED : BST_UNCHECKED);
+    Button_SetCheck(_hMC, _lastMC ? BST_CHECKED : BST_UNCHECKED);
+    Button_SetCheck(_hWW, _lastWW ? BST_CHECKED : BST_UNCHECKED);
+
+    _hSearchTxt = CreateWindowEx(styleTxtEx, RICHEDIT_CLASS, NULL, styleTxt,
+            0, btnHeight + 1, win.right - win.left, searchHeight,
+            _hSearch, NULL, HMod, NULL);
+
+    SendMessage(_hSearchTxt, EM_SETBKGNDCOLOR, 0, GetSysColor(cSearchBkgndColor));
+
+    if (_hSearchFont)
+        SendMessage(_hSearchTxt, WM_SETFONT, (WPARAM)_hSearchFont, TRUE);
+
+    INpp& npp = INpp::Get();
+
+    HWND nppHSci = npp.ReadSciHandle();
+
+    npp.SetSciHandle(_hSci);
+
+    CTextA selectionA;
+    if (!npp.IsSelectionVertical())
+        npp.GetSelection(selectionA);
+
+    npp.SetSciHandle(nppHSci);
+
+    if (!selectionA.IsEmpty())
+    {
+        const CText selection(selectionA.C_str());
+
+        Edit_SetText(_hSearchTxt, selection.C_str());
+        Edit_SetSel(_hSearchTxt, 0, -1);
+    }
+    else if (!_lastSearchTxt.IsEmpty())
+    {
+        Edit_SetText(_hSearchTxt, _lastSearchTxt.C_str());
+        Edit_SetSel(_hSearchTxt, 0, -1);
+    }
+    else
+    {
+        Edit_SetText(_hSearchTxt, _T(""));
+    }
+
+    ShowWindow(_hSearch, SW_SHOWNORMAL);
+    SetFocus(_hSearchTxt);
+}
+
+
+/**
+ *  \brief
+ */
+void ResultWin::showWindow()
+{
+    INpp::Get().ShowDockingWin(_hWnd);
+
+    ActivityWin::UpdatePositions();
+
+    SetFocus(_hWnd);
+}
+
+
+/**
+ *  \brief
+ */
+void ResultWin::hideWindow()
+{
+    if (_hSearch)
+        SendMessage(_hSearch, WM_CLOSE, 0, 0);
+
+    if (_hKeyHook)
+    {
+        UnhookWindowsHookEx(_hKeyHook);
+        _hKeyHook = NULL;
+    }
+
+    INpp& npp = INpp::Get();
+    npp.HideDockingWin(_hWnd);
+
+    ActivityWin::UpdatePositions();
+
+    if (GetFocus() != npp.ReadSciHandle())
+        SetFocus(npp.GetSciHandle());
+}
+
+
+/**
+ *  \brief
+ */
+ResultWin::Tab* ResultWin::getTab(int i)
+{
+    if (i == -1)
+    {
+        i = TabCtrl_GetCurSel(_hTab);
+        if (i == -1)
+            return NULL;
+    }
+
+    TCITEM tci  = {0};
+    tci.mask    = TCIF_PARAM;
+
+    if (!TabCtrl_GetItem(_hTab, i, &tci))
+        return NULL;
+
+    return (Tab*)tci.lParam;
+}
+
+
+/**
+ *  \brief
+ */
+void ResultWin::loadTab(ResultWin::Tab* tab)
+{
+    stopStreaming();
+
+    // The live results view can't be continued once left - its partial text is not kept
+    if (_activeTab && _activeTab == _liveTab)
+        _liveShown = false;
+
+    // store current view if there is one (and it is not the reloading placeholder)
+    if (_activeTab && _activeTab->HasText())
+    {
+        _activeTab->_currentLine = sendSci(SCI_LINEFROMPOSITION, sendSci(SCI_GETCURRENTPOS));
+        _activeTab->_firstVisibleLine = sendSci(SCI_GETFIRSTVISIBLELINE);
+
+        packTab(_activeTab);
+    }
+    else if (_activeTab)
+    {
+        releaseDoc(_activeTab);
+    }
+
+    _activeTab = NULL;
+
+    if (tab->_doc)
+    {
+        // The tab document keeps its text, styling and fold levels - only the folding is per view
+        sendSci(SCI_SETDOCPOINTER, 0, tab->_doc);
+
+        _activeTab = tab;
+        tab->_lastUsed = ++_tabUseCounter;
+
+        restoreFolding(tab);
+
+        sendSci(SCI_SETFIRSTVISIBLELINE, tab->_firstVisibleLine);
+        sendSci(SCI_GOTOLINE, tab->_currentLine);
+
+        evictTabs();
+        return;
+    }
+
+    tab->_doc = sendSci(SCI_CREATEDOCUMENT);
+    sendSci(SCI_SETDOCPOINTER, 0, tab->_doc);
+    configDocument();
+
+    sendSci(SCI_SETREADONLY, 0);
+    sendSci(SCI_CLEARALL);
+
+    _activeTab = tab;
+    tab->_lastUsed = ++_tabUseCounter;
+
+    if (tab->_parser && tab->_parser->GetText().Len() > cStreamBatchSize)
+    {
+        // Show the results around the last position right away, the rest is added on timer
+        _streamTab = tab;
+        _streamPos = 0;
+        _streamHits = 0;
+        _streamPrefixLen = 0;
+
+        streamResults(tab->_currentLine + 1);
+
+        if (_streamTab)
+            SetTimer(_hWnd, cStreamTimerId, cStreamPeriod, NULL);
+    }
+    else if (tab->_parser)
+    {
+        // Scintilla keeps its own copy of the text
+        sendSci(SCI_SETTEXT, 0, reinterpret_cast<LPARAM>(tab->_parser->GetText().C_str()));
+        tab->_parser->ReleaseText();
+    }
+    else if (tab == _liveTab)
+    {
+        // New live tab gets the results as they arrive, otherwise show placeholder until the search completes
+        _liveShown = (_liveHits == 0);
+
+        if (!_liveShown)
+        {
+            CTextA header(tab->_name.C_str());
+            header += " \"";
+            header += tab->_search;
+            header += "\" - searching in \"";
+            header += tab->_projectPath;
+            header += "\"";
+
+            sendSci(SCI_SETTEXT, 0, reinterpret_cast<LPARAM>(header.C_str()));
+        }
+    }
+    else
+    {
+        // Evicted - run the search again and show placeholder header (or why it failed)
+        if (tab->_reloadError.IsEmpty())
+            reloadTab(tab);
+
+        CTextA header(tab->_name.C_str());
+        header += " \"";
+        header += tab->_search;
+
+        if (tab->_reloadError.IsEmpty())
+        {
+            header += "\" - reloading results in \"";
+            header += tab->_projectPath;
+            header += "\"";
+        }
+        else
+        {
+            header += "\" in \"";
+            header += tab->_projectPath;
+            header += "\" - ";
+            header += tab->_reloadError;
+            header += " (double-click or press Enter to retry)";
+        }
+
+        sendSci(SCI_SETTEXT, 0, reinterpret_cast<LPARAM>(header.C_str()));
+    }
+
+    sendSci(SCI_SETREADONLY, 1);
+
+    if (tab->HasText())
+    {
+        sendSci(SCI_SETFIRSTVISIBLELINE, tab->_firstVisibleLine);
+        sendSci(SCI_GOTOLINE, tab->_currentLine);
+    }
+
+    if (_streamTab == NULL)
+        tab->_docSize = 2 * sendSci(SCI_GETLENGTH);
+
+    evictTabs();
+}
+
+
+/**
+ *  \brief  Re-applies the tab fold state to its document - file headers are folded by default
+ */
+void ResultWin::restoreFolding(ResultWin::Tab* tab)
+{
+    sendSci(SCI_FOLDALL, SC_FOLDACTION_CONTRACT);
+
+    for (int lineNum : tab->ExpandedLines())
+        sendSci(SCI_FOLDLINE, lineNum, SC_FOLDACTION_EXPAND);
+}
+
+
+/**
+ *  \brief  Drops the tab's reference to its Scintilla document
+ */
+void ResultWin::releaseDoc(ResultWin::Tab* tab)
+{
+    if (tab->_doc == 0)
+        return;
+
+    sendSci(SCI_RELEASEDOCUMENT, 0, tab->_doc);
+    tab->_doc = 0;
+    tab->_docSize = 0;
+}
+
+
+/**
+ *  \brief
+ */
+void ResultWin::deleteTab(ResultWin::Tab* tab)
+{
+    if (tab == _streamTab)
+        stopStreaming();
+
+    // Closing the live tab stops its search
+    if (tab == _liveTab)
+    {
+        if (!_liveDone)
+            _liveCmd->Cancel();
+
+        _liveTab = NULL;
+        _liveShown = false;
+    }
+
+    if (tab == _activeTab)
+        _activeTab = NULL;
+
+    dropRefreshes(*tab);
+    releaseDoc(tab);
+    delete tab;
+}
+
+
+/**
+ *  \brief  Appends the next batch of results (at least minLines lines) to the view and updates
+ *          the results counter in front of the header
+ */
+void ResultWin::streamResults(int minLines)
+{
+    const CTextA& text = _streamTab->_parser->GetText();
+    const char* pText = text.C_str();
+    const unsigned len = text.Len();
+
+    const bool countFiles = (_streamTab->_cmdId == FIND_FILE);
+    const unsigned total = countFiles ? _streamTab->_parser->FilesCount() : _streamTab->_parser->HitsCount();
+
+    unsigned end = _streamPos + cStreamBatchSize;
+    if (end > len)
+        end = len;
+
+    // Each result line starts with '\n' so batches end right before one
+    int lines = 0;
+    unsigned pos = _streamPos;
+    for (; pos < len && (pos < end || lines < minLines || pText[pos] != '\n'); ++pos)
+    {
+        if (pText[pos] == '\n')
+        {
+            ++lines;
+            if (countFiles || (pText[pos + 1] == '\t' && pText[pos + 2] == '\t'))
+                ++_streamHits;
+        }
+    }
+
+    sendSci(SCI_SETREADONLY, 0);
+
+    sendSci(SCI_APPENDTEXT, pos - _streamPos, reinterpret_cast<LPARAM>(pText + _streamPos));
+    _streamPos = pos;
+
+    if (_streamPos < len)
+    {
+        char counter[64];
+        _snprintf_s(counter, _countof(counter), _TRUNCATE, "[%u of %u results] ", _streamHits, total);
+
+        sendSci(SCI_SETTARGETSTART, 0);
+        sendSci(SCI_SETTARGETEND, _streamPrefixLen);
+        _streamPrefixLen = sendSci(SCI_REPLACETARGET, (WPARAM)-1, reinterpret_cast<LPARAM>(counter));
+    }
+    else if (_streamPrefixLen)
+    {
+        sendSci(SCI_DELETERANGE, 0, _streamPrefixLen);
+        _streamPrefixLen = 0;
+    }
+
+    sendSci(SCI_SETREADONLY, 1);
+
+    if (_streamPos >= len)
+        stopStreaming(true);
+}
+
+
+/**
+ *  \brief
+ */
+void ResultWin::stopStreaming(bool finished)
+{
+    if (_streamTab == NULL)
+        return;
+
+    KillTimer(_hWnd, cStreamTimerId);
+
+    if (_streamTab->_parser)
+        _streamTab->_parser->ReleaseText();
+
+    // Don't keep the document of a partially loaded tab
+    if (finished)
+        _streamTab->_docSize = 2 * sendSci(SCI_GETLENGTH);
+    else
+        releaseDoc(_streamTab);
+
+    _streamTab = NULL;
+}
+
+
+/**
+ *  \brief  Compresses the results of a tab that is no longer shown
+ */
+void ResultWin::packTab(ResultWin::Tab* tab)
+{
+    if (tab->_parser)
+    {
+        tab->_parser->ReleaseText();
+
+        // A part at a time on timer so big results don't stall the window
+        if (tab->_parser->CanPack())
+            SetTimer(_hWnd, cPackTimerId, cPackPeriod, NULL);
+    }
+}
+
+
+/**
+ *  \brief  Compresses the next part of an inactive tab results, stops the timer when there is nothing left
+ */
+void ResultWin::packTabs()
+{
+    for (int i = TabCtrl_GetItemCount(_hTab); i; --i)
+    {
+        Tab* tab = getTab(i - 1);
+
+        if (tab && tab != _activeTab && tab->_parser && tab->_parser->CanPack())
+        {
+            tab->_parser->Pack(cPackBatchSize);
+            return;
+        }
+    }
+
+    KillTimer(_hWnd, cPackTimerId);
+}
+
+
+/**
+ *  \brief  Shows the results of a running search as they arrive - one search at a time
+ */
+void ResultWin::onPartialResult(const PartialResult& partial)
+{
+    // Partial results are posted apart from the completion and may come after it
+    if (partial._cmd->IsCompleted())
+    {
+        // The completion didn't adopt the live tab - it won't show the results
+        if (partial._cmd == _liveCmd)
+            dropLiveTab();
+
+        return;
+    }
+
+    if (partial._last)
+    {
+        if (partial._cmd != _liveCmd)
+            return;
+
+        // Completion shows the final results and adopts the live tab, otherwise it won't come to the window
+        if (partial._cmd->Status() == OK && partial._cmd->HasResult())
+            _liveDone = true;
+        else
+            dropLiveTab();
+
+        return;
+    }
+
+    if (partial._first)
+    {
+        if (_liveCmd && !_liveDone)
+            return;
+
+        if (_liveCmd)
+            dropLiveTab();
+
+        openLiveTab(partial);
+        return;
+    }
+
+    if (partial._cmd == _liveCmd && _liveTab && _liveShown && _liveTab == _activeTab)
+        appendLiveResults(partial);
+}
+
+
+/**
+ *  \brief  Adds the live tab and shows the first results. The same search tab (if present) is kept
+ *          next to it until the search completes successfully - it is replaced in show() then.
+ */
+void ResultWin::openLiveTab(const PartialResult& partial)
+{
+    Tab* tab = new Tab(partial._cmd);
+
+    // The parser is still in use by the command thread - the tab gets it on completion
+    tab->_parser.reset();
+    tab->_reloading = true;
+
+    int i;
+    for (i = TabCtrl_GetItemCount(_hTab); i; --i)
+    {
+        Tab* oldTab = getTab(i - 1);
+
+        if (oldTab && (*tab == *oldTab))
+            break;
+    }
+
+    if (i == 0)
+        i = TabCtrl_GetItemCount(_hTab);
+
+    TCHAR buf[64];
+    _sntprintf_s(buf, _countof(buf), _TRUNCATE, _T("%s \"%s\""), partial._cmd->Name(),
+            partial._cmd->Tag().C_str());
+
+    TCITEM tci  = {0};
+    tci.mask    = TCIF_TEXT | TCIF_PARAM;
+    tci.pszText = buf;
+    tci.lParam  = (LPARAM)tab;
+
+    i = TabCtrl_InsertItem(_hTab, i, &tci);
+
+    if (i == -1)
+    {
+        delete tab;
+        return;
+    }
+
+    _liveCmd        = partial._cmd;
+    _liveTab        = tab;
+    _liveDone       = false;
+    _liveHits       = 0;
+    _livePrefixLen  = 0;
+
+    TabCtrl_SetCurSel(_hTab, i);
+    loadTab(tab);
+
+    appendLiveResults(partial);
+
+    showWindow();
+}
+
+
+/**
+ *  \brief  Appends the new results to the live tab and updates the results counter in front of the header
+ */
+void ResultWin::appendLiveResults(const PartialResult& partial)
+{
+    char counter[64];
+    _snprintf_s(counter, _countof(counter), _TRUNCATE, "[%u results so far] ", partial._hits);
+
+    sendSci(SCI_SETREADONLY, 0);
+
+    sendSci(SCI_APPENDTEXT, partial._text.Len(), reinterpret_cast<LPARAM>(partial._text.C_str()));
+
+    sendSci(SCI_SETTARGETSTART, 0);
+    sendSci(SCI_SETTARGETEND, _livePrefixLen);
+    _livePrefixLen = sendSci(SCI_REPLACETARGET, (WPARAM)-1, reinterpret_cast<LPARAM>(counter));
+
+    sendSci(SCI_SETREADONLY, 1);
 
-        TCITEM tci  = {0};
-        tci.mask    = TCIF_TEXT | TCIF_PARAM;
-        tci.pszText = buf;
-        tci.lParam  = (LPARAM)tab;
+    _liveHits = partial._hits;
+}
 
-        i = TabCtrl_InsertItem(_hTab, TabCtrl_GetItemCount(_hTab), &tci);
-        if (i == -1)
-        {
-            delete tab;
-            return;
-        }
-    }
-    else // same search tab exists - reuse it, just update results
-    {
-        TCITEM tci  = {0};
-        tci.mask    = TCIF_PARAM;
-        tci.lParam  = (LPARAM)tab;
 
-        if (!TabCtrl_SetItem(_hTab, --i, &tci))
-        {
-            TabCtrl_DeleteItem(_hTab, i);
-            delete tab;
-            tab = NULL;
-        }
-    }
+/**
+ *  \brief  Takes the live tab document for the completed search tab if it shows the beginning of the results.
+ *          Otherwise the tab keeps the live tab position and its text is loaded as usual.
+ */
+sptr_t ResultWin::adoptLiveDoc(ResultWin::Tab* tab)
+{
+    sptr_t doc = 0;
 
-    if (tab == NULL)
+    if (_liveTab && _liveShown && _liveTab == _activeTab && tab->_parser)
     {
-        if (_activeTab)
-            return;
+        sendSci(SCI_SETREADONLY, 0);
+        sendSci(SCI_DELETERANGE, 0, _livePrefixLen);
+        sendSci(SCI_SETREADONLY, 1);
+        _livePrefixLen = 0;
 
-        int cnt = TabCtrl_GetItemCount(_hTab);
-        if (cnt == 0)
+        const CTextA& text = tab->_parser->GetText();
+        const unsigned docLen = sendSci(SCI_GETLENGTH);
+        const char* pDoc = reinterpret_cast<const char*>(sendSci(SCI_GETCHARACTERPOINTER));
+
+        if (docLen <= text.Len() && !memcmp(pDoc, text.C_str(), docLen))
         {
-            closeAllTabs();
-            return;
+            doc = _liveTab->_doc;
+            _liveTab->_doc = 0;
+        }
+        else
+        {
+            tab->_currentLine = sendSci(SCI_LINEFROMPOSITION, sendSci(SCI_GETCURRENTPOS));
+            tab->_firstVisibleLine = sendSci(SCI_GETFIRSTVISIBLELINE);
         }
-
-        if (i > cnt - 1)
-            i = cnt - 1;
-        tab = getTab(i);
     }
 
-    TabCtrl_SetCurSel(_hTab, i);
-    loadTab(tab);
+    _liveCmd.reset();
+    _liveTab = NULL;
+    _liveShown = false;
+    _liveDone = false;
 
-    showWindow();
+    return doc;
 }
 
 
 /**
- *  \brief
+ *  \brief  Makes the tab active on the adopted live tab document adding the rest of the results to it
  */
-void ResultWin::applyStyle()
+void ResultWin::resumeTab(ResultWin::Tab* tab, sptr_t doc)
 {
-    INpp& npp = INpp::Get();
+    stopStreaming();
 
-    char font[32];
-    npp.GetFontName(STYLE_DEFAULT, font);
-    int size = npp.GetFontSize(STYLE_DEFAULT);
-    COLORREF caretLineBackColor = npp.GetCaretLineBack();
-    COLORREF foreColor = npp.GetForegroundColor(STYLE_DEFAULT);
-    COLORREF backColor = npp.GetBackgroundColor(STYLE_DEFAULT);
-    COLORREF lineNumColor = npp.GetForegroundColor(STYLE_LINENUMBER);
+    if (_activeTab && _activeTab->HasText())
+        packTab(_activeTab);
+    else if (_activeTab)
+        releaseDoc(_activeTab);
 
-    COLORREF fileForeColor =
-            RGB(GetRValue(backColor) ^ 0xFF, GetGValue(backColor) ^ 0x7F, GetBValue(backColor) ^ 0x7F);
-    COLORREF findForeColor =
-            RGB(GetRValue(backColor) ^ 0x1C, GetGValue(backColor) ^ 0xFF, GetBValue(backColor) ^ 0xFF);
+    tab->_doc = doc;
 
-    HFONT hFont = Tools::CreateFromSystemMenuFont();
-    if (hFont)
-        SendMessage(_hTab, WM_SETFONT, (WPARAM)hFont, TRUE);
+    _activeTab = tab;
+    tab->_lastUsed = ++_tabUseCounter;
 
-    sendSci(SCI_STYLERESETDEFAULT);
-    setStyle(STYLE_DEFAULT, foreColor, backColor, false, false, size, font);
-    sendSci(SCI_STYLECLEARALL);
+    const unsigned docLen = sendSci(SCI_GETLENGTH);
 
-    setStyle(SCE_GTAGS_HEADER, foreColor, backColor, true);
-    setStyle(SCE_GTAGS_PROJECT_PATH, foreColor, backColor, true, true);
-    setStyle(SCE_GTAGS_FILE, fileForeColor, backColor, true);
-    setStyle(SCE_GTAGS_LINE_NUM, lineNumColor, backColor, false, true);
-    setStyle(SCE_GTAGS_WORD2SEARCH, findForeColor, backColor, true);
+    if (docLen < tab->_parser->GetText().Len())
+    {
+        _streamTab = tab;
+        _streamPos = docLen;
+        _streamHits = _liveHits;
+        _streamPrefixLen = 0;
 
-    sendSci(SCI_SETCARETLINEBACK, caretLineBackColor);
-    sendSci(SCI_STYLESETHOTSPOT, SCE_GTAGS_WORD2SEARCH, true);
+        streamResults();
+
+        if (_streamTab)
+            SetTimer(_hWnd, cStreamTimerId, cStreamPeriod, NULL);
+    }
+    else
+    {
+        tab->_parser->ReleaseText();
+        tab->_docSize = 2 * docLen;
+    }
+
+    evictTabs();
 }
 
 
 /**
- *  \brief
+ *  \brief  Removes the live tab of a search that won't show its results
  */
-ResultWin::~ResultWin()
+void ResultWin::dropLiveTab()
 {
-    if (_hWnd)
+    Tab* tab = _liveTab;
+
+    _liveCmd.reset();
+    _liveTab = NULL;
+    _liveShown = false;
+    _liveDone = false;
+
+    if (tab == NULL)
+        return;
+
+    for (int i = TabCtrl_GetItemCount(_hTab); i; --i)
     {
-        closeAllTabs();
+        if (getTab(i - 1) != tab)
+            continue;
 
-        if (_hSci)
+        if (tab == _activeTab)
         {
-            INpp::Get().DestroySciHandle(_hSci);
-            _hSci = NULL;
+            TabCtrl_SetCurSel(_hTab, i - 1);
+            onCloseTab();
+        }
+        else
+        {
+            deleteTab(tab);
+            TabCtrl_DeleteItem(_hTab, i - 1);
         }
 
-        SendMessage(_hWnd, WM_CLOSE, 0, 0);
+        return;
     }
 }
 
 
 /**
- *  \brief
+ *  \brief  Drops least recently used inactive tabs' text until the tabs fit in the configured memory budget.
+ *          Evicted tabs keep their fold and scroll state and re-run their search when activated.
  */
-void ResultWin::setStyle(int style, COLORREF fore, COLORREF back, bool bold, bool italic, int size, const char *font)
+void ResultWin::evictTabs()
 {
-    sendSci(SCI_STYLESETEOLFILLED, style, 1);
-    sendSci(SCI_STYLESETFORE, style, fore);
-    sendSci(SCI_STYLESETBACK, style, back);
-    sendSci(SCI_STYLESETBOLD, style, bold);
-    sendSci(SCI_STYLESETITALIC, style, italic);
+    const unsigned budget = GTagsSettings._resultTabsMemMB * 1024 * 1024;
+    if (budget == 0)
+        return;
 
-    if (size >= 1)
-        sendSci(SCI_STYLESETSIZE, style, size);
-    if (font)
-        sendSci(SCI_STYLESETFONT, style, reinterpret_cast<LPARAM>(font));
+    const int tabsCount = TabCtrl_GetItemCount(_hTab);
+
+    unsigned total = 0;
+    for (int i = 0; i < tabsCount; ++i)
+    {
+        Tab* tab = getTab(i);
+        if (tab)
+            total += tab->MemSize();
+    }
+
+    // Drop Scintilla documents first (the tab text can be composed again from its results),
+    // then the results themselves
+    while (total > budget)
+    {
+        Tab* lruTab = NULL;
+
+        for (int i = 0; i < tabsCount; ++i)
+        {
+            Tab* tab = getTab(i);
+            if (tab && tab != _activeTab && tab->_doc && (!lruTab || tab->_lastUsed < lruTab->_lastUsed))
+                lruTab = tab;
+        }
+
+        if (lruTab == NULL)
+            break;
+
+        total -= lruTab->_docSize;
+
+        releaseDoc(lruTab);
+    }
+
+    while (total > budget)
+    {
+        Tab* lruTab = NULL;
+
+        for (int i = 0; i < tabsCount; ++i)
+        {
+            Tab* tab = getTab(i);
+            if (tab && tab != _activeTab && tab->HasText() && (!lruTab || tab->_lastUsed < lruTab->_lastUsed))
+                lruTab = tab;
+        }
+
+        if (lruTab == NULL)
+            break;
+
+        total -= lruTab->MemSize();
+
+        lruTab->_parser.reset();
+    }
 }
 
 
 /**
  *  \brief
  */
-void ResultWin::configScintilla()
+void ResultWin::reloadTab(ResultWin::Tab* tab)
 {
-    sendSci(SCI_SETCODEPAGE, SC_CP_UTF8);
-    sendSci(SCI_SETEOLMODE, SC_EOL_CRLF);
-    sendSci(SCI_USEPOPUP, false);
-    sendSci(SCI_SETUNDOCOLLECTION, false);
-    sendSci(SCI_SETCARETSTYLE, CARETSTYLE_LINE);
-    sendSci(SCI_SETCARETLINEVISIBLE, true);
-    sendSci(SCI_SETCARETLINEVISIBLEALWAYS, true);
-    sendSci(SCI_SETHOTSPOTACTIVEUNDERLINE, false);
+    if (tab->_reloading)
+        return;
 
-    sendSci(SCI_SETWRAPMODE, SC_WRAP_WORD);
-    sendSci(SCI_SETWRAPVISUALFLAGS, SC_WRAPVISUALFLAG_START);
-    sendSci(SCI_SETWRAPVISUALFLAGSLOCATION, SC_WRAPVISUALFLAGLOC_DEFAULT);
-    sendSci(SCI_SETWRAPINDENTMODE, SC_WRAPINDENT_FIXED);
-    sendSci(SCI_SETWRAPSTARTINDENT, 24);
-    sendSci(SCI_SETLAYOUTCACHE, SC_CACHE_CARET);
+    bool success;
+    DbHandle db = DbManager::Get().GetDbAt(CPath(tab->_projectPath.C_str()), false, &success);
+    if (!db)
+    {
+        tab->_reloadError = "database not found";
+        return;
+    }
+    if (!success)
+    {
+        tab->_reloadError = "database is currently in use";
+        return;
+    }
 
-    // Implement lexer in the container
-    sendSci(SCI_SETLEXER, 0);
+    ParserPtr_t parser(new TabParser);
+    CmdPtr_t cmd(new Cmd(tab->_cmdId, tab->_name.C_str(), db, parser, CText(tab->_search.C_str()).C_str(),
+            tab->_regExp, tab->_matchCase));
 
-    ApplyStyle();
+    tab->_reloading = CmdEngine::Run(cmd, reloadTabCB);
+    if (!tab->_reloading)
+    {
+        DbManager::Get().PutDb(db);
+        tab->_reloadError = "running GTags failed";
+    }
+}
 
-    sendSci(SCI_SETPROPERTY, reinterpret_cast<WPARAM>("fold"), reinterpret_cast<LPARAM>("1"));
 
-    sendSci(SCI_SETMARGINTYPEN, 1, SC_MARGIN_SYMBOL);
-    sendSci(SCI_SETMARGINMASKN, 1, SC_MASK_FOLDERS);
-    sendSci(SCI_SETMARGINWIDTHN, 1, 20);
-    sendSci(SCI_SETFOLDMARGINCOLOUR, 1, cBlack);
-    sendSci(SCI_SETFOLDMARGINHICOLOUR, 1, cBlack);
-    sendSci(SCI_SETMARGINSENSITIVEN, 1, true);
-    sendSci(SCI_SETFOLDFLAGS, 0);
+/**
+ *  \brief  Runs the search of a tab whose re-run failed again - on user request
+ */
+void ResultWin::retryReload(ResultWin::Tab* tab)
+{
+    tab->_reloadError.Clear();
 
-    sendSci(SCI_MARKERDEFINE, SC_MARKNUM_FOLDER, SC_MARK_BOXPLUS);
-    sendSci(SCI_MARKERDEFINE, SC_MARKNUM_FOLDEROPEN, SC_MARK_BOXMINUS);
-    sendSci(SCI_MARKERDEFINE, SC_MARKNUM_FOLDEREND, SC_MARK_BOXPLUSCONNECTED);
-    sendSci(SCI_MARKERDEFINE, SC_MARKNUM_FOLDERSUB, SC_MARK_VLINE);
-    sendSci(SCI_MARKERDEFINE, SC_MARKNUM_FOLDERTAIL, SC_MARK_LCORNER);
-    sendSci(SCI_MARKERDEFINE, SC_MARKNUM_FOLDERMIDTAIL, SC_MARK_TCORNER);
-    sendSci(SCI_MARKERDEFINE, SC_MARKNUM_FOLDEROPENMID, SC_MARK_BOXMINUSCONNECTED);
+    // Drop the placeholder document
+    releaseDoc(tab);
+
+    if (tab == _activeTab)
+    {
+        _activeTab = NULL;
+        loadTab(tab);
+    }
 }
 
 
 /**
  *  \brief
  */
-HWND ResultWin::composeWindow()
+void ResultWin::reloadTabCB(const CmdPtr_t& cmd)
 {
-    INpp& npp = INpp::Get();
-    HWND hOwner = npp.GetHandle();
+    DbManager::Get().PutDb(cmd->Db());
 
-    DWORD style = WS_POPUP | WS_CAPTION | WS_SIZEBOX | WS_CLIPCHILDREN;
+    if (RW)
+        RW->onTabReloaded(cmd);
+}
 
-    _hWnd = CreateWindow(cClassName, cPluginName, style,
-            0, 0, 10, 10, hOwner, NULL, HMod, NULL);
-    if (_hWnd == NULL)
-        return NULL;
 
-    _hSci = npp.CreateSciHandle(_hWnd);
-    if (_hSci)
-    {
-        _sciFunc    = (SciFnDirect)::SendMessage(_hSci, SCI_GETDIRECTFUNCTION, 0, 0);
-        _sciPtr     = (sptr_t)::SendMessage(_hSci, SCI_GETDIRECTPOINTER, 0, 0);
-    }
+/**
+ *  \brief  Puts the re-run search results back in their tab (if it is still open)
+ */
+void ResultWin::onTabReloaded(const CmdPtr_t& cmd)
+{
+    const Tab reloaded(cmd);
 
-    if (_hSci == NULL || _sciFunc == NULL || _sciPtr == 0)
+    for (int i = TabCtrl_GetItemCount(_hTab); i; --i)
     {
-        SendMessage(_hWnd, WM_CLOSE, 0, 0);
-        _hWnd = NULL;
-        _hSci = NULL;
-        return NULL;
-    }
+        Tab* tab = getTab(i - 1);
 
-    _hTab = CreateWindowEx(0, WC_TABCONTROL, NULL,
-            WS_CHILD | WS_VISIBLE | TCS_BUTTONS | TCS_FOCUSNEVER,
-            0, 0, 10, 10, _hWnd, NULL, HMod, NULL);
+        if (tab && tab->_reloading && (*tab == reloaded))
+        {
+            tab->_reloading = false;
 
-    configScintilla();
+            if (cmd->Status() == OK || cmd->Status() == PARSE_EMPTY)
+                tab->_parser = std::static_pointer_cast<TabParser>(cmd->Parser());
+            else if (cmd->Status() == CANCELLED)
+                tab->_reloadError = "reloading cancelled";
+            else if (cmd->Status() == FAILED)
+            {
+                tab->_reloadError = "reloading failed";
 
-    ShowWindow(_hSci, SW_SHOWNORMAL);
+                // First line of the error
+                const char* pErr = cmd->Result();
+                if (pErr && *pErr)
+                {
+                    unsigned len = 0;
+                    while (pErr[len] && pErr[len] != '\n' && pErr[len] != '\r')
+                        ++len;
 
-    return _hWnd;
+                    tab->_reloadError += ": ";
+                    tab->_reloadError.Append(pErr, len);
+                }
+            }
+            else if (cmd->Status() == PARSE_ERROR)
+                tab->_reloadError = "database seems outdated, re-create it";
+            else
+                tab->_reloadError = "running GTags failed";
+
+            // Drop the placeholder document
+            releaseDoc(tab);
+
+            if (tab == _activeTab)
+            {
+                // Placeholder is shown - don't store its view
+                _activeTab = NULL;
+                loadTab(tab);
+            }
+            else
+            {
+                evictTabs();
+            }
+
+            break;
+        }
+    }
 }
 
 
 /**
- *  \brief
+ *  \brief  Queues re-queries of the re-indexed files in the tabs of the database. If too many files were changed
+ *          or too many re-queries are queued already the tabs simply run their search again on activation.
  */
-void ResultWin::createSearchWindow()
+void ResultWin::onDbUpdate(const CPath& dbPath, const std::vector<CPath>& files)
 {
-    if (_hSearch)
+    const PathKey dbKey(dbPath);
+
+    for (int i = TabCtrl_GetItemCount(_hTab); i; --i)
     {
-        SetFocus(_hSearchTxt);
-        Edit_SetSel(_hSearchTxt, 0, -1);
-        return;
-    }
+        Tab* tab = getTab(i - 1);
 
-    const DWORD styleEx = WS_EX_WINDOWEDGE | WS_EX_TOOLWINDOW;
-    const DWORD style   = WS_POPUP | WS_CAPTION;
+        // File search results don't depend on the files contents
+        if (!tab || !tab->HasText() || tab->_reloading || tab->_cmdId == FIND_FILE)
+            continue;
 
-    CreateWindowEx(styleEx, cSearchClassName, _T("Search in results"), style, 0, 0, 10, 10, _hWnd, NULL, HMod, NULL);
-}
+        const CPath projectPath(tab->_projectPath.C_str());
+        if (PathKey(projectPath) != dbKey)
+            continue;
+
+        if (files.size() > cMaxRefreshFiles)
+        {
+            rerunTab(tab);
+            continue;
+        }
 
+        std::vector<const CPath*> tabFiles;
 
-/**
- *  \brief
- */
-void ResultWin::onSearchWindowCreate(HWND hWnd)
-{
-    _hSearch = hWnd;
+        for (const auto& file : files)
+        {
+            // File tags tab shows a single file
+            if (tab->_cmdId == FILE_TAGS && tab->_parser->FindFile(projectPath, PathKey(file)) < 0)
+                continue;
 
-    HDC hdc = GetWindowDC(_hSearch);
+            if (!isRefreshQueued(*tab, file))
+                tabFiles.push_back(&file);
+        }
 
-    _hSearchFont    = Tools::CreateFromSystemMessageFont(hdc, cSearchFontSize);
-    _hBtnFont       = Tools::CreateFromSystemMenuFont(hdc, cSearchFontSize - 1);
+        if (_refreshes.size() + tabFiles.size() > cMaxRefreshes)
+        {
+            rerunTab(tab);
+            continue;
+        }
 
-    int searchHeight    = Tools::GetFontHeight(hdc, _hSearchFont) + 1;
-    int btnHeight       = Tools::GetFontHeight(hdc, _hBtnFont) + 2;
+        for (const CPath* file : tabFiles)
+            _refreshes.emplace_back(*tab, *file);
+    }
 
-    ReleaseDC(_hSearch, hdc);
+    runRefreshes();
+}
 
-    const DWORD styleTxtEx  = WS_EX_CLIENTEDGE;
-    const DWORD styleTxt    = WS_CHILD | WS_VISIBLE;
 
+/**
+ *  \brief  Drops the tab results so the whole search is run again (right away if the tab is active)
+ */
+void ResultWin::rerunTab(ResultWin::Tab* tab)
+{
+    if (tab == _activeTab)
     {
-        RECT win { 0, 0, cSearchWidth, searchHeight };
-        AdjustWindowRectEx(&win, styleTxt, FALSE, styleTxtEx);
-        searchHeight = win.bottom - win.top;
+        tab->_currentLine = sendSci(SCI_LINEFROMPOSITION, sendSci(SCI_GETCURRENTPOS));
+        tab->_firstVisibleLine = sendSci(SCI_GETFIRSTVISIBLELINE);
     }
 
-    RECT win = Tools::GetWinRect(_hWnd,
-            GetWindowLongPtr(_hSearch, GWL_EXSTYLE), GetWindowLongPtr(_hSearch, GWL_STYLE),
-            cSearchWidth + 1, searchHeight + btnHeight + 1);
-    RECT ownerWin;
-    GetWindowRect(_hWnd, &ownerWin);
+    if (tab == _streamTab)
+        stopStreaming();
 
-    MoveWindow(_hSearch,
-            ownerWin.right - (win.right - win.left) -
-            GetSystemMetrics(SM_CXSIZEFRAME) - GetSystemMetrics(SM_CXFIXEDFRAME) - GetSystemMetrics(SM_CXVSCROLL),
-            ownerWin.top +
-            GetSystemMetrics(SM_CYSIZEFRAME) + GetSystemMetrics(SM_CYFIXEDFRAME) + GetSystemMetrics(SM_CYSIZE),
-            win.right - win.left, win.bottom - win.top, TRUE);
+    dropRefreshes(*tab);
 
-    GetClientRect(_hSearch, &win);
+    tab->_parser.reset();
+    releaseDoc(tab);
 
-    int btnWidth = (win.right - win.left - 120) / 3;
+    if (tab == _activeTab)
+    {
+        _activeTab = NULL;
+        loadTab(tab);
+    }
+}
 
-    _hRE = CreateWindowEx(0, _T("BUTTON"), _T("RegExp"),
-            WS_CHILD | WS_VISIBLE | BS_AUTOCHECKBOX,
-            1, 0, btnWidth, btnHeight,
-            _hSearch, NULL, HMod, NULL);
 
-    _hMC = CreateWindowEx(0, _T("BUTTON"), _T("MatchCase"),
-            WS_CHILD | WS_VISIBLE | BS_AUTOCHECKBOX,
-            btnWidth + 1, 0, btnWidth, btnHeight,
-            _hSearch, NULL, HMod, NULL);
+/**
+ *  \brief
+ */
+bool ResultWin::isRefreshQueued(const ResultWin::Tab& tab, const CPath& file) const
+{
+    const PathKey fileKey(file);
 
-    _hWW = CreateWindowEx(0, _T("BUTTON"), _T("WholeWord"),
-            WS_CHILD | WS_VISIBLE | BS_AUTOCHECKBOX,
-            2 * btnWidth + 1, 0, btnWidth, btnHeight,
-            _hSearch, NULL, HMod, NULL);
+    for (const auto& refresh : _refreshes)
+        if (refresh.IsOf(tab) && PathKey(refresh._file) == fileKey)
+            return true;
 
-    _hUp = CreateWindowEx(0, _T("BUTTON"), _T("Up"),
-            WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
-            3 * btnWidth + 1, 0, 60, btnHeight,
-            _hSearch, NULL, HMod, NULL);
+    return false;
+}
 
-    _hDown = CreateWindowEx(0, _T("BUTTON"), _T("Down"),
-            WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
-            3 * btnWidth + 61, 0, 60, btnHeight,
-            _hSearch, NULL, HMod, NULL);
 
-    if (_hBtnFont)
+/**
+ *  \brief
+ */
+void ResultWin::dropRefreshes(const ResultWin::Tab& tab)
+{
+    for (auto refresh = _refreshes.begin(); refresh != _refreshes.end();)
     {
-        SendMessage(_hRE, WM_SETFONT, (WPARAM)_hBtnFont, TRUE);
-        SendMessage(_hMC, WM_SETFONT, (WPARAM)_hBtnFont, TRUE);
-        SendMessage(_hWW, WM_SETFONT, (WPARAM)_hBtnFont, TRUE);
-        SendMessage(_hUp, WM_SETFONT, (WPARAM)_hBtnFont, TRUE);
-        SendMessage(_hDown, WM_SETFONT, (WPARAM)_hBtnFont, TRUE);
+        if (refresh->IsOf(tab))
+            refresh = _refreshes.erase(refresh);
+        else
+            ++refresh;
     }
+}
 
-    Button_SetCheck(_hRE, _lastRE ? BST_CHECKED : BST_UNCHECKED);
-    Button_SetCheck(_hMC, _lastMC ? BST_CHECKED : BST_UNCHECKED);
-    Button_SetCheck(_hWW, _lastWW ? BST_CHECKED : BST_UNCHECKED);
-
-    _hSearchTxt = CreateWindowEx(styleTxtEx, RICHEDIT_CLASS, NULL, styleTxt,
-            0, btnHeight + 1, win.right - win.left, searchHeight,
-            _hSearch, NULL, HMod, NULL);
-
-    SendMessage(_hSearchTxt, EM_SETBKGNDCOLOR, 0, GetSysColor(cSearchBkgndColor));
 
-    if (_hSearchFont)
-        SendMessage(_hSearchTxt, WM_SETFONT, (WPARAM)_hSearchFont, TRUE);
+/**
+ *  \brief  Runs the next queued tab search limited to a file in background. Only one runs at a time so the
+ *          refreshes hold a single database read lock and don't keep the next file update from writing.
+ */
+void ResultWin::runRefreshes()
+{
+    while (!RefreshCmd.Pending() && !_refreshes.empty())
+    {
+        const Refresh refresh = std::move(_refreshes.front());
+        _refreshes.pop_front();
 
-    INpp& npp = INpp::Get();
+        bool success;
+        DbHandle db = DbManager::Get().GetDbAt(CPath(refresh._projectPath.C_str()), false, &success);
+        if (!db)
+            continue;
 
-    HWND nppHSci = npp.ReadSciHandle();
+        // The database is being written - the tab search is run again instead
+        if (!success)
+        {
+            for (int i = TabCtrl_GetItemCount(_hTab); i; --i)
+            {
+                Tab* tab = getTab(i - 1);
 
-    npp.SetSciHandle(_hSci);
+                if (tab && refresh.IsOf(*tab) && tab->HasText() && !tab->_reloading)
+                {
+                    rerunTab(tab);
+                    break;
+                }
+            }
 
-    CTextA selectionA;
-    if (!npp.IsSelectionVertical())
-        npp.GetSelection(selectionA);
+            continue;
+        }
 
-    npp.SetSciHandle(nppHSci);
+        ParserPtr_t parser(new TabParser);
+        CmdPtr_t cmd(new Cmd(refresh._cmdId, refresh._name.C_str(), db, parser,
+                CText(refresh._search.C_str()).C_str(), refresh._regExp, refresh._matchCase));
 
-    if (!selectionA.IsEmpty())
-    {
-        const CText selection(selectionA.C_str());
+        cmd->Scope(refresh._file);
+        cmd->SkipLibs(true);
 
-        Edit_SetText(_hSearchTxt, selection.C_str());
-        Edit_SetSel(_hSearchTxt, 0, -1);
-    }
-    else if (!_lastSearchTxt.IsEmpty())
-    {
-        Edit_SetText(_hSearchTxt, _lastSearchTxt.C_str());
-        Edit_SetSel(_hSearchTxt, 0, -1);
-    }
-    else
-    {
-        Edit_SetText(_hSearchTxt, _T(""));
+        RefreshCmd.Run(cmd, refreshTabCB);
     }
-
-    ShowWindow(_hSearch, SW_SHOWNORMAL);
-    SetFocus(_hSearchTxt);
 }
 
 
 /**
  *  \brief
  */
-void ResultWin::showWindow()
+void ResultWin::refreshTabCB(const CmdPtr_t& cmd)
 {
-    INpp::Get().ShowDockingWin(_hWnd);
-
-    ActivityWin::UpdatePositions();
+    if (!RefreshCmd.Complete(cmd) || !RW)
+        return;
 
-    SetFocus(_hWnd);
+    RW->onTabRefreshed(cmd);
+    RW->runRefreshes();
 }
 
 
 /**
- *  \brief
+ *  \brief  Splices the file results into its tab (if it is still open) keeping the tab fold and scroll state
  */
-void ResultWin::hideWindow()
+void ResultWin::onTabRefreshed(const CmdPtr_t& cmd)
 {
-    if (_hSearch)
-        SendMessage(_hSearch, WM_CLOSE, 0, 0);
+    if (cmd->Status() != OK && cmd->Status() != PARSE_EMPTY && cmd->Status() != CANCELLED)
+        return;
 
-    if (_hKeyHook)
+    const Tab refreshed(cmd);
+
+    Tab* tab = NULL;
+    for (int i = TabCtrl_GetItemCount(_hTab); i; --i)
     {
-        UnhookWindowsHookEx(_hKeyHook);
-        _hKeyHook = NULL;
+        tab = getTab(i - 1);
+
+        if (tab && (*tab == refreshed))
+            break;
+
+        tab = NULL;
     }
 
-    INpp& npp = INpp::Get();
-    npp.HideDockingWin(_hWnd);
+    // Evicted or being reloaded - the whole search is run again anyway
+    if (!tab || !tab->HasText() || tab->_reloading)
+        return;
 
-    ActivityWin::UpdatePositions();
+    // Stopped by a database write - the file results are outdated
+    if (cmd->Status() == CANCELLED)
+    {
+        rerunTab(tab);
+        return;
+    }
 
-    if (GetFocus() != npp.ReadSciHandle())
-        SetFocus(npp.GetSciHandle());
-}
+    const CPath projectPath(tab->_projectPath.C_str());
+    const PathKey fileKey(cmd->Scope());
 
+    unsigned fileRuns;
+    unsigned updateRuns;
 
-/**
- *  \brief
- */
-ResultWin::Tab* ResultWin::getTab(int i)
-{
-    if (i == -1)
+    const int fileIdx = tab->_parser->FindFile(projectPath, fileKey, &fileRuns);
+    const int updateIdx = refreshed._parser->FindFile(projectPath, fileKey, &updateRuns);
+
+    if (fileIdx < 0 && updateIdx < 0)
+        return;
+
+    // The file results are listed in more than one place - can't be spliced
+    if (fileRuns > 1 || updateRuns > 1)
     {
-        i = TabCtrl_GetCurSel(_hTab);
-        if (i == -1)
-            return NULL;
+        rerunTab(tab);
+        return;
     }
 
-    TCITEM tci  = {0};
-    tci.mask    = TCIF_PARAM;
+    if (tab == _activeTab)
+    {
+        tab->_currentLine = sendSci(SCI_LINEFROMPOSITION, sendSci(SCI_GETCURRENTPOS));
+        tab->_firstVisibleLine = sendSci(SCI_GETFIRSTVISIBLELINE);
+    }
 
-    if (!TabCtrl_GetItem(_hTab, i, &tci))
-        return NULL;
+    if (tab == _streamTab)
+        stopStreaming();
 
-    return (Tab*)tci.lParam;
-}
+    const int start = tab->_parser->FileLine((fileIdx < 0) ? tab->_parser->FilesCount() : fileIdx);
+    const int oldLen = (fileIdx < 0) ? 0 : 1 + tab->_parser->FileHits(fileIdx);
+    const int newLen = tab->_parser->Splice(fileIdx, *refreshed._parser, updateIdx);
 
+    tab->RemapLines(start, oldLen, newLen);
 
-/**
- *  \brief
- */
-void ResultWin::loadTab(ResultWin::Tab* tab)
-{
-    // store current view if there is one
-    if (_activeTab)
+    // The document is composed again from the updated results
+    releaseDoc(tab);
+
+    if (tab == _activeTab)
     {
-        _activeTab->_currentLine = sendSci(SCI_LINEFROMPOSITION, sendSci(SCI_GETCURRENTPOS));
-        _activeTab->_firstVisibleLine = sendSci(SCI_GETFIRSTVISIBLELINE);
+        _activeTab = NULL;
+        loadTab(tab);
     }
+    else
+    {
+        packTab(tab);
+        evictTabs();
+    }
+}
 
-    _activeTab = NULL;
-
-    sendSci(SCI_SETREADONLY, 0);
-    sendSci(SCI_CLEARALL);
 
-    _activeTab = tab;
+/**
+ *  \brief  Shows how much memory the tab results take
+ */
+void ResultWin::onTabToolTip(LPNMTTDISPINFO toolTip)
+{
+    Tab* tab = getTab(toolTip->hdr.idFrom);
+    if (tab == NULL)
+        return;
 
-    sendSci(SCI_SETTEXT, 0, reinterpret_cast<LPARAM>(tab->_parser->GetText().C_str()));
-    sendSci(SCI_SETREADONLY, 1);
+    if (tab->_parser)
+        _sntprintf_s(_toolTipText, _countof(_toolTipText), _TRUNCATE,
+                _T("%u results in %u files, memory: %u KB%s"),
+                tab->_parser->HitsCount(), tab->_parser->FilesCount(), (tab->MemSize() + 1023) / 1024,
+                tab->_parser->IsPacked() ? _T(" (compressed)") : _T(""));
+    else
+        _sntprintf_s(_toolTipText, _countof(_toolTipText), _TRUNCATE,
+                _T("Results not in memory - search will be re-run on tab activation"));
 
-    sendSci(SCI_SETFIRSTVISIBLELINE, tab->_firstVisibleLine);
-    sendSci(SCI_GOTOLINE, tab->_currentLine);
+    toolTip->lpszText = _toolTipText;
 }
 
 
@@ -935,6 +2523,13 @@ bool ResultWin::openItem(int lineNum, unsigned matchNum)
     if (_activeTab->_cmdId == FIND_FILE)
         return true;
 
+    // The results are the file tags, not a searched word
+    if (_activeTab->_cmdId == FILE_TAGS)
+    {
+        npp.GoToLine(line);
+        return true;
+    }
+
     const long endPos = npp.LineEndPosition(line);
 
     const bool wholeWord = (_activeTab->_cmdId != GREP && _activeTab->_cmdId != GREP_TEXT);
@@ -1058,11 +2653,27 @@ void ResultWin::onStyleNeeded(SCNotification* notify)
 
         if ((char)sendSci(SCI_GETCHARAT, startPos) != '\t')
         {
-            int pathLen = _activeTab->_projectPath.Len();
+            // The quoted project path may be followed by a search warning
+            CTextA projectPath(" in \"");
+            projectPath += _activeTab->_projectPath;
+            projectPath += "\"";
 
-            // 2 * '"' + LF + CR = 4
-            sendSci(SCI_SETSTYLING, lineLen - pathLen - 4, SCE_GTAGS_HEADER);
-            sendSci(SCI_SETSTYLING, pathLen + 4, SCE_GTAGS_PROJECT_PATH);
+            int pathBegin = startPos;
+            int pathEnd = endPos;
+
+            if (findString(projectPath.C_str(), &pathBegin, &pathEnd, true, false, false))
+            {
+                // Skip " in "
+                pathBegin += 4;
+
+                sendSci(SCI_SETSTYLING, pathBegin - startPos, SCE_GTAGS_HEADER);
+                sendSci(SCI_SETSTYLING, pathEnd - pathBegin, SCE_GTAGS_PROJECT_PATH);
+                sendSci(SCI_SETSTYLING, endPos - pathEnd, SCE_GTAGS_HEADER);
+            }
+            else
+            {
+                sendSci(SCI_SETSTYLING, lineLen, SCE_GTAGS_HEADER);
+            }
         }
         else
         {
@@ -1207,6 +2818,13 @@ void ResultWin::onHotspotClick(SCNotification* notify)
  */
 void ResultWin::onDoubleClick(int pos)
 {
+    // Placeholder of a tab whose re-run failed
+    if (_activeTab && !_activeTab->HasText() && !_activeTab->_reloadError.IsEmpty())
+    {
+        retryReload(_activeTab);
+        return;
+    }
+
     int lineNum = sendSci(SCI_LINEFROMPOSITION, pos);
 
     if (lineNum == 0)
@@ -1464,10 +3082,7 @@ void ResultWin::onCloseTab()
     int i = TabCtrl_GetCurSel(_hTab);
 
     if (_activeTab)
-    {
-        delete _activeTab;
-        _activeTab = NULL;
-    }
+        deleteTab(_activeTab);
 
     TabCtrl_DeleteItem(_hTab, i);
 
@@ -1481,8 +3096,9 @@ void ResultWin::onCloseTab()
     }
     else
     {
-        sendSci(SCI_SETREADONLY, 0);
-        sendSci(SCI_CLEARALL);
+        sendSci(SCI_SETDOCPOINTER, 0, 0);
+        configDocument();
+
         sendSci(SCI_SETREADONLY, 1);
 
         hideWindow();
@@ -1495,18 +3111,17 @@ void ResultWin::onCloseTab()
  */
 void ResultWin::closeAllTabs()
 {
-    _activeTab = NULL;
-
     for (int i = TabCtrl_GetItemCount(_hTab); i; --i)
     {
         Tab* tab = getTab(i - 1);
         if (tab)
-            delete tab;
+            deleteTab(tab);
         TabCtrl_DeleteItem(_hTab, i - 1);
     }
 
-    sendSci(SCI_SETREADONLY, 0);
-    sendSci(SCI_CLEARALL);
+    sendSci(SCI_SETDOCPOINTER, 0, 0);
+    configDocument();
+
     sendSci(SCI_SETREADONLY, 1);
 
     hideWindow();
@@ -1767,6 +3382,10 @@ LRESULT APIENTRY ResultWin::wndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM
                     RW->onTabChange();
                 return 0;
 
+                case TTN_GETDISPINFO:
+                    RW->onTabToolTip((LPNMTTDISPINFO)lParam);
+                return 0;
+
                 case DMN_CLOSE:
                     RW->closeAllTabs();
                 return 0;
@@ -1785,21 +3404,20 @@ LRESULT APIENTRY ResultWin::wndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM
             RW->onMove();
         return 0;
 
+        case WM_TIMER:
+            if (wParam == cStreamTimerId && RW->_streamTab)
+                RW->streamResults();
+            else if (wParam == cPackTimerId)
+                RW->packTabs();
+        return 0;
+
         case WM_DESTROY:
         return 0;
 
         // Below are WM_USER messages for DLL threads synchronization
 
         case WM_RUN_CMD_CALLBACK:
-        {
-            CompletionCB    complCB = reinterpret_cast<CompletionCB>(wParam);
-            CmdPtr_t        cmd(*(reinterpret_cast<CmdPtr_t*>(lParam)));
-
-            ReplyMessage(0);
-
-            if (complCB && cmd)
-                complCB(cmd);
-        }
+            CmdEngine::RunCompletions(lParam);
         return 0;
 
         case WM_OPEN_ACTIVITY_WIN:
@@ -1809,6 +3427,30 @@ LRESULT APIENTRY ResultWin::wndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM
 
             if (hCancel)
                 ActivityWin::Show(header, hCancel);
+
+            delete [] header;
+        }
+        return 0;
+
+        case WM_UPDATE_ACTIVITY_WIN:
+        {
+            ActivityProgress* progress  = reinterpret_cast<ActivityProgress*>(wParam);
+            HANDLE hCancel              = reinterpret_cast<HANDLE>(lParam);
+
+            if (hCancel)
+                ActivityWin::Update(hCancel, *progress);
+
+            delete progress;
+        }
+        return 0;
+
+        case WM_UPDATE_RESULT_WIN:
+        {
+            PartialResult* partial = reinterpret_cast<PartialResult*>(lParam);
+
+            RW->onPartialResult(*partial);
+
+            delete partial;
         }
         return 0;
 
@@ -1822,6 +3464,8 @@ LRESULT APIENTRY ResultWin::wndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM
 
                 if (hActivityWin)
                     SendMessage(hActivityWin, WM_CLOSE, 0, 0);
+
+                CloseHandle(hCancel);
             }
         }
         return 0;
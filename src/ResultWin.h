@@ -27,10 +27,15 @@
 
 #include <windows.h>
 #include <tchar.h>
+#include <commctrl.h>
 #include <unordered_set>
+#include <vector>
+#include <list>
+#include <memory>
 #include "Scintilla.h"
 #include "Common.h"
 #include "Cmd.h"
+#include "BackgroundCmd.h"
 
 
 namespace GTags
@@ -50,16 +55,73 @@ public:
     class TabParser : public ResultParser
     {
     public:
-        TabParser() {}
+        TabParser() : _previewsLen(0), _packedLen(0), _packFailed(false), _partialFiles(0), _partialHits(0),
+                _partialFile(-1) {}
         virtual ~TabParser() {}
 
         virtual int Parse(const CmdPtr_t&);
+        virtual int ParsePartial(const CmdPtr_t&, const char* pLines, CTextA& text);
+        virtual const CTextA& GetText() const;
+
+        inline void ReleaseText() { _text.reset(); }
+
+        inline unsigned FilesCount() const { return _fileNameLen.size(); }
+        inline unsigned HitsCount() const { return _hitLine.size(); }
+        inline bool IsPacked() const { return (_previews.empty() && !_packedPreviews.empty()); }
+        inline bool CanPack() const { return (!_packFailed && !_previews.empty()); }
+
+        bool Pack(unsigned maxLen);
+        unsigned MemSize() const;
+
+        int FindFile(const CPath& root, const PathKey& file, unsigned* runs = NULL) const;
+        unsigned FileLine(unsigned fileIdx) const;
+        inline unsigned FileHits(unsigned fileIdx) const { return _fileHits[fileIdx]; }
+        unsigned Splice(int fileIdx, const TabParser& update, int updateIdx);
 
     private:
+        static const unsigned cSpillChunkSize;
+
         static bool filterEntry(const DbConfig& cfg, const char* pEntry, unsigned len);
 
-        int parseCmd(const CmdPtr_t&);
-        int parseFindFile(const CmdPtr_t&);
+        void composeHeader(const CmdPtr_t&);
+        void clear();
+
+        int parseCmd(const CmdPtr_t&, const char* pSrc);
+        int parseFindFile(const CmdPtr_t&, const char* pSrc);
+        int parseFileTags(const CmdPtr_t&);
+        int parseSpillFile(const CmdPtr_t&, const SpillFile& file);
+
+        inline const char* fileName(unsigned fileIdx) const { return _fileNames.data() + _fileNameOffset[fileIdx]; }
+        unsigned internFile(const char* pFile, unsigned len);
+        void eraseFile(unsigned fileIdx);
+        void addHit(unsigned fileIdx, unsigned line, const char* pPreview, unsigned len);
+        void composeText() const;
+
+        // Results model - interned file table and parallel per-result arrays.
+        // The display text is composed from it only when needed.
+        CTextA                  _header;
+        std::vector<char>       _fileNames;
+        std::vector<unsigned>   _fileNameOffset;
+        std::vector<unsigned>   _fileNameLen;
+        std::vector<unsigned>   _fileHits;
+        std::vector<unsigned>   _hitFile;
+        std::vector<unsigned>   _hitLine;
+        std::vector<unsigned>   _hitPreviewOffset;
+        std::vector<unsigned>   _hitPreviewLen;
+        std::vector<char>       _previews;
+        std::vector<char>       _packedPreviews;
+        unsigned                _previewsLen;
+
+        // Previews are compressed a part at a time - the pool is dropped when it is all packed
+        unsigned                _packedLen;
+        bool                    _packFailed;
+
+        // Results already given as partial text - in the order they were found
+        unsigned                _partialFiles;
+        unsigned                _partialHits;
+        int                     _partialFile;
+
+        mutable std::unique_ptr<CTextA>     _text;
     };
 
 
@@ -100,6 +162,12 @@ public:
         return CPath();
     }
 
+    static void OnDbUpdate(const CPath& dbPath, const std::vector<CPath>& files)
+    {
+        if (RW)
+            RW->onDbUpdate(dbPath, files);
+    }
+
 private:
     /**
      *  \struct  Tab
@@ -119,22 +187,65 @@ private:
         const CmdId_t   _cmdId;
         const bool      _regExp;
         const bool      _matchCase;
+        CText           _name;
         CTextA          _projectPath;
         CTextA          _search;
         int             _currentLine;
         int             _firstVisibleLine;
-        ParserPtr_t     _parser;
+        std::shared_ptr<TabParser>  _parser;
+
+        // Scintilla document with the tab text, styling and fold levels
+        sptr_t          _doc;
+        unsigned        _docSize;
+
+        // Inactive tab results are kept compressed, evicted tabs have no parser
+        unsigned        _lastUsed;
+        bool            _reloading;
+
+        // Why the last re-run failed - the tab is not re-run again until the user asks
+        CTextA          _reloadError;
+
+        inline bool HasText() const { return (_parser != NULL); }
+        inline unsigned MemSize() const { return (_parser ? _parser->MemSize() : 0) + _docSize; }
 
         inline void SetFolded(int lineNum);
         inline void SetAllFolded();
         inline void ClearFolded(int lineNum);
         inline bool IsFolded(int lineNum);
+        inline const std::unordered_set<int>& ExpandedLines() const { return _expandedLines; }
+
+        void RemapLines(int start, int oldLen, int newLen);
 
     private:
         std::unordered_set<int> _expandedLines;
     };
 
 
+    /**
+     *  \struct  Refresh
+     *  \brief  Queued tab search limited to a re-indexed file
+     */
+    struct Refresh
+    {
+        Refresh(const Tab& tab, const CPath& file) :
+            _cmdId(tab._cmdId), _regExp(tab._regExp), _matchCase(tab._matchCase), _name(tab._name),
+            _projectPath(tab._projectPath), _search(tab._search), _file(file) {}
+
+        inline bool IsOf(const Tab& tab) const
+        {
+            return (_cmdId == tab._cmdId && _projectPath == tab._projectPath && _search == tab._search);
+        }
+
+        CmdId_t     _cmdId;
+        bool        _regExp;
+        bool        _matchCase;
+        CText       _name;
+        CTextA      _projectPath;
+        CTextA      _search;
+        CPath       _file;
+    };
+
+
     static const COLORREF   cBlack = RGB(0,0,0);
     static const COLORREF   cWhite = RGB(255,255,255);
 
@@ -145,13 +256,31 @@ private:
     static const unsigned   cSearchFontSize;
     static const int        cSearchWidth;
 
+    static const UINT_PTR   cStreamTimerId;
+    static const UINT       cStreamPeriod;
+    static const unsigned   cStreamBatchSize;
+
+    static const UINT_PTR   cPackTimerId;
+    static const UINT       cPackPeriod;
+    static const unsigned   cPackBatchSize;
+    static const unsigned   cPackBlockSize;
+
+    static const unsigned   cMaxRefreshFiles;
+    static const unsigned   cMaxRefreshes;
+
+    static BackgroundCmd    RefreshCmd;
+
+    static void reloadTabCB(const CmdPtr_t& cmd);
+    static void refreshTabCB(const CmdPtr_t& cmd);
+
     static LRESULT CALLBACK keyHookProc(int code, WPARAM wParam, LPARAM lParam);
     static LRESULT APIENTRY wndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
     static LRESULT APIENTRY searchWndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 
     ResultWin() : _hWnd(NULL), _hSci(NULL), _hKeyHook(NULL), _sciFunc(NULL), _sciPtr(0), _activeTab(NULL),
-            _hSearch(NULL), _hSearchFont(NULL), _hBtnFont(NULL),
-            _lastRE(false), _lastMC(true), _lastWW(true) {}
+            _tabUseCounter(0), _streamTab(NULL), _streamPos(0), _streamHits(0), _streamPrefixLen(0),
+            _liveTab(NULL), _liveShown(false), _liveDone(false), _liveHits(0), _livePrefixLen(0),
+            _hSearch(NULL), _hSearchFont(NULL), _hBtnFont(NULL), _lastRE(false), _lastMC(true), _lastWW(true) {}
     ResultWin(const ResultWin&);
     ~ResultWin();
 
@@ -169,6 +298,7 @@ private:
             int size = 0, const char *font = NULL);
 
     void configScintilla();
+    void configDocument();
     HWND composeWindow();
     void createSearchWindow();
     void onSearchWindowCreate(HWND hWnd);
@@ -182,6 +312,30 @@ private:
 
     Tab* getTab(int i = -1);
     void loadTab(Tab* tab);
+    void restoreFolding(Tab* tab);
+    void releaseDoc(Tab* tab);
+    void deleteTab(Tab* tab);
+    void streamResults(int minLines = 0);
+    void stopStreaming(bool finished = false);
+    void packTab(Tab* tab);
+    void packTabs();
+    void retryReload(Tab* tab);
+    void onPartialResult(const PartialResult& partial);
+    void openLiveTab(const PartialResult& partial);
+    void appendLiveResults(const PartialResult& partial);
+    sptr_t adoptLiveDoc(Tab* tab);
+    void resumeTab(Tab* tab, sptr_t doc);
+    void dropLiveTab();
+    void evictTabs();
+    void reloadTab(Tab* tab);
+    void onTabReloaded(const CmdPtr_t& cmd);
+    void onDbUpdate(const CPath& dbPath, const std::vector<CPath>& files);
+    void rerunTab(Tab* tab);
+    bool isRefreshQueued(const Tab& tab, const CPath& file) const;
+    void dropRefreshes(const Tab& tab);
+    void runRefreshes();
+    void onTabRefreshed(const CmdPtr_t& cmd);
+    void onTabToolTip(LPNMTTDISPINFO toolTip);
     bool openItem(int lineNum, unsigned matchNum = 1);
 
     bool findString(const char* str, int* startPos, int* endPos, bool matchCase, bool wholeWord, bool regExp);
@@ -209,6 +363,25 @@ private:
     SciFnDirect _sciFunc;
     sptr_t      _sciPtr;
     Tab*        _activeTab;
+    unsigned    _tabUseCounter;
+    TCHAR       _toolTipText[128];
+
+    // Results of big searches are added to the view in batches
+    Tab*        _streamTab;
+    unsigned    _streamPos;
+    unsigned    _streamHits;
+    unsigned    _streamPrefixLen;
+
+    // Results of the running search shown as they arrive - the tab has no parser until the search completes
+    CmdPtr_t    _liveCmd;
+    Tab*        _liveTab;
+    bool        _liveShown;
+    bool        _liveDone;
+    unsigned    _liveHits;
+    unsigned    _livePrefixLen;
+
+    // Re-indexed files re-queried in the open tabs - one at a time through RefreshCmd
+    std::list<Refresh>  _refreshes;
 
     HWND        _hSearch;
     HWND        _hSearchTxt;
@@ -28,11 +28,13 @@
 #include <windows.h>
 #include <windowsx.h>
 #include <tchar.h>
+#include <string.h>
 #include <commctrl.h>
 #include "Common.h"
 #include "INpp.h"
 #include "GTags.h"
 #include "CmdEngine.h"
+#include "SpeculativeFind.h"
 #include "SearchWin.h"
 #include "Cmd.h"
 #include "LineParser.h"
@@ -183,7 +185,7 @@ HWND SearchWin::composeWindow(HWND hOwner, bool enRE, bool enMC)
 
     _hSearch = CreateWindowEx(0, WC_COMBOBOX, NULL,
             WS_CHILD | WS_VISIBLE | WS_VSCROLL |
-            CBS_DROPDOWN | CBS_HASSTRINGS | CBS_AUTOHSCROLL | CBS_SORT,
+            CBS_DROPDOWN | CBS_HASSTRINGS | CBS_AUTOHSCROLL | (GTagsSettings._fuzzyCompletion ? 0 : CBS_SORT),
             2, btnHeight + 10, win.right - win.left - 4, txtHeight,
             _hWnd, NULL, HMod, NULL);
 
@@ -241,8 +243,7 @@ void SearchWin::startCompletion()
 
     CmdId_t cmplId;
     TCHAR tag[cComplAfter + 2];
-    CompletionCB complCB;
-    ParserPtr_t parser;
+    ParserPtr_t parser(new LineParser);
 
     if (_cmd->Id() == FIND_FILE)
     {
@@ -251,9 +252,6 @@ void SearchWin::startCompletion()
         tag[0] = _T('/');
         ComboBox_GetText(_hSearch, tag + 1, _countof(tag) - 1);
         tag[cComplAfter + 1] = 0;
-
-        complCB = endCompletion;
-        parser.reset(new LineParser);
     }
     else
     {
@@ -265,50 +263,24 @@ void SearchWin::startCompletion()
         for (int i = 0; tag[i] != 0; ++i)
             if (tag[i] == _T(' ') || tag[i] == _T('\t'))
                 return;
+    }
+
+    bool matchCase = (Button_GetCheck(_hMC) == BST_CHECKED);
 
-        complCB = halfComplete;
+    if (GTagsSettings._fuzzyCompletion)
+    {
+        tag[(cmplId == AUTOCOMPLETE_FILE) ? 2 : 1] = 0;
+        matchCase = false;
     }
 
-    CmdPtr_t cmpl(new Cmd(cmplId, _T("AutoComplete"), _cmd->Db(), parser,
-            tag, false, (Button_GetCheck(_hMC) == BST_CHECKED)));
+    CmdPtr_t cmpl(new Cmd(cmplId, _T("AutoComplete"), _cmd->Db(), parser, tag, false, matchCase));
 
     if (_cmd->Id() != FIND_DEFINITION)
         cmpl->SkipLibs(true);
 
     _completionStarted = true;
 
-    CmdEngine::Run(cmpl, complCB);
-}
-
-
-/**
- *  \brief
- */
-void SearchWin::halfComplete(const CmdPtr_t& cmpl)
-{
-    if (SW == NULL)
-        return;
-
-    if (ComboBox_GetTextLength(SW->_hSearch) < cComplAfter)
-    {
-        SW->_completionStarted = false;
-        return;
-    }
-
-    if (cmpl->Status() == OK)
-    {
-        cmpl->Id(AUTOCOMPLETE_SYMBOL);
-
-        ParserPtr_t parser(new LineParser);
-        cmpl->Parser(parser);
-
-        CmdEngine::Run(cmpl, endCompletion);
-    }
-    else
-    {
-        SW->_completionStarted = false;
-        SW->_completionDone = true;
-    }
+    CmdEngine::Run(cmpl, endCompletion);
 }
 
 
@@ -328,6 +300,10 @@ void SearchWin::endCompletion(const CmdPtr_t& cmpl)
     if (cmpl->Status() == OK && cmpl->Result())
     {
         SW->_completion = cmpl->Parser();
+
+        if (GTagsSettings._fuzzyCompletion)
+            SW->_matcher.reset(new FuzzyMatcher(SW->_completion->GetList()));
+
         SW->filterComplList();
     }
 
@@ -353,6 +329,7 @@ void SearchWin::clearCompletion()
     ComboBox_SetText(_hSearch, txt.C_str());
     PostMessage(_hSearch, CB_SETEDITSEL, 0, MAKELPARAM(pos, pos));
 
+    _matcher.reset();
     _completion.reset();
     _completionDone = false;
 }
@@ -372,12 +349,15 @@ void SearchWin::filterComplList()
 
     int pos = HIWORD(SendMessage(_hSearch, CB_GETEDITSEL, 0, 0));
 
-    int (*pCompare)(const TCHAR*, const TCHAR*, size_t);
+    // The candidates are compared in the command output encoding
+    const CTextA filterA(filter.C_str());
+
+    int (*pCompare)(const char*, const char*, size_t);
 
     if (Button_GetCheck(_hMC) == BST_CHECKED)
-        pCompare = &_tcsncmp;
+        pCompare = &strncmp;
     else
-        pCompare = &_tcsnicmp;
+        pCompare = &_strnicmp;
 
     ComboBox_ResetContent(_hSearch);
     ComboBox_ShowDropdown(_hSearch, FALSE);
@@ -386,16 +366,28 @@ void SearchWin::filterComplList()
 
     SendMessage(_hSearch, WM_SETREDRAW, FALSE, 0);
 
-    if (filter.Len() == cComplAfter)
+    std::vector<const char*> matches;
+
+    if (_matcher)
     {
-        for (const auto& complEntry : _completion->GetList())
-            ComboBox_AddString(_hSearch, complEntry);
+        _matcher->Match(filterA.C_str(), (Button_GetCheck(_hMC) == BST_CHECKED), matches);
+    }
+    else if (filter.Len() == cComplAfter)
+    {
+        matches.assign(_completion->GetList().begin(), _completion->GetList().end());
     }
     else
     {
-        for (const auto& complEntry : _completion->GetList())
-            if (!pCompare(complEntry, filter.C_str(), filter.Len()))
-                ComboBox_AddString(_hSearch, complEntry);
+        for (const char* complEntry : _completion->GetList())
+            if (!pCompare(complEntry, filterA.C_str(), filterA.Len()))
+                matches.push_back(complEntry);
+    }
+
+    // Only the listed entries get converted
+    for (const char* complEntry : matches)
+    {
+        CText entry(complEntry);
+        ComboBox_AddString(_hSearch, entry.C_str());
     }
 
     if (ComboBox_GetCount(_hSearch))
@@ -486,7 +478,11 @@ void SearchWin::onOK()
         _cmd->MatchCase(mc);
 
         _cancelled = false;
-        CmdEngine::Run(_cmd, _complCB);
+
+        if (_cmd->Id() == FIND_DEFINITION || _cmd->Id() == FIND_REFERENCE)
+            SpeculativeFind::Run(_cmd, _complCB);
+        else
+            CmdEngine::Run(_cmd, _complCB);
     }
 
     SendMessage(_hWnd, WM_CLOSE, 0, 0);
@@ -27,9 +27,11 @@
 
 #include <windows.h>
 #include <tchar.h>
+#include <memory>
 #include "Common.h"
 #include "GTags.h"
 #include "CmdDefines.h"
+#include "FuzzyMatcher.h"
 
 
 namespace GTags
@@ -56,7 +58,6 @@ private:
     static LRESULT CALLBACK keyHookProc(int code, WPARAM wParam, LPARAM lParam);
     static LRESULT APIENTRY wndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 
-    static void halfComplete(const CmdPtr_t&);
     static void endCompletion(const CmdPtr_t&);
 
     SearchWin(const CmdPtr_t& cmd, CompletionCB complCB) :
@@ -93,6 +94,8 @@ private:
     bool        _completionStarted;
     bool        _completionDone;
     ParserPtr_t _completion;
+
+    std::unique_ptr<FuzzyMatcher>   _matcher;
 };
 
 } // namespace GTags
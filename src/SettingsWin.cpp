@@ -698,7 +698,7 @@ void SettingsWin::readTabData()
         _activeTab->_cfg.DbPathsFromBuf(libDbPaths.C_str(), _T("\n\r"));
     }
 
-    _activeTab->_cfg._pathFilters.clear();
+    _activeTab->_cfg.ClearFilters();
 
     len = Edit_GetTextLength(_hPathFilters);
     if (len)
@@ -787,10 +787,13 @@ bool SettingsWin::saveTab(SettingsWin::Tab* tab)
         return saveDbConfig(tab);
     }
 
+    // Start from the current settings to keep the options that are not edited here
     Settings newSettings;
+    newSettings = GTagsSettings;
 
     newSettings._genericDbCfg = tab->_cfg;
     newSettings._useDefDb = (Button_GetCheck(_hEnDefDb) == BST_CHECKED) ? true : false;
+    newSettings._defDbPath.Clear();
 
     const int len = Edit_GetTextLength(_hDefDb);
     if (len)
@@ -803,9 +806,6 @@ bool SettingsWin::saveTab(SettingsWin::Tab* tab)
             newSettings._defDbPath.Clear();
     }
 
-    newSettings._re = GTagsSettings._re;
-    newSettings._mc = GTagsSettings._mc;
-
     CPath cfgFile;
     INpp::Get().GetPluginsConfDir(cfgFile);
     cfgFile += cPluginCfgFileName;
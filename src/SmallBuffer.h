@@ -0,0 +1,244 @@
+/**
+ *  \file
+ *  \brief  Vector-like character buffer keeping short contents inline
+ *
+ *  \author  Pavel Nedev <pg.nedev@gmail.com>
+ *
+ *  \section COPYRIGHT
+ *  Copyright(C) 2015 Pavel Nedev
+ *
+ *  \section LICENSE
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+
+#include <string.h>
+#include <stdlib.h>
+#include <new>
+
+
+/**
+ *  \class  SmallBuffer
+ *  \brief  Subset of std::vector for trivially copyable types. Up to InlineSize elements are kept
+ *          in the object itself so short texts don't allocate. Iterators are plain pointers.
+ */
+template<typename T, unsigned InlineSize>
+class SmallBuffer
+{
+public:
+    typedef T*          iterator;
+    typedef const T*    const_iterator;
+
+    SmallBuffer() : _data(_inline), _size(0), _capacity(InlineSize) {}
+
+    SmallBuffer(const SmallBuffer& buf) : _data(_inline), _size(0), _capacity(InlineSize)
+    {
+        assign(buf.begin(), buf.end());
+    }
+
+    SmallBuffer(SmallBuffer&& buf) throw() : _data(_inline), _size(0), _capacity(InlineSize)
+    {
+        steal(buf);
+    }
+
+    ~SmallBuffer()
+    {
+        if (_data != _inline)
+            free(_data);
+    }
+
+    SmallBuffer& operator=(const SmallBuffer& buf)
+    {
+        if (this != &buf)
+            assign(buf.begin(), buf.end());
+        return *this;
+    }
+
+    SmallBuffer& operator=(SmallBuffer&& buf) throw()
+    {
+        if (this != &buf)
+        {
+            if (_data != _inline)
+                free(_data);
+
+            _data = _inline;
+            _size = 0;
+            _capacity = InlineSize;
+
+            steal(buf);
+        }
+        return *this;
+    }
+
+    inline bool operator==(const SmallBuffer& buf) const
+    {
+        return (_size == buf._size && !memcmp(_data, buf._data, _size * sizeof(T)));
+    }
+
+    inline T& operator[](unsigned pos) { return _data[pos]; }
+    inline const T& operator[](unsigned pos) const { return _data[pos]; }
+
+    inline T* data() { return _data; }
+    inline const T* data() const { return _data; }
+    inline unsigned size() const { return _size; }
+    inline unsigned capacity() const { return _capacity; }
+    inline bool empty() const { return (_size == 0); }
+
+    inline iterator begin() { return _data; }
+    inline iterator end() { return _data + _size; }
+    inline const_iterator begin() const { return _data; }
+    inline const_iterator end() const { return _data + _size; }
+    inline const_iterator cbegin() const { return _data; }
+    inline const_iterator cend() const { return _data + _size; }
+
+    inline void clear() { _size = 0; }
+
+    inline void push_back(T val)
+    {
+        if (_size == _capacity)
+            grow(_size + 1);
+        _data[_size++] = val;
+    }
+
+    inline void pop_back() { --_size; }
+
+    void resize(unsigned size, T val = T())
+    {
+        if (size > _capacity)
+            grow(size);
+
+        for (unsigned i = _size; i < size; ++i)
+            _data[i] = val;
+
+        _size = size;
+    }
+
+    void assign(const T* first, const T* last)
+    {
+        const unsigned count = last - first;
+
+        if (count > _capacity)
+        {
+            // The source may be in the current storage
+            SmallBuffer tmp;
+            tmp.reserve(count);
+            memcpy(tmp._data, first, count * sizeof(T));
+            tmp._size = count;
+
+            *this = static_cast<SmallBuffer&&>(tmp);
+            return;
+        }
+
+        memmove(_data, first, count * sizeof(T));
+        _size = count;
+    }
+
+    iterator insert(const_iterator pos, T val)
+    {
+        return insert(pos, &val, &val + 1);
+    }
+
+    iterator insert(const_iterator pos, const T* first, const T* last)
+    {
+        const unsigned at = pos - _data;
+        const unsigned count = last - first;
+
+        if (count == 0)
+            return _data + at;
+
+        if (_size + count > _capacity || (first < _data + _size && last > _data))
+        {
+            // Build anew if the storage must grow or if the source is in the current storage
+            SmallBuffer tmp;
+            tmp.reserve(_size + count);
+            tmp.assign(_data, _data + at);
+            memcpy(tmp._data + at, first, count * sizeof(T));
+            memcpy(tmp._data + at + count, _data + at, (_size - at) * sizeof(T));
+            tmp._size = _size + count;
+
+            *this = static_cast<SmallBuffer&&>(tmp);
+        }
+        else
+        {
+            memmove(_data + at + count, _data + at, (_size - at) * sizeof(T));
+            memcpy(_data + at, first, count * sizeof(T));
+            _size += count;
+        }
+
+        return _data + at;
+    }
+
+    iterator erase(const_iterator first, const_iterator last)
+    {
+        const unsigned at = first - _data;
+        const unsigned count = last - first;
+
+        memmove(_data + at, _data + at + count, (_size - at - count) * sizeof(T));
+        _size -= count;
+
+        return _data + at;
+    }
+
+    void reserve(unsigned capacity)
+    {
+        if (capacity > _capacity)
+            grow(capacity);
+    }
+
+private:
+    void grow(unsigned minCapacity)
+    {
+        unsigned capacity = _capacity + _capacity / 2;
+        if (capacity < minCapacity)
+            capacity = minCapacity;
+
+        T* data = static_cast<T*>(malloc(capacity * sizeof(T)));
+        if (data == NULL)
+            throw std::bad_alloc();
+
+        memcpy(data, _data, _size * sizeof(T));
+
+        if (_data != _inline)
+            free(_data);
+
+        _data = data;
+        _capacity = capacity;
+    }
+
+    void steal(SmallBuffer& buf)
+    {
+        if (buf._data == buf._inline)
+        {
+            memcpy(_inline, buf._inline, buf._size * sizeof(T));
+        }
+        else
+        {
+            _data = buf._data;
+            _capacity = buf._capacity;
+
+            buf._data = buf._inline;
+            buf._capacity = InlineSize;
+        }
+
+        _size = buf._size;
+        buf._size = 0;
+    }
+
+    T*          _data;
+    unsigned    _size;
+    unsigned    _capacity;
+    T           _inline[InlineSize];
+};
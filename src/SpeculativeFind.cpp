@@ -0,0 +1,214 @@
+/**
+ *  \file
+ *  \brief  Find definition / reference with symbol search fallback
+ *
+ *  \author  Pavel Nedev <pg.nedev@gmail.com>
+ *
+ *  \section COPYRIGHT
+ *  Copyright(C) 2015 Pavel Nedev
+ *
+ *  \section LICENSE
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "SpeculativeFind.h"
+#include "Config.h"
+#include "DbManager.h"
+#include "Cmd.h"
+#include "CmdEngine.h"
+#include "ResultWin.h"
+#include "GTags.h"
+
+
+namespace GTags
+{
+
+const TCHAR SpeculativeFind::cFindSymbol[]  = _T("Find Symbol");
+const float SpeculativeFind::cAlpha         = 0.25f;
+const float SpeculativeFind::cMinGainMs     = 20.0f;
+
+std::list<SpeculativeFind::Race> SpeculativeFind::Races;
+std::unordered_map<PathKey, SpeculativeFind::DbEntry, PathKey::Hasher> SpeculativeFind::DbStats;
+
+
+/**
+ *  \brief  Runs the command, complCB gets either it or the symbol search that replaced it
+ */
+bool SpeculativeFind::Run(const CmdPtr_t& cmd, CompletionCB complCB)
+{
+    if (!complCB)
+        return false;
+
+    Race race;
+    race._stats         = &getStats(cmd);
+    race._main          = cmd;
+    race._complCB       = complCB;
+    race._fallbackStart = GetTickCount();
+    race._mainDone      = false;
+    race._fallbackDone  = false;
+
+    // Speculate only if the expected time saved is worth an extra process
+    if (GTagsSettings._speculativeFind && race._stats->_emptyRate * race._stats->_fallbackMs >= cMinGainMs)
+        race._fallback = startFallback(cmd);
+
+    if (!CmdEngine::Run(cmd, mainCB))
+    {
+        if (race._fallback)
+            race._fallback->Cancel();
+        return false;
+    }
+
+    Races.push_back(race);
+
+    return true;
+}
+
+
+/**
+ *  \brief
+ */
+SpeculativeFind::Stats& SpeculativeFind::getStats(const CmdPtr_t& cmd)
+{
+    DbEntry& entry = DbStats[cmd->Db()->GetKey()];
+
+    return (cmd->Id() == FIND_DEFINITION) ? entry._def : entry._ref;
+}
+
+
+/**
+ *  \brief  Starts background symbol search with the same parameters (and its own database lock)
+ */
+CmdPtr_t SpeculativeFind::startFallback(const CmdPtr_t& cmd)
+{
+    bool success;
+    DbHandle db = DbManager::Get().GetDbAt(cmd->Db()->GetPath(), false, &success);
+    if (!db || !success)
+        return CmdPtr_t();
+
+    ParserPtr_t parser(new ResultWin::TabParser);
+    CmdPtr_t fallback(new Cmd(FIND_SYMBOL, cFindSymbol, db, parser, cmd->Tag().C_str(),
+            cmd->RegExp(), cmd->MatchCase()));
+    fallback->Background(true);
+
+    if (!CmdEngine::Run(fallback, fallbackCB))
+    {
+        DbManager::Get().PutDb(db);
+        return CmdPtr_t();
+    }
+
+    return fallback;
+}
+
+
+/**
+ *  \brief
+ */
+void SpeculativeFind::mainCB(const CmdPtr_t& cmd)
+{
+    std::list<Race>::iterator race;
+    for (race = Races.begin(); race != Races.end() && race->_main != cmd; ++race);
+
+    if (race == Races.end())
+        return;
+
+    race->_mainDone = true;
+
+    const bool empty = (cmd->Status() == OK && !cmd->HasResult());
+
+    if (cmd->Status() == OK)
+        race->_stats->_emptyRate += cAlpha * ((empty ? 1.0f : 0.0f) - race->_stats->_emptyRate);
+
+    if (empty)
+    {
+        if (race->_fallbackDone)
+        {
+            const CmdPtr_t fallback = race->_fallback;
+            const CompletionCB complCB = race->_complCB;
+
+            Races.erase(race);
+
+            DbManager::Get().PutDb(cmd->Db());
+            complCB(fallback);
+            return;
+        }
+
+        if (race->_fallback)
+        {
+            // Wait for the symbol search and let the user see it is running
+            race->_fallback->Background(false);
+            return;
+        }
+
+        // No speculation - run the symbol search now re-using the command (and its database lock)
+        cmd->Id(FIND_SYMBOL);
+        cmd->Name(cFindSymbol);
+
+        race->_fallback = cmd;
+        race->_fallbackStart = GetTickCount();
+
+        if (CmdEngine::Run(cmd, fallbackCB))
+            return;
+    }
+    else if (race->_fallback)
+    {
+        // The main search decides - drop the symbol search
+        if (race->_fallbackDone)
+            DbManager::Get().PutDb(race->_fallback->Db());
+        else
+            race->_fallback->Cancel();
+    }
+
+    const CompletionCB complCB = race->_complCB;
+
+    Races.erase(race);
+
+    complCB(cmd);
+}
+
+
+/**
+ *  \brief
+ */
+void SpeculativeFind::fallbackCB(const CmdPtr_t& cmd)
+{
+    std::list<Race>::iterator race;
+    for (race = Races.begin(); race != Races.end() && race->_fallback != cmd; ++race);
+
+    // Cancelled loser - just release its database lock
+    if (race == Races.end())
+    {
+        DbManager::Get().PutDb(cmd->Db());
+        return;
+    }
+
+    if (cmd->Status() == OK || cmd->Status() == PARSE_EMPTY)
+        race->_stats->_fallbackMs +=
+                cAlpha * ((float)(GetTickCount() - race->_fallbackStart) - race->_stats->_fallbackMs);
+
+    race->_fallbackDone = true;
+
+    if (!race->_mainDone)
+        return;
+
+    const CompletionCB complCB = race->_complCB;
+
+    if (race->_main != cmd)
+        DbManager::Get().PutDb(race->_main->Db());
+
+    Races.erase(race);
+
+    complCB(cmd);
+}
+
+} // namespace GTags
@@ -0,0 +1,101 @@
+/**
+ *  \file
+ *  \brief  Find definition / reference with symbol search fallback
+ *
+ *  \author  Pavel Nedev <pg.nedev@gmail.com>
+ *
+ *  \section COPYRIGHT
+ *  Copyright(C) 2015 Pavel Nedev
+ *
+ *  \section LICENSE
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+
+#include <windows.h>
+#include <tchar.h>
+#include <list>
+#include <unordered_map>
+#include "Common.h"
+#include "CmdDefines.h"
+
+
+namespace GTags
+{
+
+/**
+ *  \class  SpeculativeFind
+ *  \brief  Runs find definition / reference and falls back to symbol search if nothing is found.
+ *          When it is likely to pay off (learned per database) the symbol search is started
+ *          together with the main one and is cancelled if the main search finds something.
+ */
+class SpeculativeFind
+{
+public:
+    static bool Run(const CmdPtr_t& cmd, CompletionCB complCB);
+
+private:
+    /**
+     *  \struct  Stats
+     *  \brief  Moving averages of how often the main search is empty and how long the fallback takes
+     */
+    struct Stats
+    {
+        Stats() : _emptyRate(0.5f), _fallbackMs(100.0f) {}
+
+        float   _emptyRate;
+        float   _fallbackMs;
+    };
+
+    /**
+     *  \struct  DbEntry
+     *  \brief  Find definition and find reference stats of a database
+     */
+    struct DbEntry
+    {
+        Stats   _def;
+        Stats   _ref;
+    };
+
+    /**
+     *  \struct  Race
+     *  \brief
+     */
+    struct Race
+    {
+        Stats*          _stats;
+        CmdPtr_t        _main;
+        CmdPtr_t        _fallback;
+        CompletionCB    _complCB;
+        DWORD           _fallbackStart;
+        bool            _mainDone;
+        bool            _fallbackDone;
+    };
+
+    static const TCHAR  cFindSymbol[];
+    static const float  cAlpha;
+    static const float  cMinGainMs;
+
+    static std::list<Race>  Races;
+    static std::unordered_map<PathKey, DbEntry, PathKey::Hasher>    DbStats;
+
+    static Stats& getStats(const CmdPtr_t& cmd);
+    static CmdPtr_t startFallback(const CmdPtr_t& cmd);
+    static void mainCB(const CmdPtr_t& cmd);
+    static void fallbackCB(const CmdPtr_t& cmd);
+};
+
+} // namespace GTags
@@ -27,12 +27,12 @@
 
 #include <string>
 #include <unordered_set>
-#include <functional>
+#include "Common.h"
 
 
 /**
  *  \class  StrUniquenessChecker
- *  \brief
+ *  \brief  Hashes the strings in place - no temporary copies are made
  */
 template<typename CharType>
 class StrUniquenessChecker
@@ -46,10 +46,15 @@ public:
         if (!ptr)
             return false;
 
-        std::basic_string<CharType> str(ptr);
-        std::hash<std::basic_string<CharType>> hash;
+        return IsUnique(ptr, std::char_traits<CharType>::length(ptr));
+    }
+
+    bool IsUnique(const CharType* ptr, std::size_t len)
+    {
+        if (!ptr)
+            return false;
 
-        return _set.insert(hash(str)).second;
+        return _set.insert(TextView<CharType>(ptr, (unsigned)len).Hash()).second;
     }
 
 private:
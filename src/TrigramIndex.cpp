@@ -0,0 +1,858 @@
+/**
+ *  \file
+ *  \brief  Trigram index of the database files for text search narrowing
+ *
+ *  \author  Pavel Nedev <pg.nedev@gmail.com>
+ *
+ *  \section COPYRIGHT
+ *  Copyright(C) 2015 Pavel Nedev
+ *
+ *  \section LICENSE
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <string.h>
+#include <algorithm>
+#include "TrigramIndex.h"
+
+
+namespace
+{
+
+/**
+ *  \brief
+ */
+inline unsigned char toLowerAscii(unsigned char ch)
+{
+    return (ch >= 'A' && ch <= 'Z') ? ch + ('a' - 'A') : ch;
+}
+
+
+/**
+ *  \brief
+ */
+void putVarint(std::vector<unsigned char>& buf, unsigned val)
+{
+    while (val >= 0x80)
+    {
+        buf.push_back((unsigned char)(val | 0x80));
+        val >>= 7;
+    }
+
+    buf.push_back((unsigned char)val);
+}
+
+
+/**
+ *  \brief
+ */
+template <typename T>
+void putValue(std::vector<char>& buf, T val)
+{
+    const char* pVal = reinterpret_cast<const char*>(&val);
+    buf.insert(buf.end(), pVal, pVal + sizeof(T));
+}
+
+
+/**
+ *  \brief
+ */
+template <typename T>
+bool getValue(const char*& pSrc, const char* pEnd, T& val)
+{
+    if ((size_t)(pEnd - pSrc) < sizeof(T))
+        return false;
+
+    memcpy(&val, pSrc, sizeof(T));
+    pSrc += sizeof(T);
+
+    return true;
+}
+
+
+/**
+ *  \brief  Converts file list entry to full path
+ */
+CPath fullPath(const CPath& dbPath, const char* pFile, unsigned len)
+{
+    CPath path(dbPath);
+    path.Append(pFile, len);
+
+    for (TCHAR* pCh = path.C_str(); *pCh; ++pCh)
+        if (*pCh == _T('/'))
+            *pCh = _T('\\');
+
+    return path;
+}
+
+} // anonymous namespace
+
+
+namespace GTags
+{
+
+const char TrigramIndex::cMagic[4]              = {'N', 'G', 'T', 'I'};
+const unsigned TrigramIndex::cVersion           = 2;
+const TCHAR TrigramIndex::cIndexFile[]          = _T("GTRIGRAMS");
+const TCHAR TrigramIndex::cJournalFile[]        = _T("GTRIGRAMS.upd");
+const unsigned TrigramIndex::cMaxFileSize       = 256 * 1024 * 1024;
+const unsigned TrigramIndex::cMaxPostingsSize   = 512 * 1024 * 1024;
+
+Mutex TrigramIndex::CacheLock;
+std::unordered_map<PathKey, TrigramIndex::CacheEntry, PathKey::Hasher> TrigramIndex::Cache;
+
+
+/**
+ *  \brief  Indexes the listed files (one path relative to the database per line).
+ *          Gives up (leaving no index) if stopped or if the index grows too big.
+ */
+bool TrigramIndex::Build(const CPath& dbPath, const char* fileList, volatile bool& stop)
+{
+    /**
+     *  \struct  Posting
+     *  \brief
+     */
+    struct Posting
+    {
+        Posting() : _last(0), _count(0) {}
+
+        std::vector<unsigned char>  _data;
+        unsigned                    _last;
+        unsigned                    _count;
+    };
+
+    Remove(dbPath);
+
+    // Files changed after the build start are not trusted to the index
+    FILETIME buildTime;
+    GetSystemTimeAsFileTime(&buildTime);
+
+    std::vector<CTextA> files;
+
+    for (const char* pSrc = fileList; pSrc && *pSrc;)
+    {
+        while (*pSrc == '\n' || *pSrc == '\r')
+            ++pSrc;
+        if (*pSrc == 0)
+            break;
+
+        const char* pEol = pSrc;
+        while (*pEol != '\n' && *pEol != '\r' && *pEol != 0)
+            ++pEol;
+
+        files.push_back(CTextA());
+        files.back().Append(pSrc, pEol - pSrc);
+
+        pSrc = pEol;
+    }
+
+    std::unordered_map<unsigned, Posting> postings;
+    size_t postingsSize = 0;
+    std::vector<unsigned> trigrams;
+
+    for (unsigned i = 0; i < files.size(); ++i)
+    {
+        if (stop)
+            return false;
+
+        fileTrigrams(fullPath(dbPath, files[i].C_str(), files[i].Len()), trigrams);
+
+        for (unsigned trigram : trigrams)
+        {
+            Posting& posting = postings[trigram];
+            const size_t size = posting._data.size();
+
+            putVarint(posting._data, i - posting._last);
+            posting._last = i;
+            ++posting._count;
+
+            postingsSize += posting._data.size() - size;
+        }
+
+        if (postingsSize > cMaxPostingsSize)
+            return false;
+    }
+
+    std::vector<unsigned> keys;
+    keys.reserve(postings.size());
+    for (const auto& posting : postings)
+        keys.push_back(posting.first);
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<char> data;
+    data.insert(data.end(), cMagic, cMagic + sizeof(cMagic));
+    putValue(data, cVersion);
+    putValue(data, (unsigned)files.size());
+    putValue(data, (unsigned)keys.size());
+    putValue(data, (unsigned)postingsSize);
+    putValue(data, buildTime);
+
+    for (const auto& file : files)
+    {
+        putValue(data, (unsigned short)file.Len());
+        data.insert(data.end(), file.C_str(), file.C_str() + file.Len());
+    }
+
+    unsigned offset = 0;
+    for (unsigned key : keys)
+    {
+        const Posting& posting = postings[key];
+
+        putValue(data, key);
+        putValue(data, offset);
+        putValue(data, posting._count);
+
+        offset += posting._data.size();
+    }
+
+    for (unsigned key : keys)
+    {
+        Posting& posting = postings[key];
+        data.insert(data.end(), posting._data.begin(), posting._data.end());
+        std::vector<unsigned char>().swap(posting._data);
+    }
+
+    if (stop)
+        return false;
+
+    CPath indexPath(dbPath);
+    indexPath += cIndexFile;
+
+    if (!writeFile(indexPath, data))
+    {
+        DeleteFile(indexPath.C_str());
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+ *  \brief  Journals the file new trigrams (none if the file was deleted)
+ */
+bool TrigramIndex::UpdateFile(const CPath& dbPath, const CPath& file)
+{
+    CPath indexPath(dbPath);
+    indexPath += cIndexFile;
+
+    if (!indexPath.FileExists() || !file.IsSubpathOf(dbPath))
+        return false;
+
+    const CTextA path(file.C_str() + dbPath.Len());
+
+    // Taken before reading so a later change of the file is seen as newer than the journaled trigrams
+    WIN32_FILE_ATTRIBUTE_DATA attr;
+    if (!GetFileAttributesEx(file.C_str(), GetFileExInfoStandard, &attr))
+        memset(&attr.ftLastWriteTime, 0, sizeof(attr.ftLastWriteTime));
+
+    std::vector<unsigned> trigrams;
+    fileTrigrams(file, trigrams);
+
+    std::vector<char> record;
+    putValue(record, (unsigned short)path.Len());
+    for (const char* pCh = path.C_str(); *pCh; ++pCh)
+        record.push_back((*pCh == '\\') ? '/' : *pCh);
+    putValue(record, attr.ftLastWriteTime);
+    putValue(record, (unsigned)trigrams.size());
+    for (unsigned trigram : trigrams)
+        putValue(record, trigram);
+
+    CPath journalPath(dbPath);
+    journalPath += cJournalFile;
+
+    HANDLE hFile = CreateFile(journalPath.C_str(), FILE_APPEND_DATA, FILE_SHARE_READ, NULL, OPEN_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        // The index would miss the file change - better have no index
+        Remove(dbPath);
+        return false;
+    }
+
+    DWORD bytesWritten;
+    const bool success = (WriteFile(hFile, record.data(), record.size(), &bytesWritten, NULL) &&
+            bytesWritten == record.size());
+
+    CloseHandle(hFile);
+
+    if (!success)
+        Remove(dbPath);
+
+    return success;
+}
+
+
+/**
+ *  \brief
+ */
+void TrigramIndex::Remove(const CPath& dbPath)
+{
+    {
+        AUTOLOCK(CacheLock);
+        Cache.erase(PathKey(dbPath));
+    }
+
+    CPath path(dbPath);
+    path += cIndexFile;
+    DeleteFile(path.C_str());
+
+    path = dbPath;
+    path += cJournalFile;
+    DeleteFile(path.C_str());
+}
+
+
+/**
+ *  \brief  Returns the (cached) index of the database, NULL if there is none.
+ *          The database should be at least read locked.
+ */
+std::shared_ptr<TrigramIndex> TrigramIndex::Get(const CPath& dbPath)
+{
+    const PathKey dbKey(dbPath);
+
+    AUTOLOCK(CacheLock);
+
+    CPath indexPath(dbPath);
+    indexPath += cIndexFile;
+
+    WIN32_FILE_ATTRIBUTE_DATA attr;
+    if (!GetFileAttributesEx(indexPath.C_str(), GetFileExInfoStandard, &attr))
+    {
+        Cache.erase(dbKey);
+        return std::shared_ptr<TrigramIndex>();
+    }
+
+    CacheEntry& entry = Cache[dbKey];
+
+    if (!entry._index || CompareFileTime(&entry._indexTime, &attr.ftLastWriteTime))
+    {
+        std::shared_ptr<TrigramIndex> index(new TrigramIndex);
+
+        if (!index->load(dbPath))
+        {
+            Cache.erase(dbKey);
+            return std::shared_ptr<TrigramIndex>();
+        }
+
+        entry._index = index;
+        entry._indexTime = attr.ftLastWriteTime;
+    }
+    else
+    {
+        entry._index->syncJournal(dbPath);
+    }
+
+    return entry._index;
+}
+
+
+/**
+ *  \brief  Keeps from the list only the files that may contain the pattern, the files unknown to the index
+ *          and the files changed since they were indexed.
+ *          Returns false if the pattern gives no trigrams to narrow the list with.
+ */
+bool TrigramIndex::FilterFiles(const char* fileList, const CTextA& pattern, bool regExp,
+        std::vector<char>& filtered) const
+{
+    std::vector<unsigned> required;
+    patternTrigrams(pattern, regExp, required);
+
+    if (required.empty())
+        return false;
+
+    AUTOLOCK(_lock);
+
+    // Intersect the posting lists starting from the shortest
+    std::vector<const Trigram*> lists;
+
+    for (unsigned trigram : required)
+    {
+        auto it = std::lower_bound(_trigrams.begin(), _trigrams.end(), trigram,
+                [](const Trigram& t, unsigned val) { return t._trigram < val; });
+
+        if (it == _trigrams.end() || it->_trigram != trigram)
+        {
+            lists.clear();
+            break;
+        }
+
+        lists.push_back(&*it);
+    }
+
+    std::vector<bool> isCandidate(_files.size(), false);
+
+    if (!lists.empty())
+    {
+        std::sort(lists.begin(), lists.end(),
+                [](const Trigram* lhs, const Trigram* rhs) { return lhs->_count < rhs->_count; });
+
+        std::vector<unsigned> candidates;
+        postings(*lists[0], candidates);
+
+        std::vector<unsigned> files;
+        std::vector<unsigned> common;
+
+        for (unsigned i = 1; i < lists.size() && !candidates.empty(); ++i)
+        {
+            postings(*lists[i], files);
+
+            common.clear();
+            std::set_intersection(candidates.begin(), candidates.end(), files.begin(), files.end(),
+                    std::back_inserter(common));
+            candidates.swap(common);
+        }
+
+        for (unsigned idx : candidates)
+            isCandidate[idx] = true;
+    }
+
+    for (const auto& updated : _updated)
+    {
+        bool hasAll = true;
+
+        const std::vector<unsigned>& trigrams = updated.second._trigrams;
+
+        for (unsigned trigram : required)
+        {
+            if (!std::binary_search(trigrams.begin(), trigrams.end(), trigram))
+            {
+                hasAll = false;
+                break;
+            }
+        }
+
+        isCandidate[updated.first] = hasAll;
+    }
+
+    filtered.clear();
+
+    for (const char* pSrc = fileList; pSrc && *pSrc;)
+    {
+        while (*pSrc == '\n' || *pSrc == '\r')
+            ++pSrc;
+        if (*pSrc == 0)
+            break;
+
+        const char* pEol = pSrc;
+        while (*pEol != '\n' && *pEol != '\r' && *pEol != 0)
+            ++pEol;
+
+        auto it = _fileIdx.find(std::string(pSrc, pEol - pSrc));
+
+        if (it == _fileIdx.end() || isCandidate[it->second] || isModified(it->second))
+        {
+            filtered.insert(filtered.end(), pSrc, pEol);
+            filtered.push_back('\n');
+        }
+
+        pSrc = pEol;
+    }
+
+    filtered.push_back(0);
+
+    return true;
+}
+
+
+/**
+ *  \brief  Gives the sorted unique trigrams of the text file (none for binary or too big files).
+ *          Returns false if the file cannot be read.
+ */
+bool TrigramIndex::fileTrigrams(const CPath& file, std::vector<unsigned>& trigrams)
+{
+    trigrams.clear();
+
+    HANDLE hFile = CreateFile(file.C_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(hFile, &size) || size.QuadPart == 0 || size.QuadPart > cMaxFileSize)
+    {
+        CloseHandle(hFile);
+        return true;
+    }
+
+    HANDLE hMap = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(hFile);
+
+    if (hMap == NULL)
+        return false;
+
+    const char* pData = static_cast<const char*>(MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0));
+    CloseHandle(hMap);
+
+    if (pData == NULL)
+        return false;
+
+    const unsigned len = (unsigned)size.QuadPart;
+
+    // Binary files are not searched
+    if (!memchr(pData, 0, std::min<unsigned>(len, 8000)))
+        addTrigrams(pData, len, trigrams);
+
+    UnmapViewOfFile(pData);
+
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+
+    return true;
+}
+
+
+/**
+ *  \brief  Gives the trigrams every match must contain. For regular expressions only the literal runs outside
+ *          groups that are not made optional are used and alternations give none.
+ */
+void TrigramIndex::patternTrigrams(const CTextA& pattern, bool regExp, std::vector<unsigned>& trigrams)
+{
+    trigrams.clear();
+
+    if (!regExp)
+    {
+        addTrigrams(pattern.C_str(), pattern.Len(), trigrams);
+    }
+    else if (!strchr(pattern.C_str(), '|'))
+    {
+        const char* pSrc = pattern.C_str();
+        std::string literal;
+        int depth = 0;
+
+        for (;; ++pSrc)
+        {
+            const char ch = *pSrc;
+
+            if (ch == '*' || ch == '?' || ch == '{')
+            {
+                if (!literal.empty())
+                    literal.pop_back();
+            }
+
+            // Non-ASCII letters may be case folded by the regular expression engine
+            if (ch == 0 || (unsigned char)ch >= 0x80 || strchr("\\()[].^$*?{}+", ch))
+            {
+                if (literal.size() >= 3)
+                    addTrigrams(literal.data(), literal.size(), trigrams);
+                literal.clear();
+
+                if (ch == 0)
+                    break;
+
+                if (ch == '\\')
+                {
+                    if (*(pSrc + 1))
+                        ++pSrc;
+                }
+                else if (ch == '(')
+                {
+                    ++depth;
+                }
+                else if (ch == ')')
+                {
+                    if (depth)
+                        --depth;
+                }
+                else if (ch == '[')
+                {
+                    ++pSrc;
+                    if (*pSrc == '^')
+                        ++pSrc;
+                    if (*pSrc == ']')
+                        ++pSrc;
+                    while (*pSrc && *pSrc != ']')
+                        ++pSrc;
+                    if (*pSrc == 0)
+                        break;
+                }
+                else if (ch == '{')
+                {
+                    while (*(pSrc + 1) && *pSrc != '}')
+                        ++pSrc;
+                }
+
+                continue;
+            }
+
+            if (depth == 0)
+                literal += ch;
+        }
+    }
+
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+}
+
+
+/**
+ *  \brief  Adds the lower-cased trigrams of the text that don't span lines
+ */
+void TrigramIndex::addTrigrams(const char* pSrc, unsigned len, std::vector<unsigned>& trigrams)
+{
+    if (len < 3)
+        return;
+
+    const unsigned char* pText = reinterpret_cast<const unsigned char*>(pSrc);
+    unsigned trigram = (toLowerAscii(pText[0]) << 8) | toLowerAscii(pText[1]);
+    unsigned lineBreak = 0;
+
+    if (pText[0] == '\n' || pText[0] == '\r')
+        lineBreak = 1;
+    if (pText[1] == '\n' || pText[1] == '\r')
+        lineBreak = 2;
+
+    for (unsigned i = 2; i < len; ++i)
+    {
+        trigram = ((trigram << 8) | toLowerAscii(pText[i])) & 0xFFFFFF;
+
+        if (pText[i] == '\n' || pText[i] == '\r')
+            lineBreak = 3;
+
+        if (lineBreak)
+            --lineBreak;
+        else
+            trigrams.push_back(trigram);
+    }
+}
+
+
+/**
+ *  \brief
+ */
+bool TrigramIndex::writeFile(const CPath& path, const std::vector<char>& data)
+{
+    HANDLE hFile = CreateFile(path.C_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    DWORD bytesWritten;
+    const bool success = (WriteFile(hFile, data.data(), data.size(), &bytesWritten, NULL) &&
+            bytesWritten == data.size());
+
+    CloseHandle(hFile);
+
+    return success;
+}
+
+
+/**
+ *  \brief
+ */
+bool TrigramIndex::load(const CPath& dbPath)
+{
+    CPath indexPath(dbPath);
+    indexPath += cIndexFile;
+
+    HANDLE hFile = CreateFile(indexPath.C_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+            FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    std::vector<char> data;
+    DWORD bytesRead = 0;
+
+    if (GetFileSizeEx(hFile, &size) && size.QuadPart <= cMaxPostingsSize * 2)
+    {
+        data.resize((size_t)size.QuadPart);
+        if (!ReadFile(hFile, data.data(), data.size(), &bytesRead, NULL))
+            bytesRead = 0;
+    }
+
+    CloseHandle(hFile);
+
+    if (data.empty() || bytesRead != data.size())
+        return false;
+
+    const char* pSrc = data.data();
+    const char* pEnd = pSrc + data.size();
+
+    unsigned version, filesCount, trigramsCount, postingsSize;
+
+    if (memcmp(pSrc, cMagic, sizeof(cMagic)))
+        return false;
+    pSrc += sizeof(cMagic);
+
+    if (!getValue(pSrc, pEnd, version) || version != cVersion ||
+            !getValue(pSrc, pEnd, filesCount) || !getValue(pSrc, pEnd, trigramsCount) ||
+            !getValue(pSrc, pEnd, postingsSize) || !getValue(pSrc, pEnd, _buildTime))
+        return false;
+
+    _dbPath = dbPath;
+
+    _files.resize(filesCount);
+
+    for (unsigned i = 0; i < filesCount; ++i)
+    {
+        unsigned short len;
+
+        if (!getValue(pSrc, pEnd, len) || (unsigned)(pEnd - pSrc) < len)
+            return false;
+
+        _files[i].Append(pSrc, len);
+        _fileIdx.emplace(std::string(pSrc, len), i);
+        pSrc += len;
+    }
+
+    _trigrams.resize(trigramsCount);
+
+    for (auto& trigram : _trigrams)
+    {
+        if (!getValue(pSrc, pEnd, trigram._trigram) || !getValue(pSrc, pEnd, trigram._offset) ||
+                !getValue(pSrc, pEnd, trigram._count))
+            return false;
+    }
+
+    if ((unsigned)(pEnd - pSrc) != postingsSize)
+        return false;
+
+    _postings.assign(pSrc, pEnd);
+
+    syncJournal(dbPath);
+
+    return true;
+}
+
+
+/**
+ *  \brief  Applies the journal records added since the last sync
+ */
+void TrigramIndex::syncJournal(const CPath& dbPath)
+{
+    AUTOLOCK(_lock);
+
+    CPath journalPath(dbPath);
+    journalPath += cJournalFile;
+
+    HANDLE hFile = CreateFile(journalPath.C_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return;
+
+    LARGE_INTEGER size;
+    std::vector<char> data;
+    DWORD bytesRead = 0;
+
+    if (GetFileSizeEx(hFile, &size) && size.QuadPart > _journalSize)
+    {
+        data.resize((size_t)(size.QuadPart - _journalSize));
+
+        LARGE_INTEGER pos;
+        pos.QuadPart = _journalSize;
+
+        if (!SetFilePointerEx(hFile, pos, NULL, FILE_BEGIN) ||
+                !ReadFile(hFile, data.data(), data.size(), &bytesRead, NULL))
+            bytesRead = 0;
+    }
+
+    CloseHandle(hFile);
+
+    const char* pSrc = data.data();
+    const char* pEnd = pSrc + bytesRead;
+
+    for (;;)
+    {
+        const char* pRecord = pSrc;
+
+        unsigned short len;
+        if (!getValue(pSrc, pEnd, len) || (unsigned)(pEnd - pSrc) < len)
+            break;
+
+        const std::string path(pSrc, len);
+        pSrc += len;
+
+        FILETIME fileTime;
+        unsigned count;
+        if (!getValue(pSrc, pEnd, fileTime) || !getValue(pSrc, pEnd, count) ||
+                (size_t)(pEnd - pSrc) / sizeof(unsigned) < count)
+        {
+            pSrc = pRecord;
+            break;
+        }
+
+        auto res = _fileIdx.emplace(path, _files.size());
+        if (res.second)
+        {
+            _files.push_back(CTextA());
+            _files.back().Append(path.data(), path.size());
+        }
+
+        JournaledFile& updated = _updated[res.first->second];
+        updated._fileTime = fileTime;
+
+        std::vector<unsigned>& trigrams = updated._trigrams;
+        trigrams.resize(count);
+        if (count)
+            memcpy(trigrams.data(), pSrc, count * sizeof(unsigned));
+        pSrc += count * sizeof(unsigned);
+
+        _journalSize += pSrc - pRecord;
+    }
+}
+
+
+/**
+ *  \brief
+ */
+void TrigramIndex::postings(const Trigram& trigram, std::vector<unsigned>& files) const
+{
+    files.clear();
+    files.reserve(trigram._count);
+
+    const unsigned char* pSrc = _postings.data() + trigram._offset;
+    const unsigned char* pEnd = _postings.data() + _postings.size();
+    unsigned idx = 0;
+
+    for (unsigned i = 0; i < trigram._count && pSrc < pEnd; ++i)
+    {
+        unsigned delta = 0;
+        unsigned shift = 0;
+
+        while (pSrc < pEnd && (*pSrc & 0x80))
+        {
+            delta |= (*pSrc++ & 0x7F) << shift;
+            shift += 7;
+        }
+
+        if (pSrc < pEnd)
+            delta |= *pSrc++ << shift;
+
+        idx += delta;
+
+        if (idx < _files.size())
+            files.push_back(idx);
+    }
+}
+
+
+/**
+ *  \brief  Checks if the file was changed (outside Notepad++) after its trigrams were taken.
+ *          Files that cannot be checked are reported as modified.
+ */
+bool TrigramIndex::isModified(unsigned idx) const
+{
+    const CPath file = fullPath(_dbPath, _files[idx].C_str(), _files[idx].Len());
+
+    WIN32_FILE_ATTRIBUTE_DATA attr;
+    if (!GetFileAttributesEx(file.C_str(), GetFileExInfoStandard, &attr))
+        return true;
+
+    auto updated = _updated.find(idx);
+    const FILETIME& indexedTime = (updated == _updated.end()) ? _buildTime : updated->second._fileTime;
+
+    return (CompareFileTime(&attr.ftLastWriteTime, &indexedTime) > 0);
+}
+
+} // namespace GTags
@@ -0,0 +1,129 @@
+/**
+ *  \file
+ *  \brief  Trigram index of the database files for text search narrowing
+ *
+ *  \author  Pavel Nedev <pg.nedev@gmail.com>
+ *
+ *  \section COPYRIGHT
+ *  Copyright(C) 2015 Pavel Nedev
+ *
+ *  \section LICENSE
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+
+#include <windows.h>
+#include <tchar.h>
+#include <vector>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "Common.h"
+#include "AutoLock.h"
+
+
+namespace GTags
+{
+
+/**
+ *  \class  TrigramIndex
+ *  \brief  Posting lists of the (ASCII lower-cased) trigrams of the database files, stored next to the database.
+ *          Single file updates are appended to a journal that overrides the file's base posting entries.
+ *          The index is only used to narrow the files list - the search still verifies every candidate.
+ */
+class TrigramIndex
+{
+public:
+    static bool Build(const CPath& dbPath, const char* fileList, volatile bool& stop);
+    static bool UpdateFile(const CPath& dbPath, const CPath& file);
+    static void Remove(const CPath& dbPath);
+    static std::shared_ptr<TrigramIndex> Get(const CPath& dbPath);
+
+    bool FilterFiles(const char* fileList, const CTextA& pattern, bool regExp, std::vector<char>& filtered) const;
+
+private:
+    /**
+     *  \struct  Trigram
+     *  \brief  Posting list of a trigram - file indexes delta-encoded as varints
+     */
+    struct Trigram
+    {
+        unsigned    _trigram;
+        unsigned    _offset;
+        unsigned    _count;
+    };
+
+    /**
+     *  \struct  CacheEntry
+     *  \brief
+     */
+    struct CacheEntry
+    {
+        std::shared_ptr<TrigramIndex>   _index;
+        FILETIME                        _indexTime;
+    };
+
+    /**
+     *  \struct  JournaledFile
+     *  \brief  File trigrams as journaled on its last update
+     */
+    struct JournaledFile
+    {
+        FILETIME                _fileTime;
+        std::vector<unsigned>   _trigrams;
+    };
+
+    static const char       cMagic[4];
+    static const unsigned   cVersion;
+    static const TCHAR      cIndexFile[];
+    static const TCHAR      cJournalFile[];
+    static const unsigned   cMaxFileSize;
+    static const unsigned   cMaxPostingsSize;
+
+    static Mutex CacheLock;
+    static std::unordered_map<PathKey, CacheEntry, PathKey::Hasher> Cache;
+
+    static bool fileTrigrams(const CPath& file, std::vector<unsigned>& trigrams);
+    static void patternTrigrams(const CTextA& pattern, bool regExp, std::vector<unsigned>& trigrams);
+    static void addTrigrams(const char* pSrc, unsigned len, std::vector<unsigned>& trigrams);
+    static bool writeFile(const CPath& path, const std::vector<char>& data);
+
+    TrigramIndex() : _journalSize(0) {}
+
+    TrigramIndex(const TrigramIndex&) = delete;
+    TrigramIndex& operator=(const TrigramIndex&) = delete;
+
+    bool load(const CPath& dbPath);
+    void syncJournal(const CPath& dbPath);
+    void postings(const Trigram& trigram, std::vector<unsigned>& files) const;
+    bool isModified(unsigned idx) const;
+
+    // Guards the journal sync against the filtering on other threads
+    mutable Mutex                                   _lock;
+
+    CPath                                           _dbPath;
+    FILETIME                                        _buildTime;
+    std::vector<CTextA>                             _files;
+    std::unordered_map<std::string, unsigned>       _fileIdx;
+    std::vector<Trigram>                            _trigrams;
+    std::vector<unsigned char>                      _postings;
+
+    // Journaled files - their trigrams override the posting lists
+    std::unordered_map<unsigned, JournaledFile>     _updated;
+    unsigned                                        _journalSize;
+};
+
+} // namespace GTags